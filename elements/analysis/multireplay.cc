@@ -84,6 +84,12 @@ MultiReplay::initialize(ErrorHandler * errh) {
         _output[i].ring.initialize(_queue);
     }
     ScheduleInfo::initialize_task(this,&_task,_active,errh);
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy && _nshards > 1)
+        return errh->error("SHARDS requires MultiReplayUnqueue");
+    if (_zerocopy)
+        return initialize_shards(errh);
+#endif
     return 0;
 }
 
@@ -95,6 +101,36 @@ MultiReplay::run_task(Task* task)
     if (!_active)
         return false;
 
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy) {
+        if (unlikely(!_loaded) && !load_zerocopy(task))
+            return false;
+        Shard &s = _shards[0];
+        unsigned n = 0;
+        while (!s.done && n < _burst) {
+            if (s.next >= (uint32_t) _slots.size()) {
+                shard_loop_end(s);
+                continue;
+            }
+            int port = (uint8_t) _slots[s.next].anno[PAINT_ANNO_OFFSET];
+            if (_output[port].ring.is_full()) {
+                _notifier.sleep();
+                return n > 0;
+            }
+            WritablePacket *q = slot_packet(s.next);
+            if (unlikely(!q))
+                break;
+            s.next++;
+            _output[port].ring.insert(q);
+            _notifier.wake();
+            n++;
+        }
+        if (!s.done)
+            task->fast_reschedule();
+        return n > 0;
+    }
+#endif
+
     if (unlikely(!_loaded && !load_packets()))
         return false;
 
@@ -164,12 +200,20 @@ MultiReplayUnqueue::initialize(ErrorHandler * errh) {
         _input[i].signal = Notifier::upstream_empty_signal(this, i, (Task*)NULL);
     }
     ScheduleInfo::initialize_task(this,&_task,true,errh);
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy)
+        return initialize_shards(errh);
+#endif
     return 0;
 }
 
 bool
 MultiReplayUnqueue::run_task(Task* task)
 {
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy)
+        return run_zerocopy(task, 0, true);
+#endif
     if (!_active)
         return false;
 
@@ -58,7 +58,9 @@ class MultiReplayUnqueue : public ReplayBase { public:
     int initialize(ErrorHandler *errh) CLICK_COLD;
 
     bool get_spawning_threads(Bitvector& bmp, bool, int) override {
-        bmp[router()->home_thread_id(this)] = true;
+        int home = router()->home_thread_id(this);
+        for (int i = 0; i < _nshards; i++)
+            bmp[(home + i) % master()->nthreads()] = true;
         return false;
     }
 
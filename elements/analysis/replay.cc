@@ -21,9 +21,18 @@
 #include "replay.hh"
 #include <click/args.hh>
 #include <click/standard/scheduleinfo.hh>
+#include <click/master.hh>
+#include <click/bitvector.hh>
+#if HAVE_REPLAY_ZEROCOPY
+# include <sys/mman.h>
+#endif
 CLICK_DECLS
 
-ReplayBase::ReplayBase() : _active(true), _loaded(false), _burst(64), _stop(-1),_stop_time(0),  _quick_clone(false), _task(this), _limit(-1), _queue_head(0), _queue_current(0), _use_signal(false),_verbose(false),_freeonterminate(true), _timing_packet(), _timing_real(), _startsent(), _fnt_expr() {
+ReplayBase::ReplayBase() :
+#if HAVE_REPLAY_ZEROCOPY
+    _slab(0),
+#endif
+    _zerocopy(false), _nshards(1), _active(true), _loaded(false), _burst(64), _stop(-1),_stop_time(0),  _quick_clone(false), _task(this), _limit(-1), _queue_head(0), _queue_current(0), _use_signal(false),_verbose(false),_freeonterminate(true), _timing_packet(), _timing_real(), _startsent(), _fnt_expr() {
 #if HAVE_BATCH
     in_batch_mode = BATCH_MODE_YES;
 #endif
@@ -45,10 +54,20 @@ int ReplayBase::parse(Args* args) {
              .read("FREEONTERMINATE", _freeonterminate)
              .read("LIMIT", _limit)
              .read("ACTIVE",_active)
+             .read("ZEROCOPY", _zerocopy)
+             .read("SHARDS", _nshards)
              .execute() < 0) {
         return -1;
     }
 
+#if !HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy)
+        return args->errh()->error("ZEROCOPY is not available in this configuration");
+#endif
+    if (_nshards < 1)
+        return args->errh()->error("SHARDS must be positive");
+    if (_nshards > 1 && !_zerocopy)
+        return args->errh()->error("SHARDS requires ZEROCOPY");
     return 0;
 }
 
@@ -74,8 +93,302 @@ void ReplayBase::cleanup_packets() {
 
 void ReplayBase::cleanup(CleanupStage) {
     cleanup_packets();
+#if HAVE_REPLAY_ZEROCOPY
+    cleanup_shards();
+    release_slab();
+#endif
+}
+
+#if HAVE_REPLAY_ZEROCOPY
+static unsigned char *
+replay_alloc_slab(size_t size)
+{
+    void *m = MAP_FAILED;
+# ifdef MAP_HUGETLB
+    m = mmap(0, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+# endif
+    if (m == MAP_FAILED) {
+        m = mmap(0, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED)
+            return 0;
+# ifdef MADV_HUGEPAGE
+        madvise(m, size, MADV_HUGEPAGE);
+# endif
+    }
+    return (unsigned char *) m;
+}
+
+/**
+ * Move the loaded packets into slots of a single buffer, and free them.
+ */
+bool ReplayBase::layout_slots() {
+    uint32_t n = 0;
+    size_t size = 0;
+    for (Packet *p = _queue_head; p; p = p->next()) {
+        n++;
+        // slots are cache-line aligned
+        size += (p->length() + 63) & ~(size_t) 63;
+    }
+
+    // the buffer is made of 2MB pages
+    size = (size + (2 << 20) - 1) & ~(size_t) ((2 << 20) - 1);
+    if (size == 0)
+        size = 2 << 20;
+    unsigned char *data = replay_alloc_slab(size);
+    if (!data) {
+        click_chatter("%p{element}: cannot allocate %lu bytes for the trace", this, (unsigned long) size);
+        cleanup_packets();
+        _active = false;
+        return false;
+    }
+    _slab = new Slab;
+    _slab->data = data;
+    _slab->size = size;
+    _slab->refs = 1;
+
+    _slots.resize(n);
+    Timestamp first = _queue_head ? _queue_head->timestamp_anno() : Timestamp();
+    double cycles_per_nsec = (double) cycles_hz() / 1000000000.;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        Packet *p = _queue_head;
+        Slot &slot = _slots[i];
+        slot.offset = pos;
+        memcpy(data + pos, p->data(), p->length());
+        pos += (p->length() + 63) & ~(size_t) 63;
+        slot.length = p->length();
+        slot.mac_offset = p->mac_header() && p->mac_header_offset() >= 0 ? p->mac_header_offset() : -1;
+        slot.network_offset = p->has_network_header() && p->network_header_offset() >= 0 ? p->network_header_offset() : -1;
+        slot.transport_offset = p->has_transport_header() && p->transport_header_offset() >= 0 ? p->transport_header_offset() : -1;
+        slot.timestamp = p->timestamp_anno();
+        Timestamp offset = slot.timestamp - first;
+        slot.departure = offset > Timestamp() ? (click_cycles_t) ((double) offset.nsecval() * cycles_per_nsec) : 0;
+        memcpy(slot.anno, p->anno(), Packet::anno_size);
+        _queue_head = p->next();
+        p->kill();
+    }
+    _queue_current = 0;
+
+    if (_verbose)
+        click_chatter("%p{element}: %u packets in %lu bytes", this, n, (unsigned long) size);
+    return true;
+}
+
+/**
+ * Drop the reference of the loaded trace to its slab. The slab is unmapped
+ * once the packets still pointing into it are freed too.
+ */
+void ReplayBase::release_slab() {
+    if (_slab)
+        slab_destructor(0, 0, _slab);
+    _slab = 0;
+    _slots.clear();
 }
 
+void ReplayBase::slab_destructor(unsigned char *, size_t, void *arg) {
+    Slab *slab = static_cast<Slab *>(arg);
+    if (slab->refs.dec_and_test()) {
+        munmap(slab->data, slab->size);
+        delete slab;
+    }
+}
+
+/**
+ * Create the tasks of the shards. The first shard uses _task, which must have
+ * been initialized already.
+ */
+int ReplayBase::initialize_shards(ErrorHandler *errh) {
+    // calibrate the cycle counter now rather than when loading the trace
+    (void) cycles_hz();
+    _shards.resize(_nshards);
+    int home = router()->home_thread_id(this);
+    for (int i = 0; i < _nshards; i++) {
+        Shard &s = _shards[i];
+        s.first = s.next = i;
+        s.loops = 0;
+        s.start = 0;
+        s.done = false;
+        if (i == 0)
+            s.task = &_task;
+        else {
+            s.task = new Task(this);
+            ScheduleInfo::initialize_task(this, s.task, false, errh);
+            s.task->move_thread((home + i) % master()->nthreads());
+        }
+    }
+    return 0;
+}
+
+void ReplayBase::cleanup_shards() {
+    for (int i = 1; i < _shards.size(); i++)
+        delete _shards[i].task;
+    _shards.clear();
+}
+
+/**
+ * Forget the loaded trace. The threads of the shards are held while the
+ * slots they read are dropped. The first shard loads the trace again when it
+ * runs, and starts the others.
+ */
+void ReplayBase::reset_zerocopy() {
+    Bitvector blocked(master()->nthreads());
+    for (int i = 0; i < _shards.size(); i++) {
+        RouterThread *th = _shards[i].task->thread();
+        if (th->thread_id() == click_current_cpu_id() || blocked[th->thread_id()])
+            continue;
+        th->block_tasks(false);
+        blocked[th->thread_id()] = true;
+    }
+    for (int i = 1; i < _shards.size(); i++)
+        _shards[i].task->unschedule();
+    // packets of the current slab may still be in flight
+    release_slab();
+    _loaded = false;
+    for (int i = 0; i < blocked.size(); i++)
+        if (blocked[i])
+            master()->thread(i)->unblock_tasks();
+}
+
+/**
+ * Load the trace from the first shard's task, then start all shards.
+ */
+bool ReplayBase::load_zerocopy(Task *t) {
+    if (t != &_task || !load_packets())
+        return false;
+    _startsent = Timestamp::now_steady();
+    click_cycles_t now = click_get_cycles();
+    _shards_running = _shards.size();
+    for (int i = 0; i < _shards.size(); i++) {
+        _shards[i].next = _shards[i].first;
+        _shards[i].loops = 0;
+        _shards[i].start = now;
+        _shards[i].done = _stop == 0 || _shards[i].first >= (uint32_t) _slots.size();
+        if (_shards[i].done)
+            _shards_running--;
+        else if (i > 0)
+            _shards[i].task->reschedule();
+    }
+    if (_shards_running == 0) {
+        router()->please_stop_driver();
+        _active = false;
+    }
+    return !_shards[0].done;
+}
+
+/**
+ * Finish the loop of shard @a s. Returns false if it must stop.
+ */
+bool ReplayBase::shard_loop_end(Shard &s) {
+    s.next = s.first;
+    s.start = click_get_cycles();
+    ++s.loops;
+    if (_verbose)
+        click_chatter("%p{element}: Replay loop", this);
+    if (_stop > 0 && s.loops >= _stop)
+        s.done = true;
+    else
+        shard_check_time(s);
+    if (s.done && _shards_running.dec_and_test()) {
+        router()->please_stop_driver();
+        _active = false;
+    }
+    return !s.done;
+}
+
+/**
+ * Mark shard @a s done if STOP_TIME has elapsed.
+ */
+bool ReplayBase::shard_check_time(Shard &s) {
+    if (_stop_time > 0 && (Timestamp::now_steady() - _startsent).sec() >= _stop_time) {
+        if (_verbose)
+            click_chatter("%p{element}: Replay stopped after %d seconds", this, _stop_time);
+        s.done = true;
+    }
+    return s.done;
+}
+
+/**
+ * Push up to BURST packets of the shard of @a t, as a batch per output port.
+ * With a non-zero @a timing, packets leave at their offset in the trace scaled
+ * by @a timing percent. If @a by_paint, packets go to the output matching
+ * their paint annotation, else to output 0.
+ */
+bool ReplayBase::run_zerocopy(Task *t, unsigned timing, bool by_paint) {
+    if (!_active)
+        return false;
+    if (unlikely(!_loaded) && !load_zerocopy(t))
+        return false;
+
+    Shard &s = shard(t);
+    if (s.done)
+        return false;
+
+    click_cycles_t now = click_get_cycles();
+    uint32_t nslots = _slots.size();
+    unsigned n = 0;
+#if HAVE_BATCH
+    PacketBatch *head = 0;
+    Packet *last = 0;
+    unsigned c = 0;
+    int port = 0;
+#endif
+    while (n < _burst) {
+        if (s.next >= nslots) {
+#if HAVE_BATCH
+            // the last shard to finish stops the driver: send everything first
+            if (head) {
+                output_push_batch(port, head->make_tail(last, c));
+                head = 0;
+            }
+#endif
+            if (!shard_loop_end(s))
+                break;
+            now = s.start;
+        }
+        const Slot &slot = _slots[s.next];
+        if (timing && (now - s.start) * timing < slot.departure * 100)
+            break;
+        WritablePacket *q = slot_packet(s.next);
+        if (unlikely(!q))
+            break;
+        s.next += _nshards;
+        int qport = by_paint ? PAINT_ANNO(q) : 0;
+#if HAVE_BATCH
+        if (head && qport != port) {
+            output_push_batch(port, head->make_tail(last, c));
+            head = 0;
+        }
+        if (!head) {
+            head = PacketBatch::start_head(q);
+            port = qport;
+            c = 0;
+        } else
+            last->set_next(q);
+        last = q;
+        c++;
+#else
+        output(qport).push(q);
+#endif
+        n++;
+    }
+#if HAVE_BATCH
+    if (head)
+        output_push_batch(port, head->make_tail(last, c));
+#endif
+
+    if (n == 0 && !s.done && shard_check_time(s)
+        && _shards_running.dec_and_test()) {
+        router()->please_stop_driver();
+        _active = false;
+    }
+    if (!s.done)
+        t->fast_reschedule();
+    return n > 0;
+}
+#endif
+
 void
 ReplayBase::set_active(bool active) {
     _active = active;
@@ -104,6 +417,12 @@ ReplayBase::write_handler(const String & s_in, Element *e, void *thunk, ErrorHan
         return 0;
       case 1:
           q->cleanup_packets();
+#if HAVE_REPLAY_ZEROCOPY
+          if (q->_zerocopy) {
+              q->reset_zerocopy();
+              return 0;
+          }
+#endif
           q->_loaded = false;
           return 0;
       default:
@@ -178,6 +497,12 @@ Replay::initialize(ErrorHandler * errh) {
      _input[0].signal = Notifier::upstream_empty_signal(this, 0, (Task*)NULL);
     _output.ring.initialize(_queue);
     ScheduleInfo::initialize_task(this,&_task,_active,errh);
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy && _nshards > 1)
+        return errh->error("SHARDS requires ReplayUnqueue");
+    if (_zerocopy)
+        return initialize_shards(errh);
+#endif
     return 0;
 }
 
@@ -189,6 +514,35 @@ Replay::run_task(Task* task)
     if (!_active)
         return false;
 
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy) {
+        if (unlikely(!_loaded) && !load_zerocopy(task))
+            return false;
+        Shard &s = _shards[0];
+        unsigned n = 0;
+        while (!s.done && n < _burst) {
+            if (s.next >= (uint32_t) _slots.size()) {
+                shard_loop_end(s);
+                continue;
+            }
+            if (_output.ring.is_full()) {
+                _notifier.sleep();
+                return n > 0;
+            }
+            WritablePacket *q = slot_packet(s.next);
+            if (unlikely(!q))
+                break;
+            s.next++;
+            _output.ring.insert(q);
+            _notifier.wake();
+            n++;
+        }
+        if (!s.done)
+            task->fast_reschedule();
+        return n > 0;
+    }
+#endif
+
     if (unlikely(!_loaded && !load_packets()))
         return false;
 
@@ -270,6 +624,9 @@ ReplayUnqueue::configure(Vector<String> &conf, ErrorHandler *errh)
 
     }
 
+    if (_zerocopy && _fnt_expr)
+        return errh->error("TIMING_FNT cannot be used with ZEROCOPY");
+
 
     return 0;
 }
@@ -279,6 +636,10 @@ ReplayUnqueue::initialize(ErrorHandler * errh) {
     _input.resize(1);
     _input[0].signal = Notifier::upstream_empty_signal(this, 0, (Task*)NULL);
     ScheduleInfo::initialize_task(this,&_task,true,errh);
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy && initialize_shards(errh) < 0)
+        return -1;
+#endif
 
     if (_fnt_expr) {
         _timing = _fnt_expr.eval(0);
@@ -292,6 +653,10 @@ ReplayUnqueue::initialize(ErrorHandler * errh) {
 bool
 ReplayUnqueue::run_task(Task* task)
 {
+#if HAVE_REPLAY_ZEROCOPY
+    if (_zerocopy)
+        return run_zerocopy(task, _timing, false);
+#endif
     if (!_active)
         return false;
 
@@ -7,9 +7,16 @@
 #include <click/vector.hh>
 #include <click/notifier.hh>
 #include <click/tinyexpr.hh>
+#include <click/atomic.hh>
+#include <click/pair.hh>
+#include <click/master.hh>
 #include <strings.h>
 CLICK_DECLS
 
+#if CLICK_USERLEVEL && !CLICK_PACKET_USE_DPDK
+# define HAVE_REPLAY_ZEROCOPY 1
+#endif
+
 class Args;
 
 /*
@@ -32,6 +39,28 @@ Keyword arguments are:
 
 Integer.  Number of loop to replay.
 
+=item ZEROCOPY
+
+Boolean. Once the trace is loaded, copy it into a single buffer, backed by
+hugepages when the system has some, and free the original packets. Each packet
+gets a slot of its length rounded up to a cache line. Each loop then emits
+packets pointing directly to their slot, which are not clones: no buffer is
+allocated per packet, they only hold a reference to the whole buffer, which
+a reset frees once they are all gone. Only the annotation area, timestamp and
+header annotations of the original packets are kept. Downstream elements must
+not modify the packet data in place, as the next loop would send the modified
+data. Only available at user level without DPDK packets. Default is false.
+
+=item SHARDS
+
+Integer. ReplayUnqueue and MultiReplayUnqueue only, with ZEROCOPY. Split the
+trace across SHARDS tasks, on as many threads starting from the home thread
+of the element: task I sends packets I, I+SHARDS, I+2*SHARDS, and so on.
+Each shard loops on its own and the replay stops when all of them are done.
+With TIMING, each shard sends a packet when the time elapsed since the start of
+its loop, measured with the cycle counter, reaches the packet's offset in the
+trace scaled by TIMING. Default is 1.
+
 */
 
 class ReplayBase : public BatchElement { public:
@@ -53,6 +82,54 @@ protected:
 
     void reset_time();
 
+#if HAVE_REPLAY_ZEROCOPY
+    // ZEROCOPY mode: the trace lives in _slab, each packet in a slot of its
+    // length rounded up to a cache line
+    struct Slab {
+        unsigned char *data;
+        size_t size;
+        atomic_uint32_t refs;	// packets pointing into it, plus one while loaded
+    };
+    struct Slot {
+        size_t offset;		// in the slab
+        uint32_t length;
+        int16_t mac_offset;	// -1 if none
+        int16_t network_offset;
+        int16_t transport_offset;
+        Timestamp timestamp;
+        click_cycles_t departure;	// offset in the trace, in cycles
+        char anno[Packet::anno_size];
+    };
+    struct Shard {
+        Task *task;
+        uint32_t first;
+        uint32_t next;		// next slot to send
+        int loops;
+        click_cycles_t start;	// beginning of the current loop
+        bool done;
+    } CLICK_CACHE_ALIGN;
+
+    Slab *_slab;
+    Vector<Slot> _slots;
+    Vector<Shard> _shards;
+    atomic_uint32_t _shards_running;
+
+    bool layout_slots();
+    void release_slab();
+    static void slab_destructor(unsigned char *, size_t, void *arg);
+    int initialize_shards(ErrorHandler *errh);
+    void cleanup_shards();
+    void reset_zerocopy();
+    bool load_zerocopy(Task *t);
+    bool shard_loop_end(Shard &s);
+    bool shard_check_time(Shard &s);
+    inline Shard &shard(Task *t);
+    inline WritablePacket *slot_packet(uint32_t i) const;
+    bool run_zerocopy(Task *t, unsigned timing, bool by_paint);
+#endif
+    bool _zerocopy;
+    int _nshards;
+
     struct s_input {
 		NotifierSignal signal;
     };
@@ -131,7 +208,9 @@ class ReplayUnqueue : public ReplayBase { public:
     int initialize(ErrorHandler *errh) CLICK_COLD;
 
     bool get_spawning_threads(Bitvector& bmp, bool, int) override {
-        bmp[router()->home_thread_id(this)] = true;
+        int home = router()->home_thread_id(this);
+        for (int i = 0; i < _nshards; i++)
+            bmp[(home + i) % master()->nthreads()] = true;
         return false;
     }
 
@@ -203,6 +282,17 @@ inline bool ReplayBase::load_packets() {
         } while(dry < 0 && (_limit < 0 || count < _limit));
 
         click_chatter("%s : Successfully loaded %d packets. Input %d dried out.",name().c_str(),count,dry);
+#if HAVE_REPLAY_ZEROCOPY
+        if (_zerocopy) {
+            for (int i = 0; i < ninputs(); i++)
+                if (p_input[i])
+                    p_input[i]->kill();
+            if (!layout_slots())
+                return false;
+            _loaded = true;
+            return true;
+        }
+#endif
 
         //Clean left overs
         for (int i = 0; i < ninputs(); i++) {
@@ -251,5 +341,42 @@ stop:
     t->fast_reschedule();
 }
 
+#if HAVE_REPLAY_ZEROCOPY
+inline ReplayBase::Shard &
+ReplayBase::shard(Task *t)
+{
+    for (int i = 1; i < _shards.size(); i++)
+        if (_shards[i].task == t)
+            return _shards[i];
+    return _shards[0];
+}
+
+/** @brief Return a packet pointing to the data of slot @a i.
+ *
+ * The packet holds a reference to the slab, so that a slab dropped by a
+ * reset stays mapped until its last packet is freed. */
+inline WritablePacket *
+ReplayBase::slot_packet(uint32_t i) const
+{
+    const Slot &slot = _slots[i];
+    unsigned char *data = _slab->data + slot.offset;
+    WritablePacket *q = Packet::make(data, slot.length, slab_destructor, _slab, 0, 0);
+    if (unlikely(!q))
+        return 0;
+    _slab->refs++;
+    memcpy(q->anno(), slot.anno, Packet::anno_size);
+    q->set_timestamp_anno(slot.timestamp);
+    if (slot.mac_offset >= 0)
+        q->set_mac_header(data + slot.mac_offset);
+    if (slot.network_offset >= 0) {
+        if (slot.transport_offset >= 0)
+            q->set_network_header(data + slot.network_offset, slot.transport_offset - slot.network_offset);
+        else
+            q->set_network_header(data + slot.network_offset);
+    }
+    return q;
+}
+#endif
+
 CLICK_ENDDECLS
 #endif
@@ -236,11 +236,18 @@ CoDel::delegate_codel()
 // determines the next drop time of the packet - scaling done to allow usage of int_sqrt to minimize floating point arithmetic, etc. //
 Timestamp
 CoDel::control_law(Timestamp t)
+{
+    return control_law(t, _codel_interval_ts, _state_drops);
+}
+
+// the control law itself, shared with the elements keeping several CoDel states (FQCoDel) //
+Timestamp
+CoDel::control_law(Timestamp t, Timestamp interval, uint32_t drops)
 {
     uint32_t scale_factor = 1 << 4;
     uint32_t scale_factor_squared = scale_factor * scale_factor;
-    uint32_t scaled_codel_interval = _codel_interval_ts.msecval() * scale_factor;
-    uint32_t scaled_state_drops = _state_drops * scale_factor_squared;
+    uint32_t scaled_codel_interval = interval.msecval() * scale_factor;
+    uint32_t scaled_state_drops = drops * scale_factor_squared;
 
     uint32_t val_click_ns = int_divide(scaled_codel_interval * Timestamp::nsec_per_msec, int_sqrt(scaled_state_drops));
 
@@ -106,6 +106,8 @@ class CoDel : public Element { public:
     void handle_drop(Packet *);
     Packet *pull(int port);
 
+    static Timestamp control_law(Timestamp t, Timestamp interval, uint32_t drops);
+
   protected:
 
     Storage *_queue1;
@@ -0,0 +1,437 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * fqcodel.{cc,hh} -- flow-queueing queue with per-flow CoDel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fqcodel.hh"
+#include "elements/aqm/codel.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+CLICK_DECLS
+
+FQCoDel::FQCoDel()
+    : _len(0), _bytes(0), _highwater_length(0),
+      _codel_drops(0), _overlimit_drops(0), _new_flow_count(0)
+{
+    _new_flows.head = _new_flows.tail = -1;
+    _old_flows.head = _old_flows.tail = -1;
+}
+
+FQCoDel::~FQCoDel()
+{
+}
+
+void *
+FQCoDel::cast(const char *n)
+{
+    if (strcmp(n, "FQCoDel") == 0)
+	return this;
+    else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else
+	return BatchElement::cast(n);
+}
+
+int
+FQCoDel::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t nflows = 1024;
+    _limit = 10240;
+    _quantum = 1514;
+    _drop_batch = 64;
+    _target = Timestamp::make_msec(0, 5);
+    _interval = Timestamp::make_msec(0, 100);
+
+    if (Args(conf, this, errh)
+	.read("FLOWS", nflows)
+	.read("LIMIT", _limit)
+	.read("QUANTUM", _quantum)
+	.read("TARGET", _target)
+	.read("INTERVAL", _interval)
+	.read("DROP_BATCH", _drop_batch)
+	.complete() < 0)
+	return -1;
+
+    if (nflows == 0 || nflows > 65536)
+	return errh->error("FLOWS must be between 1 and 65536");
+    if (_limit == 0)
+	return errh->error("LIMIT must be positive");
+    if (_quantum <= 0)
+	return errh->error("QUANTUM must be positive");
+    if (_drop_batch == 0)
+	_drop_batch = 1;
+
+    Flow f;
+    f.head = f.tail = 0;
+    f.deficit = 0;
+    f.packets = f.bytes = f.drops = 0;
+    f.next = -1;
+    f.list = list_none;
+    f.count = f.last_count = 0;
+    f.dropping = false;
+    _flows.resize(nflows, f);
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    return 0;
+}
+
+void
+FQCoDel::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _flows.size(); i++)
+	while (Packet *p = flow_pop(_flows[i]))
+	    p->kill();
+}
+
+inline void
+FQCoDel::list_push_tail(FlowList &l, int fi)
+{
+    _flows[fi].next = -1;
+    if (l.tail < 0)
+	l.head = fi;
+    else
+	_flows[l.tail].next = fi;
+    l.tail = fi;
+    _flows[fi].list = (&l == &_new_flows ? list_new : list_old);
+}
+
+inline void
+FQCoDel::list_pop_head(FlowList &l)
+{
+    Flow &f = _flows[l.head];
+    l.head = f.next;
+    if (l.head < 0)
+	l.tail = -1;
+    f.next = -1;
+    f.list = list_none;
+}
+
+inline unsigned
+FQCoDel::classify(Packet *p) const
+{
+    if (!p->has_network_header())
+	return 0;
+    const click_ip *iph = p->ip_header();
+    if (iph->ip_v != 4)
+	return 0;
+    uint32_t h = iph->ip_src.s_addr * 0x9E3779B1U;
+    h ^= iph->ip_dst.s_addr + (h << 6) + (h >> 2);
+    h ^= iph->ip_p + (h << 6) + (h >> 2);
+    if (IP_FIRSTFRAG(iph) && p->has_transport_header()
+	&& (iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+	&& p->transport_length() >= 4) {
+	const click_udp *udph = p->udp_header();
+	h ^= ((uint32_t) udph->uh_sport << 16 | udph->uh_dport) + (h << 6) + (h >> 2);
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return h % _flows.size();
+}
+
+inline Packet *
+FQCoDel::flow_pop(Flow &f)
+{
+    Packet *p = f.head;
+    if (p) {
+	f.head = p->next();
+	if (!f.head)
+	    f.tail = 0;
+	p->set_next(0);
+	f.packets--;
+	f.bytes -= p->length();
+	_len--;
+	_bytes -= p->length();
+    }
+    return p;
+}
+
+inline void
+FQCoDel::enqueue(Packet *p, const Timestamp &now)
+{
+    int fi = classify(p);
+    Flow &f = _flows[fi];
+
+    FIRST_TIMESTAMP_ANNO(p) = now;
+    p->set_next(0);
+    if (f.tail)
+	f.tail->set_next(p);
+    else
+	f.head = p;
+    f.tail = p;
+    f.packets++;
+    f.bytes += p->length();
+    _len++;
+    _bytes += p->length();
+    if (_len > _highwater_length)
+	_highwater_length = _len;
+
+    if (f.list == list_none) {
+	list_push_tail(_new_flows, fi);
+	f.deficit = _quantum;
+	_new_flow_count++;
+    }
+
+    if (_len > _limit)
+	drop_fattest();
+}
+
+// RFC 8290 4.1.1: drop from the head of the flow with the largest backlog //
+void
+FQCoDel::drop_fattest()
+{
+    int fattest = 0;
+    for (int i = 1; i < _flows.size(); i++)
+	if (_flows[i].bytes > _flows[fattest].bytes)
+	    fattest = i;
+
+    Flow &f = _flows[fattest];
+    uint32_t threshold = f.bytes / 2;
+    uint32_t dropped = 0, dropped_bytes = 0;
+    while (dropped < _drop_batch && dropped_bytes < threshold) {
+	Packet *p = flow_pop(f);
+	if (!p)
+	    break;
+	dropped++;
+	dropped_bytes += p->length();
+	checked_output_push(1, p);
+    }
+    f.drops += dropped;
+    _overlimit_drops += dropped;
+}
+
+inline bool
+FQCoDel::should_drop(Flow &f, Packet *p, const Timestamp &now)
+{
+    if (!p) {
+	f.first_above_time = Timestamp();
+	return false;
+    }
+    Timestamp sojourn_time = now - FIRST_TIMESTAMP_ANNO(p);
+    if (sojourn_time < _target || f.bytes <= (uint32_t) _quantum) {
+	// below target, or not even an MTU to send
+	f.first_above_time = Timestamp();
+	return false;
+    }
+    if (!f.first_above_time) {
+	f.first_above_time = now + _interval;
+	return false;
+    }
+    return now >= f.first_above_time;
+}
+
+// the CoDel dequeue of one sub-queue, as in the pseudocode of the CoDel element //
+inline Packet *
+FQCoDel::codel_dequeue(Flow &f, const Timestamp &now)
+{
+    Packet *p = flow_pop(f);
+    if (!p) {
+	f.dropping = false;
+	f.first_above_time = Timestamp();
+	return 0;
+    }
+
+    bool drop = should_drop(f, p, now);
+    if (f.dropping) {
+	if (!drop)
+	    f.dropping = false;
+	else
+	    while (f.dropping && now >= f.drop_next) {
+		f.count++;
+		f.drops++;
+		_codel_drops++;
+		checked_output_push(1, p);
+		p = flow_pop(f);
+		if (!should_drop(f, p, now))
+		    f.dropping = false;
+		else
+		    f.drop_next = CoDel::control_law(f.drop_next, _interval, f.count);
+	    }
+    } else if (drop) {
+	f.drops++;
+	_codel_drops++;
+	checked_output_push(1, p);
+	p = flow_pop(f);
+	should_drop(f, p, now);
+	f.dropping = true;
+	// start close to the previous drop rate if we were dropping recently
+	uint32_t delta = f.count - f.last_count;
+	if (delta > 1 && now - f.drop_next < _interval * 16)
+	    f.count = delta;
+	else
+	    f.count = 1;
+	f.last_count = f.count;
+	f.drop_next = CoDel::control_law(now, _interval, f.count);
+    }
+    return p;
+}
+
+// DRR++ over the new and old flows //
+inline Packet *
+FQCoDel::dequeue(const Timestamp &now)
+{
+    while (1) {
+	FlowList *l = &_new_flows;
+	if (l->head < 0) {
+	    l = &_old_flows;
+	    if (l->head < 0)
+		return 0;
+	}
+
+	int fi = l->head;
+	Flow &f = _flows[fi];
+	if (f.deficit <= 0) {
+	    f.deficit += _quantum;
+	    list_pop_head(*l);
+	    list_push_tail(_old_flows, fi);
+	    continue;
+	}
+
+	Packet *p = codel_dequeue(f, now);
+	if (!p) {
+	    // an emptied new flow goes through the old list once, so that
+	    // a flow cannot stay new by sending one packet at a time
+	    list_pop_head(*l);
+	    if (l == &_new_flows && _old_flows.head >= 0)
+		list_push_tail(_old_flows, fi);
+	    continue;
+	}
+
+	f.deficit -= p->length();
+	return p;
+    }
+}
+
+void
+FQCoDel::push(int, Packet *p)
+{
+    enqueue(p, Timestamp::now_steady());
+    _empty_note.wake();
+}
+
+Packet *
+FQCoDel::pull(int)
+{
+    Packet *p = dequeue(Timestamp::now_steady());
+    if (!p)
+	_empty_note.sleep();
+    return p;
+}
+
+#if HAVE_BATCH
+void
+FQCoDel::push_batch(int, PacketBatch *batch)
+{
+    Timestamp now = Timestamp::now_steady();
+    FOR_EACH_PACKET_SAFE(batch, p)
+	enqueue(p, now);
+    _empty_note.wake();
+}
+
+PacketBatch *
+FQCoDel::pull_batch(int, unsigned max)
+{
+    Timestamp now = Timestamp::now_steady();
+    PacketBatch *batch;
+    MAKE_BATCH(dequeue(now), batch, max);
+    if (!batch)
+	_empty_note.sleep();
+    return batch;
+}
+#endif
+
+enum { h_length, h_bytes, h_highwater, h_drops, h_codel_drops,
+       h_overlimit_drops, h_new_flows, h_active_flows, h_flows,
+       h_reset_counts };
+
+String
+FQCoDel::read_handler(Element *e, void *thunk)
+{
+    FQCoDel *q = static_cast<FQCoDel *>(e);
+    switch ((intptr_t) thunk) {
+    case h_length:
+	return String(q->_len);
+    case h_bytes:
+	return String(q->_bytes);
+    case h_highwater:
+	return String(q->_highwater_length);
+    case h_drops:
+	return String(q->_codel_drops + q->_overlimit_drops);
+    case h_codel_drops:
+	return String(q->_codel_drops);
+    case h_overlimit_drops:
+	return String(q->_overlimit_drops);
+    case h_new_flows:
+	return String(q->_new_flow_count);
+    case h_active_flows: {
+	int n = 0;
+	for (int i = 0; i < q->_flows.size(); i++)
+	    if (q->_flows[i].packets)
+		n++;
+	return String(n);
+    }
+    case h_flows: {
+	StringAccum sa;
+	for (int i = 0; i < q->_flows.size(); i++) {
+	    const Flow &f = q->_flows[i];
+	    if (f.packets || f.drops)
+		sa << i << ' ' << f.packets << ' ' << f.bytes << ' ' << f.drops << '\n';
+	}
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+int
+FQCoDel::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    FQCoDel *q = static_cast<FQCoDel *>(e);
+    switch ((intptr_t) thunk) {
+    case h_reset_counts:
+	q->_codel_drops = q->_overlimit_drops = q->_new_flow_count = 0;
+	q->_highwater_length = q->_len;
+	for (int i = 0; i < q->_flows.size(); i++)
+	    q->_flows[i].drops = 0;
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+void
+FQCoDel::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("bytes", read_handler, h_bytes);
+    add_read_handler("highwater_length", read_handler, h_highwater);
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("codel_drops", read_handler, h_codel_drops);
+    add_read_handler("overlimit_drops", read_handler, h_overlimit_drops);
+    add_read_handler("new_flows", read_handler, h_new_flows);
+    add_read_handler("active_flows", read_handler, h_active_flows);
+    add_read_handler("flows", read_handler, h_flows);
+    add_data_handlers("target", Handler::OP_READ | Handler::OP_WRITE, &_target, true);
+    add_data_handlers("interval", Handler::OP_READ | Handler::OP_WRITE, &_interval, true);
+    add_write_handler("reset_counts", write_handler, h_reset_counts, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(CoDel int64)
+EXPORT_ELEMENT(FQCoDel)
@@ -0,0 +1,211 @@
+#ifndef CLICK_FQCODEL_HH
+#define CLICK_FQCODEL_HH
+#include <click/batchelement.hh>
+#include <click/notifier.hh>
+#include <click/timestamp.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FQCoDel([, I<KEYWORDS>])
+
+=s aqm
+
+flow-queueing queue with per-flow P<CoDel>
+
+=d
+
+Implements FQ-CoDel (RFC 8290), a queue that isolates flows from each other.
+Packets are hashed on their IP 5-tuple into FLOWS sub-queues, which are
+served with deficit round robin. A sub-queue that just became active is served
+before the ones that stayed backlogged (DRR++), so sparse flows such as DNS,
+ACKs or interactive traffic bypass the bulk ones. Each sub-queue runs its own
+CoDel state, with the control law of the CoDel element, so a flow building a
+standing queue only has its own packets dropped.
+
+FQCoDel has a push input and a pull output, like a Queue. Non-IP packets all
+go to the same sub-queue. The enqueue time is stored in the "first timestamp"
+annotation. When the queue holds more than LIMIT packets, packets are dropped
+from the head of the sub-queue with the largest backlog in bytes. Dropped
+packets are emitted on output 1 if it exists.
+
+FQCoDel is not thread-safe: one thread should push and pull.
+
+Keyword arguments are:
+
+=over 8
+
+=item FLOWS
+
+Integer. Number of sub-queues. Default is 1024.
+
+=item LIMIT
+
+Integer. Maximum number of packets in all the sub-queues. Default is 10240.
+
+=item QUANTUM
+
+Integer. Number of bytes a sub-queue may send at each round. It is also the
+backlog under which a sub-queue never drops, as for an MTU. Default is 1514.
+
+=item TARGET
+
+Timestamp. Target sojourn time of the packets, default is 5 ms.
+
+=item INTERVAL
+
+Timestamp. Sliding minimum window width, default is 100 ms.
+
+=item DROP_BATCH
+
+Integer. Maximum number of packets dropped at once from the fattest sub-queue
+when LIMIT is reached. At most half of its backlog is dropped. Default is 64.
+
+=back
+
+=h length read-only
+
+Number of packets in all the sub-queues.
+
+=h bytes read-only
+
+Number of bytes in all the sub-queues.
+
+=h highwater_length read-only
+
+Maximum number of packets seen in the sub-queues so far.
+
+=h drops read-only
+
+Number of packets dropped so far, either by CoDel or because of LIMIT.
+
+=h codel_drops read-only
+
+Number of packets dropped by CoDel.
+
+=h overlimit_drops read-only
+
+Number of packets dropped because LIMIT was reached.
+
+=h new_flows read-only
+
+Number of times a sub-queue became active.
+
+=h active_flows read-only
+
+Number of sub-queues that hold packets.
+
+=h flows read-only
+
+Statistics of the sub-queues that hold packets or dropped some, one per line:
+index, backlog in packets, backlog in bytes, and drops.
+
+=h target read/write
+
+Returns or sets the TARGET parameter.
+
+=h interval read/write
+
+Returns or sets the INTERVAL parameter.
+
+=h reset_counts write-only
+
+Resets the drop counters of the element and of the sub-queues.
+
+=e
+
+  FromDevice(eth0) -> ... -> q :: FQCoDel(LIMIT 4096) -> ToDevice(eth1);
+
+=a CoDel, Queue, RED
+
+T. Hoeiland-Joergensen, P. McKenney, D. Taht, J. Gettys and E. Dumazet.
+I<The Flow Queue CoDel Packet Scheduler and Active Queue Management Algorithm>.
+RFC 8290, 2018. */
+
+class FQCoDel : public BatchElement { public:
+
+    FQCoDel() CLICK_COLD;
+    ~FQCoDel() CLICK_COLD;
+
+    const char *class_name() const override	{ return "FQCoDel"; }
+    const char *port_count() const override	{ return PORTS_1_1X2; }
+    const char *processing() const override	{ return "h/lh"; }
+    void *cast(const char *) override;
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+    PacketBatch *pull_batch(int port, unsigned max);
+#endif
+
+  private:
+
+    enum { list_none = 0, list_new, list_old };
+
+    struct Flow {
+	Packet *head;
+	Packet *tail;
+	int deficit;
+	uint32_t packets;
+	uint32_t bytes;
+	uint32_t drops;
+	int next;		// next flow of its list, -1 at the end
+	int list;
+
+	// CoDel state
+	Timestamp first_above_time;
+	Timestamp drop_next;
+	uint32_t count;
+	uint32_t last_count;
+	bool dropping;
+    };
+
+    struct FlowList {
+	int head;
+	int tail;
+    };
+
+    Vector<Flow> _flows;
+    FlowList _new_flows;
+    FlowList _old_flows;
+
+    uint32_t _len;
+    uint32_t _bytes;
+    uint32_t _highwater_length;
+    uint32_t _limit;
+    int _quantum;
+    uint32_t _drop_batch;
+    Timestamp _target;
+    Timestamp _interval;
+
+    uint64_t _codel_drops;
+    uint64_t _overlimit_drops;
+    uint64_t _new_flow_count;
+
+    ActiveNotifier _empty_note;
+
+    inline unsigned classify(Packet *p) const;
+    inline void enqueue(Packet *p, const Timestamp &now);
+    inline Packet *dequeue(const Timestamp &now);
+    inline Packet *flow_pop(Flow &f);
+    inline bool should_drop(Flow &f, Packet *p, const Timestamp &now);
+    inline Packet *codel_dequeue(Flow &f, const Timestamp &now);
+    void drop_fattest();
+
+    inline void list_push_tail(FlowList &l, int fi);
+    inline void list_pop_head(FlowList &l);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
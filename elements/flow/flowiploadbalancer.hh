@@ -54,8 +54,44 @@ IP Address. Can be repeated multiple times, once per destination.
 =item VIP
 IP Address of this load-balancer.
 
+=item LB_MODE
+
+The load-balancing method: rr, wrr, awrr, hash, chash, hash_ip, hash_agg,
+cst_hash_agg, least, pow2, table or maglev. Default is rr.
+
+In maglev mode, new flows are assigned through a Maglev lookup table, see
+IPLoadBalancer. Established flows keep their server whatever the table says.
+
+=item NSERVER
+
+Integer. Number of DST that are active at start, the following ones are
+spares. Default is all of them.
+
+=item MAGLEV_SIZE
+
+Integer. Size of the maglev table, which must be a prime number much larger
+than the number of servers. Default is 65537.
+
+=item WEIGHTS
+
+List of integers, one per DST, giving the relative weights of the servers in
+maglev mode. Default is 1 for all.
+
 =back
 
+=h add_server write-only
+
+In maglev mode, activate a spare server, given by its index in the DST list or
+its address.
+
+=h remove_server write-only
+
+In maglev mode, deactivate a server, given by its index or its address.
+
+=h weights read/write
+
+In maglev mode, the weights of the servers, as a space-separated list.
+
 =e
     FlowIPLoadBalancer(VIP 10.220.0.1, DST 10.221.0.1, DST 10.221.0.2, DST 10.221.0.3)
 
@@ -21,13 +21,15 @@
 #include <click/routervisitor.hh>
 #include <click/error.hh>
 #include "flowipmanager.hh"
+#if HAVE_FLOW_RTE_HASH
 #include <rte_hash.h>
 #include <click/dpdk_glue.hh>
 #include <rte_ethdev.h>
+#endif
 
 CLICK_DECLS
 
-FlowIPManager::FlowIPManager() : _verbose(1), _flags(0), _timer(this), _task(this), _cache(true)
+FlowIPManager::FlowIPManager() : hash(0), fcbs(0), _verbose(1), _flags(0), _timer(this), _task(this), _cache(true), _bulk(true), _mp(false), _native(false), _cuckoo(0), _sweep_left(0)
 {
 }
 
@@ -39,19 +41,32 @@ int
 FlowIPManager::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     bool lf = false;
+#if HAVE_FLOW_RTE_HASH
+    bool native = false;
+#else
+    bool native = true;
+#endif
 
     if (Args(conf, this, errh)
         .read_or_set_p("CAPACITY", _table_size, 65536)
         .read_or_set("RESERVE",_reserve, 0)
         .read_or_set("TIMEOUT", _timeout, 60)
-#if RTE_VERSION > RTE_VERSION_NUM(18,8,0,0)
+#if HAVE_FLOW_RTE_HASH
         .read_or_set("LF", lf, false)
 #endif
         .read_or_set("CACHE", _cache, true)
+        .read_or_set("BULK", _bulk, true)
+        .read("NATIVE", native)
         .read_or_set("VERBOSE", _verbose, 1)
         .complete() < 0)
         return -1;
 
+#if !HAVE_FLOW_RTE_HASH
+    if (!native)
+        return errh->error("NATIVE false requires DPDK");
+#endif
+    _native = native;
+
     find_children(_verbose);
 
     router()->get_root_init_future()->postOnce(&_fcb_builded_init_future);
@@ -62,38 +77,48 @@ FlowIPManager::configure(Vector<String> &conf, ErrorHandler *errh)
         click_chatter("Real capacity will be %d",_table_size);
     }
 
-#if RTE_VERSION > RTE_VERSION_NUM(18,8,0,0)
+#if HAVE_FLOW_RTE_HASH
     if (lf) {
         _flags &= ~RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY;
         _flags |= RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF | RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD;
+        _mp = true;
     }
 #endif
 
-    _reserve += sizeof(IPFlow5ID)  + sizeof(FlowControlBlock);
+    _reserve += sizeof(IPFlow5ID);
 
     return 0;
 }
 
 int FlowIPManager::solve_initialize(ErrorHandler *errh)
 {
-    struct rte_hash_parameters hash_params = {0};
-    char buf[32];
-    hash_params.name = buf;
-    hash_params.entries = _table_size;
-    hash_params.key_len = sizeof(IPFlow5ID);
-    hash_params.hash_func = ipv4_hash_crc;
-    hash_params.hash_func_init_val = 0;
-    hash_params.extra_flag = _flags;
-
-    assert(_reserve >=  sizeof(IPFlow5ID) + sizeof(FlowControlBlock));
-    _flow_state_size_full = _reserve;
+    assert(_reserve >= sizeof(IPFlow5ID));
+    _flow_state_size_full = sizeof(FlowControlBlock) + _reserve;
 
     if (_verbose)
-     errh->message("Per-flow size is %d", _reserve);
-    sprintf(buf, "%s", name().c_str());
-    hash = rte_hash_create(&hash_params);
-    if (!hash)
-        return errh->error("Could not init flow table !");
+     errh->message("Per-flow size is %d", _flow_state_size_full);
+
+    if (_native) {
+        _cuckoo = new FlowCuckooTable<IPFlow5ID>(_table_size, _mp);
+        if (!_cuckoo->initialized())
+            return errh->error("Could not init flow table !");
+    } else {
+#if HAVE_FLOW_RTE_HASH
+        struct rte_hash_parameters hash_params = {0};
+        char buf[32];
+        hash_params.name = buf;
+        hash_params.entries = _table_size;
+        hash_params.key_len = sizeof(IPFlow5ID);
+        hash_params.hash_func = ipv4_hash_crc;
+        hash_params.hash_func_init_val = 0;
+        hash_params.extra_flag = _flags;
+
+        sprintf(buf, "%s", name().c_str());
+        hash = rte_hash_create(&hash_params);
+        if (!hash)
+            return errh->error("Could not init flow table !");
+#endif
+    }
 
     fcbs =  (FlowControlBlock*)CLICK_ALIGNED_ALLOC(_flow_state_size_full * _table_size);
     bzero(fcbs,_flow_state_size_full * _table_size);
@@ -102,7 +127,8 @@ int FlowIPManager::solve_initialize(ErrorHandler *errh)
         return errh->error("Could not init data table !");
 
     if (_timeout > 0) {
-        _timer_wheel.initialize(_timeout);
+        if (!_native)
+            _timer_wheel.initialize(_timeout);
 
         _timer.initialize(this);
         _timer.schedule_after(Timestamp::make_sec(1));
@@ -126,6 +152,19 @@ static const auto setter = [](FlowControlBlock* prev, FlowControlBlock* next)
 bool FlowIPManager::run_task(Task* t)
 {
     Timestamp recent = Timestamp::recent_steady();
+    if (_cuckoo) {
+        uint32_t nb = _sweep_left < sweep_burst ? _sweep_left : (uint32_t) sweep_burst;
+        int n = _cuckoo->sweep(nb, [this,recent](int pos) -> bool {
+            return (recent - fcb_at(pos)->lastseen).sec() > _timeout;
+        });
+        if (unlikely(_verbose > 1 && n))
+            click_chatter("Released %d expired flows", n);
+        _sweep_left -= nb;
+        if (_sweep_left)
+            _task.fast_reschedule();
+        return nb > 0;
+    }
+#if HAVE_FLOW_RTE_HASH
     _timer_wheel.run_timers([this,recent](FlowControlBlock* prev) -> FlowControlBlock*{
         FlowControlBlock* next = *fcb_next_ptr(prev);
         int old = (recent - prev->lastseen).sec();
@@ -140,61 +179,100 @@ bool FlowIPManager::run_task(Task* t)
         }
         return next;
     });
+#endif
     return true;
 }
 
 void FlowIPManager::run_timer(Timer* t)
 {
+    //Start a new pass once the previous one is over
+    if (_cuckoo && !_sweep_left)
+        _sweep_left = _cuckoo->buckets();
     _task.reschedule();
     t->reschedule_after(Timestamp::make_sec(1));
 }
 
 void FlowIPManager::cleanup(CleanupStage stage)
 {
+#if HAVE_FLOW_RTE_HASH
     if (hash)
         rte_hash_free(hash);
+#endif
+    delete _cuckoo;
+    _cuckoo = 0;
 }
 
-void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+inline int FlowIPManager::table_lookup(const IPFlow5ID& fid, uint32_t sig)
 {
-    IPFlow5ID fid = IPFlow5ID(p);
+#if HAVE_FLOW_RTE_HASH
+    if (!_cuckoo)
+        return rte_hash_lookup_with_hash(hash, &fid, sig);
+#endif
+    return _cuckoo->lookup(fid, sig);
+}
 
-    if (_cache && fid == b.last_id) {
-        b.append(p);
+inline void FlowIPManager::table_lookup_bulk(FlowKeyBatch& k)
+{
+#if HAVE_FLOW_RTE_HASH
+    if (!_cuckoo) {
+# if RTE_VERSION >= RTE_VERSION_NUM(20,11,0,0) && defined(ALLOW_EXPERIMENTAL_API)
+        rte_hash_lookup_with_hash_bulk(hash, k.key_ptrs, k.hashes, k.count, k.positions);
+# else
+        rte_hash_lookup_bulk(hash, k.key_ptrs, k.count, k.positions);
+# endif
         return;
     }
+#endif
+    _cuckoo->lookup_bulk(k);
+}
 
-    rte_hash*& table = hash;
-    FlowControlBlock* fcb;
-    int ret = rte_hash_lookup(table, &fid);
+int FlowIPManager::table_count()
+{
+#if HAVE_FLOW_RTE_HASH
+    if (!_cuckoo)
+        return rte_hash_count(hash);
+#endif
+    return _cuckoo->count();
+}
 
-    if (ret < 0) { // new flow
-        ret = rte_hash_add_key(table, &fid);
-        if (unlikely(ret < 0)) {
-            if (unlikely(_verbose > 0)) {
-                click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret);
-            }
-            p->kill();
-            return;
+int FlowIPManager::add_flow(const IPFlow5ID& fid, uint32_t sig)
+{
+    int ret;
+#if HAVE_FLOW_RTE_HASH
+    if (!_cuckoo)
+        ret = rte_hash_add_key_with_hash(hash, &fid, sig);
+    else
+#endif
+        ret = _cuckoo->add(fid, sig);
+    if (unlikely(ret < 0)) {
+        if (unlikely(_verbose > 0)) {
+            click_chatter("Cannot add key (have %d items. Error %d)!", table_count(), ret);
         }
-        if (unlikely(_verbose > 1))
-            click_chatter("New flow %d", ret);
-        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
-        //Remember ID for deletion
-        *((IPFlow5ID*)&fcb->data_32[0]) = fid;
-        if (_timeout) {
-            if (_flags) {
-                _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
-            } else {
-                _timer_wheel.schedule_after(fcb, _timeout, setter);
-            }
+        return ret;
+    }
+    if (unlikely(_verbose > 1))
+        click_chatter("New flow %d", ret);
+    FlowControlBlock* fcb = fcb_at(ret);
+    //Remember ID for deletion
+    *((IPFlow5ID*)&fcb->data_32[0]) = fid;
+    if (_cuckoo) {
+        //The position may be the one of a swept flow, whose state and
+        //lastseen are still there
+        bzero(&fcb->data[sizeof(IPFlow5ID)], _flow_state_size_full - sizeof(FlowControlBlock) - sizeof(IPFlow5ID));
+        fcb->flags = 0;
+        fcb->lastseen = Timestamp::recent_steady();
+    } else if (_timeout) {
+        if (_mp) {
+            _timer_wheel.schedule_after_mp(fcb, _timeout, setter);
+        } else {
+            _timer_wheel.schedule_after(fcb, _timeout, setter);
         }
-    } else { //existing flow
-        if (unlikely(_verbose > 1))
-            click_chatter("Existing flow %d", ret);
-        fcb = (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * ret));
     }
+    return ret;
+}
 
+void FlowIPManager::append(Packet* p, int ret, BatchBuilder& b, const Timestamp& recent)
+{
     if (b.last == ret) {
         b.append(p);
     } else {
@@ -204,13 +282,73 @@ void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
             fcb_stack->lastseen = recent;
             output_push_batch(0, batch);
         }
-        fcb_stack = fcb;
+        fcb_stack = fcb_at(ret);
         b.init();
         b.append(p);
         b.last = ret;
-        if (_cache)
-            b.last_id = fid;
+    }
+}
+
+void FlowIPManager::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+{
+    IPFlow5ID fid = IPFlow5ID(p);
 
+    if (_cache && fid == b.last_id) {
+        b.append(p);
+        return;
+    }
+
+    uint32_t sig = flow_hash_crc(fid);
+    int ret = table_lookup(fid, sig);
+
+    if (ret < 0) { // new flow
+        ret = add_flow(fid, sig);
+        if (unlikely(ret < 0)) {
+            p->kill();
+            return;
+        }
+    } else { //existing flow
+        if (unlikely(_verbose > 1))
+            click_chatter("Existing flow %d", ret);
+    }
+
+    int last = b.last;
+    append(p, ret, b, recent);
+    if (_cache && last != ret)
+        b.last_id = fid;
+}
+
+/**
+ * Classify packets by bursts of FlowKeyBatch::max_size: all keys are hashed,
+ * looked up at once, and the FCBs found are prefetched before the first
+ * packet is dispatched.
+ */
+void FlowIPManager::process_bulk(PacketBatch* batch, BatchBuilder& b, const Timestamp& recent)
+{
+    FlowKeyBatch k;
+    Packet* next = batch->first();
+    while (next) {
+        next = k.extract(next);
+        table_lookup_bulk(k);
+        for (int i = 0; i < k.count; i++)
+            if (k.positions[i] >= 0)
+                __builtin_prefetch(fcb_at(k.positions[i]));
+
+        for (int i = 0; i < k.count; i++) {
+            Packet* p = k.packets[i];
+            int ret = k.positions[i];
+            if (ret < 0) {
+                //A previous packet of the burst may have created the flow
+                ret = table_lookup(k.keys[i], k.hashes[i]);
+                if (ret < 0)
+                    ret = add_flow(k.keys[i], k.hashes[i]);
+                if (unlikely(ret < 0)) {
+                    p->kill();
+                    continue;
+                }
+            }
+            append(p, ret, b, recent);
+        }
     }
 }
 
@@ -218,8 +356,12 @@ void FlowIPManager::push_batch(int, PacketBatch* batch)
 {
     BatchBuilder b;
     Timestamp recent = Timestamp::recent_steady();
-    FOR_EACH_PACKET_SAFE(batch, p) {
-        process(p, b, recent);
+    if (_bulk) {
+        process_bulk(batch, b, recent);
+    } else {
+        FOR_EACH_PACKET_SAFE(batch, p) {
+            process(p, b, recent);
+        }
     }
 
     batch = b.finish();
@@ -234,10 +376,9 @@ String FlowIPManager::read_handler(Element* e, void* thunk)
 {
     FlowIPManager* fc = static_cast<FlowIPManager*>(e);
 
-    rte_hash* table = fc->hash;
     switch ((intptr_t)thunk) {
     case h_count:
-        return String(rte_hash_count(table));
+        return String(fc->table_count());
     default:
         return "<error>";
     }
@@ -250,6 +391,6 @@ void FlowIPManager::add_handlers()
 
 CLICK_ENDDECLS
 
-ELEMENT_REQUIRES(dpdk dpdk19)
+ELEMENT_REQUIRES(flow)
 EXPORT_ELEMENT(FlowIPManager)
 ELEMENT_MT_SAFE(FlowIPManager)
@@ -10,6 +10,8 @@
 #include <click/flow/common.hh>
 #include <click/batchbuilder.hh>
 #include <click/timerwheel.hh>
+#include <click/flow/flowkeybatch.hh>
+#include <click/flow/flowcuckoo.hh>
 CLICK_DECLS
 class DPDKDevice;
 struct rte_hash;
@@ -26,6 +28,19 @@ struct rte_hash;
  * Initialize the FCB stack for every packets passing by.
  * The classification is done using a unique cuckoo hash table.
  *
+ * Unless BULK is false, the flow keys of up to 64 packets of a batch are
+ * extracted and hashed at once, the table is searched with a single bulk
+ * lookup, and the FCBs found are prefetched before the packets are
+ * dispatched, which hides most of the memory latency with large tables.
+ * With BULK false, packets are classified one by one, and CACHE avoids the
+ * lookup for consecutive packets of the same flow.
+ *
+ * If NATIVE is true, the table is Click's FlowCuckooTable instead of DPDK's
+ * rte_hash, and idle flows are expired by sweeping the table rather than
+ * with a timer wheel. Every second, a pass sweeps the whole table, a few
+ * buckets per task run. NATIVE defaults to true when Click is compiled
+ * without DPDK, in which case it is the only choice.
+ *
  * This element does not find automatically the FCB layout for FlowElement,
  * neither set the offsets for placement in the FCB automatically. Look at
  * the middleclick branch for alternatives.
@@ -72,9 +87,25 @@ class FlowIPManager: public VirtualFlowManager, public Router::InitFuture {
         Task _task;
 
         bool _cache;
+        bool _bulk;
+        bool _mp;
+        bool _native;
+        FlowCuckooTable<IPFlow5ID>* _cuckoo;
+        uint32_t _sweep_left; //Buckets left to sweep in the current pass
+
+        enum { sweep_burst = 256 }; //Buckets swept per task run
 
         static String read_handler(Element* e, void* thunk);
+        inline FlowControlBlock* fcb_at(int pos) {
+            return (FlowControlBlock*)((unsigned char*)fcbs + (_flow_state_size_full * pos));
+        }
+        inline int table_lookup(const IPFlow5ID& fid, uint32_t sig);
+        inline void table_lookup_bulk(FlowKeyBatch& k);
+        int table_count();
+        inline int add_flow(const IPFlow5ID& fid, uint32_t sig);
+        inline void append(Packet* p, int ret, BatchBuilder& b, const Timestamp& recent);
         inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent);
+        inline void process_bulk(PacketBatch* batch, BatchBuilder& b, const Timestamp& recent);
         TimerWheel<FlowControlBlock> _timer_wheel;
 };
 
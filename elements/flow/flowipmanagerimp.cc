@@ -9,14 +9,16 @@
 #include <click/routervisitor.hh>
 #include <click/error.hh>
 #include "flowipmanagerimp.hh"
+#if HAVE_FLOW_RTE_HASH
 #include <rte_hash.h>
 #include <click/dpdk_glue.hh>
 #include <rte_ethdev.h>
 #include <rte_errno.h>
+#endif
 
 CLICK_DECLS
 
-FlowIPManagerIMP::FlowIPManagerIMP() : _verbose(1), _flags(0), _timer(this), _task(this), _tables(0), _cache(true) {
+FlowIPManagerIMP::FlowIPManagerIMP() : _verbose(1), _flags(0), _timer(this), _task(this), _tables(0), _cache(true), _bulk(true), _native(false) {
 }
 
 FlowIPManagerIMP::~FlowIPManagerIMP()
@@ -26,14 +28,27 @@ FlowIPManagerIMP::~FlowIPManagerIMP()
 int
 FlowIPManagerIMP::configure(Vector<String> &conf, ErrorHandler *errh)
 {
+#if HAVE_FLOW_RTE_HASH
+    bool native = false;
+#else
+    bool native = true;
+#endif
     if (Args(conf, this, errh)
         .CLICK_NEVER_REPLACE(read_or_set_p)("CAPACITY", _table_size, 65536)
         .CLICK_NEVER_REPLACE(read_or_set)("RESERVE", _reserve, 0)
         .read_or_set("TIMEOUT", _timeout, -1)
         .read_or_set("CACHE", _cache, true)
+        .read_or_set("BULK", _bulk, true)
+        .read("NATIVE", native)
         .complete() < 0)
         return -1;
 
+#if !HAVE_FLOW_RTE_HASH
+    if (!native)
+        return errh->error("NATIVE false requires DPDK");
+#endif
+    _native = native;
+
     if (_timeout > 0) {
         return errh->error("Timeout unsupported!");
     }
@@ -53,18 +68,20 @@ FlowIPManagerIMP::configure(Vector<String> &conf, ErrorHandler *errh)
 
 int FlowIPManagerIMP::solve_initialize(ErrorHandler *errh)
 {
-    struct rte_hash_parameters hash_params = {0};
-    char buf[64];
-    hash_params.name = buf;
     auto passing = get_passing_threads();
     _tables_count = passing.size();
     _table_size = next_pow2(_table_size/passing.weight());
     click_chatter("Real capacity for each table will be %d", _table_size);
+#if HAVE_FLOW_RTE_HASH
+    struct rte_hash_parameters hash_params = {0};
+    char buf[64];
+    hash_params.name = buf;
     hash_params.entries = _table_size;
     hash_params.key_len = sizeof(IPFlow5ID);
     hash_params.hash_func = ipv4_hash_crc;
     hash_params.hash_func_init_val = 0;
     hash_params.extra_flag = _flags;
+#endif
 
     _flow_state_size_full = sizeof(FlowControlBlock) + _reserve;
 
@@ -74,10 +91,18 @@ int FlowIPManagerIMP::solve_initialize(ErrorHandler *errh)
     for (int i = 0; i < _tables_count; i++) {
         if (!passing[i])
             continue;
-        sprintf(buf, "%d-%s",i,name().c_str());
-        _tables[i].hash = rte_hash_create(&hash_params);
-        if (!_tables[i].hash)
-            return errh->error("Could not init flow table %d : error %d (%s)!", i, rte_errno, rte_strerror(rte_errno));
+        if (_native) {
+            _tables[i].cuckoo = new FlowCuckooTable<IPFlow5ID>(_table_size, false);
+            if (!_tables[i].cuckoo->initialized())
+                return errh->error("Could not init flow table %d!", i);
+        } else {
+#if HAVE_FLOW_RTE_HASH
+            sprintf(buf, "%d-%s",i,name().c_str());
+            _tables[i].hash = rte_hash_create(&hash_params);
+            if (!_tables[i].hash)
+                return errh->error("Could not init flow table %d : error %d (%s)!", i, rte_errno, rte_strerror(rte_errno));
+#endif
+        }
 
         _tables[i].fcbs =  (FlowControlBlock*)CLICK_ALIGNED_ALLOC(_flow_state_size_full * _table_size);
         CLICK_ASSERT_ALIGNED(_tables[i].fcbs);
@@ -133,8 +158,11 @@ void FlowIPManagerIMP::cleanup(CleanupStage stage)
     click_chatter("Cleanup the table");
     if (_tables) {
         for(int i =0; i<click_max_cpu_ids(); i++) {
+#if HAVE_FLOW_RTE_HASH
            if (_tables[i].hash)
                rte_hash_free(_tables[i].hash);
+#endif
+           delete _tables[i].cuckoo;
 
            if (_tables[i].fcbs)
                 delete _tables[i].fcbs;
@@ -144,43 +172,69 @@ void FlowIPManagerIMP::cleanup(CleanupStage stage)
     }
 }
 
-void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+inline int FlowIPManagerIMP::table_lookup(gtable& tab, const IPFlow5ID& fid, uint32_t sig)
 {
-    IPFlow5ID fid = IPFlow5ID(p);
+#if HAVE_FLOW_RTE_HASH
+    if (!tab.cuckoo)
+        return rte_hash_lookup_with_hash(tab.hash, &fid, sig);
+#endif
+    return tab.cuckoo->lookup(fid, sig);
+}
 
-    if (_cache && fid == b.last_id) {
-        b.append(p);
+inline void FlowIPManagerIMP::table_lookup_bulk(gtable& tab, FlowKeyBatch& k)
+{
+#if HAVE_FLOW_RTE_HASH
+    if (!tab.cuckoo) {
+# if RTE_VERSION >= RTE_VERSION_NUM(20,11,0,0) && defined(ALLOW_EXPERIMENTAL_API)
+        rte_hash_lookup_with_hash_bulk(tab.hash, k.key_ptrs, k.hashes, k.count, k.positions);
+# else
+        rte_hash_lookup_bulk(tab.hash, k.key_ptrs, k.count, k.positions);
+# endif
         return;
     }
-    auto& tab = _tables[click_current_cpu_id()];
-    rte_hash* table = tab.hash;
+#endif
+    tab.cuckoo->lookup_bulk(k);
+}
 
-    FlowControlBlock* fcb;
+int FlowIPManagerIMP::table_count(gtable& tab)
+{
+#if HAVE_FLOW_RTE_HASH
+    if (tab.hash)
+        return rte_hash_count(tab.hash);
+#endif
+    return tab.cuckoo ? tab.cuckoo->count() : 0;
+}
 
-    int ret = rte_hash_lookup(table, &fid);
-    if (ret < 0) { //new flow
-        ret = rte_hash_add_key(table, &fid);
-        if (unlikely(ret < 0)) {
-            if (unlikely(_verbose > 0)) {
-                click_chatter("Cannot add key (have %d items. Error %d)!", rte_hash_count(table), ret);
-            }
-            p->kill();
-            return;
+int FlowIPManagerIMP::add_flow(gtable& tab, const IPFlow5ID& fid, uint32_t sig)
+{
+    int ret;
+#if HAVE_FLOW_RTE_HASH
+    if (!tab.cuckoo)
+        ret = rte_hash_add_key_with_hash(tab.hash, &fid, sig);
+    else
+#endif
+        ret = tab.cuckoo->add(fid, sig);
+    if (unlikely(ret < 0)) {
+        if (unlikely(_verbose > 0)) {
+            click_chatter("Cannot add key (have %d items. Error %d)!", table_count(tab), ret);
         }
-        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret));
-        //We remember the index in the first 4 reserved bytes
-        fcb->data_32[0] = ret;
-        if (_timeout > 0) {
-            if (_flags) {
-                _timer_wheel.schedule_after_mp(fcb, _timeout, fim_setter);
-            } else {
-                _timer_wheel.schedule_after(fcb, _timeout, fim_setter);
-            }
+        return ret;
+    }
+    FlowControlBlock* fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret));
+    //We remember the index in the first 4 reserved bytes
+    fcb->data_32[0] = ret;
+    if (_timeout > 0) {
+        if (_flags) {
+            _timer_wheel.schedule_after_mp(fcb, _timeout, fim_setter);
+        } else {
+            _timer_wheel.schedule_after(fcb, _timeout, fim_setter);
         }
-    } else { //existing flow
-        fcb = (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret));
     }
+    return ret;
+}
 
+void FlowIPManagerIMP::append(Packet* p, FlowControlBlock* fcb, int ret, BatchBuilder& b, const Timestamp& recent)
+{
     if (b.last == ret) {
         b.append(p);
     } else {
@@ -194,8 +248,62 @@ void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& rece
         b.init();
         b.append(p);
         b.last = ret;
-        if (_cache)
-            b.last_id = fid;
+    }
+}
+
+void FlowIPManagerIMP::process(Packet* p, BatchBuilder& b, const Timestamp& recent)
+{
+    IPFlow5ID fid = IPFlow5ID(p);
+
+    if (_cache && fid == b.last_id) {
+        b.append(p);
+        return;
+    }
+    auto& tab = _tables[click_current_cpu_id()];
+    uint32_t sig = flow_hash_crc(fid);
+
+    int ret = table_lookup(tab, fid, sig);
+    if (ret < 0) { //new flow
+        ret = add_flow(tab, fid, sig);
+        if (unlikely(ret < 0)) {
+            p->kill();
+            return;
+        }
+    }
+
+    int last = b.last;
+    append(p, (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret)), ret, b, recent);
+    if (_cache && last != ret)
+        b.last_id = fid;
+}
+
+void FlowIPManagerIMP::process_bulk(PacketBatch* batch, BatchBuilder& b, const Timestamp& recent)
+{
+    auto& tab = _tables[click_current_cpu_id()];
+    FlowKeyBatch k;
+    Packet* next = batch->first();
+    while (next) {
+        next = k.extract(next);
+        table_lookup_bulk(tab, k);
+        for (int i = 0; i < k.count; i++)
+            if (k.positions[i] >= 0)
+                __builtin_prefetch((unsigned char*)tab.fcbs + (_flow_state_size_full * k.positions[i]));
+
+        for (int i = 0; i < k.count; i++) {
+            Packet* p = k.packets[i];
+            int ret = k.positions[i];
+            if (ret < 0) {
+                //A previous packet of the burst may have created the flow
+                ret = table_lookup(tab, k.keys[i], k.hashes[i]);
+                if (ret < 0)
+                    ret = add_flow(tab, k.keys[i], k.hashes[i]);
+                if (unlikely(ret < 0)) {
+                    p->kill();
+                    continue;
+                }
+            }
+            append(p, (FlowControlBlock*)((unsigned char*)tab.fcbs + (_flow_state_size_full * ret)), ret, b, recent);
+        }
     }
 }
 
@@ -203,8 +311,12 @@ void FlowIPManagerIMP::push_batch(int, PacketBatch* batch)
 {
     BatchBuilder b;
     Timestamp recent = Timestamp::recent_steady();
-    FOR_EACH_PACKET_SAFE(batch, p) {
-        process(p, b, recent);
+    if (_bulk) {
+        process_bulk(batch, b, recent);
+    } else {
+        FOR_EACH_PACKET_SAFE(batch, p) {
+            process(p, b, recent);
+        }
     }
 
     batch = b.finish();
@@ -224,10 +336,7 @@ String FlowIPManagerIMP::read_handler(Element* e, void* thunk)
         int count = 0;
         for(int i=0; i< fc->_tables_count; i++)
         {
-        gtable * t = (fc->_tables)+i;
-        rte_hash* table = t->hash;
-        if(table)
-            count+=rte_hash_count(table);
+            count += fc->table_count(fc->_tables[i]);
         }
         return String(count);
     }
@@ -243,6 +352,6 @@ void FlowIPManagerIMP::add_handlers()
 
 CLICK_ENDDECLS
 
-ELEMENT_REQUIRES(dpdk dpdk19)
+ELEMENT_REQUIRES(flow)
 EXPORT_ELEMENT(FlowIPManagerIMP)
 ELEMENT_MT_SAFE(FlowIPManagerIMP)
@@ -10,6 +10,8 @@
 #include <click/flow/flowelement.hh>
 #include <click/batchbuilder.hh>
 #include <click/timerwheel.hh>
+#include <click/flow/flowkeybatch.hh>
+#include <click/flow/flowcuckoo.hh>
 
 CLICK_DECLS
 
@@ -27,6 +29,13 @@ struct rte_hash;
  * Initialize the FCB stack for every packets passing by.
  * The classification is done using a per-core cuckoo hash table.
  *
+ * Unless BULK is false, packets are classified by bursts of up to 64 with a
+ * single bulk lookup, see FlowIPManager.
+ *
+ * If NATIVE is true, each table is a FlowCuckooTable in per-thread mode
+ * instead of a DPDK rte_hash. This is the default, and only choice, when
+ * Click is compiled without DPDK.
+ *
  * This element does not find automatically the FCB layout for FlowElement,
  * neither set the offsets for placement in the FCB automatically. Look at
  * the middleclick branch for alternatives.
@@ -61,9 +70,10 @@ class FlowIPManagerIMP: public VirtualFlowManager, public Router::InitFuture {
 
 
         struct gtable {
-            gtable() : hash(0), fcbs(0) {
+            gtable() : hash(0), cuckoo(0), fcbs(0) {
             }
             rte_hash* hash;
+            FlowCuckooTable<IPFlow5ID>* cuckoo;
             FlowControlBlock *fcbs;
         } CLICK_ALIGNED(CLICK_CACHE_LINE_SIZE);
 
@@ -79,9 +89,17 @@ class FlowIPManagerIMP: public VirtualFlowManager, public Router::InitFuture {
         Timer _timer; //Timer to launch the wheel
         Task _task;
         bool _cache;
+        bool _bulk;
+        bool _native;
 
         static String read_handler(Element* e, void* thunk);
+        inline int table_lookup(gtable& tab, const IPFlow5ID& fid, uint32_t sig);
+        inline void table_lookup_bulk(gtable& tab, FlowKeyBatch& k);
+        int table_count(gtable& tab);
+        inline int add_flow(gtable& tab, const IPFlow5ID& fid, uint32_t sig);
+        inline void append(Packet* p, FlowControlBlock* fcb, int ret, BatchBuilder& b, const Timestamp& recent);
         inline void process(Packet* p, BatchBuilder& b, const Timestamp& recent);
+        inline void process_bulk(PacketBatch* batch, BatchBuilder& b, const Timestamp& recent);
         TimerWheel<FlowControlBlock> _timer_wheel;
 };
 
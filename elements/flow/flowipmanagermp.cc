@@ -17,13 +17,18 @@
 #include <click/config.h>
 #include <click/glue.hh>
 #include "flowipmanagermp.hh"
+#if HAVE_FLOW_RTE_HASH
 #include <rte_hash.h>
+#endif
 
 CLICK_DECLS
 
 FlowIPManagerMP::FlowIPManagerMP()
 {
+#if HAVE_FLOW_RTE_HASH
     _flags = RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD | RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY;
+#endif
+    _mp = true;
 }
 
 FlowIPManagerMP::~FlowIPManagerMP()
@@ -32,6 +37,6 @@ FlowIPManagerMP::~FlowIPManagerMP()
 
 CLICK_ENDDECLS
 
-ELEMENT_REQUIRES(dpdk FlowIPManager)
+ELEMENT_REQUIRES(FlowIPManager)
 EXPORT_ELEMENT(FlowIPManagerMP)
 ELEMENT_MT_SAFE(FlowIPManagerMP)
@@ -23,7 +23,8 @@ struct rte_hash;
  *
  * =d
  *  Multi-thread equivalent of FlowIPManager. This version uses DPDK's
- *  thread-safe implementation of cuckoo hash table to ensure thread safeness.
+ *  thread-safe implementation of cuckoo hash table to ensure thread safeness,
+ *  or FlowCuckooTable in MP mode if NATIVE is true.
  *
  *  See FlowIPManager documentation for usage.
  *
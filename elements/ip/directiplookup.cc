@@ -67,6 +67,8 @@ DirectIPLookup::Table::cleanup()
     _rtable = 0;
     _tbl_0_23_plen = _tbl_24_31_plen = 0;
     _rt_hashtbl = 0;
+    _pending_blocks.clear();
+    _pending_vports.clear();
 }
 
 
@@ -112,6 +114,8 @@ DirectIPLookup::Table::flush()
 
     _tbl_24_31_size = 0;
     _tbl_24_31_empty_head = 0x8000;
+    _pending_blocks.clear();
+    _pending_vports.clear();
 }
 
 String
@@ -142,8 +146,11 @@ DirectIPLookup::Table::vport_find(IPAddress gw, int16_t port)
 	if (!new_vport)
 	    return -ENOMEM;
 	memcpy(new_vport, _vport, sizeof(VirtualPort) * _vport_capacity);
-	CLICK_LFREE(_vport, sizeof(VirtualPort) * _vport_capacity);
+	VirtualPort *old_vport = _vport;
+	click_write_fence();
 	_vport = new_vport;
+	synchronize();
+	CLICK_LFREE(old_vport, sizeof(VirtualPort) * _vport_capacity);
 	_vport_capacity *= 2;
     }
     if (_vport_empty_head < 0) {
@@ -171,12 +178,42 @@ DirectIPLookup::Table::vport_unref(uint16_t vport_i)
 	if (next >= 0)
 	    _vport[next].ll_prev = prev;
 
-	// Add the entry to empty vports list
-	_vport[vport_i].ll_next = _vport_empty_head;
-	_vport_empty_head = vport_i;
+	// The lookup tables still point to it: reclaim() adds it to the
+	// empty vports list once they don't and no reader has its index
+	_pending_vports.push_back(vport_i);
     }
 }
 
+void
+DirectIPLookup::Table::synchronize()
+{
+    if (_rcu)
+	_rcu->synchronize();
+}
+
+/*
+ * Make the second-level blocks and vports released by the last update
+ * available again. They are unreachable from the lookup tables by now, but
+ * readers that started before the update may still hold their indexes.
+ */
+void
+DirectIPLookup::Table::reclaim()
+{
+    if (!_pending_blocks.size() && !_pending_vports.size())
+	return;
+    synchronize();
+    for (int i = 0; i < _pending_blocks.size(); i++) {
+	_tbl_24_31[_pending_blocks[i] << 8] = _tbl_24_31_empty_head;
+	_tbl_24_31_empty_head = _pending_blocks[i];
+    }
+    for (int i = 0; i < _pending_vports.size(); i++) {
+	_vport[_pending_vports[i]].ll_next = _vport_empty_head;
+	_vport_empty_head = _pending_vports[i];
+    }
+    _pending_blocks.clear();
+    _pending_vports.clear();
+}
+
 int
 DirectIPLookup::Table::find_entry(uint32_t prefix, uint32_t plen) const
 {
@@ -253,10 +290,15 @@ DirectIPLookup::Table::add_route(const IPRoute& route, bool allow_replace, IPRou
 	    if (!new_tbl)
 		return -ENOMEM;
 	    memcpy(new_tbl, _tbl_24_31, sizeof(uint16_t) * _tbl_24_31_capacity);
-	    memcpy(new_tbl + _tbl_24_31_capacity, _tbl_24_31_plen, sizeof(uint8_t) * _tbl_24_31_capacity);
-	    CLICK_LFREE(_tbl_24_31, (sizeof(uint16_t) + sizeof(uint8_t)) * _tbl_24_31_capacity);
+	    memcpy(new_tbl + 2 * _tbl_24_31_capacity, _tbl_24_31_plen, sizeof(uint8_t) * _tbl_24_31_capacity);
+	    // Readers must be done with the old table before _tbl_0_23
+	    // points beyond its end
+	    uint16_t *old_tbl = _tbl_24_31;
+	    click_write_fence();
 	    _tbl_24_31 = new_tbl;
 	    _tbl_24_31_plen = (uint8_t *) (new_tbl + 2 * _tbl_24_31_capacity);
+	    synchronize();
+	    CLICK_LFREE(old_tbl, (sizeof(uint16_t) + sizeof(uint8_t)) * _tbl_24_31_capacity);
 	    _tbl_24_31_capacity *= 2;
 	}
 	_tbl_24_31_empty_head = _tbl_24_31_size >> 8;
@@ -296,6 +338,8 @@ DirectIPLookup::Table::add_route(const IPRoute& route, bool allow_replace, IPRou
     ++_vport[vport_i].refcount;
     _rtable[rt_i].vport = vport_i;
 
+    // The vport must be complete before the lookup tables point to it
+    click_write_fence();
     for (int i = start; i < end; i++) {
 	if (_tbl_0_23[i] & 0x8000) {
 	    // Entries with plen > 24 already there in _tbl_24_31[]!
@@ -344,6 +388,7 @@ DirectIPLookup::Table::add_route(const IPRoute& route, bool allow_replace, IPRou
 			    _tbl_24_31_plen[sec_i + j] = _tbl_0_23_plen[i];
 			}
 		    }
+		    click_write_fence();
 		    _tbl_0_23[i] = (sec_i >> 8) | 0x8000;
 		} else {
 		    _tbl_0_23[i] = vport_i;
@@ -361,6 +406,7 @@ DirectIPLookup::Table::add_route(const IPRoute& route, bool allow_replace, IPRou
 	}
     }
 
+    reclaim();
     return 0;
 }
 
@@ -459,16 +505,17 @@ DirectIPLookup::Table::remove_route(const IPRoute& route, IPRoute* old_route, Er
 		    }
 		}
 		// Check if we can prune the entire secondary table range?
+		// Only if a single route of length <= 24 covers it: two /25s
+		// have the same length, but not the same vport.
 		for (j = sec_i ; j < sec_i + 255; j++)
 		    if (_tbl_24_31_plen[j] != _tbl_24_31_plen[j+1])
 			break;
-		if (j == sec_i + 255) {
+		if (j == sec_i + 255 && _tbl_24_31_plen[sec_i] <= 24) {
 		    // Yup, adjust entries in primary tables...
 		    _tbl_0_23[i] = _tbl_24_31[sec_i];
 		    _tbl_0_23_plen[i] = _tbl_24_31_plen[sec_i];
-		    // ... and free up the entry (adding it to free space list)
-		    _tbl_24_31[sec_i] = _tbl_24_31_empty_head;
-		    _tbl_24_31_empty_head = sec_i >> 8;
+		    // ... and free up the entry once readers are done with it
+		    _pending_blocks.push_back(sec_i >> 8);
 		}
 	    } else {
 		if (plen == _tbl_0_23_plen[i]) {
@@ -481,6 +528,7 @@ DirectIPLookup::Table::remove_route(const IPRoute& route, IPRoute* old_route, Er
 	    }
 	}
     }
+    reclaim();
     return 0;
 }
 
@@ -488,11 +536,8 @@ DirectIPLookup::Table::remove_route(const IPRoute& route, IPRoute* old_route, Er
 // DIRECTIPLOOKUP
 
 DirectIPLookup::DirectIPLookup()
+    : _t(0)
 {
-#if HAVE_BATCH
-	// TODO: Remove this when push_batch() will actually be implemented
-	in_batch_mode = BATCH_MODE_NO;
-#endif
 }
 
 DirectIPLookup::~DirectIPLookup()
@@ -503,16 +548,44 @@ int
 DirectIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int r;
-    if ((r = _t.initialize()) < 0)
+    Table *t = new Table;
+    if ((r = t->initialize()) < 0) {
+	delete t;
 	return r;
-    _t.flush();
+    }
+    t->flush();
+    publish(t);
     return IPRouteTable::configure(conf, errh);
 }
 
 void
 DirectIPLookup::cleanup(CleanupStage)
 {
-    _t.cleanup();
+    delete _t;
+    _t = 0;
+}
+
+/*
+ * Switch the data path to table @a t. The old table is freed once no reader
+ * can still be walking it.
+ */
+void
+DirectIPLookup::publish(Table *t)
+{
+    Table *old = _t;
+    t->_rcu = &_rcu;
+    click_write_fence();
+    _t = t;
+    if (old) {
+	_rcu.retire(old, free_table, 0);
+	_rcu.collect();
+    }
+}
+
+void
+DirectIPLookup::free_table(void *obj, void *)
+{
+    delete static_cast<Table *>(obj);
 }
 
 void
@@ -533,40 +606,145 @@ int
 DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
 {
     uint32_t ip_addr = ntohl(dest.addr());
-    uint16_t vport_i = _t._tbl_0_23[ip_addr >> 8];
+    _rcu.read_begin();
+    const Table *t = _t;
+    uint16_t vport_i = t->_tbl_0_23[ip_addr >> 8];
 
     if (vport_i & 0x8000)
-        vport_i = _t._tbl_24_31[((vport_i & 0x7fff) << 8) | (ip_addr & 0xff)];
+        vport_i = t->_tbl_24_31[((vport_i & 0x7fff) << 8) | (ip_addr & 0xff)];
+
+    gw = t->_vport[vport_i].gw;
+    int port = t->_vport[vport_i].port;
+    _rcu.read_end();
+    return port;
+}
+
+/**
+ * Look up @a n addresses in stages: the _tbl_0_23 entries of all the
+ * addresses are prefetched first, then the _tbl_24_31 entries of those that
+ * need one, then the virtual ports. The DRAM accesses of a burst overlap
+ * instead of forming one dependent chain per address.
+ */
+void
+DirectIPLookup::lookup_routes(const IPAddress *dst, int n, int *port, IPAddress *gw) const
+{
+    uint32_t ip_addr[burst_size];
+    uint16_t vport_i[burst_size];
+    for (int b = 0; b < n; b += burst_size) {
+	int k = n - b < burst_size ? n - b : (int) burst_size;
+	_rcu.read_begin();
+	const Table *t = _t;
+	for (int i = 0; i < k; i++) {
+	    ip_addr[i] = ntohl(dst[b + i].addr());
+	    __builtin_prefetch(&t->_tbl_0_23[ip_addr[i] >> 8]);
+	}
+#if HAVE_AVX2
+	lookup_vports_avx2(t, ip_addr, k, vport_i);
+#else
+	for (int i = 0; i < k; i++) {
+	    vport_i[i] = t->_tbl_0_23[ip_addr[i] >> 8];
+	    if (vport_i[i] & 0x8000)
+		__builtin_prefetch(&t->_tbl_24_31[((vport_i[i] & 0x7fff) << 8) | (ip_addr[i] & 0xff)]);
+	}
+	for (int i = 0; i < k; i++) {
+	    if (vport_i[i] & 0x8000)
+		vport_i[i] = t->_tbl_24_31[((vport_i[i] & 0x7fff) << 8) | (ip_addr[i] & 0xff)];
+	    __builtin_prefetch(&t->_vport[vport_i[i]]);
+	}
+#endif
+	for (int i = 0; i < k; i++) {
+	    gw[b + i] = t->_vport[vport_i[i]].gw;
+	    port[b + i] = t->_vport[vport_i[i]].port;
+	}
+	_rcu.read_end();
+    }
+}
 
-    gw = _t._vport[vport_i].gw;
-    return _t._vport[vport_i].port;
+#if HAVE_AVX2
+/**
+ * Resolve the virtual ports of @a n addresses, 8 at a time, with AVX2
+ * gathers. The tables hold 16-bit entries and gathers load 32 bits, so the
+ * upper half of each loaded word is masked off. Reading past the last entry
+ * is safe, since the prefix length arrays follow the tables in memory.
+ */
+void
+DirectIPLookup::lookup_vports_avx2(const Table *t, const uint32_t *ip_addr, int n, uint16_t *vport_i)
+{
+    const __m256i lo16 = _mm256_set1_epi32(0xffff);
+    const __m256i lo15 = _mm256_set1_epi32(0x7fff);
+    const __m256i lo8 = _mm256_set1_epi32(0xff);
+    const __m256i ext = _mm256_set1_epi32(0x8000);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+	__m256i addr = _mm256_loadu_si256((const __m256i *) (ip_addr + i));
+	__m256i v = _mm256_i32gather_epi32((const int *) t->_tbl_0_23,
+					   _mm256_srli_epi32(addr, 8), 2);
+	v = _mm256_and_si256(v, lo16);
+	__m256i more = _mm256_cmpeq_epi32(_mm256_and_si256(v, ext), ext);
+	if (!_mm256_testz_si256(more, more)) {
+	    __m256i idx = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(v, lo15), 8),
+					  _mm256_and_si256(addr, lo8));
+	    v = _mm256_mask_i32gather_epi32(v, (const int *) t->_tbl_24_31, idx, more, 2);
+	    v = _mm256_and_si256(v, lo16);
+	}
+	uint32_t out[8];
+	_mm256_storeu_si256((__m256i *) out, v);
+	for (int j = 0; j < 8; j++) {
+	    vport_i[i + j] = out[j];
+	    __builtin_prefetch(&t->_vport[out[j]]);
+	}
+    }
+    for (; i < n; i++) {
+	vport_i[i] = t->_tbl_0_23[ip_addr[i] >> 8];
+	if (vport_i[i] & 0x8000)
+	    vport_i[i] = t->_tbl_24_31[((vport_i[i] & 0x7fff) << 8) | (ip_addr[i] & 0xff)];
+    }
 }
+#endif
 
 int
 DirectIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
-    return _t.add_route(route, allow_replace, old_route, errh);
+    return _t->add_route(route, allow_replace, old_route, errh);
 }
 
 int
 DirectIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler *errh)
 {
-    return _t.remove_route(route, old_route, errh);
+    return _t->remove_route(route, old_route, errh);
+}
+
+int
+DirectIPLookup::load_routes(const Vector<IPRoute> &routes, ErrorHandler *errh)
+{
+    int r;
+    Table *t = new Table;
+    if ((r = t->initialize()) < 0) {
+	delete t;
+	return r;
+    }
+    t->flush();
+    for (int i = 0; i < routes.size(); i++)
+	if ((r = t->add_route(routes[i], true, 0, errh)) < 0) {
+	    delete t;
+	    return r;
+	}
+    publish(t);
+    return 0;
 }
 
 int
 DirectIPLookup::flush_handler(const String &, Element *e, void *,
-				ErrorHandler *)
+				ErrorHandler *errh)
 {
     DirectIPLookup *t = static_cast<DirectIPLookup *>(e);
-    t->_t.flush();
-    return 0;
+    return t->load_routes(Vector<IPRoute>(), errh);
 }
 
 String
 DirectIPLookup::dump_routes()
 {
-    return _t.dump();
+    return _t->dump();
 }
 
 void
@@ -574,6 +752,7 @@ DirectIPLookup::add_handlers()
 {
     IPRouteTable::add_handlers();
     add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_write_handler("load", load_handler, 0);
 }
 
 CLICK_ENDDECLS
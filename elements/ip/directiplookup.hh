@@ -1,7 +1,11 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_DIRECTIPLOOKUP_HH
 #define CLICK_DIRECTIPLOOKUP_HH
+#include <click/multithread.hh>
 #include "iproutetable.hh"
+#if HAVE_AVX2
+# include <immintrin.h>
+#endif
 CLICK_DECLS
 
 /*
@@ -33,6 +37,20 @@ relatively low CPU overhead, allowing for high update rates.
 DirectIPLookup implements the I<DIR-24-8-BASIC> lookup scheme described by
 Gupta, Lin, and McKeown in the paper cited below.
 
+Batches are looked up by bursts of 32 packets. The first-level entries of all
+the addresses of a burst are prefetched before any of them is read, then the
+second-level entries, so that the memory accesses of the packets overlap.
+When Click is built with AVX2 support, both levels are read with vector
+gathers, 8 addresses at a time.
+
+Routes can be added and removed while other threads look addresses up,
+without locking them. Table entries are updated in place, in an order that
+keeps every intermediate state valid for readers. Second-level blocks and
+gateway entries that become unused, and tables that must grow, are only
+recycled or freed once no thread can still be reading them. The C<load> and
+C<flush> handlers build a whole new table aside, then switch the data path to
+it in one step. This needs memory for two tables while the new one is built.
+
 =h table read-only
 
 Outputs a human-readable version of the current routing table.
@@ -65,6 +83,14 @@ operation.
 
 Clears the entire routing table in a single atomic operation.
 
+=h load write-only
+
+Replaces the entire routing table in a single atomic operation. Write the
+routes in the `C<ADDR/MASK [GW] OUT>' format, separated by commas or
+newlines, as in the configuration string. If any route is
+invalid, the table is left unchanged. Packets are looked up in the old table
+until the new one is complete.
+
 =n
 
 See IPRouteTable for a performance comparison of the various IP routing
@@ -102,6 +128,8 @@ class DirectIPLookup : public IPRouteTable { public:
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_routes(const IPAddress *, int, int *, IPAddress *) const;
+    int load_routes(const Vector<IPRoute> &, ErrorHandler *);
     String dump_routes();
 
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
@@ -155,9 +183,17 @@ class DirectIPLookup : public IPRouteTable { public:
 	uint32_t _tbl_24_31_capacity;
 	uint32_t _vport_capacity;
 
+	// Second-level blocks and vports that readers may still reach
+	Vector<int> _pending_blocks;
+	Vector<int> _pending_vports;
+
+	// Readers of the lookup structures, if any
+	rcu_reclaimer *_rcu;
+
 	Table()
 	    : _tbl_0_23(0), _tbl_24_31(0), _vport(0), _rtable(0),
-	      _rt_hashtbl(0), _tbl_0_23_plen(0), _tbl_24_31_plen(0) {
+	      _rt_hashtbl(0), _tbl_0_23_plen(0), _tbl_24_31_plen(0),
+	      _rcu(0) {
 	}
 
 	~Table() {
@@ -174,6 +210,8 @@ class DirectIPLookup : public IPRouteTable { public:
 
 	int vport_find(IPAddress gw, int16_t port);
 	void vport_unref(uint16_t);
+	void synchronize();
+	void reclaim();
 
 	int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
 	int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
@@ -183,7 +221,15 @@ class DirectIPLookup : public IPRouteTable { public:
 
   protected:
 
-    Table _t;
+    Table * volatile _t;
+    mutable rcu_reclaimer _rcu;
+
+    void publish(Table *t);
+    static void free_table(void *obj, void *arg);
+
+#if HAVE_AVX2
+    static void lookup_vports_avx2(const Table *t, const uint32_t *ip_addr, int n, uint16_t *vport_i);
+#endif
 
     friend class RangeIPLookup;
 
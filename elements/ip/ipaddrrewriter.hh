@@ -93,6 +93,13 @@ Set the maximum number of mappings this rewriter can hold to I<capacity>.
 I<Capacity> can either be an integer or the name of another rewriter-like
 element, in which case this element will share the other element's capacity.
 
+=item TIMER_WHEEL
+
+Boolean.  If true, keep mappings in hierarchical timing wheels rather than
+heaps to expire them. Refreshing a mapping is then O(1), and expired mappings
+are swept lazily, which helps with millions of mappings. Ignored if
+MAPPING_CAPACITY names another element. Default is false.
+
 =back
 
 =h table read-only
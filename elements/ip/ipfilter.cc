@@ -1323,8 +1323,10 @@ int
 IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     // Consume key-value argument before parsing the rules
+    bool jit = true;
     if (Args(this, errh).bind(conf)
         .read("CACHING", _caching)
+        .read("JIT", jit)
         .consume() < 0)
         return -1;
 
@@ -1336,7 +1338,17 @@ IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
     parse_program(zprog, conf, noutputs(), this, errh);
 
     if (!errh->nerrors()) {
+#if CLICK_CLASSIFICATION_JIT
+        // the old code assumes the old program's safe length
+        _jit.clear();
+#endif
         _zprog = zprog;
+#if CLICK_CLASSIFICATION_JIT
+        if (jit && !_caching)
+            _jit.compile(_zprog, offset_net, offset_transp);
+#else
+        (void) jit;
+#endif
         return 0;
     }
 
@@ -1352,6 +1364,13 @@ IPFilter::read_handler(Element *e, void *thunk)
         case H_PROGRAM: {
             return ipf->_zprog.unparse();
         }
+        case H_JIT: {
+#if CLICK_CLASSIFICATION_JIT
+            return String(ipf->_jit.compiled());
+#else
+            return String(false);
+#endif
+        }
         case H_CACHE_HITS: {
             if (!ipf->_caching){
                 return "-1";
@@ -1400,6 +1419,7 @@ void
 IPFilter::add_handlers()
 {
     add_read_handler("program", read_handler, H_PROGRAM);
+    add_read_handler("jit", read_handler, H_JIT);
     add_read_handler("cache_hits_count", read_handler, H_CACHE_HITS);
     add_read_handler("cache_misses_count", read_handler, H_CACHE_MISSES);
     add_read_handler("cache_total_count", read_handler, H_CACHE_TOTAL);
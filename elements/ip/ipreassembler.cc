@@ -23,12 +23,10 @@
 #include "ipreassembler.hh"
 #include <click/ipaddress.hh>
 #include <click/args.hh>
-#include <click/bitvector.hh>
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/packet_anno.hh>
 #include <click/straccum.hh>
-#include <click/ipflowid.hh>
 CLICK_DECLS
 
 #define PACKET_CHUNK(p)		(*((ChunkLink *)((p)->anno_u8() + IPREASSEMBLER_ANNO_OFFSET)))
@@ -36,10 +34,7 @@ CLICK_DECLS
 #define IP_BYTE_OFF(iph)	((ntohs((iph)->ip_off) & IP_OFFMASK) << 3)
 
 IPReassembler::IPReassembler()
-    : _stat_frags_seen(0), _stat_good_assem(0), _stat_failed_assem(0), _stat_bad_pkts(0)
 {
-    for (int i = 0; i < NMAP; i++)
-	_map[i] = 0;
     static_assert(IPREASSEMBLER_ANNO_OFFSET + IPREASSEMBLER_ANNO_SIZE <= Packet::anno_size, "anno too big");
     static_assert(sizeof(ChunkLink) == IPREASSEMBLER_ANNO_SIZE, "sizeof(ChunkLink) is expected to equal IPREASSEMBLER_ANNO_SIZE.");
 }
@@ -51,35 +46,59 @@ IPReassembler::~IPReassembler()
 int
 IPReassembler::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    _mem_high_thresh = 256 * 1024;
+    _mem_high_thresh = 1024 * 1024;
+    _timeout = REAP_TIMEOUT * 1000;
     int mtu_anno = -1;
+    uint32_t source_quota = 0;
     if (Args(conf, this, errh)
 	.read("HIMEM", _mem_high_thresh)
+	.read("SOURCE_QUOTA", source_quota)
+	.read("TIMEOUT", SecondsArg(3), _timeout)
 	.read("MAX_MTU_ANNO", AnnoArg(2), mtu_anno)
 	.complete() < 0)
 	return -1;
+    if (_timeout == 0)
+	return errh->error("TIMEOUT must be positive");
+    if (_timeout >= (1U << 30))
+	return errh->error("TIMEOUT too large");
     _mtu_anno = mtu_anno;
     _mem_low_thresh = (_mem_high_thresh >> 2) * 3;
+    _source_quota = source_quota ? source_quota : _mem_high_thresh >> 2;
     return 0;
 }
 
 int
 IPReassembler::initialize(ErrorHandler *)
 {
-    _mem_used = 0;
-    _reap_time = 0;
+    _seed = click_random();
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	s.map = new Datagram *[NMAP];
+	for (int b = 0; b < NMAP; b++)
+	    s.map[b] = 0;
+    }
     return 0;
 }
 
 void
 IPReassembler::cleanup(CleanupStage)
 {
-    for (int i = 0; i < NMAP; i++)
-	while (_map[i]) {
-	    WritablePacket *next = (WritablePacket *)(_map[i]->next());
-	    _map[i]->kill();
-	    _map[i] = next;
-	}
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	if (!s.map)
+	    continue;
+	for (int b = 0; b < NMAP; b++)
+	    while (Datagram *d = s.map[b]) {
+		s.map[b] = d->hnext;
+		while (Packet *f = d->frags) {
+		    d->frags = f->next();
+		    f->kill();
+		}
+		s.alloc.deallocate(d);
+	    }
+	delete[] s.map;
+	s.map = 0;
+    }
 }
 
 void
@@ -103,42 +122,48 @@ IPReassembler::check(ErrorHandler *errh)
 {
     if (!errh)
 	errh = ErrorHandler::default_handler();
-    uint32_t mem_used = 0;
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = _map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (q->has_network_header()) {
-		const click_ip *qip = q->ip_header();
-		if (bucketno(qip) != b)
-		    check_error(errh, b, q, "in wrong bucket");
-		mem_used += IPH_MEM_USED + q->transport_length();
-		ChunkLink *chunk = &PACKET_CHUNK(q);
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	State &s = _state.get_value(i);
+	if (!s.map)
+	    continue;
+	uint32_t mem_used = 0;
+	HashTable<uint32_t, uint32_t> source_mem;
+	for (int b = 0; b < NMAP; b++)
+	    for (Datagram *d = s.map[b]; d; d = d->hnext) {
+		uint32_t mem = sizeof(Datagram), received = 0;
 		int off = 0;
-#if VERBOSE_DEBUG
-		check_error(errh, b, q, "");
-		StringAccum sa;
-		while (chunk && (!off || off < q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
-		}
-		errh->message("  %s", sa.c_str());
-		chunk = &PACKET_CHUNK(q);
-		off = 0;
-#endif
-		while (chunk) {
-		    if (chunk->off >= chunk->lastoff
-			|| chunk->lastoff > q->transport_length()
-			|| (off != 0 && chunk->off < off + 8)) {
-			check_error(errh, b, q, "bad chunk (%d, %d) at %d", chunk->off, chunk->lastoff, off);
-			break;
+		for (Packet *q = d->frags; q; q = q->next()) {
+		    if (!q->has_network_header()) {
+			errh->error("buck %d: missing IP header", b);
+			continue;
 		    }
-		    off = chunk->lastoff;
-		    chunk = next_chunk(q, chunk);
+		    const click_ip *qip = q->ip_header();
+		    if (bucketno(qip) != b || !same_segment(qip, d))
+			check_error(errh, b, q, "in wrong bucket");
+		    ChunkLink &chunk = PACKET_CHUNK(q);
+		    if (chunk.off >= chunk.lastoff || chunk.off < off
+			|| chunk.lastoff - chunk.off > PACKET_DLEN(q)
+			|| (d->total && chunk.lastoff > d->total))
+			check_error(errh, b, q, "bad chunk (%d, %d) at %d", chunk.off, chunk.lastoff, off);
+		    off = chunk.lastoff;
+		    received += chunk.lastoff - chunk.off;
+		    mem += q->buffer_length();
 		}
-	    } else
-		errh->error("buck %d: missing IP header", b);
-    if (mem_used != _mem_used)
-	errh->error("bad mem_used: have %u, claim %u", mem_used, _mem_used);
+		if (received != d->received || mem != d->mem)
+		    errh->error("buck %d: bad datagram accounting", b);
+		if (!d->link.scheduled())
+		    errh->error("buck %d: datagram not scheduled", b);
+		mem_used += d->mem;
+		source_mem[d->src] += d->mem;
+	    }
+	if (mem_used != s.mem_used)
+	    errh->error("thread %d: bad mem_used: have %u, claim %u", i, mem_used, s.mem_used);
+	if (source_mem.size() != s.source_mem.size())
+	    errh->error("thread %d: bad source accounting", i);
+	for (auto it = source_mem.begin(); it != source_mem.end(); ++it)
+	    if (s.source_mem.get(it.key()) != it.value())
+		errh->error("thread %d: bad memory for %s", i, IPAddress(it.key()).unparse().c_str());
+    }
     return 0;
 }
 
@@ -147,142 +172,310 @@ IPReassembler::debug_dump(Element *e, void *)
 {
     IPReassembler *r = (IPReassembler *) e;
     r->check();
+    uint32_t frags_seen = 0, good_assem = 0, failed_assem = 0, bad_pkts = 0, quota_drops = 0;
+    for (unsigned i = 0; i < r->_state.weight(); i++) {
+	State &s = r->_state.get_value(i);
+	frags_seen += s.stat_frags_seen;
+	good_assem += s.stat_good_assem;
+	failed_assem += s.stat_failed_assem;
+	bad_pkts += s.stat_bad_pkts;
+	quota_drops += s.stat_quota_drops;
+    }
     StringAccum sa;
     sa <<
-	"frags seen total:    " << r->_stat_frags_seen << "\n"
-	"good reassemblies:   " << r->_stat_good_assem << "\n"
-	"failed reassemblies: " << r->_stat_failed_assem << "\n"
-	"bad fragments seen:  " << r->_stat_bad_pkts << "\n"
+	"frags seen total:    " << frags_seen << "\n"
+	"good reassemblies:   " << good_assem << "\n"
+	"failed reassemblies: " << failed_assem << "\n"
+	"bad fragments seen:  " << bad_pkts << "\n"
+	"over source quota:   " << quota_drops << "\n"
 	"cached chunk data:\n";
-    for (int b = 0; b < NMAP; b++)
-	for (WritablePacket *q = r->_map[b]; q; q = (WritablePacket *)(q->next()))
-	    if (const click_ip *qip = q->ip_header()) {
-		sa << ' ' << IPFlowID(qip) << ' ' << ntohs(qip->ip_id);
-		ChunkLink *chunk = &PACKET_CHUNK(q);
-		while (chunk &&
-		       (chunk->lastoff > chunk->off) &&
-		       (chunk->lastoff <= q->transport_length())) {
-		    sa << " (" << chunk->off << ',' << chunk->lastoff << ')';
-		    chunk = next_chunk(q, chunk);
-		}
+    for (unsigned i = 0; i < r->_state.weight(); i++) {
+	State &s = r->_state.get_value(i);
+	for (int b = 0; s.map && b < NMAP; b++)
+	    for (Datagram *d = s.map[b]; d; d = d->hnext) {
+		sa << ' ' << IPAddress(d->src) << " > " << IPAddress(d->dst)
+		   << ' ' << (int) d->proto << ' ' << ntohs(d->id);
+		for (Packet *q = d->frags; q; q = q->next())
+		    sa << " (" << PACKET_CHUNK(q).off << ',' << PACKET_CHUNK(q).lastoff << ')';
 		sa << '\n';
 	    }
+    }
     return sa.take_string();
 }
 
-WritablePacket *
-IPReassembler::find_queue(Packet *p, WritablePacket ***store_pprev)
+String
+IPReassembler::read_handler(Element *e, void *thunk)
 {
-    const click_ip *iph = p->ip_header();
-    int bucket = bucketno(iph);
-    WritablePacket **pprev = &_map[bucket];
-    WritablePacket *q;
-    for (q = *pprev; q; pprev = (WritablePacket **)&q->next(), q = *pprev) {
-	const click_ip *qiph = q->ip_header();
-	if (same_segment(iph, qiph)) {
-	    *store_pprev = pprev;
-	    return q;
+    IPReassembler *r = static_cast<IPReassembler *>(e);
+    uint32_t x = 0;
+    for (unsigned i = 0; i < r->_state.weight(); i++) {
+	State &s = r->_state.get_value(i);
+	switch ((intptr_t) thunk) {
+	case 0:
+	    x += s.stat_good_assem;
+	    break;
+	case 1:
+	    x += s.stat_failed_assem;
+	    break;
+	case 2:
+	    x += s.stat_quota_drops;
+	    break;
+	default:
+	    x += s.mem_used;
+	    break;
 	}
     }
-    *store_pprev = &_map[bucket];
-    return 0;
+    return String(x);
+}
+
+IPReassembler::Datagram *
+IPReassembler::make_datagram(State &s, const click_ip *iph, uint32_t now)
+{
+    Datagram *d = (Datagram *) s.alloc.allocate();
+    if (!d)
+	return 0;
+    d->frags = 0;
+    d->src = iph->ip_src.s_addr;
+    d->dst = iph->ip_dst.s_addr;
+    d->id = iph->ip_id;
+    d->proto = iph->ip_p;
+    d->max_len = 0;
+    d->received = d->lastoff = d->total = 0;
+    d->mem = sizeof(Datagram);
+    d->link.prev = 0;
+    s.wheel.schedule(d, now + _timeout);
+
+    int bucket = bucketno(iph);
+    d->hnext = s.map[bucket];
+    s.map[bucket] = d;
+    s.mem_used += d->mem;
+    s.source_mem[d->src] += d->mem;
+    return d;
+}
+
+// Remove d from the table and free it. Its fragments must have been taken.
+void
+IPReassembler::release(State &s, Datagram *d)
+{
+    Datagram **pprev = &s.map[bucketno(d->src, d->dst, d->id, d->proto)];
+    while (*pprev != d)
+	pprev = &(*pprev)->hnext;
+    *pprev = d->hnext;
+    s.wheel.unschedule(d);
+
+    s.mem_used -= d->mem;
+    auto it = s.source_mem.find(d->src);
+    if (it.value() == d->mem)
+	s.source_mem.erase(it);
+    else
+	it.value() -= d->mem;
+    s.alloc.deallocate(d);
+}
+
+void
+IPReassembler::kill_datagram(State &s, Datagram *d)
+{
+    while (Packet *f = d->frags) {
+	d->frags = f->next();
+	f->kill();
+    }
+    ++s.stat_failed_assem;
+    release(s, d);
+}
+
+WritablePacket *
+IPReassembler::extend_first(Packet *first, uint32_t len)
+{
+    if (!first->shared() && first->tailroom() >= len)
+	return first->put(len);
+
+    // copy the headroom too, it may hold the MAC header
+    uint32_t headroom = first->headroom();
+    WritablePacket *q = Packet::make(0, first->buffer(), headroom + first->length(), len);
+    if (q) {
+	q->pull(headroom);
+	q->copy_annotations(first);
+	if (first->has_mac_header())
+	    q->set_mac_header(q->data() + first->mac_header_offset(), first->mac_header_length());
+	q->set_ip_header((click_ip *) (q->data() + first->network_header_offset()), first->network_header_length());
+	q = q->put(len);
+    }
+    first->kill();
+    return q;
 }
 
 Packet *
-IPReassembler::emit_whole_packet(WritablePacket *q, WritablePacket **q_pprev,
-				 Packet *p_in)
+IPReassembler::emit_whole_packet(State &s, Datagram *d, Packet *p_in)
 {
-    ++_stat_good_assem;
-    *q_pprev = (WritablePacket *)q->next();
+    Packet *first = d->frags;
+    Timestamp timestamp = p_in->timestamp_anno();
+    uint16_t max_len = d->max_len;
+    uint32_t total = d->total;
+    d->frags = 0;
+    release(s, d);
+
+    Packet *rest = first->next();
+    WritablePacket *q = extend_first(first, total - PACKET_CHUNK(first).lastoff);
+    for (Packet *f = rest; f; f = rest) {
+	rest = f->next();
+	if (q)
+	    memcpy(q->transport_header() + PACKET_CHUNK(f).off, f->transport_header(), PACKET_CHUNK(f).lastoff - PACKET_CHUNK(f).off);
+	f->kill();
+    }
+    if (!q) {
+	click_chatter("out of memory");
+	++s.stat_failed_assem;
+	return 0;
+    }
+    ++s.stat_good_assem;
 
     click_ip *q_iph = q->ip_header();
     q_iph->ip_len = htons(q->network_length());
+    q_iph->ip_off &= ~htons(IP_MF | IP_OFFMASK); // leave DF, RF
     q_iph->ip_sum = 0;
     q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
 
     // zero out the annotations we used
     memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
-    q->set_timestamp_anno(p_in->timestamp_anno());
+    q->set_timestamp_anno(timestamp);
+    if (_mtu_anno >= 0)
+	q->set_anno_u16(_mtu_anno, max_len);
     q->set_next(0);
-
-    p_in->kill();
-    _mem_used -= IPH_MEM_USED + q->transport_length();
     return q;
 }
 
-void
-IPReassembler::make_queue(Packet *p, WritablePacket **q_pprev)
+// Build the packet pushed on output 1 for an incomplete datagram: the
+// fragments received at their offsets, behind the IP header of the first
+// fragment if it was received, or else of the earliest one.
+Packet *
+IPReassembler::make_partial_packet(Datagram *d)
 {
-    int p_off = IP_BYTE_OFF(p->ip_header());
-    int p_lastoff = p_off + PACKET_DLEN(p);
+    Packet *first = d->frags;
+    Packet *rest = first->next();
+    uint32_t lastoff = PACKET_CHUNK(first).lastoff;
     WritablePacket *q;
-
-    if (p_off == 0) {
-	q = p->uniqueify();
-	if (!q) {
-	    click_chatter("out of memory");
-	    return;
-	}
-    } else {
-	q = Packet::make(p->headroom() + p->ip_header_offset(), 0, 20 + p_lastoff, 0);
-	if (!q) {
-	    p->kill();
-	    click_chatter("out of memory");
-	    return;
+    if (PACKET_CHUNK(first).off == 0)
+	q = extend_first(first, d->lastoff - lastoff);
+    else {
+	q = Packet::make(first->headroom() + first->network_header_offset(), 0, sizeof(click_ip) + d->lastoff, 0);
+	if (q) {
+	    q->copy_annotations(first);
+	    q->set_ip_header((click_ip *) q->data(), sizeof(click_ip));
+	    memcpy(q->ip_header(), first->ip_header(), sizeof(click_ip));
+	    q->ip_header()->ip_hl = sizeof(click_ip) >> 2;
+	    memset(q->transport_header(), 0, d->lastoff);
 	}
-	q->set_ip_header((click_ip *)q->data(), 20);
-	memcpy(q->ip_header(), p->ip_header(), 20);
-	// copy data
-	memcpy(q->transport_header() + p_off, p->transport_header(), PACKET_DLEN(p));
-	p->kill();
+	rest = first;
+	lastoff = 0;
     }
-
-    _mem_used += IPH_MEM_USED + p_lastoff;
+    if (q)
+	memset(q->transport_header() + lastoff, 0, d->lastoff - lastoff);
+    for (Packet *f = rest; f; f = rest) {
+	rest = f->next();
+	if (q)
+	    memcpy(q->transport_header() + PACKET_CHUNK(f).off, f->transport_header(), PACKET_CHUNK(f).lastoff - PACKET_CHUNK(f).off);
+	f->kill();
+    }
+    d->frags = 0;
+    if (!q)
+	return 0;
 
     click_ip *q_iph = q->ip_header();
-    q_iph->ip_off = (q_iph->ip_off & ~htons(IP_OFFMASK)); // leave MF, DF, RF
-
+    q_iph->ip_len = htons(q->network_length());
+    q_iph->ip_off &= ~htons(IP_OFFMASK);
+    if (d->total)
+	q_iph->ip_off &= ~htons(IP_MF);
+    q_iph->ip_sum = 0;
+    q_iph->ip_sum = click_in_cksum((const unsigned char *)q_iph, q_iph->ip_hl << 2);
+    memset(&PACKET_CHUNK(q), 0, sizeof(ChunkLink));
     if (_mtu_anno >= 0)
-	q->set_anno_u16(_mtu_anno, q->network_length());
-
-    PACKET_CHUNK(q).off = p_off;
-    PACKET_CHUNK(q).lastoff = p_lastoff;
+	q->set_anno_u16(_mtu_anno, d->max_len);
+    return q;
+}
 
-    // link it up
-    q->set_next(*q_pprev);
-    *q_pprev = q;
+// Throw away an incomplete datagram, adding it to the failed list if there is
+// an output 1.
+void
+IPReassembler::expire(State &s, Datagram *d, Packet *&failed)
+{
+    if (noutputs() < 2) {
+	kill_datagram(s, d);
+	return;
+    }
+    if (Packet *q = make_partial_packet(d)) {
+	q->set_next(failed);
+	failed = q;
+    }
+    ++s.stat_failed_assem;
+    release(s, d);
+}
 
-    check();
+void
+IPReassembler::reap_overfull(State &s, Packet *&failed)
+{
+    // Throw away the oldest datagrams first. They never move in the wheel,
+    // as their expiry is set by their first fragment.
+    while (s.mem_used > _mem_low_thresh) {
+	Datagram *d = s.wheel.first([](Datagram *d) {
+		return d->link.expires;
+	    });
+	if (!d) {
+	    click_chatter("%p{element}: cannot free enough memory!", this);
+	    return;
+	}
+	expire(s, d, failed);
+    }
 }
 
-IPReassembler::ChunkLink *
-IPReassembler::next_chunk(WritablePacket *q, ChunkLink *chunk)
+void
+IPReassembler::push_failed(Packet *failed)
 {
-    if (chunk->lastoff >= q->transport_length())
-	return 0;
-    else
-	return (ChunkLink *)(q->transport_header() + chunk->lastoff);
+    // The list is in reverse order of expiry
+    Packet *head = 0;
+    while (Packet *q = failed) {
+	failed = q->next();
+	q->set_next(head);
+	head = q;
+    }
+#if HAVE_BATCH
+    if (receives_batch) {
+	checked_output_push_batch(1, PacketBatch::make_from_simple_list(head));
+	return;
+    }
+#endif
+    while (Packet *q = head) {
+	head = q->next();
+	q->set_next(0);
+	checked_output_push(1, q);
+    }
 }
 
 Packet *
-IPReassembler::simple_action(Packet *p)
+IPReassembler::add_fragment(State &s, Packet *p, Packet *&failed)
 {
-    // check common case: not a fragment
-    assert(p->has_network_header());
     const click_ip *iph = p->ip_header();
-    if (!IP_ISFRAG(iph))
-	return p;
+    ++s.stat_frags_seen;
 
-    ++_stat_frags_seen;
-
-    // reap if necessary
-    int now = p->timestamp_anno().sec();
-    if (!now) {
+    // expire old datagrams. Time is the packets' timestamp in milliseconds,
+    // modulo 2^32. A jump of more than TIMEOUT, either way, expires every
+    // datagram and restarts the wheel, instead of walking the gap or
+    // comparing times too far apart.
+    if (!p->timestamp_anno().sec())
 	p->timestamp_anno().assign_now();
-	now = p->timestamp_anno().sec();
-    }
-    if (now >= _reap_time)
-	reap(now);
+    uint32_t now = p->timestamp_anno().msecval();
+    int32_t delta = now - s.wheel.now();
+    if (!s.wheel.initialized())
+	s.wheel.initialize(now);
+    else if (delta > (int32_t) _timeout || delta < -(int32_t) _timeout) {
+	while (Datagram *d = s.wheel.first([](Datagram *d) {
+		    return d->link.expires;
+		}))
+	    expire(s, d, failed);
+	s.wheel.initialize(now);
+    } else
+	s.wheel.run(now, [this, &s, &failed](Datagram *d) {
+		expire(s, d, failed);
+	    });
 
     // calculate packet edges
     int p_off = IP_BYTE_OFF(iph);
@@ -294,7 +487,7 @@ IPReassembler::simple_action(Packet *p)
 	|| ((p_lastoff & 7) != 0 && (iph->ip_off & htons(IP_MF)) != 0)
 	|| PACKET_DLEN(p) < p_lastoff - p_off) {
 	p->kill();
-	++_stat_bad_pkts;
+	++s.stat_bad_pkts;
 	return 0;
     }
     p->take(PACKET_DLEN(p) - (p_lastoff - p_off));
@@ -302,171 +495,125 @@ IPReassembler::simple_action(Packet *p)
     // otherwise, we need to keep the packet
 
     // clean up memory if necessary
-    if (_mem_used > _mem_high_thresh)
-	reap_overfull(now);
-
-    // get its Packet queue
-    WritablePacket **q_pprev;
-    WritablePacket *q = find_queue(p, &q_pprev);
-    if (!q) {			// make a new queue
-	make_queue(p, q_pprev);
+    uint32_t mem = p->buffer_length();
+    if (s.mem_used + mem + sizeof(Datagram) > _mem_high_thresh)
+	reap_overfull(s, failed);
+
+    // get its datagram, within the source's quota
+    Datagram *d = s.map[bucketno(iph)];
+    while (d && !same_segment(iph, d))
+	d = d->hnext;
+    auto it = s.source_mem.find(iph->ip_src.s_addr);
+    if ((it ? it.value() : 0) + mem + (d ? 0 : sizeof(Datagram)) > _source_quota) {
+	p->kill();
+	++s.stat_quota_drops;
+	return 0;
+    }
+    if (!d && !(d = make_datagram(s, iph, now))) {
+	click_chatter("out of memory");
+	p->kill();
 	return 0;
     }
-    WritablePacket *q_bucket_next = (WritablePacket *)(q->next());
-
-    if (_mtu_anno >= 0 && q->anno_u16(_mtu_anno) < p->network_length())
-	q->set_anno_u16(_mtu_anno, p->network_length());
 
-    // extend the packet if necessary
-    if (p_lastoff + 8 > q->transport_length()) {
-	// error if packet already completed
-	if (!(q->ip_header()->ip_off & htons(IP_MF))) {
-	    p->kill();
-	    return 0;
-	}
-	// Figure out how much space to request. Add 8 extra bytes to ensure
-	// room for a ChunkLink, and request extra space if this packet has MF
-	// set. XXX This algorithm could result in a number of intermediate
-	// packet copies linear in the final packet length.
-	int old_transport_length = q->transport_length();
-	assert((old_transport_length & 7) == 0);
-	int want_space = p_lastoff - old_transport_length + 8;
-	if (iph->ip_off & htons(IP_MF))
-	    want_space += (p_lastoff - p_off);
-	// request space
-	if (!(q = q->put(want_space))) {
-	    click_chatter("out of memory");
-	    *q_pprev = q_bucket_next;
-	    _mem_used -= IPH_MEM_USED + old_transport_length;
+    // find the fragments before and after p
+    Packet **pprev = &d->frags;
+    while (*pprev && PACKET_CHUNK(*pprev).lastoff <= p_off)
+	pprev = &(*pprev)->next();
+    Packet *after = *pprev;
+
+    // drop duplicates; overlaps and inconsistent lengths are attacks or
+    // errors, and throw away the whole datagram
+    bool is_last = !(iph->ip_off & htons(IP_MF));
+    if (after && PACKET_CHUNK(after).off < p_lastoff) {
+	if (PACKET_CHUNK(after).off == p_off && PACKET_CHUNK(after).lastoff == p_lastoff) {
 	    p->kill();
 	    return 0;
 	}
-	// get rid of extra space
-	q->take(q->transport_length() - p_lastoff);
-	// hook up packet, and add final chunk
-	*q_pprev = q;
-	ChunkLink *last_chunk = (ChunkLink *)(q->transport_header() + old_transport_length);
-	last_chunk->off = last_chunk->lastoff = p_lastoff;
-	_mem_used += p_lastoff - old_transport_length;
+	goto bad;
     }
+    if (is_last ? (d->total || d->lastoff > (uint32_t) p_lastoff)
+	: (d->total && (uint32_t) p_lastoff > d->total))
+	goto bad;
 
-    // find chunks before and after p
-    ChunkLink *chunk = &PACKET_CHUNK(q);
-    while (chunk->lastoff < p_off)
-	chunk = next_chunk(q, chunk);
-    ChunkLink *last = chunk;
-    while (last && last->lastoff < p_lastoff)
-	last = next_chunk(q, last);
-
-    // patch chunks
-    assert(chunk && last);
-    if (p_lastoff < last->off) {
-	ChunkLink *new_chunk = (ChunkLink *)(q->transport_header() + p_lastoff);
-	*new_chunk = *last;
-	chunk->lastoff = p_lastoff;
-    } else
-	chunk->lastoff = last->lastoff;
-    if (p_off < chunk->off)
-	chunk->off = p_off;
-
-    // copy p's data into q
-    memcpy(q->transport_header() + p_off, p->transport_header(), p_lastoff - p_off);
-
-    // copy p's annotations and IP header if it is the first packet
-    if (p_off == 0) {
-	uint16_t old_ip_off = q->ip_header()->ip_off;
-	int header_delta = p->ip_header_offset() - q->ip_header_offset() + p->ip_header_length() - q->ip_header_length();
-	if (header_delta > 0)
-	    q = q->push(header_delta);
-	else if (header_delta < 0)
-	    q->pull(-header_delta);
-	q->set_ip_header((click_ip *)(q->data() + p->ip_header_offset()), p->ip_header_length());
-        if (p->has_mac_header())
-	    q->set_mac_header((q->data() + p->mac_header_offset()), p->mac_header_length());
-	memcpy(q->data(), p->data(), p->ip_header_offset() + p->ip_header_length());
-	q->ip_header()->ip_off = old_ip_off;
-	ChunkLink old_chunk = PACKET_CHUNK(q);
-	if (_mtu_anno >= 0) {
-	    uint16_t old_mtu = q->anno_u16(_mtu_anno);
-	    q->copy_annotations(p);
-	    q->set_anno_u16(_mtu_anno, old_mtu);
-	} else {
-	    q->copy_annotations(p);
-	}
-	PACKET_CHUNK(q) = old_chunk;
-    }
-
-    // clear MF if incoming packet has it cleared
-    if (!(iph->ip_off & htons(IP_MF)))
-	q->ip_header()->ip_off &= ~htons(IP_MF);
-
-    // Are we done with this packet?
-    if ((q->ip_header()->ip_off & htons(IP_MF)) == 0
-	&& PACKET_CHUNK(q).off == 0
-	&& PACKET_CHUNK(q).lastoff == q->transport_length())
-	return emit_whole_packet(q, q_pprev, p);
+    // link it up
+    PACKET_CHUNK(p).off = p_off;
+    PACKET_CHUNK(p).lastoff = p_lastoff;
+    p->set_next(after);
+    *pprev = p;
+    d->received += p_lastoff - p_off;
+    if ((uint32_t) p_lastoff > d->lastoff)
+	d->lastoff = p_lastoff;
+    if (is_last)
+	d->total = p_lastoff;
+    if (p->network_length() > d->max_len)
+	d->max_len = p->network_length();
+    d->mem += mem;
+    s.mem_used += mem;
+    s.source_mem[d->src] += mem;
+
+    // Are we done with this datagram?
+    if (d->total && d->received == d->total)
+	return emit_whole_packet(s, d, p);
+    return 0;
 
-    // Otherwise, done for now
-    //check();
+  bad:
     p->kill();
+    ++s.stat_bad_pkts;
+    kill_datagram(s, d);
     return 0;
 }
 
-void
-IPReassembler::reap_overfull(int now)
+inline Packet *
+IPReassembler::handle(State &s, Packet *p, Packet *&failed)
 {
-    check();
-
-    // First throw away fragments at least 10 seconds old, then at least 5
-    // seconds old, then any fragments.
-    for (int delta = 10; delta >= 0; delta -= 5)
-	for (int bucket = 0; bucket < NMAP; bucket++) {
-	    WritablePacket **pprev = &_map[bucket];
-	    for (WritablePacket *q = *pprev; q; q = *pprev)
-		if (!delta || q->timestamp_anno().sec() < now - delta) {
-		    *pprev = (WritablePacket *)q->next();
-		    _mem_used -= IPH_MEM_USED + q->transport_length();
-		    q->set_next(0);
-		    checked_output_push(1, q);
-		    ++_stat_failed_assem;
-		    if (_mem_used <= _mem_low_thresh)
-			return;
-		} else
-		    pprev = (WritablePacket **)&q->next();
-	}
-
-    click_chatter("IPReassembler: cannot free enough memory!");
+    // check common case: not a fragment
+    assert(p->has_network_header());
+    if (!IP_ISFRAG(p->ip_header()))
+	return p;
+    return add_fragment(s, p, failed);
 }
 
-void
-IPReassembler::reap(int now)
+Packet *
+IPReassembler::simple_action(Packet *p)
 {
-    // look at all queues. If no activity for 30 seconds, kill that queue
-
-    int kill_time = now - REAP_TIMEOUT;
-
-    for (int i = 0; i < NMAP; i++) {
-	WritablePacket **q_pprev = &_map[i];
-	for (WritablePacket *q = *q_pprev; q; ) {
-	    if (q->timestamp_anno().sec() < kill_time) {
-		*q_pprev = (WritablePacket *)q->next();
-		q->set_next(0);
-		_mem_used -= IPH_MEM_USED + q->transport_length();
-		checked_output_push(1, q);
-	    } else
-		q_pprev = (WritablePacket **)&q->next();
-	    q = *q_pprev;
-	}
-    }
+    Packet *failed = 0;
+    p = handle(*_state, p, failed);
+    if (failed)
+	push_failed(failed);
+    return p;
+}
 
-    _reap_time = now + REAP_INTERVAL;
+#if HAVE_BATCH
+PacketBatch *
+IPReassembler::simple_action_batch(PacketBatch *batch)
+{
+    State &s = *_state;
+    Packet *failed = 0;
+    auto fnt = [this, &s, &failed](Packet *p) -> Packet * {
+	Packet *next = p->next();
+	Packet *q = handle(s, p, failed);
+	// a reassembled packet may be the input fragment, relinked
+	if (q == p)
+	    q->set_next(next);
+	return q;
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet *){});
+    if (failed)
+	push_failed(failed);
+    return batch;
 }
+#endif
 
 void
 IPReassembler::add_handlers()
 {
     add_read_handler("dump", debug_dump);
+    add_read_handler("reassembled", read_handler, 0);
+    add_read_handler("failed", read_handler, 1);
+    add_read_handler("quota_drops", read_handler, 2);
+    add_read_handler("mem_used", read_handler, 3);
 }
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPReassembler)
+ELEMENT_MT_SAFE(IPReassembler)
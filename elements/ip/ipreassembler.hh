@@ -1,10 +1,12 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_IPREASSEMBLER_HH
 #define CLICK_IPREASSEMBLER_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/glue.hh>
 #include <clicknet/ip.h>
-#include <click/timer.hh>
+#include <click/hashtable.hh>
+#include <click/sync.hh>
+#include <click/timerwheel.hh>
 CLICK_DECLS
 
 /*
@@ -21,14 +23,31 @@ Reassembles fragmented IP packets
 Expects IP packets as input to port 0. If input packets are fragments,
 IPReassembler holds them until it has enough fragments to recreate a complete
 packet. When a complete packet is constructed, it is emitted onto output 0. If
-a set of fragments making a single packet is incomplete and dormant for 30
-seconds, the fragments are generally dropped. If IPReassembler has two
+a set of fragments making a single packet is still incomplete TIMEOUT after
+its first fragment arrived, the fragments are generally dropped. If IPReassembler has two
 outputs, however, a single packet containing all the received fragments at
 their proper offsets is pushed onto output 1.
 
-IPReassembler's memory usage is bounded. When memory consumption rises above
-HIMEM bytes, IPReassembler throws away old fragments until memory consumption
-drops below 3/4*HIMEM bytes. Default HIMEM is 256K.
+Fragments are held as they arrive, in a list sorted by offset, and are only
+copied once the packet is complete: the fragment at offset 0 is extended in
+place when its buffer has room, and the others are copied behind it. A
+fragment that duplicates one already held is dropped. A fragment that
+otherwise overlaps held fragments, or contradicts the length given by the
+last fragment, is dropped along with the whole packet, as RFC 5722 does for
+IPv6.
+
+Each thread has its own table of packets being reassembled, its own memory
+budget and its own timing wheel for expiry, so IPReassembler may run on
+several threads without locking. All the fragments of a packet must then
+reach the same thread; with RSS, hash on IP addresses only, as fragments
+other than the first have no ports.
+
+IPReassembler's memory usage is bounded. The buffers of held fragments are
+accounted for. When a fragment would take a thread's memory consumption above
+HIMEM bytes, IPReassembler throws away the oldest incomplete packets until
+memory consumption drops below 3/4*HIMEM bytes. In addition, fragments from a
+source address that already holds SOURCE_QUOTA bytes are dropped, so that a
+single host cannot take over the table.
 
 Output packets have the same MAC header as the fragment that contains
 offset 0.  Other than that, input MAC headers are ignored.
@@ -43,7 +62,21 @@ Keyword arguments are:
 
 =item HIMEM
 
-The upper bound for memory consumption, in bytes. Default is 256K.
+The upper bound for memory consumption of each thread, in bytes. Default is
+1M.
+
+=item SOURCE_QUOTA
+
+The upper bound for memory held by the fragments of one source address, in
+bytes. Default is HIMEM/4.
+
+=item TIMEOUT
+
+Time after its first fragment was received after which an incomplete packet
+is dropped. Time is taken from the fragments' timestamp annotations, or from
+the current time if it is not set. When the timestamps jump by more than
+TIMEOUT, backwards or forwards, all incomplete packets are dropped. Must be
+less than 12 days. Default is 30 seconds.
 
 =item MAX_MTU_ANNO
 
@@ -53,16 +86,41 @@ is unchanged.
 
 =back
 
+=h dump read-only
+
+Statistics and the fragments held by each thread.
+
+=h reassembled read-only
+
+Number of packets reassembled.
+
+=h failed read-only
+
+Number of incomplete packets thrown away, because they timed out, memory ran
+short, or their fragments overlapped.
+
+=h quota_drops read-only
+
+Number of fragments dropped because of SOURCE_QUOTA.
+
+=h mem_used read-only
+
+Memory held, in bytes.
+
 =n
 
 You may want to attach an C<ICMPError(ADDR, timeexceeded, reassembly)> to the
 second output.
 
+Packets expire when later fragments are processed by the same thread, using
+the timestamp annotation of these fragments. Fragments without a timestamp
+are stamped with the current time.
+
 IPReassembler destroys its input packets' "next packet" annotations.
 
 =a IPFragmenter */
 
-class IPReassembler : public Element { public:
+class IPReassembler : public BatchElement { public:
 
     IPReassembler() CLICK_COLD;
     ~IPReassembler() CLICK_COLD;
@@ -78,6 +136,9 @@ class IPReassembler : public Element { public:
     int check(ErrorHandler * = 0);
 
     Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
     void add_handlers() CLICK_COLD;
 
@@ -89,51 +150,104 @@ class IPReassembler : public Element { public:
   private:
 
     enum { REAP_TIMEOUT = 30, // seconds
-	   REAP_INTERVAL = 10, // seconds
-	   IPH_MEM_USED = 40 };
-
-    enum { NMAP = 256 };
-    WritablePacket *_map[NMAP];
-
-    int _reap_time;
-
-    uint32_t _stat_frags_seen;
-    uint32_t _stat_good_assem;
-    uint32_t _stat_failed_assem;
-    uint32_t _stat_bad_pkts;
-
-    uint32_t _mem_used;
-    uint32_t _mem_high_thresh;	// defaults to 256K
+	   NMAP = 1024 };
+
+    // A packet being reassembled. Its fragments are linked through their
+    // next() annotations, sorted by offset, and their ChunkLink annotations
+    // hold the bytes of the payload they carry.
+    struct Datagram {
+	Datagram *hnext;
+	TimerWheelLink<Datagram> link;
+	Packet *frags;
+	uint32_t src;
+	uint32_t dst;
+	uint16_t id;
+	uint8_t proto;
+	uint16_t max_len;	// largest fragment, for MAX_MTU_ANNO
+	uint32_t received;	// payload bytes held
+	uint32_t lastoff;	// end of the payload held
+	uint32_t total;		// payload length, or 0 if unknown yet
+	uint32_t mem;
+
+	TimerWheelLink<Datagram> &wheel_link() {
+	    return link;
+	}
+    };
+
+    struct State {
+	Datagram **map;
+	HierarchicalTimerWheel<Datagram> wheel;
+	HashTable<uint32_t, uint32_t> source_mem;
+	SizedHashAllocator<sizeof(Datagram)> alloc;
+	uint32_t mem_used;
+
+	uint32_t stat_frags_seen;
+	uint32_t stat_good_assem;
+	uint32_t stat_failed_assem;
+	uint32_t stat_bad_pkts;
+	uint32_t stat_quota_drops;
+
+	State()
+	    : map(0), mem_used(0), stat_frags_seen(0), stat_good_assem(0),
+	      stat_failed_assem(0), stat_bad_pkts(0), stat_quota_drops(0) {
+	}
+    };
+
+    per_thread<State> _state;
+
+    uint32_t _mem_high_thresh;	// defaults to 1M
     uint32_t _mem_low_thresh;	// defaults to 3/4 * _mem_high_thresh
+    uint32_t _source_quota;	// defaults to 1/4 * _mem_high_thresh
+    uint32_t _timeout;		// milliseconds
+    uint32_t _seed;
     int8_t _mtu_anno;
 
-    static inline int bucketno(const click_ip *);
-    static inline bool same_segment(const click_ip *, const click_ip *);
+    inline int bucketno(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto) const;
+    inline int bucketno(const click_ip *) const;
+    static inline bool same_segment(const click_ip *, const Datagram *);
+    static String read_handler(Element *, void *) CLICK_COLD;
     static String debug_dump(Element *e, void *);
 
-    WritablePacket *find_queue(Packet *, WritablePacket ***);
-    void make_queue(Packet *, WritablePacket **);
-    static ChunkLink *next_chunk(WritablePacket *, ChunkLink *);
-    Packet *emit_whole_packet(WritablePacket *, WritablePacket **, Packet *);
-    void reap_overfull(int);
-    void reap(int);
+    inline Packet *handle(State &s, Packet *p, Packet *&failed);
+    Packet *add_fragment(State &s, Packet *p, Packet *&failed);
+    Datagram *make_datagram(State &s, const click_ip *iph, uint32_t now);
+    Packet *emit_whole_packet(State &s, Datagram *d, Packet *p_in);
+    Packet *make_partial_packet(Datagram *d);
+    static WritablePacket *extend_first(Packet *first, uint32_t len);
+    void release(State &s, Datagram *d);
+    void expire(State &s, Datagram *d, Packet *&failed);
+    void kill_datagram(State &s, Datagram *d);
+    void reap_overfull(State &s, Packet *&failed);
+    void push_failed(Packet *failed);
     static void check_error(ErrorHandler *, int, const Packet *, const char *, ...);
 
 };
 
 
+// Seeded, so that sources cannot aim at one bucket
+inline int
+IPReassembler::bucketno(uint32_t src, uint32_t dst, uint16_t id, uint8_t proto) const
+{
+    uint32_t x = (src ^ _seed) * 0x9E3779B1U;
+    x ^= dst;
+    x = (x ^ (x >> 15)) * 0x85EBCA6BU;
+    x ^= id | (proto << 16);
+    x = (x ^ (x >> 13)) * 0xC2B2AE35U;
+    return (x ^ (x >> 16)) & (NMAP - 1);
+}
+
 inline int
-IPReassembler::bucketno(const click_ip *h)
+IPReassembler::bucketno(const click_ip *h) const
 {
-    return (h->ip_id % NMAP);
+    return bucketno(h->ip_src.s_addr, h->ip_dst.s_addr, h->ip_id, h->ip_p);
 }
 
 inline bool
-IPReassembler::same_segment(const click_ip *h, const click_ip *h2)
+IPReassembler::same_segment(const click_ip *h, const Datagram *d)
 {
-    return h->ip_id == h2->ip_id && h->ip_p == h2->ip_p
-	&& h->ip_src.s_addr == h2->ip_src.s_addr
-	&& h->ip_dst.s_addr == h2->ip_dst.s_addr;
+    return h->ip_id == d->id && h->ip_p == d->proto
+	&& h->ip_src.s_addr == d->src
+	&& h->ip_dst.s_addr == d->dst;
 }
 
 CLICK_ENDDECLS
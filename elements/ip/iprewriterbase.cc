@@ -179,6 +179,7 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
     int32_t heapcap;
     bool use_cache = false;
     bool set_aggregate = false;
+    bool timer_wheel = false;
     bool _handle_migration; //TODO Temp placeholder
 
     if (Args(this, errh).bind(conf)
@@ -190,6 +191,7 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("REAP_TIME", Args::deprecated, SecondsArg(), _gc_interval_sec)
 	.read("USE_CACHE", use_cache)
 	.read("SET_AGGREGATE", set_aggregate)
+	.read("TIMER_WHEEL", timer_wheel)
     .read("HANDLE_MIGRATION", _handle_migration)
 	.consume() < 0)
 	return -1;
@@ -205,6 +207,11 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
     _use_cache = use_cache;
     _set_aggregate = set_aggregate;
 
+    // A shared heap keeps its owner's expiry structure
+    if (timer_wheel)
+        for (unsigned i = 0; i < _mem_units_no; i++)
+            _heap[i]->_use_wheel = true;
+
     if (capacity_word) {
         Element *e;
         IPRewriterBase *rwb;
@@ -253,6 +260,13 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 	    _input_specs[i].u.mapper->notify_rewriter(this, &_input_specs[i], &cerrh);
     }
 
+    click_jiffies_t now_j = click_jiffies();
+    for (unsigned i = 0; i < _mem_units_no; i++)
+	if (_heap[i]->_use_wheel && !_heap[i]->_wheels[0].initialized()) {
+	    _heap[i]->_wheels[0].initialize(now_j);
+	    _heap[i]->_wheels[1].initialize(now_j);
+	}
+
     for (int i = 0; i < _state.weight(); i ++) {
 	    IPRewriterState &state = _state.get_value(i);
         Timer& gc_timer = state.gc_timer;
@@ -338,10 +352,7 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 		old->flow()->destroy(heap);
     }
 
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[flow->guaranteed()];
-    myheap.push_back(flow);
-    push_heap(myheap.begin(), myheap.end(),
-	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    heap->insert(flow);
     ++_input_specs[input].count;
 
     if (unlikely(heap->size() > heap->capacity())) {
@@ -374,14 +385,25 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 }
 
 void
-IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
+IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j, int thid)
 {
     // Shift flows with expired guarantees to the best-effort heap.
-    Vector<IPRewriterFlow *> &guaranteed_heap = _heap[click_current_cpu_id()]->_heaps[1];
+    IPRewriterHeap *heap = _heap[thid];
+    if (heap->_use_wheel) {
+	heap->_wheels[1].run(now_j, [heap, now_j](IPRewriterFlow *mf) {
+		if (mf->expired(now_j)) {
+		    click_jiffies_t new_expiry = mf->owner()->owner->best_effort_expiry(mf);
+		    mf->change_expiry(heap, false, new_expiry);
+		} else		// postponed
+		    heap->_wheels[1].schedule(mf, mf->expiry());
+	    });
+	return;
+    }
+    Vector<IPRewriterFlow *> &guaranteed_heap = heap->_heaps[1];
     while (guaranteed_heap.size() && guaranteed_heap[0]->expired(now_j)) {
 	IPRewriterFlow *mf = guaranteed_heap[0];
 	click_jiffies_t new_expiry = mf->owner()->owner->best_effort_expiry(mf);
-	mf->change_expiry(_heap[click_current_cpu_id()], false, new_expiry);
+	mf->change_expiry(heap, false, new_expiry);
     }
 }
 
@@ -398,17 +420,16 @@ bool
 IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
-    shift_heap_best_effort(now_j);
+    shift_heap_best_effort(now_j, click_current_cpu_id());
     // At this point, all flows in the guarantee heap expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
     // In that case we always remove the current flow to honor previous
     // guarantees (= admission control).
-    IPRewriterFlow *deadf;
-    if (_heap[click_current_cpu_id()]->_heaps[0].empty()) {
+    IPRewriterFlow *deadf = _heap[click_current_cpu_id()]->first(0);
+    if (!deadf) {
 	assert(flow->guaranteed());
 	deadf = flow;
-    } else
-	deadf = _heap[click_current_cpu_id()]->_heaps[0][0];
+    }
     deadf->destroy(_heap[click_current_cpu_id()]);
     return deadf == flow;
 }
@@ -417,15 +438,27 @@ void
 IPRewriterBase::shrink_heap(bool clear_all, int thid)
 {
     click_jiffies_t now_j = click_jiffies();
-    shift_heap_best_effort(now_j);
-    Vector<IPRewriterFlow *> &best_effort_heap = _heap[thid]->_heaps[0];
-    while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap[thid]);
-
-    int32_t capacity = clear_all ? 0 : _heap[thid]->_capacity;
-    while (_heap[thid]->size() > capacity) {
-	IPRewriterFlow *deadf = _heap[thid]->_heaps[_heap[thid]->_heaps[0].empty()][0];
-	deadf->destroy(_heap[thid]);
+    shift_heap_best_effort(now_j, thid);
+    IPRewriterHeap *heap = _heap[thid];
+    if (heap->_use_wheel)
+	heap->_wheels[0].run(now_j, [heap, now_j](IPRewriterFlow *mf) {
+		if (mf->expired(now_j))
+		    mf->destroy(heap);
+		else		// postponed
+		    heap->_wheels[0].schedule(mf, mf->expiry());
+	    });
+    else {
+	Vector<IPRewriterFlow *> &best_effort_heap = heap->_heaps[0];
+	while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
+	    best_effort_heap[0]->destroy(heap);
+    }
+
+    int32_t capacity = clear_all ? 0 : heap->_capacity;
+    while (heap->size() > capacity) {
+	IPRewriterFlow *deadf = heap->first(0);
+	if (!deadf)
+	    deadf = heap->first(1);
+	deadf->destroy(heap);
     }
 }
 
@@ -530,14 +563,18 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     assert(click_current_cpu_id() == 0); //MT to be reviewed
 
 	// remove all existing flows created by this input
+	IPRewriterHeap *heap = rw->_heap[click_current_cpu_id()]; //TODO : Same comment about MT
 	for (int which_heap = 0; which_heap < 2; ++which_heap) {
-	    Vector<IPRewriterFlow *> &myheap = rw->_heap[click_current_cpu_id()]->_heaps[which_heap]; //TODO : Same comment about MT
-	    for (int i = myheap.size() - 1; i >= 0; --i)
-		if (myheap[i]->owner() == spec) {
-		    myheap[i]->destroy(rw->_heap[click_current_cpu_id()]);  //TODO : Same comment about MT
-		    if (i < myheap.size())
-			++i;
-		}
+	    Vector<IPRewriterFlow *> flows;
+	    if (heap->_use_wheel)
+		heap->_wheels[which_heap].for_each([&flows](IPRewriterFlow *mf) {
+			flows.push_back(mf);
+		    });
+	    else
+		flows = heap->_heaps[which_heap];
+	    for (int i = 0; i < flows.size(); ++i)
+		if (flows[i]->owner() == spec)
+		    flows[i]->destroy(heap);
 	}
 
 	// change pattern
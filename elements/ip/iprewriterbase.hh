@@ -8,6 +8,7 @@
 #include <click/multithread.hh>
 #include <click/error.hh>
 #include <click/standard/scheduleinfo.hh>
+#include <click/heap.hh>
 
 CLICK_DECLS
 class IPMapper;
@@ -47,7 +48,7 @@ class IPRewriterInput { public:
 class IPRewriterHeap { public:
 
     IPRewriterHeap()
-	: _capacity(0x7FFFFFFF), _use_count(1) {
+	: _capacity(0x7FFFFFFF), _use_count(1), _use_wheel(false) {
     }
     ~IPRewriterHeap() {
 	assert(size() == 0);
@@ -63,11 +64,16 @@ class IPRewriterHeap { public:
     }
 
     Vector<IPRewriterFlow *>::size_type size() const {
-	    return _heaps[0].size() + _heaps[1].size();
+	if (_use_wheel)
+	    return _wheels[0].size() + _wheels[1].size();
+	return _heaps[0].size() + _heaps[1].size();
     }
     int32_t capacity() const {
 	return _capacity;
     }
+    bool timer_wheel() const {
+	return _use_wheel;
+    }
 
   private:
 
@@ -78,18 +84,53 @@ class IPRewriterHeap { public:
     int32_t _capacity;
     uint32_t _use_count;
 
+    // With TIMER_WHEEL, flows are kept in timing wheels (in jiffies)
+    // instead of heaps.
+    bool _use_wheel;
+    HierarchicalTimerWheel<IPRewriterFlow> _wheels[2];
+
+    inline void insert(IPRewriterFlow *flow);
+    inline IPRewriterFlow *first(int which);
+
     friend class IPRewriterBase;
     friend class IPRewriterFlow;
 
 };
 
+inline void
+IPRewriterHeap::insert(IPRewriterFlow *flow)
+{
+    if (_use_wheel)
+	_wheels[flow->guaranteed()].schedule(flow, flow->expiry());
+    else {
+	Vector<IPRewriterFlow *> &myheap = _heaps[flow->guaranteed()];
+	myheap.push_back(flow);
+	push_heap(myheap.begin(), myheap.end(),
+		  IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+    }
+}
+
+/** @brief Return the next-to-expire flow of the best-effort (0) or
+ * guaranteed (1) flows, or null. With a timing wheel, the flow is one of
+ * those expiring first, at the wheel's bucket granularity. */
+inline IPRewriterFlow *
+IPRewriterHeap::first(int which)
+{
+    if (_use_wheel)
+	return _wheels[which].first([](IPRewriterFlow *flow) {
+		return (uint32_t) flow->expiry();
+	    });
+    return _heaps[which].empty() ? 0 : _heaps[which][0];
+}
+
 #define THREAD_MIGRATION_TIMEOUT 10000
 
 /**
  * Base for Rewriter elements
  *
  * Flows are kept in a Map, implemented by y a hashtable. That is for efficient flow lookup.
- * For expiration, flows are kept in a heap.
+ * For expiration, flows are kept in a heap, or in a hierarchical timing wheel
+ * with TIMER_WHEEL.
  */
 class IPRewriterBase : public BatchElement { public:
 
@@ -218,7 +259,7 @@ class IPRewriterBase : public BatchElement { public:
 
   private:
 
-    void shift_heap_best_effort(click_jiffies_t now_j);
+    void shift_heap_best_effort(click_jiffies_t now_j, int thid);
     bool shrink_heap_for_new_flow(IPRewriterFlow *flow, click_jiffies_t now_j);
     void shrink_heap(bool clear_all, int thid);
 
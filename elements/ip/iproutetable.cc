@@ -143,12 +143,34 @@ IPRouteTable::lookup_route(IPAddress, IPAddress&) const
     return -1;			// by default, route lookups fail
 }
 
+void
+IPRouteTable::lookup_routes(const IPAddress *addr, int n, int *port, IPAddress *gw) const
+{
+    for (int i = 0; i < n; i++)
+	port[i] = lookup_route(addr[i], gw[i]);
+}
+
+int
+IPRouteTable::load_routes(const Vector<IPRoute> &, ErrorHandler *errh)
+{
+    // by default, cannot load routes
+    return errh->error("cannot load routes into this routing table");
+}
+
 String
 IPRouteTable::dump_routes()
 {
     return String();
 }
 
+void
+IPRouteTable::no_route(IPAddress dst)
+{
+    static int complained = 0;
+    if (++complained <= 5)
+	click_chatter("IPRouteTable: no route for %s", dst.unparse().c_str());
+}
+
 int
 IPRouteTable::process(int, Packet *p)
 {
@@ -161,13 +183,38 @@ IPRouteTable::process(int, Packet *p)
 		return port;
     }
     else {
-		static int complained = 0;
-		if (++complained <= 5)
-		    click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
+		no_route(p->dst_ip_anno());
 		return -1;
     }
 }
 
+/**
+ * Look up the destinations of @a p and of the packets following it, up to
+ * burst_size packets, with a single lookup_routes() call. Sets @a outputs to
+ * their output ports and returns the number of packets looked up.
+ */
+int
+IPRouteTable::process_burst(Packet *p, int *outputs)
+{
+    Packet *q[burst_size];
+    IPAddress dst[burst_size], gw[burst_size];
+    int n = 0;
+    for (; p && n < burst_size; p = p->next(), n++) {
+	q[n] = p;
+	dst[n] = p->dst_ip_anno();
+    }
+
+    lookup_routes(dst, n, outputs, gw);
+    for (int i = 0; i < n; i++)
+	if (outputs[i] >= 0) {
+	    assert(outputs[i] < noutputs());
+	    if (gw[i])
+		q[i]->set_dst_ip_anno(gw[i]);
+	} else
+	    no_route(dst[i]);
+    return n;
+}
+
 void
 IPRouteTable::push(int port, Packet *p)
 {
@@ -182,10 +229,9 @@ IPRouteTable::push(int port, Packet *p)
 
 #if HAVE_BATCH
 void
-IPRouteTable::push_batch(int port, PacketBatch *batch)
+IPRouteTable::push_batch(int, PacketBatch *batch)
 {
-
-  CLASSIFY_EACH_PACKET(noutputs() + 1,([this,port](Packet* p){return process(port,p);}),batch,checked_output_push_batch);
+    CLASSIFY_EACH_PACKET_BURST(noutputs() + 1, process_burst, burst_size, batch, checked_output_push_batch);
 }
 #endif
 
@@ -292,6 +338,42 @@ IPRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHandl
     return r;
 }
 
+int
+IPRouteTable::load_handler(const String &conf_in, Element *e, void *, ErrorHandler *errh)
+{
+    IPRouteTable *table = static_cast<IPRouteTable *>(e);
+    String conf = cp_uncomment(conf_in);
+    const char *s = conf.begin(), *end = conf.end();
+    Vector<IPRoute> routes;
+    IPRoute route;
+    int r = 0;
+
+    for (int line = 1; s < end; line++) {
+	const char *nl = find(s, end, '\n');
+	Vector<String> words;
+	cp_argvec(conf.substring(s, nl), words);
+	s = nl + 1;
+	for (String *it = words.begin(); it != words.end(); ++it) {
+	    if (!it->length())
+		continue;
+	    if (!cp_ip_route(*it, &route, false, table))
+		r = errh->error("line %d: expected %<ADDR/MASK [GATEWAY] OUTPUT%>", line);
+	    else if (route.port < 0 || route.port >= table->noutputs())
+		r = errh->error("line %d: bad OUTPUT", line);
+	    else
+		routes.push_back(route);
+	}
+    }
+    if (r < 0)
+	return r;
+
+    int before = errh->nerrors();
+    r = table->load_routes(routes, errh);
+    if (r == -ENOMEM && errh->nerrors() == before)
+	errh->error("no memory to store %d routes", routes.size());
+    return r;
+}
+
 String
 IPRouteTable::table_handler(Element *e, void *)
 {
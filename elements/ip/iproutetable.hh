@@ -108,6 +108,24 @@ Looks up the route associated with address C<dst>. Should set C<gw_return> to
 the resulting gateway and return the relevant output port (or negative if
 there is no route). The default implementation returns -1.
 
+=item C<void B<lookup_routes>(const IPAddress *dst, int n, int *port_return, IPAddress *gw_return) const>
+
+Looks up the routes of the C<n> addresses C<dst[0]> to C<dst[n-1]>, setting
+C<port_return[i]> and C<gw_return[i]> like B<lookup_route> does for each of
+them. Elements whose lookups go through several dependent memory accesses
+should override this function to prefetch the entries of all the addresses
+before reading any of them. The default implementation calls B<lookup_route>
+for each address.
+
+=item C<int B<load_routes>(const VectorE<lt>IPRouteE<gt> &routes, ErrorHandler *errh)>
+
+Replaces the whole routing table with C<routes>. Readers should see either
+the old table or the new one, never a mix of them, so elements that support
+it generally build the new table aside and then switch to it. If a route
+cannot be added, the table should be left unchanged. Should return 0 on
+success and negative on failure. The default implementation reports an error
+"cannot load routes into this routing table".
+
 =item C<String B<dump_routes>()>
 
 Returns a textual description of the current routing table. The default
@@ -132,6 +150,13 @@ The default implementation of B<push> uses B<lookup_route> to perform IP
 routing lookup. Normally, subclasses implement their own B<push> methods,
 avoiding virtual function call overhead.
 
+=item C<void B<push_batch>(int port, PacketBatch *batch)>
+
+The default implementation of B<push_batch> collects the destination address
+annotations of up to 32 packets of the batch at a time, and looks them up
+with a single call to B<lookup_routes>. The batch is then split into one
+batch per output port.
+
 =item C<static int B<add_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as an add-route request
@@ -155,6 +180,12 @@ up to the `C<ctrl>' handler.
 This read handler callback function returns the element's routing table via
 the B<dump_routes> function. Normally hooked up to the `C<table>' handler.
 
+=item C<static int B<load_handler>(const String &, Element *, void *, ErrorHandler *)>
+
+This write handler callback function parses its input as a list of routes,
+separated by commas or newlines, and calls B<load_routes> with them. Normally hooked up to the
+`C<load>' handler.
+
 =back
 
 =a RadixIPLookup, DirectIPLookup, RangeIPLookup, StaticIPLookup,
@@ -194,6 +225,8 @@ class IPRouteTable : public BatchElement { public:
     virtual int add_route(const IPRoute& route, bool allow_replace, IPRoute* replaced_route, ErrorHandler* errh);
     virtual int remove_route(const IPRoute& route, IPRoute* removed_route, ErrorHandler* errh);
     virtual int lookup_route(IPAddress addr, IPAddress& gw) const = 0;
+    virtual void lookup_routes(const IPAddress *addr, int n, int *port, IPAddress *gw) const;
+    virtual int load_routes(const Vector<IPRoute> &routes, ErrorHandler *errh);
     virtual String dump_routes();
 
     void push(int, Packet      *p);
@@ -206,6 +239,9 @@ class IPRouteTable : public BatchElement { public:
     static int ctrl_handler(const String&, Element*, void*, ErrorHandler*);
     static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
     static String table_handler(Element*, void*);
+    static int load_handler(const String&, Element*, void*, ErrorHandler*);
+
+    enum { burst_size = 32 };
 
   private:
 
@@ -215,6 +251,8 @@ class IPRouteTable : public BatchElement { public:
     // The actual processing of this element is abstracted from the push operation.
     // This allows both push and push_batch to exploit the same processing.
     int process(int port, Packet *p);
+    int process_burst(Packet *p, int *outputs);
+    void no_route(IPAddress dst);
 };
 
 inline StringAccum&
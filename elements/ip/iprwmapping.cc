@@ -41,6 +41,7 @@ IPRewriterFlow::IPRewriterFlow(IPRewriterInput *owner, const IPFlowID &flowid,
       _guaranteed(guaranteed), _reply_anno(0),
       _owner(owner), _input(input)
 {
+    _wheel.prev = 0;
     _e[0].initialize(flowid, owner->foutput, false);
     _e[1].initialize(rewritten_flowid.reverse(), owner->routput, true);
 
@@ -96,6 +97,20 @@ void
 IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
 			      click_jiffies_t expiry_j)
 {
+    if (h->_use_wheel) {
+	// Postponing is lazy: the wheel checks the real expiry when it
+	// reaches the flow's bucket.
+	if (_guaranteed != guaranteed) {
+	    h->_wheels[_guaranteed].unschedule(this);
+	    _guaranteed = guaranteed;
+	    h->_wheels[_guaranteed].schedule(this, expiry_j);
+	} else if (!_wheel.scheduled()
+		   || (int32_t) ((uint32_t) expiry_j - _wheel.expires) < 0)
+	    h->_wheels[_guaranteed].schedule(this, expiry_j);
+	_expiry_j = expiry_j;
+	return;
+    }
+
     Vector<IPRewriterFlow *> &current_heap = h->_heaps[_guaranteed];
     assert(current_heap[_place] == this);
     _expiry_j = expiry_j;
@@ -118,10 +133,14 @@ IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
 void
 IPRewriterFlow::destroy(IPRewriterHeap *heap)
 {
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[_guaranteed];
-    remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
-		heap_less(), heap_place());
-    myheap.pop_back();
+    if (heap->_use_wheel)
+	heap->_wheels[_guaranteed].unschedule(this);
+    else {
+	Vector<IPRewriterFlow *> &myheap = heap->_heaps[_guaranteed];
+	remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
+		    heap_less(), heap_place());
+	myheap.pop_back();
+    }
     --_owner->count;
     _owner->owner->destroy_flow(this);
 }
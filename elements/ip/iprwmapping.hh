@@ -5,6 +5,7 @@
 #include <click/timer.hh>
 #include <click/hashtable.hh>
 #include <click/ipflowid.hh>
+#include <click/timerwheel.hh>
 #include <clicknet/ip.h>
 #include "iprwpattern.hh"
 CLICK_DECLS
@@ -98,7 +99,10 @@ class IPRewriterFlow { public:
     /** @brief Set expiration time to @a expiry_j.
      * @param h heap containing this flow
      * @param guaranteed whether the flow is guaranteed
-     * @param expiry_j expiration time in absolute jiffies */
+     * @param expiry_j expiration time in absolute jiffies
+     *
+     * If @a h is a timing wheel, postponing the expiration is O(1) and does
+     * not move the flow. */
     void change_expiry(IPRewriterHeap *h, bool guaranteed,
 		       click_jiffies_t expiry_j);
 
@@ -159,13 +163,20 @@ class IPRewriterFlow { public:
 	}
     };
 
+    TimerWheelLink<IPRewriterFlow> &wheel_link() {
+	return _wheel;
+    }
+
   protected:
 
     IPRewriterEntry _e[2];
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
     click_jiffies_t _expiry_j;
-    size_t _place : 32;
+    union {			// position in the heap or in the timing wheel
+	uint32_t _place;
+	TimerWheelLink<IPRewriterFlow> _wheel;
+    };
     uint8_t _ip_p;
     uint8_t _tflags;
     bool _guaranteed;
@@ -176,6 +187,7 @@ class IPRewriterFlow { public:
 
     friend class IPRewriterBase;
     friend class IPRewriterEntry;
+    friend class IPRewriterHeap;
 
   private:
 
@@ -48,6 +48,35 @@ class RadixIPLookup::Radix { public:
 	return cur;
     }
     
+    // Walk the radix one level at a time for all of the n <= burst_size
+    // addresses, prefetching the children of the next level
+    static inline void lookup_burst(const Radix *r, int dflt, const uint32_t *addr, int n, int *key) {
+	const Radix *node[burst_size];
+	int active[burst_size];
+	int nactive = 0;
+	for (int i = 0; i < n; i++) {
+	    key[i] = dflt;
+	    node[i] = r;
+	    __builtin_prefetch(&r->_children[addr[i] >> _bitshift[0]]);
+	    active[nactive++] = i;
+	}
+	for (int level = 0; nactive; level++) {
+	    int k = 0;
+	    for (int j = 0; j < nactive; j++) {
+		int i = active[j];
+		int i1 = (addr[i] >> _bitshift[level]) & (_nbuckets[level] - 1);
+		const Child &c = node[i]->_children[i1];
+		if (c.key)
+		    key[i] = c.key;
+		if ((node[i] = c.child)) {
+		    __builtin_prefetch(&c.child->_children[(addr[i] >> _bitshift[level + 1]) & (_nbuckets[level + 1] - 1)]);
+		    active[k++] = i;
+		}
+	    }
+	    nactive = k;
+	}
+    }
+
 private:
 
 
@@ -86,9 +115,14 @@ const int RadixIPLookup::Radix::_nbuckets [5] = {65536, 16, 16, 16, 16};
     
 int
 RadixIPLookup::find_lookup_key(IPAddress gw, int32_t port) {
-    for(int i=0; i  < _lookup.size(); i++) {
-	if(_lookup[i].gw == gw  &&
-	   _lookup[i].port == port) 
+    return find_lookup_key(_t, gw, port);
+}
+
+int
+RadixIPLookup::find_lookup_key(const Table *t, IPAddress gw, int32_t port) {
+    for(int i=0; i  < t->nlookup; i++) {
+	if(t->lookup[i].gw == gw  &&
+	   t->lookup[i].port == port) 
 	    return (i + 1);
     }
     return 0;
@@ -124,9 +158,11 @@ RadixIPLookup::Radix::change(uint32_t addr, uint32_t mask, int key, bool set, in
 
     // check if change only affects children
     if (mask & ((1U << shift) - 1)) {
-	if (!_children[i1].child
-	    && (_children[i1].child = make_radix(level + 1))) {
-	    ;
+	if (!_children[i1].child) {
+	    Radix *child = make_radix(level + 1);
+	    // Readers may follow the link as soon as it is stored
+	    click_write_fence();
+	    _children[i1].child = child;
 	}
 	if (_children[i1].child)
 	    return _children[i1].child->change(addr, mask, key, set, level+1);
@@ -161,7 +197,7 @@ RadixIPLookup::Radix::change(uint32_t addr, uint32_t mask, int key, bool set, in
 
 
 RadixIPLookup::RadixIPLookup()
-    : _vfree(-1), _default_key(0), _radix(Radix::make_radix(0))
+    : _t(make_table())
 {
 }
 
@@ -173,10 +209,45 @@ RadixIPLookup::~RadixIPLookup()
 void
 RadixIPLookup::cleanup(CleanupStage)
 {
+    if (_t)
+	free_table(_t, 0);
+    _t = 0;
+}
+
+RadixIPLookup::Table *
+RadixIPLookup::make_table()
+{
+    Table *t = new Table;
+    t->radix = Radix::make_radix(0);
+    t->default_key = 0;
+    t->nlookup = 0;
+    t->vfree = -1;
+    return t;
+}
+
+void
+RadixIPLookup::free_table(void *obj, void *)
+{
+    Table *t = static_cast<Table *>(obj);
     int level = 0;
-    _v.clear();
-    Radix::free_radix(_radix, level);
-    _radix = 0;
+    Radix::free_radix(t->radix, level);
+    delete t;
+}
+
+/*
+ * Switch the data path to table @a t. The old table is freed once no reader
+ * can still be walking it.
+ */
+void
+RadixIPLookup::publish(Table *t)
+{
+    Table *old = _t;
+    click_write_fence();
+    _t = t;
+    if (old) {
+	_rcu.retire(old, free_table, 0);
+	_rcu.collect();
+    }
 }
 
 void
@@ -184,17 +255,19 @@ RadixIPLookup::add_handlers()
 {
     IPRouteTable::add_handlers();
     add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_write_handler("load", load_handler, 0);
 }
 
 String
 RadixIPLookup::dump_routes()
 {
     StringAccum sa;
-    for (int j = _vfree; j >= 0; j = _v[j].extra)
-	_v[j].kill();
-    for (int i = 0; i < _v.size(); i++)
-	if (_v[i].real())
-	    _v[i].unparse(sa, true) << '\n';
+    Vector<IPRoute> &v = _t->v;
+    for (int j = _t->vfree; j >= 0; j = v[j].extra)
+	v[j].kill();
+    for (int i = 0; i < v.size(); i++)
+	if (v[i].real())
+	    v[i].unparse(sa, true) << '\n';
     return sa.take_string();
 }
 
@@ -202,52 +275,69 @@ RadixIPLookup::dump_routes()
 int
 RadixIPLookup::add_route(const IPRoute &route, bool set, IPRoute *old_route, ErrorHandler *)
 {
-    int found = (_vfree < 0 ? _v.size() : _vfree), last_key;
-    int lookup_key = find_lookup_key(route.gw, route.port);
-    if(!lookup_key) 
-	lookup_key = _lookup.size() + 1;
+    return insert_route(_t, route, set, old_route);
+}
+
+int
+RadixIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler*)
+{
+    return erase_route(_t, route, old_route);
+}
+
+int
+RadixIPLookup::insert_route(Table *t, const IPRoute &route, bool set, IPRoute *old_route)
+{
+    int found = (t->vfree < 0 ? t->v.size() : t->vfree), last_key;
+    int lookup_key = find_lookup_key(t, route.gw, route.port);
+    if (!lookup_key) {
+	if (t->nlookup == max_lookup_keys)
+	    return -ENOMEM;
+	// Readers may find the key as soon as change() stores it
+	lookup_key = t->nlookup + 1;
+	t->lookup[lookup_key - 1].gw = route.gw;
+	t->lookup[lookup_key - 1].port = route.port;
+	click_write_fence();
+    }
 		    
     if (route.mask) {
 	uint32_t addr = ntohl(route.addr.addr());
 	uint32_t mask = ntohl(route.mask.addr());
 	int level = 0;
-	last_key = _radix->change(addr, mask, combine_key(found + 1, lookup_key), set, level);
+	last_key = t->radix->change(addr, mask, combine_key(found + 1, lookup_key), set, level);
 	// The key returned by change is the combined key, we need only the _v key.
 	last_key = get_key(last_key);
     } else {
-	last_key = get_key(_default_key);
+	last_key = get_key(t->default_key);
 	if (!last_key || set)
-	    _default_key = combine_key(found + 1, lookup_key);
+	    t->default_key = combine_key(found + 1, lookup_key);
     }
 
     if (last_key && old_route)
-	*old_route = _v[last_key - 1];
+	*old_route = t->v[last_key - 1];
     if (last_key && !set)
 	return -EEXIST;
 
-    if (lookup_key == (_lookup.size() + 1)) {
-	GWPort gw_port = {route.gw, route.port};
-	_lookup.push_back(gw_port);
-    }
+    if (lookup_key == t->nlookup + 1)
+	t->nlookup++;
 
-    if (found == _v.size())
-	_v.push_back(route);
+    if (found == t->v.size())
+	t->v.push_back(route);
     else {
-	_vfree = _v[found].extra;
-	_v[found] = route;
+	t->vfree = t->v[found].extra;
+	t->v[found] = route;
     }
-    _v[found].extra = -1;
+    t->v[found].extra = -1;
 
     if (last_key) {
-	_v[last_key - 1].extra = _vfree;
-	_vfree = last_key - 1;
+	t->v[last_key - 1].extra = t->vfree;
+	t->vfree = last_key - 1;
     }
 
     return 0;
 }
 
 int
-RadixIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler*)
+RadixIPLookup::erase_route(Table *t, const IPRoute& route, IPRoute* old_route)
 {
     int last_key;
     if (route.mask) {
@@ -255,51 +345,87 @@ RadixIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandl
 	uint32_t mask = ntohl(route.mask.addr());
 	int level = 0;
 	// NB: this will never actually make changes
-	last_key = get_key(_radix->change(addr, mask, 0, false, level));
+	last_key = get_key(t->radix->change(addr, mask, 0, false, level));
     } else
-	last_key = get_key(_default_key);
+	last_key = get_key(t->default_key);
 
     if (last_key && old_route)
-	*old_route = _v[last_key - 1];
-    if (!last_key || !route.match(_v[last_key - 1]))
+	*old_route = t->v[last_key - 1];
+    if (!last_key || !route.match(t->v[last_key - 1]))
 	return -ENOENT;
-    _v[last_key - 1].extra = _vfree;
-    _vfree = last_key - 1;
+    t->v[last_key - 1].extra = t->vfree;
+    t->vfree = last_key - 1;
 
     if (route.mask) {
 	uint32_t addr = ntohl(route.addr.addr());
 	uint32_t mask = ntohl(route.mask.addr());
 	int level = 0;
-	(void) _radix->change(addr, mask, 0, true, level);
+	(void) t->radix->change(addr, mask, 0, true, level);
     } else
-	_default_key = 0;
+	t->default_key = 0;
+    return 0;
+}
+
+int
+RadixIPLookup::load_routes(const Vector<IPRoute> &routes, ErrorHandler *)
+{
+    Table *t = make_table();
+    for (int i = 0; i < routes.size(); i++) {
+	int r = insert_route(t, routes[i], true, 0);
+	if (r < 0) {
+	    free_table(t, 0);
+	    return r;
+	}
+    }
+    publish(t);
     return 0;
 }
 
 int
 RadixIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
 {
-    int level = 0;    
-    int key = Radix::lookup(_radix, _default_key, ntohl(addr.addr()), level);
+    int level = 0, port = -1;
+    _rcu.read_begin();
+    const Table *t = _t;
+    int key = Radix::lookup(t->radix, t->default_key, ntohl(addr.addr()), level);
     int lookup_key = get_lookup_key(key);
     if (lookup_key) {
-	gw = _lookup[lookup_key - 1].gw;
-	return _lookup[lookup_key - 1].port;
-    } else {
+	gw = t->lookup[lookup_key - 1].gw;
+	port = t->lookup[lookup_key - 1].port;
+    } else
 	gw = 0;
-	return -1;
+    _rcu.read_end();
+    return port;
+}
+
+void
+RadixIPLookup::lookup_routes(const IPAddress *addr, int n, int *port, IPAddress *gw) const
+{
+    uint32_t a[burst_size];
+    int key[burst_size];
+    for (int b = 0; b < n; b += burst_size) {
+	int k = n - b < burst_size ? n - b : (int) burst_size;
+	for (int i = 0; i < k; i++)
+	    a[i] = ntohl(addr[b + i].addr());
+	_rcu.read_begin();
+	const Table *t = _t;
+	Radix::lookup_burst(t->radix, t->default_key, a, k, key);
+	for (int i = 0; i < k; i++)
+	    if (int lookup_key = get_lookup_key(key[i])) {
+		gw[b + i] = t->lookup[lookup_key - 1].gw;
+		port[b + i] = t->lookup[lookup_key - 1].port;
+	    } else {
+		gw[b + i] = 0;
+		port[b + i] = -1;
+	    }
+	_rcu.read_end();
     }
 }
 
 void
 RadixIPLookup::flush_table()
 {
-    int level = 0;
-    _v.clear();
-    Radix::free_radix(_radix, level);
-    _radix = Radix::make_radix(0);
-    _vfree = -1;
-    _default_key = 0;
+    publish(make_table());
 }
 
 int
@@ -3,6 +3,7 @@
 #define CLICK_RADIXIPLOOKUP_HH
 #include <click/glue.hh>
 #include <click/element.hh>
+#include <click/multithread.hh>
 #include "iproutetable.hh"
 CLICK_DECLS
 
@@ -31,6 +32,17 @@ gateway IP address, and an output port.
 
 Uses the IPRouteTable interface; see IPRouteTable for description.
 
+Batches are looked up by bursts of 32 packets, walking the radix trees of all
+the addresses of a burst one level at a time and prefetching the nodes of the
+next level, so that the memory accesses of the packets overlap.
+
+Routes can be added and removed while other threads look addresses up,
+without locking them: new nodes are complete before they are linked in the
+tree, and each change of a key is a single store. The C<load> and C<flush>
+handlers build a whole new tree aside, then switch the data path to it in one
+step. The old tree is freed once no thread can still be walking it. The
+routes of a table can use at most 255 different gateway and output pairs.
+
 =h table read-only
 
 Outputs a human-readable version of the current routing table.
@@ -59,6 +71,17 @@ add a route, and `C<remove ADDR/MASK>' to remove a route. You can supply
 multiple commands, one per line; all commands are executed as one atomic
 operation.
 
+=h flush write-only
+
+Clears the entire routing table in a single atomic operation.
+
+=h load write-only
+
+Replaces the entire routing table in a single atomic operation. Write the
+routes in the `C<ADDR/MASK [GW] OUT>' format, separated by commas or
+newlines, as in the configuration string. If any route is
+invalid, the table is left unchanged.
+
 =n
 
 See IPRouteTable for a performance comparison of the various IP routing
@@ -85,6 +108,8 @@ class RadixIPLookup : public IPRouteTable { public:
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    void lookup_routes(const IPAddress *, int, int *, IPAddress *) const;
+    int load_routes(const Vector<IPRoute> &, ErrorHandler *);
     int find_lookup_key(IPAddress gw, int port);
     String dump_routes();
 
@@ -115,15 +140,32 @@ class RadixIPLookup : public IPRouteTable { public:
 
     class Radix;
 
-    // Simple routing table
-    Vector<IPRoute> _v;
-    int _vfree;
-    
-    // Compressed routing table holding unique values of (gw, port).
-    Vector<GWPort> _lookup;
+    enum { max_lookup_keys = 0xff };
+
+    // The data path only reads radix, default_key and lookup
+    struct Table {
+	Radix *radix;
+	int default_key;
+
+	// Compressed routing table holding unique values of (gw, port).
+	GWPort lookup[max_lookup_keys];
+	int nlookup;
+
+	// Simple routing table
+	Vector<IPRoute> v;
+	int vfree;
+    };
+
+    Table * volatile _t;
+    mutable rcu_reclaimer _rcu;
+
+    static Table *make_table();
+    static void free_table(void *obj, void *arg);
+    void publish(Table *t);
 
-    int _default_key;
-    Radix *_radix;
+    static int find_lookup_key(const Table *t, IPAddress gw, int port);
+    static int insert_route(Table *t, const IPRoute &, bool, IPRoute *);
+    static int erase_route(Table *t, const IPRoute &, IPRoute *);
 
 };
 
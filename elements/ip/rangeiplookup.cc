@@ -27,29 +27,44 @@
 CLICK_DECLS
 
 RangeIPLookup::RangeIPLookup()
-    : _range_base((uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t))),
-      _range_len((uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t))),
-      _range_t((uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t))),
-      _active(false)
+    : _current(&_ranges[0]), _active(false),
+      _helper(new DirectIPLookup::Table)
 {
 #if HAVE_BATCH
     // TODO: Remove this when push_batch() will actually be implemented
     in_batch_mode = BATCH_MODE_NO;
 #endif
+    for (int i = 0; i < 2; i++) {
+	Ranges &r = _ranges[i];
+	r.range_base = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+	r.range_len = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+	r.range_t = (uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t));
+	r.vport = (Nexthop *) CLICK_LALLOC(DirectIPLookup::vport_capacity_limit * sizeof(Nexthop));
+	memset(r.range_base, 0, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	memset(r.range_len, 0, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	memset(r.range_t, 0, RANGES_MAX * sizeof(uint32_t));
+	r.vport[0].gw = IPAddress();
+	r.vport[0].port = DirectIPLookup::DISCARD_PORT;
+    }
 }
 
 RangeIPLookup::~RangeIPLookup()
 {
-    CLICK_LFREE(_range_base, (1 << KICKSTART_BITS) * sizeof(uint32_t));
-    CLICK_LFREE(_range_len, (1 << KICKSTART_BITS) * sizeof(uint32_t));
-    CLICK_LFREE(_range_t, RANGES_MAX * sizeof(uint32_t));
+    for (int i = 0; i < 2; i++) {
+	Ranges &r = _ranges[i];
+	CLICK_LFREE(r.range_base, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	CLICK_LFREE(r.range_len, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	CLICK_LFREE(r.range_t, RANGES_MAX * sizeof(uint32_t));
+	CLICK_LFREE(r.vport, DirectIPLookup::vport_capacity_limit * sizeof(Nexthop));
+    }
+    delete _helper;
 }
 
 int
 RangeIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int r;
-    if ((r = _helper.initialize()) < 0)
+    if ((r = _helper->initialize()) < 0)
 	return r;
     flush_table();
     return IPRouteTable::configure(conf, errh);
@@ -66,7 +81,7 @@ RangeIPLookup::initialize(ErrorHandler *)
 void
 RangeIPLookup::cleanup(CleanupStage)
 {
-    _helper.cleanup();
+    _helper->cleanup();
 }
 
 void
@@ -78,7 +93,7 @@ RangeIPLookup::push(int, Packet *p)
 #ifdef RANGEIPLOOKUP_VERBOSE
     // Consistency check - does directiplookup yied the same result?
     IPAddress gw1;
-    int port1 = _helper.lookup_route(p->dst_ip_anno(), gw1);
+    int port1 = _helper->lookup_route(p->dst_ip_anno(), gw1);
     if (port != port1 || gw != gw1)
 	click_chatter("RangeIPLookup: consistency check failed!");
 #endif
@@ -99,16 +114,18 @@ RangeIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     uint32_t i = ip_addr >> RANGE_SHIFT; // kickstart table index = MS bits
     uint16_t vport_i;
 
-    lowerbound = _range_base[i];
-    upperbound = lowerbound + _range_len[i];
+    _rcu.read_begin();
+    const Ranges *r = _current;
+    lowerbound = r->range_base[i];
+    upperbound = lowerbound + r->range_len[i];
     i = ip_addr & RANGE_MASK;		// Compare only masked LS bits
 
     // Binary search for a matching range
     while (upperbound > lowerbound) {
 	middle = (upperbound + lowerbound) >> 1;
-	if (i < (_range_t[middle] & RANGE_MASK))
+	if (i < (r->range_t[middle] & RANGE_MASK))
 	    upperbound = middle;
-	else if (i < (_range_t[middle + 1] & RANGE_MASK)) {
+	else if (i < (r->range_t[middle + 1] & RANGE_MASK)) {
 	    lowerbound = middle;
 	    break;
 	} else
@@ -116,9 +133,11 @@ RangeIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     }
 
     // MS bits of the found range contain an index into the output port table
-    vport_i = _range_t[lowerbound] >> RANGE_SHIFT;
-    gw = _helper._vport[vport_i].gw;
-    return _helper._vport[vport_i].port;
+    vport_i = r->range_t[lowerbound] >> RANGE_SHIFT;
+    gw = r->vport[vport_i].gw;
+    int port = r->vport[vport_i].port;
+    _rcu.read_end();
+    return port;
 }
 
 void
@@ -126,12 +145,13 @@ RangeIPLookup::add_handlers()
 {
     IPRouteTable::add_handlers();
     add_write_handler("flush", flush_handler, 0, Handler::BUTTON);
+    add_write_handler("load", load_handler, 0);
 }
 
 int
 RangeIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
-    int error = _helper.add_route(route, allow_replace, old_route, errh);
+    int error = _helper->add_route(route, allow_replace, old_route, errh);
     if (error == 0 && _active)
 	expand();
     return error;
@@ -140,15 +160,40 @@ RangeIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_
 int
 RangeIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler *errh)
 {
-    int error = _helper.remove_route(route, old_route, errh);
+    int error = _helper->remove_route(route, old_route, errh);
     if (error == 0 && _active)
 	expand();
     return error;
 }
 
+int
+RangeIPLookup::load_routes(const Vector<IPRoute> &routes, ErrorHandler *errh)
+{
+    // The data path does not read the helper table, so the new one can
+    // replace it right away
+    int r;
+    DirectIPLookup::Table *t = new DirectIPLookup::Table;
+    if ((r = t->initialize()) < 0) {
+	delete t;
+	return r;
+    }
+    t->flush();
+    for (int i = 0; i < routes.size(); i++)
+	if ((r = t->add_route(routes[i], true, 0, errh)) < 0) {
+	    delete t;
+	    return r;
+	}
+    delete _helper;
+    _helper = t;
+    if (_active)
+	expand();
+    return 0;
+}
+
 /*
  * On each routing table update, we distill the address range based lookup
- * table from the structures provided by the DirectIPLookup class.
+ * table from the structures provided by the DirectIPLookup class, into the
+ * copy of the lookup structures that the data path is not using.
  * The main cost of this operation is associated with traversing through
  * 32 + 16 = 48 MBytes of directiplookup tables.  We should implement a
  * more efficient method for updating range-based lookup structures in
@@ -157,6 +202,7 @@ RangeIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandl
 void
 RangeIPLookup::expand()
 {
+    Ranges *r = (_current == &_ranges[0] ? &_ranges[1] : &_ranges[0]);
     uint32_t range_t_index = 0;
     uint32_t tbl_0_23_index = 0;
     uint32_t range_base;
@@ -166,20 +212,20 @@ RangeIPLookup::expand()
 	uint16_t vport_i, vport_i1;
 
 	vport_i = 0xffff;       // Duh!
-	_range_base[range_base] = range_t_index;
+	r->range_base[range_base] = range_t_index;
 
 	for (range_len = 0;
 	  tbl_0_23_index < ((range_base + 1) << (24 - KICKSTART_BITS));
 	  tbl_0_23_index++) {
-	    if (_helper._tbl_0_23[tbl_0_23_index] & 0x8000) {
+	    if (_helper->_tbl_0_23[tbl_0_23_index] & 0x8000) {
 		uint32_t tbl_24_31_index, j;
 		tbl_24_31_index =
-			(_helper._tbl_0_23[tbl_0_23_index] & 0x7fff) << 8;
+			(_helper->_tbl_0_23[tbl_0_23_index] & 0x7fff) << 8;
 		for (j = 0; j < 256; j++) {
-		    vport_i1 = _helper._tbl_24_31[tbl_24_31_index + j];
+		    vport_i1 = _helper->_tbl_24_31[tbl_24_31_index + j];
 		    if (vport_i != vport_i1) {
 			vport_i = vport_i1;
-			_range_t[range_t_index] =
+			r->range_t[range_t_index] =
 					vport_i << (32 - KICKSTART_BITS) |
 					(((tbl_0_23_index << 8) + j) &
 					(0xffffffff >> KICKSTART_BITS));
@@ -188,10 +234,10 @@ RangeIPLookup::expand()
 		    }
 		}
 	    } else {
-		vport_i1 = _helper._tbl_0_23[tbl_0_23_index];
+		vport_i1 = _helper->_tbl_0_23[tbl_0_23_index];
 		if (vport_i != vport_i1) {
 		    vport_i = vport_i1;
-		    _range_t[range_t_index] =
+		    r->range_t[range_t_index] =
 					vport_i << (32 - KICKSTART_BITS) |
 					((tbl_0_23_index << 8) &
 					(0xffffffff >> KICKSTART_BITS));
@@ -200,23 +246,32 @@ RangeIPLookup::expand()
 		}
 	    }
 	}
-	_range_len[range_base] = range_len - 1;
+	r->range_len[range_base] = range_len - 1;
     }
 
 #ifdef RANGEIPLOOKUP_VERBOSE
     click_chatter("Range expansion done: %d ranges using %d + %d bytes",
-		  range_t_index, sizeof(_range_base) + sizeof(_range_len),
+		  range_t_index, sizeof(uint32_t) << (KICKSTART_BITS + 1),
 		  range_t_index * sizeof(uint32_t));
 #endif
+
+    for (uint32_t i = 0; i < _helper->_vport_size; i++) {
+	r->vport[i].gw = _helper->_vport[i].gw;
+	r->vport[i].port = _helper->_vport[i].port;
+    }
+
+    // Switch to the new version, and wait until the old one can be reused
+    click_write_fence();
+    _current = r;
+    _rcu.synchronize();
 }
 
 void
 RangeIPLookup::flush_table()
 {
-    _helper.flush();
-    memset(_range_base, 0, (1 << KICKSTART_BITS) * sizeof(*_range_base));
-    memset(_range_len, 0, (1 << KICKSTART_BITS) * sizeof(*_range_len));
-    memset(_range_t, 0, RANGES_MAX * sizeof(*_range_t));
+    _helper->flush();
+    if (_active)
+	expand();
 }
 
 int
@@ -231,7 +286,7 @@ RangeIPLookup::flush_handler(const String &, Element *e, void *,
 String
 RangeIPLookup::dump_routes()
 {
-    return _helper.dump();
+    return _helper->dump();
 }
 
 CLICK_ENDDECLS
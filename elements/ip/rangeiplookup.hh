@@ -38,6 +38,10 @@ RangeIPLookup maintains a large DirectIPLookup table as well as its own
 tables.  Although this subsidiary table is only accessed during route updates,
 it significantly adds to RangeIPLookup's total memory footprint.
 
+The lookup structure is double-buffered: each update expands the routing
+table into the spare copy, then switches the data path to it in one step.
+Other threads can thus look addresses up during updates without locking.
+
 =h table read-only
 
 Outputs a human-readable version of the current routing table.
@@ -70,6 +74,13 @@ operation.
 
 Clears the entire routing table in a single atomic operation.
 
+=h load write-only
+
+Replaces the entire routing table in a single atomic operation. Write the
+routes in the `C<ADDR/MASK [GW] OUT>' format, separated by commas or
+newlines, as in the configuration string. If any route is
+invalid, the table is left unchanged.
+
 =n
 
 See IPRouteTable for a performance comparison of the various IP routing
@@ -98,6 +109,7 @@ class RangeIPLookup : public IPRouteTable { public:
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
+    int load_routes(const Vector<IPRoute> &, ErrorHandler *);
     String dump_routes();
 
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
@@ -112,12 +124,25 @@ class RangeIPLookup : public IPRouteTable { public:
     enum { RANGE_MASK = 0xffffffff >> KICKSTART_BITS };
     enum { RANGE_SHIFT = 32 - KICKSTART_BITS };
 
-    uint32_t *_range_base;
-    uint32_t *_range_len;
-    uint32_t *_range_t;
+    struct Nexthop {
+	IPAddress gw;
+	int32_t port;
+    };
+
+    // A version of the lookup structure
+    struct Ranges {
+	uint32_t *range_base;
+	uint32_t *range_len;
+	uint32_t *range_t;
+	Nexthop *vport;
+    };
+
+    Ranges _ranges[2];
+    Ranges * volatile _current;
     bool _active;
 
-    DirectIPLookup::Table _helper;
+    DirectIPLookup::Table *_helper;
+    mutable rcu_reclaimer _rcu;
 
 };
 
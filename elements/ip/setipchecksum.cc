@@ -34,8 +34,8 @@ SetIPChecksum::~SetIPChecksum()
 {
 }
 
-Packet *
-SetIPChecksum::simple_action(Packet *p_in)
+inline WritablePacket *
+SetIPChecksum::clear_checksum(Packet *p_in)
 {
     if (WritablePacket *p = p_in->uniqueify()) {
 	unsigned char *nh_data = (p->has_network_header() ? p->network_header() : p->data());
@@ -46,7 +46,6 @@ SetIPChecksum::simple_action(Packet *p_in)
 	    && likely((hlen = iph->ip_hl << 2) >= sizeof(click_ip))
 	    && likely(hlen <= plen)) {
 	    iph->ip_sum = 0;
-	    iph->ip_sum = click_in_cksum((unsigned char *) iph, hlen);
 	    return p;
 	}
 
@@ -57,11 +56,27 @@ SetIPChecksum::simple_action(Packet *p_in)
     return 0;
 }
 
+Packet *
+SetIPChecksum::simple_action(Packet *p_in)
+{
+    if (WritablePacket *p = clear_checksum(p_in)) {
+	click_ip *iph = reinterpret_cast<click_ip *>(p->has_network_header() ? p->network_header() : p->data());
+	iph->ip_sum = click_in_cksum((unsigned char *) iph, iph->ip_hl << 2);
+	return p;
+    }
+    return 0;
+}
+
 #if HAVE_BATCH
 PacketBatch *
 SetIPChecksum::simple_action_batch(PacketBatch *batch)
 {
-    EXECUTE_FOR_EACH_PACKET_DROPPABLE(SetIPChecksum::simple_action, batch, [](Packet *){});
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(clear_checksum, batch, [](Packet *){});
+    if (!batch)
+	return 0;
+
+    // clear_checksum() made every packet writable
+    batch->set_ip_checksums();
     return batch;
 }
 #endif
@@ -37,6 +37,8 @@ class SetIPChecksum : public BatchElement { public:
 
     unsigned _drops;
 
+    inline WritablePacket *clear_checksum(Packet *p);
+
 };
 
 CLICK_ENDDECLS
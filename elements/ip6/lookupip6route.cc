@@ -88,8 +88,8 @@ LookupIP6Route::initialize(ErrorHandler *)
   return 0;
 }
 
-void
-LookupIP6Route::push(int, Packet *p)
+int
+LookupIP6Route::process(Packet *p)
 {
   IP6Address a = DST_IP6_ANNO(p);
   IP6Address gw;
@@ -101,8 +101,7 @@ LookupIP6Route::push(int, Packet *p)
 	{
 	    SET_DST_IP6_ANNO(p, _last_gw);
 	}
-      output(_last_output).push(p);
-      return;
+      return _last_output;
     }
  #ifdef IP_RT_CACHE2
     else if (a == _last_addr2) {
@@ -116,8 +115,7 @@ LookupIP6Route::push(int, Packet *p)
       if (_last_gw2) {
 	  SET_DST_IP6_ANNO(p, _last_gw2);
       }
-      output(_last_output2).push(p);
-      return;
+      return _last_output2;
     }
 #endif
   }
@@ -136,13 +134,27 @@ LookupIP6Route::push(int, Packet *p)
     if (gw != IP6Address("::0")) {
 	SET_DST_IP6_ANNO(p, IP6Address(gw));
     }
-    output(ifi).push(p);
+    return ifi;
 
   } else {
-    p->kill();
+    return -1;
   }
 }
 
+void
+LookupIP6Route::push(int, Packet *p)
+{
+  checked_output_push(process(p), p);
+}
+
+#if HAVE_BATCH
+void
+LookupIP6Route::push_batch(int, PacketBatch *batch)
+{
+  CLASSIFY_EACH_PACKET(noutputs() + 1, ([this](Packet *p){ return process(p); }), batch, checked_output_push_batch);
+}
+#endif
+
 int
 LookupIP6Route::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
                           int output, ErrorHandler *errh)
@@ -53,6 +53,9 @@ public:
   void add_handlers() CLICK_COLD;
 
   void push(int port, Packet *p);
+#if HAVE_BATCH
+  void push_batch(int port, PacketBatch *batch);
+#endif
 
   int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
   int remove_route(IP6Address, IP6Address, ErrorHandler *);
@@ -62,6 +65,8 @@ private:
 
   IP6Table _t;
 
+  int process(Packet *p);
+
   IP6Address _last_addr;
   IP6Address _last_gw;
   int _last_output;
@@ -0,0 +1,534 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * poptrieip6lookup.{cc,hh} -- IPv6 route lookup using a compressed multibit
+ * trie with population counts
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "poptrieip6lookup.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+PoptrieIP6Lookup::PoptrieIP6Lookup()
+    : _direct(0), _nh(0), _default(0), _long(0), _nh_refs(0),
+      _nh_count(0), _nroutes(0), _trie_size(0), _deferred(false)
+{
+}
+
+PoptrieIP6Lookup::~PoptrieIP6Lookup()
+{
+    if (_direct) {
+	for (int s = 0; s < nslots; s++)
+	    if (!(_direct[s] & 1))
+		free_subtree((void *) _direct[s], 0);
+	delete[] const_cast<uintptr_t *>(_direct);
+    }
+    if (_long)
+	for (int s = 0; s < nslots; s++)
+	    delete _long[s];
+    delete[] _long;
+    delete[] _default;
+    delete[] _nh_refs;
+    delete[] _nh;
+}
+
+int
+PoptrieIP6Lookup::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (!_direct) {
+	uintptr_t *direct = new uintptr_t[nslots];
+	for (int s = 0; s < nslots; s++)
+	    direct[s] = 1;
+	_direct = direct;
+	_default = new uint16_t[nslots]();
+	_long = new Vector<Prefix> *[nslots]();
+	_nh = new Nexthop[max_nexthops + 1];
+	_nh_refs = new uint32_t[max_nexthops + 1]();
+    }
+
+    // Build all the tries once, after the whole table is known
+    _deferred = true;
+    int ret = 0;
+    for (int i = 0; i < conf.size(); i++) {
+	Vector<String> words;
+	cp_spacevec(conf[i], words);
+	IP6Address dst, mask, gw;
+	int port = -1;
+	Args args(words, this, errh);
+	args.read_mp("PREFIX", IP6PrefixArg(true), dst, mask);
+	if (words.size() > 2)
+	    args.read_mp("GATEWAY", gw);
+	if (args.read_mp("PORT", port).complete() < 0)
+	    ret = errh->error("argument %d should be `ADDR/MASK [GW] OUT'", i + 1);
+	else if (add_route(dst, mask, gw, port, errh) < 0)
+	    ret = -1;
+    }
+    _deferred = false;
+
+    if (update_defaults(0, nslots, true) < 0)
+	return errh->error("out of memory");
+    return ret;
+}
+
+IP6Address
+PoptrieIP6Lookup::join(uint64_t hi, uint64_t lo)
+{
+    IP6Address a;
+    uint32_t *d = a.data32();
+    d[0] = htonl(hi >> 32);
+    d[1] = htonl((uint32_t) hi);
+    d[2] = htonl(lo >> 32);
+    d[3] = htonl((uint32_t) lo);
+    return a;
+}
+
+void
+PoptrieIP6Lookup::push(int, Packet *p)
+{
+    uint64_t hi, lo;
+    split(DST_IP6_ANNO(p), hi, lo);
+    int port = -1;
+    _rcu.read_begin();
+    if (uint16_t nh = lookup_nexthop(hi, lo)) {
+	if (_nh[nh].gw)
+	    SET_DST_IP6_ANNO(p, _nh[nh].gw);
+	port = _nh[nh].port;
+    }
+    _rcu.read_end();
+    checked_output_push(port, p);
+}
+
+/**
+ * Look up the packets starting at @a p, up to burst_size of them. Set their
+ * gateway annotation and store their output port in @a outputs.
+ * @return the number of packets looked up
+ */
+int
+PoptrieIP6Lookup::process_burst(Packet *p, int *outputs)
+{
+    Packet *q[burst_size];
+    uint64_t hi[burst_size], lo[burst_size];
+    uint16_t nh[burst_size];
+    int n = 0;
+    for (; p && n < burst_size; p = p->next(), n++) {
+	q[n] = p;
+	split(DST_IP6_ANNO(p), hi[n], lo[n]);
+    }
+
+    _rcu.read_begin();
+    lookup_burst(hi, lo, n, nh);
+    for (int i = 0; i < n; i++) {
+	if (!nh[i]) {
+	    outputs[i] = -1;
+	    continue;
+	}
+	const Nexthop &h = _nh[nh[i]];
+	if (h.gw)
+	    SET_DST_IP6_ANNO(q[i], h.gw);
+	outputs[i] = h.port;
+    }
+    _rcu.read_end();
+    return n;
+}
+
+#if HAVE_BATCH
+void
+PoptrieIP6Lookup::push_batch(int, PacketBatch *batch)
+{
+    CLASSIFY_EACH_PACKET_BURST(noutputs() + 1, process_burst, burst_size, batch, checked_output_push_batch);
+}
+#endif
+
+int
+PoptrieIP6Lookup::lookup_route(const IP6Address &addr, IP6Address &gw)
+{
+    uint64_t hi, lo;
+    split(addr, hi, lo);
+    int port = -1;
+    _rcu.read_begin();
+    if (uint16_t nh = lookup_nexthop(hi, lo)) {
+	gw = _nh[nh].gw;
+	port = _nh[nh].port;
+    }
+    _rcu.read_end();
+    return port;
+}
+
+void
+PoptrieIP6Lookup::lookup_routes(const IP6Address *addr, int n, int *port, IP6Address *gw)
+{
+    uint64_t hi[burst_size], lo[burst_size];
+    uint16_t nh[burst_size];
+    for (int b = 0; b < n; b += burst_size) {
+	int k = n - b < burst_size ? n - b : (int) burst_size;
+	for (int i = 0; i < k; i++)
+	    split(addr[b + i], hi[i], lo[i]);
+	_rcu.read_begin();
+	lookup_burst(hi, lo, k, nh);
+	for (int i = 0; i < k; i++) {
+	    if (nh[i]) {
+		gw[b + i] = _nh[nh[i]].gw;
+		port[b + i] = _nh[nh[i]].port;
+	    } else
+		port[b + i] = -1;
+	}
+	_rcu.read_end();
+    }
+}
+
+int
+PoptrieIP6Lookup::nexthop_ref(const IP6Address &gw, int port)
+{
+    Pair<IP6Address, int> key(gw, port);
+    HashTable<Pair<IP6Address, int>, int>::iterator it = _nh_map.find(key);
+    if (it) {
+	_nh_refs[it.value()]++;
+	return it.value();
+    }
+
+    int nh;
+    if (!_nh_free.size() && _nh_count == max_nexthops)
+	_rcu.collect();
+    if (_nh_free.size()) {
+	nh = _nh_free.back();
+	_nh_free.pop_back();
+    } else if (_nh_count < max_nexthops)
+	nh = ++_nh_count;
+    else
+	return 0;
+    _nh[nh].gw = gw;
+    _nh[nh].port = port;
+    _nh_refs[nh] = 1;
+    _nh_map.set(key, nh);
+    return nh;
+}
+
+void
+PoptrieIP6Lookup::nexthop_unref(int nh)
+{
+    if (--_nh_refs[nh] == 0) {
+	_nh_map.erase(Pair<IP6Address, int>(_nh[nh].gw, _nh[nh].port));
+	// Old tries may still lead readers to this nexthop
+	_rcu.retire(this, free_nexthop, (void *) (uintptr_t) nh);
+    }
+}
+
+void
+PoptrieIP6Lookup::free_nexthop(void *obj, void *arg)
+{
+    static_cast<PoptrieIP6Lookup *>(obj)->_nh_free.push_back((uintptr_t) arg);
+}
+
+void
+PoptrieIP6Lookup::free_subtree(void *obj, void *)
+{
+    Subtree *t = static_cast<Subtree *>(obj);
+    CLICK_LFREE(t, sizeof(Subtree) + t->nnodes * sizeof(Node) + t->nleaves * sizeof(uint16_t));
+}
+
+void
+PoptrieIP6Lookup::build_node(Vector<Node> &nodes, Vector<uint16_t> &leaves, int ni,
+			     const Vector<const Prefix *> &routes, int offset, uint16_t dflt)
+{
+    uint16_t leaf[64];
+    int leaf_len[64];
+    Vector<const Prefix *> children[64];
+    for (int c = 0; c < 64; c++) {
+	leaf[c] = dflt;
+	leaf_len[c] = offset;
+    }
+
+    // Routes ending in this node are expanded to the leaves they cover,
+    // longer ones are pushed down to the child of their next 6 bits
+    for (int i = 0; i < routes.size(); i++) {
+	const Prefix *p = routes[i];
+	unsigned c = chunk(p->hi, p->lo, offset);
+	if (p->len > offset + stride) {
+	    children[c].push_back(p);
+	    continue;
+	}
+	unsigned end = c + (1U << (offset + stride - p->len));
+	for (unsigned j = c; j < end; j++)
+	    if (p->len > leaf_len[j]) {
+		leaf[j] = p->nh;
+		leaf_len[j] = p->len;
+	    }
+    }
+
+    uint64_t vector = 0, leafvec = 0;
+    uint32_t base0 = leaves.size();
+    for (int c = 0; c < 64; c++) {
+	if (children[c].size())
+	    vector |= 1ULL << c;
+	else if (leaves.size() == (int) base0 || leaf[c] != leaves.back()) {
+	    leafvec |= 1ULL << c;
+	    leaves.push_back(leaf[c]);
+	}
+    }
+
+    uint32_t base1 = nodes.size();
+    nodes.resize(base1 + __builtin_popcountll(vector));
+    nodes[ni].vector = vector;
+    nodes[ni].leafvec = leafvec;
+    nodes[ni].base0 = base0;
+    nodes[ni].base1 = base1;
+
+    int k = base1;
+    for (int c = 0; c < 64; c++)
+	if (children[c].size())
+	    build_node(nodes, leaves, k++, children[c], offset + stride, leaf[c]);
+}
+
+/**
+ * Build the direct entry of @a slot: its nexthop if it has no route longer
+ * than /16, else a new trie. Return 0 if memory is exhausted.
+ */
+uintptr_t
+PoptrieIP6Lookup::build_subtree(int slot)
+{
+    Vector<Prefix> *routes = _long[slot];
+    if (!routes || !routes->size())
+	return ((uintptr_t) _default[slot] << 1) | 1;
+
+    Vector<const Prefix *> r;
+    for (int i = 0; i < routes->size(); i++)
+	r.push_back(&(*routes)[i]);
+    Vector<Node> nodes;
+    Vector<uint16_t> leaves;
+    nodes.resize(1);
+    build_node(nodes, leaves, 0, r, direct_bits, _default[slot]);
+
+    size_t size = sizeof(Subtree) + nodes.size() * sizeof(Node) + leaves.size() * sizeof(uint16_t);
+    Subtree *t = static_cast<Subtree *>(CLICK_LALLOC(size));
+    if (!t)
+	return 0;
+    t->nnodes = nodes.size();
+    t->nleaves = leaves.size();
+    memcpy(t + 1, nodes.begin(), nodes.size() * sizeof(Node));
+    memcpy(const_cast<uint16_t *>(t->leaves()), leaves.begin(), leaves.size() * sizeof(uint16_t));
+    _trie_size += size;
+    return (uintptr_t) t;
+}
+
+/** Rebuild the direct entry of @a slot and swap it with the current one */
+int
+PoptrieIP6Lookup::publish(int slot)
+{
+    uintptr_t e = build_subtree(slot);
+    if (!e)
+	return -ENOMEM;
+    uintptr_t old = _direct[slot];
+    click_write_fence(); // The trie must be complete before it is reachable
+    _direct[slot] = e;
+    if (!(old & 1)) {
+	const Subtree *t = reinterpret_cast<const Subtree *>(old);
+	_trie_size -= sizeof(Subtree) + t->nnodes * sizeof(Node) + t->nleaves * sizeof(uint16_t);
+	_rcu.retire((void *) old, free_subtree, 0);
+    }
+    return 0;
+}
+
+/**
+ * Recompute the nexthop given by routes up to /16 to the /16s of
+ * [@a first, @a last), and publish the ones that changed, or all of them if
+ * @a force is true.
+ */
+int
+PoptrieIP6Lookup::update_defaults(int first, int last, bool force)
+{
+    Vector<uint16_t> d(last - first, 0);
+    // _short is sorted by length, so more specific routes are painted last
+    for (const Prefix *p = _short.begin(); p != _short.end(); ++p) {
+	int a = p->hi >> (64 - direct_bits);
+	int b = a + (1 << (direct_bits - p->len));
+	for (int s = (a > first ? a : first); s < (b < last ? b : last); s++)
+	    d[s - first] = p->nh;
+    }
+
+    int ret = 0;
+    for (int s = first; s < last; s++)
+	if (force || d[s - first] != _default[s]) {
+	    _default[s] = d[s - first];
+	    if (publish(s) < 0)
+		ret = -ENOMEM;
+	}
+    return ret;
+}
+
+PoptrieIP6Lookup::Prefix *
+PoptrieIP6Lookup::find_route(uint64_t hi, uint64_t lo, int len)
+{
+    Vector<Prefix> *v = len <= direct_bits ? &_short : _long[hi >> (64 - direct_bits)];
+    if (v)
+	for (Prefix *p = v->begin(); p != v->end(); ++p)
+	    if (p->hi == hi && p->lo == lo && p->len == len)
+		return p;
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::update(const Prefix &p)
+{
+    if (_deferred)
+	return 0;
+    int ret;
+    if (p.len <= direct_bits) {
+	int first = p.hi >> (64 - direct_bits);
+	ret = update_defaults(first, first + (1 << (direct_bits - p.len)));
+    } else
+	ret = publish(p.hi >> (64 - direct_bits));
+    // Free the tries replaced by this update as soon as possible
+    _rcu.collect();
+    return ret;
+}
+
+int
+PoptrieIP6Lookup::add_route(IP6Address addr, IP6Address mask, IP6Address gw,
+			    int port, ErrorHandler *errh)
+{
+    int len = mask.mask_to_prefix_len();
+    if (len < 0)
+	return errh->error("mask %s is not a prefix", mask.unparse().c_str());
+    if (port < 0 || port >= noutputs())
+	return errh->error("port number out of range");
+
+    Prefix p;
+    split(addr & mask, p.hi, p.lo);
+    p.len = len;
+    p.nh = nexthop_ref(gw, port);
+    if (!p.nh)
+	return errh->error("too many different gateways");
+
+    int old_nh = 0;
+    if (Prefix *old = find_route(p.hi, p.lo, len)) {
+	old_nh = old->nh;
+	old->nh = p.nh;
+    } else if (len <= direct_bits) {
+	Prefix *it = _short.begin();
+	while (it != _short.end() && it->len <= len)
+	    ++it;
+	_short.insert(it, p);
+	_nroutes++;
+    } else {
+	int slot = p.hi >> (64 - direct_bits);
+	if (!_long[slot])
+	    _long[slot] = new Vector<Prefix>();
+	_long[slot]->push_back(p);
+	_nroutes++;
+    }
+
+    int ret = update(p);
+    if (old_nh)
+	nexthop_unref(old_nh);
+    if (ret < 0)
+	return errh->error("out of memory");
+    return 0;
+}
+
+int
+PoptrieIP6Lookup::remove_route(IP6Address addr, IP6Address mask, ErrorHandler *errh)
+{
+    int len = mask.mask_to_prefix_len();
+    Prefix p;
+    split(addr & mask, p.hi, p.lo);
+    p.len = len;
+    Prefix *old = len < 0 ? 0 : find_route(p.hi, p.lo, len);
+    if (!old)
+	return errh->error("no route for %s/%d", addr.unparse().c_str(), len);
+
+    p.nh = old->nh;
+    if (len <= direct_bits)
+	_short.erase(old);
+    else
+	_long[p.hi >> (64 - direct_bits)]->erase(old);
+    _nroutes--;
+
+    int ret = update(p);
+    nexthop_unref(p.nh);
+    if (ret < 0)
+	return errh->error("out of memory");
+    return 0;
+}
+
+String
+PoptrieIP6Lookup::dump_routes()
+{
+    StringAccum sa;
+    for (int s = -1; s < nslots; s++) {
+	Vector<Prefix> *v = s < 0 ? &_short : _long[s];
+	if (!v)
+	    continue;
+	for (const Prefix *p = v->begin(); p != v->end(); ++p) {
+	    const Nexthop &h = _nh[p->nh];
+	    sa << join(p->hi, p->lo) << '/' << p->len;
+	    sa << '\t' << h.gw << '\t' << h.port << '\n';
+	}
+    }
+    return sa.take_string();
+}
+
+size_t
+PoptrieIP6Lookup::memory_size() const
+{
+    return nslots * sizeof(uintptr_t) + (_nh_count + 1) * sizeof(Nexthop) + _trie_size;
+}
+
+int
+PoptrieIP6Lookup::lookup_handler(int, String &s, Element *e, const Handler *, ErrorHandler *errh)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    IP6Address a;
+    if (!IP6AddressArg().parse(s, a, t))
+	return errh->error("expected IPv6 address");
+    IP6Address gw;
+    int port = t->lookup_route(a, gw);
+    if (gw)
+	s = String(port) + " " + gw.unparse();
+    else
+	s = String(port);
+    return 0;
+}
+
+enum { h_nroutes, h_memory };
+
+String
+PoptrieIP6Lookup::read_handler(Element *e, void *thunk)
+{
+    PoptrieIP6Lookup *t = static_cast<PoptrieIP6Lookup *>(e);
+    switch ((intptr_t) thunk) {
+    case h_nroutes:
+	return String(t->nroutes());
+    case h_memory:
+	return String(t->memory_size());
+    default:
+	return String();
+    }
+}
+
+void
+PoptrieIP6Lookup::add_handlers()
+{
+    add_write_handler("add", add_route_handler, 0);
+    add_write_handler("remove", remove_route_handler, 0);
+    add_write_handler("ctrl", ctrl_handler, 0);
+    add_read_handler("table", table_handler, 0, Handler::f_expensive);
+    set_handler("lookup", Handler::f_read | Handler::f_read_param, lookup_handler);
+    add_read_handler("nroutes", read_handler, h_nroutes);
+    add_read_handler("memory", read_handler, h_memory);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel IP6RouteTable)
+EXPORT_ELEMENT(PoptrieIP6Lookup)
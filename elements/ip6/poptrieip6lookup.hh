@@ -0,0 +1,304 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_POPTRIEIP6LOOKUP_HH
+#define CLICK_POPTRIEIP6LOOKUP_HH
+#include <click/ip6address.hh>
+#include <click/hashtable.hh>
+#include <click/pair.hh>
+#include <click/multithread.hh>
+#include "ip6routetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+PoptrieIP6Lookup(ADDR1/MASK1 [GW1] OUT1, ADDR2/MASK2 [GW2] OUT2, ...)
+
+=s ip6
+
+IPv6 routing lookup using a compressed multibit trie
+
+=d
+
+Expects a destination IPv6 address annotation with each packet. Looks up that
+address in its routing table, using longest-prefix-match, sets the
+destination annotation to the corresponding GW (if specified), and emits the
+packet on the indicated OUTput port. Packets that match no route are dropped.
+
+Each argument is a route, specifying a destination and mask, an optional
+gateway IPv6 address, and an output port.
+
+PoptrieIP6Lookup is meant for large tables, like a full IPv6 BGP view. The
+first 16 bits of the address index a direct table of 65536 entries. An entry
+either holds the result of the lookup, or points to a trie for the longer
+prefixes of that /16. Each node of the trie consumes 6 bits of the address
+and has 64 children, described by two 64-bit vectors: one tells which
+children are nodes, and the other where runs of identical results start
+among the leaves. The child to follow is found with a population count, so
+nodes only store the children that exist and the results that differ, as in
+the I<Poptrie> structure described by Asai and Ohara in the paper cited
+below. A lookup of an address covered by a /48 reads the direct table and six
+nodes, all of which fit in a few cache lines.
+
+Batches are looked up by bursts of 32 packets: the direct table entries and
+the first node of all addresses of a burst are prefetched before any trie is
+walked, to overlap the memory accesses of the packets.
+
+Routes can be added and removed at run time without stopping the data path.
+An update rebuilds the trie of the /16 it belongs to aside, then swaps the
+direct table entry atomically. The old trie is only freed when no thread is
+looking addresses up in it anymore. Updates are not atomic between
+different /16s, and must be done by a single thread at a time, as handlers
+are.
+
+=h table read-only
+
+Outputs a human-readable version of the current routing table.
+
+=h lookup read-only, requires parameters
+
+Reports the OUTput port and GW corresponding to an address.
+
+=h add write-only
+
+Adds a route to the table. Format should be `C<ADDR/MASK [GW] OUT>'. Replaces
+any route for the same prefix.
+
+=h remove write-only
+
+Removes a route from the table. Format should be `C<ADDR/MASK>'.
+
+=h ctrl write-only
+
+Adds or removes a route. Write `C<add ADDR/MASK [GW] OUT>' to add a route, and
+`C<remove ADDR/MASK>' to remove a route.
+
+=h nroutes read-only
+
+Returns the number of routes in the table.
+
+=h memory read-only
+
+Returns the number of bytes used by the lookup structures.
+
+=a LookupIP6Route, IP6LookupTest, DirectIPLookup
+
+Hirochika Asai and Yasuhiro Ohara. "Poptrie: A Compressed Trie with
+Population Count for Fast and Scalable Software IP Routing Table Lookup".
+In Proc. ACM SIGCOMM 2015, pp. 57-70.
+
+*/
+
+class PoptrieIP6Lookup : public IP6RouteTable { public:
+
+    PoptrieIP6Lookup() CLICK_COLD;
+    ~PoptrieIP6Lookup() CLICK_COLD;
+
+    const char *class_name() const override	{ return "PoptrieIP6Lookup"; }
+    const char *port_count() const override	{ return "1/-"; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
+
+    int add_route(IP6Address, IP6Address, IP6Address, int, ErrorHandler *);
+    int remove_route(IP6Address, IP6Address, ErrorHandler *);
+    String dump_routes();
+
+    /** @brief Look up @a addr, returning the output port or -1 if no route
+     * matches, and set @a gw to the gateway of the route. */
+    int lookup_route(const IP6Address &addr, IP6Address &gw);
+
+    /** @brief Look up the @a n addresses of @a addr, setting @a port[i] and
+     * @a gw[i] like lookup_route() does for each of them. */
+    void lookup_routes(const IP6Address *addr, int n, int *port, IP6Address *gw);
+
+    int nroutes() const			{ return _nroutes; }
+    size_t memory_size() const;
+
+    enum { burst_size = 32, max_nexthops = 65535 };
+
+  private:
+
+    enum { direct_bits = 16, nslots = 1 << direct_bits, stride = 6 };
+
+    struct Node {
+	uint64_t vector;	// children that are nodes
+	uint64_t leafvec;	// leaf children that start a run of equal leaves
+	uint32_t base0;		// index of the first leaf of the node
+	uint32_t base1;		// index of the first child node
+    };
+
+    // The trie of a /16: a header followed by the nodes, then the leaves
+    struct Subtree {
+	uint32_t nnodes;
+	uint32_t nleaves;
+
+	const Node *nodes() const {
+	    return reinterpret_cast<const Node *>(this + 1);
+	}
+	const uint16_t *leaves() const {
+	    return reinterpret_cast<const uint16_t *>(nodes() + nnodes);
+	}
+    };
+
+    struct Nexthop {
+	IP6Address gw;
+	int port;
+    };
+
+    struct Prefix {
+	uint64_t hi;
+	uint64_t lo;
+	int len;
+	uint16_t nh;
+    };
+
+    // Data plane. A direct entry is either (nexthop << 1) | 1, or a
+    // Subtree pointer. Nexthop 0 means no route.
+    volatile uintptr_t *_direct;
+    Nexthop *_nh;
+
+    // Control plane
+    uint16_t *_default;			// nexthop of each /16 from short routes
+    Vector<Prefix> _short;		// routes up to /16, sorted by length
+    Vector<Prefix> **_long;		// longer routes of each /16
+    uint32_t *_nh_refs;
+    HashTable<Pair<IP6Address, int>, int> _nh_map;
+    Vector<int> _nh_free;
+    int _nh_count;
+    int _nroutes;
+    size_t _trie_size;
+    bool _deferred;
+
+    rcu_reclaimer _rcu;			// last: its destructor uses _nh_free
+
+    static inline unsigned chunk(uint64_t hi, uint64_t lo, int offset);
+    static inline void split(const IP6Address &a, uint64_t &hi, uint64_t &lo);
+    static IP6Address join(uint64_t hi, uint64_t lo);
+
+    static inline uint16_t walk(const Subtree *t, uint64_t hi, uint64_t lo);
+    inline uint16_t lookup_nexthop(uint64_t hi, uint64_t lo) const;
+    inline void lookup_burst(const uint64_t *hi, const uint64_t *lo, int n, uint16_t *nh) const;
+    int process_burst(Packet *p, int *outputs);
+
+    int nexthop_ref(const IP6Address &gw, int port);
+    void nexthop_unref(int nh);
+    static void free_nexthop(void *obj, void *arg);
+    static void free_subtree(void *obj, void *arg);
+
+    Prefix *find_route(uint64_t hi, uint64_t lo, int len);
+    int update(const Prefix &p);
+    int update_defaults(int first, int last, bool force = false);
+    int publish(int slot);
+    uintptr_t build_subtree(int slot);
+    static void build_node(Vector<Node> &nodes, Vector<uint16_t> &leaves, int ni,
+			   const Vector<const Prefix *> &routes, int offset, uint16_t dflt);
+
+    static int lookup_handler(int, String &, Element *, const Handler *, ErrorHandler *);
+    static String read_handler(Element *, void *);
+
+};
+
+inline unsigned
+PoptrieIP6Lookup::chunk(uint64_t hi, uint64_t lo, int offset)
+{
+    // Offsets are 16 + 6k, so a chunk never straddles hi and lo. The
+    // last chunk, at 124, is padded with zero bits.
+    if (offset < 64)
+	return (hi >> (58 - offset)) & 63;
+    else if (offset <= 122)
+	return (lo >> (122 - offset)) & 63;
+    else
+	return (lo << (offset - 122)) & 63;
+}
+
+inline void
+PoptrieIP6Lookup::split(const IP6Address &a, uint64_t &hi, uint64_t &lo)
+{
+    const uint32_t *d = a.data32();
+    hi = ((uint64_t) ntohl(d[0]) << 32) | ntohl(d[1]);
+    lo = ((uint64_t) ntohl(d[2]) << 32) | ntohl(d[3]);
+}
+
+inline uint16_t
+PoptrieIP6Lookup::walk(const Subtree *t, uint64_t hi, uint64_t lo)
+{
+    const Node *nodes = t->nodes();
+    const Node *n = nodes;
+    for (int o = direct_bits; ; o += stride) {
+	unsigned c = chunk(hi, lo, o);
+	uint64_t below = (2ULL << c) - 1;
+	if (!(n->vector & (1ULL << c)))
+	    return t->leaves()[n->base0 + __builtin_popcountll(n->leafvec & below) - 1];
+	n = &nodes[n->base1 + __builtin_popcountll(n->vector & below) - 1];
+    }
+}
+
+inline uint16_t
+PoptrieIP6Lookup::lookup_nexthop(uint64_t hi, uint64_t lo) const
+{
+    uintptr_t e = _direct[hi >> (64 - direct_bits)];
+    if (e & 1)
+	return e >> 1;
+    return walk(reinterpret_cast<const Subtree *>(e), hi, lo);
+}
+
+/**
+ * Look up @a n <= burst_size addresses. The tries are walked one level at a
+ * time for all the addresses, and the nodes of the next level are
+ * prefetched, so the cache misses of the burst overlap instead of adding up.
+ */
+inline void
+PoptrieIP6Lookup::lookup_burst(const uint64_t *hi, const uint64_t *lo, int n, uint16_t *nh) const
+{
+    const Subtree *t[burst_size];
+    const Node *node[burst_size];
+    const uint16_t *leaf[burst_size];
+    int active[burst_size];
+    int nactive = 0;
+
+    for (int i = 0; i < n; i++)
+	__builtin_prefetch((const void *) &_direct[hi[i] >> (64 - direct_bits)]);
+    for (int i = 0; i < n; i++) {
+	uintptr_t e = _direct[hi[i] >> (64 - direct_bits)];
+	if (e & 1) {
+	    nh[i] = e >> 1;
+	    leaf[i] = &nh[i];
+	} else {
+	    t[i] = reinterpret_cast<const Subtree *>(e);
+	    node[i] = t[i]->nodes();
+	    __builtin_prefetch(node[i]);
+	    active[nactive++] = i;
+	}
+    }
+
+    for (int o = direct_bits; nactive; o += stride) {
+	int k = 0;
+	for (int j = 0; j < nactive; j++) {
+	    int i = active[j];
+	    const Node *x = node[i];
+	    unsigned c = chunk(hi[i], lo[i], o);
+	    uint64_t below = (2ULL << c) - 1;
+	    if (x->vector & (1ULL << c)) {
+		node[i] = &t[i]->nodes()[x->base1 + __builtin_popcountll(x->vector & below) - 1];
+		__builtin_prefetch(node[i]);
+		active[k++] = i;
+	    } else {
+		leaf[i] = &t[i]->leaves()[x->base0 + __builtin_popcountll(x->leafvec & below) - 1];
+		__builtin_prefetch(leaf[i]);
+	    }
+	}
+	nactive = k;
+    }
+
+    for (int i = 0; i < n; i++)
+	nh[i] = *leaf[i];
+}
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,553 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * aesgcm.{cc,hh} -- batched AES-GCM for IPsec ESP (RFC 4106)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "aesgcm.hh"
+#if defined(__AES__) && defined(__PCLMUL__) && defined(__SSSE3__)
+# include <immintrin.h>
+# define AESGCM_NI 1
+# if defined(__VAES__) && defined(__VPCLMULQDQ__) && defined(__AVX512F__) && defined(__AVX512BW__)
+#  define AESGCM_VAES 1
+# endif
+#endif
+CLICK_DECLS
+
+/* A lane is the unit of work of the AES rounds: one counter block, or four
+ * with VAES, of a single job. */
+struct AESGCM::Lane {
+    const AESGCM *gcm;
+    const uint8_t *base;	// salt, IV, and a zero counter
+    uint32_t ctr;
+    const uint8_t *in;
+    uint8_t *out;
+    int len;
+};
+
+#if AESGCM_VAES
+enum { LANE_BYTES = 64, LANES = 4 };
+#elif AESGCM_NI
+enum { LANE_BYTES = 16, LANES = 8 };
+#else
+enum { LANE_BYTES = 16, LANES = 4 };
+#endif
+
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static inline uint8_t
+xtime(uint8_t x)
+{
+    return (x << 1) ^ (x & 0x80 ? 0x1b : 0);
+}
+
+int
+AESGCM::set_key(const uint8_t *key, int key_len, const uint8_t *salt)
+{
+    if (key_len != 16 && key_len != 32)
+	return -1;
+
+    // FIPS-197 key expansion; the round keys are in the byte order AES-NI
+    // expects
+    int nk = key_len / 4, nr = nk + 6;
+    uint8_t *w = &_rk[0][0];
+    uint8_t rcon = 1;
+    memcpy(w, key, key_len);
+    for (int i = nk; i < 4 * (nr + 1); ++i) {
+	uint8_t t[4];
+	memcpy(t, w + 4 * (i - 1), 4);
+	if (i % nk == 0) {
+	    uint8_t u = t[0];
+	    t[0] = aes_sbox[t[1]] ^ rcon;
+	    t[1] = aes_sbox[t[2]];
+	    t[2] = aes_sbox[t[3]];
+	    t[3] = aes_sbox[u];
+	    rcon = xtime(rcon);
+	} else if (nk > 6 && i % nk == 4)
+	    for (int k = 0; k < 4; ++k)
+		t[k] = aes_sbox[t[k]];
+	for (int k = 0; k < 4; ++k)
+	    w[4 * i + k] = w[4 * (i - nk) + k] ^ t[k];
+    }
+    _rounds = nr;
+    memcpy(_salt, salt, SALT_SIZE);
+
+    // H = E(K, 0^128)
+    uint8_t zero[BLOCK_SIZE], h[BLOCK_SIZE];
+    memset(zero, 0, sizeof(zero));
+    Lane l = {this, zero, 0, zero, h, BLOCK_SIZE};
+    ctr_lanes(&l, 1);
+    init_hpowers(h);
+    return 0;
+}
+
+#if AESGCM_NI
+
+static inline __m128i
+bswap128(__m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+/* GHASH works on byte-reflected blocks, as in Intel's "Carry-Less
+ * Multiplication Instruction and its Usage for Computing the GCM Mode". The
+ * 256-bit products of several blocks are summed before a single reduction. */
+static inline void
+clmul_acc(__m128i a, __m128i b, __m128i &lo, __m128i &mid, __m128i &hi)
+{
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, b, 0x00));
+    hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, b, 0x11));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x10));
+    mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(a, b, 0x01));
+}
+
+static inline __m128i
+ghash_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // shift the product left by one bit to account for the reflection
+    __m128i c_lo = _mm_srli_epi32(lo, 31), c_hi = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i c = _mm_srli_si128(c_lo, 12);
+    c_hi = _mm_slli_si128(c_hi, 4);
+    c_lo = _mm_slli_si128(c_lo, 4);
+    lo = _mm_or_si128(lo, c_lo);
+    hi = _mm_or_si128(hi, _mm_or_si128(c_hi, c));
+
+    // reduce modulo x^128 + x^7 + x^2 + x + 1
+    __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+			      _mm_slli_epi32(lo, 25));
+    __m128i b = _mm_srli_si128(a, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+    __m128i d = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+			      _mm_xor_si128(_mm_srli_epi32(lo, 7), b));
+    return _mm_xor_si128(hi, _mm_xor_si128(lo, d));
+}
+
+static inline __m128i
+gfmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    clmul_acc(a, b, lo, mid, hi);
+    return ghash_reduce(lo, mid, hi);
+}
+
+# if AESGCM_VAES
+/* The zero-masking forms avoid spurious -Wmaybe-uninitialized warnings from
+ * the GCC intrinsics that take an undefined source. */
+static inline __m512i
+broadcast128(const uint8_t *p)
+{
+    return _mm512_maskz_broadcast_i32x4((__mmask16) -1, _mm_loadu_si128((const __m128i *) p));
+}
+
+static inline __m128i
+fold512(__m512i v)
+{
+    v = _mm512_xor_si512(v, _mm512_maskz_shuffle_i64x2((__mmask8) -1, v, v, 0x4E));
+    v = _mm512_xor_si512(v, _mm512_maskz_shuffle_i64x2((__mmask8) -1, v, v, 0xB1));
+    return _mm512_maskz_extracti32x4_epi32((__mmask8) -1, v, 0);
+}
+# endif
+
+void
+AESGCM::init_hpowers(const uint8_t *h)
+{
+    __m128i hh = bswap128(_mm_loadu_si128((const __m128i *) h)), p = hh;
+    _mm_storeu_si128((__m128i *) _hpow[HPOWERS - 1], p);
+    for (int i = HPOWERS - 2; i >= 0; --i) {
+	p = gfmul(p, hh);
+	_mm_storeu_si128((__m128i *) _hpow[i], p);
+    }
+}
+
+void
+AESGCM::ghash(uint8_t *xp, const uint8_t *data, int len) const
+{
+    __m128i x = _mm_loadu_si128((const __m128i *) xp);
+# if AESGCM_VAES
+    if (len >= 16 * BLOCK_SIZE) {
+	static const uint8_t bswap_mask[16] = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+	const __m512i bswap = broadcast128(bswap_mask);
+	__m512i h0 = _mm512_loadu_si512(_hpow[0]), h1 = _mm512_loadu_si512(_hpow[4]),
+	    h2 = _mm512_loadu_si512(_hpow[8]), h3 = _mm512_loadu_si512(_hpow[12]);
+	do {
+	    __m512i d0 = _mm512_shuffle_epi8(_mm512_loadu_si512(data), bswap),
+		d1 = _mm512_shuffle_epi8(_mm512_loadu_si512(data + 64), bswap),
+		d2 = _mm512_shuffle_epi8(_mm512_loadu_si512(data + 128), bswap),
+		d3 = _mm512_shuffle_epi8(_mm512_loadu_si512(data + 192), bswap);
+	    d0 = _mm512_xor_si512(d0, _mm512_zextsi128_si512(x));
+	    __m512i lo = _mm512_xor_si512(
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d0, h0, 0x00), _mm512_clmulepi64_epi128(d1, h1, 0x00)),
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d2, h2, 0x00), _mm512_clmulepi64_epi128(d3, h3, 0x00)));
+	    __m512i hi = _mm512_xor_si512(
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d0, h0, 0x11), _mm512_clmulepi64_epi128(d1, h1, 0x11)),
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d2, h2, 0x11), _mm512_clmulepi64_epi128(d3, h3, 0x11)));
+	    __m512i mid = _mm512_xor_si512(
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d0, h0, 0x10), _mm512_clmulepi64_epi128(d1, h1, 0x10)),
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d2, h2, 0x10), _mm512_clmulepi64_epi128(d3, h3, 0x10)));
+	    mid = _mm512_xor_si512(mid, _mm512_xor_si512(
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d0, h0, 0x01), _mm512_clmulepi64_epi128(d1, h1, 0x01)),
+		_mm512_xor_si512(_mm512_clmulepi64_epi128(d2, h2, 0x01), _mm512_clmulepi64_epi128(d3, h3, 0x01))));
+	    x = ghash_reduce(fold512(lo), fold512(mid), fold512(hi));
+	    data += 16 * BLOCK_SIZE;
+	    len -= 16 * BLOCK_SIZE;
+	} while (len >= 16 * BLOCK_SIZE);
+    }
+# endif
+    if (len >= 4 * BLOCK_SIZE) {
+	__m128i h4 = _mm_loadu_si128((const __m128i *) _hpow[HPOWERS - 4]),
+	    h3 = _mm_loadu_si128((const __m128i *) _hpow[HPOWERS - 3]),
+	    h2 = _mm_loadu_si128((const __m128i *) _hpow[HPOWERS - 2]),
+	    h1 = _mm_loadu_si128((const __m128i *) _hpow[HPOWERS - 1]);
+	do {
+	    const __m128i *d = (const __m128i *) data;
+	    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+	    clmul_acc(_mm_xor_si128(x, bswap128(_mm_loadu_si128(d))), h4, lo, mid, hi);
+	    clmul_acc(bswap128(_mm_loadu_si128(d + 1)), h3, lo, mid, hi);
+	    clmul_acc(bswap128(_mm_loadu_si128(d + 2)), h2, lo, mid, hi);
+	    clmul_acc(bswap128(_mm_loadu_si128(d + 3)), h1, lo, mid, hi);
+	    x = ghash_reduce(lo, mid, hi);
+	    data += 4 * BLOCK_SIZE;
+	    len -= 4 * BLOCK_SIZE;
+	} while (len >= 4 * BLOCK_SIZE);
+    }
+    __m128i h1 = _mm_loadu_si128((const __m128i *) _hpow[HPOWERS - 1]);
+    for (; len > 0; data += BLOCK_SIZE, len -= BLOCK_SIZE) {
+	__m128i d;
+	if (len >= BLOCK_SIZE)
+	    d = _mm_loadu_si128((const __m128i *) data);
+	else {
+	    uint8_t tmp[BLOCK_SIZE];
+	    memset(tmp, 0, sizeof(tmp));
+	    memcpy(tmp, data, len);
+	    d = _mm_loadu_si128((const __m128i *) tmp);
+	}
+	x = gfmul(_mm_xor_si128(x, bswap128(d)), h1);
+    }
+    _mm_storeu_si128((__m128i *) xp, x);
+}
+
+void
+AESGCM::ghash_final(const uint8_t *x, uint8_t *s)
+{
+    _mm_storeu_si128((__m128i *) s, bswap128(_mm_loadu_si128((const __m128i *) x)));
+}
+
+# if AESGCM_VAES
+
+void
+AESGCM::ctr_lanes(const Lane *l, int n)
+{
+    __m512i b[LANES];
+    int maxr = 0;
+    for (int i = 0; i < n; ++i) {
+	uint32_t c = l[i].ctr;
+	__m512i ctr = _mm512_setr_epi32(0, 0, 0, __builtin_bswap32(c), 0, 0, 0, __builtin_bswap32(c + 1),
+					0, 0, 0, __builtin_bswap32(c + 2), 0, 0, 0, __builtin_bswap32(c + 3));
+	b[i] = _mm512_or_si512(broadcast128(l[i].base), ctr);
+	b[i] = _mm512_xor_si512(b[i], broadcast128(l[i].gcm->_rk[0]));
+	if (l[i].gcm->_rounds > maxr)
+	    maxr = l[i].gcm->_rounds;
+    }
+    for (int r = 1; r < maxr; ++r)
+	for (int i = 0; i < n; ++i)
+	    if (r < l[i].gcm->_rounds)
+		b[i] = _mm512_aesenc_epi128(b[i], broadcast128(l[i].gcm->_rk[r]));
+    for (int i = 0; i < n; ++i) {
+	const AESGCM *g = l[i].gcm;
+	b[i] = _mm512_aesenclast_epi128(b[i], broadcast128(g->_rk[g->_rounds]));
+	if (l[i].len == LANE_BYTES)
+	    _mm512_storeu_si512(l[i].out, _mm512_xor_si512(b[i], _mm512_loadu_si512(l[i].in)));
+	else {
+	    __mmask64 m = (((__mmask64) 1) << l[i].len) - 1;
+	    _mm512_mask_storeu_epi8(l[i].out, m, _mm512_xor_si512(b[i], _mm512_maskz_loadu_epi8(m, l[i].in)));
+	}
+    }
+}
+
+# else
+
+void
+AESGCM::ctr_lanes(const Lane *l, int n)
+{
+    __m128i b[LANES];
+    int maxr = 0;
+    for (int i = 0; i < n; ++i) {
+	__m128i ctr = _mm_setr_epi32(0, 0, 0, __builtin_bswap32(l[i].ctr));
+	b[i] = _mm_or_si128(_mm_loadu_si128((const __m128i *) l[i].base), ctr);
+	b[i] = _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i *) l[i].gcm->_rk[0]));
+	if (l[i].gcm->_rounds > maxr)
+	    maxr = l[i].gcm->_rounds;
+    }
+    for (int r = 1; r < maxr; ++r)
+	for (int i = 0; i < n; ++i)
+	    if (r < l[i].gcm->_rounds)
+		b[i] = _mm_aesenc_si128(b[i], _mm_loadu_si128((const __m128i *) l[i].gcm->_rk[r]));
+    for (int i = 0; i < n; ++i) {
+	const AESGCM *g = l[i].gcm;
+	b[i] = _mm_aesenclast_si128(b[i], _mm_loadu_si128((const __m128i *) g->_rk[g->_rounds]));
+	if (l[i].len == BLOCK_SIZE)
+	    _mm_storeu_si128((__m128i *) l[i].out, _mm_xor_si128(b[i], _mm_loadu_si128((const __m128i *) l[i].in)));
+	else {
+	    uint8_t ks[BLOCK_SIZE];
+	    _mm_storeu_si128((__m128i *) ks, b[i]);
+	    for (int k = 0; k < l[i].len; ++k)
+		l[i].out[k] = l[i].in[k] ^ ks[k];
+	}
+    }
+}
+
+# endif
+
+#else /* !AESGCM_NI */
+
+static void
+aes_encrypt(const uint8_t (*rk)[16], int nr, const uint8_t *in, uint8_t *out)
+{
+    uint8_t s[16], t[16];
+    for (int i = 0; i < 16; ++i)
+	s[i] = in[i] ^ rk[0][i];
+    for (int r = 1; r <= nr; ++r) {
+	// SubBytes and ShiftRows; byte i is row i % 4 of column i / 4
+	for (int c = 0; c < 4; ++c)
+	    for (int row = 0; row < 4; ++row)
+		t[c * 4 + row] = aes_sbox[s[((c + row) % 4) * 4 + row]];
+	if (r < nr)
+	    for (int c = 0; c < 4; ++c) {
+		uint8_t *a = t + c * 4;
+		uint8_t a0 = a[0], all = a[0] ^ a[1] ^ a[2] ^ a[3];
+		a[0] ^= all ^ xtime(a[0] ^ a[1]);
+		a[1] ^= all ^ xtime(a[1] ^ a[2]);
+		a[2] ^= all ^ xtime(a[2] ^ a[3]);
+		a[3] ^= all ^ xtime(a[3] ^ a0);
+	    }
+	for (int i = 0; i < 16; ++i)
+	    s[i] = t[i] ^ rk[r][i];
+    }
+    memcpy(out, s, 16);
+}
+
+void
+AESGCM::ctr_lanes(const Lane *l, int n)
+{
+    for (int i = 0; i < n; ++i) {
+	uint8_t block[BLOCK_SIZE];
+	memcpy(block, l[i].base, BLOCK_SIZE - 4);
+	block[12] = l[i].ctr >> 24;
+	block[13] = l[i].ctr >> 16;
+	block[14] = l[i].ctr >> 8;
+	block[15] = l[i].ctr;
+	aes_encrypt(l[i].gcm->_rk, l[i].gcm->_rounds, block, block);
+	for (int k = 0; k < l[i].len; ++k)
+	    l[i].out[k] = l[i].in[k] ^ block[k];
+    }
+}
+
+static inline uint64_t
+load_be64(const uint8_t *p)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < 8; ++i)
+	x = (x << 8) | p[i];
+    return x;
+}
+
+static inline void
+store_be64(uint8_t *p, uint64_t x)
+{
+    for (int i = 7; i >= 0; --i, x >>= 8)
+	p[i] = x;
+}
+
+void
+AESGCM::init_hpowers(const uint8_t *h)
+{
+    memcpy(_hpow[HPOWERS - 1], h, BLOCK_SIZE);
+}
+
+void
+AESGCM::ghash(uint8_t *xp, const uint8_t *data, int len) const
+{
+    // NIST SP 800-38D algorithm 1, one bit at a time
+    uint64_t xh = load_be64(xp), xl = load_be64(xp + 8);
+    uint64_t hh = load_be64(_hpow[HPOWERS - 1]), hl = load_be64(_hpow[HPOWERS - 1] + 8);
+    uint8_t tmp[BLOCK_SIZE];
+    for (; len > 0; data += BLOCK_SIZE, len -= BLOCK_SIZE) {
+	if (len < BLOCK_SIZE) {
+	    memset(tmp, 0, sizeof(tmp));
+	    memcpy(tmp, data, len);
+	    data = tmp;
+	}
+	xh ^= load_be64(data);
+	xl ^= load_be64(data + 8);
+	uint64_t zh = 0, zl = 0, vh = hh, vl = hl;
+	for (int i = 0; i < 128; ++i) {
+	    uint64_t bit = (i < 64 ? xh >> (63 - i) : xl >> (127 - i)) & 1;
+	    zh ^= vh & -bit;
+	    zl ^= vl & -bit;
+	    uint64_t lsb = vl & 1;
+	    vl = (vl >> 1) | (vh << 63);
+	    vh = (vh >> 1) ^ (-lsb & 0xE100000000000000ULL);
+	}
+	xh = zh;
+	xl = zl;
+    }
+    store_be64(xp, xh);
+    store_be64(xp + 8, xl);
+}
+
+void
+AESGCM::ghash_final(const uint8_t *x, uint8_t *s)
+{
+    memcpy(s, x, BLOCK_SIZE);
+}
+
+#endif
+
+const char *
+AESGCM::implementation()
+{
+#if AESGCM_VAES
+    return "vaes";
+#elif AESGCM_NI
+    return "aesni";
+#else
+    return "generic";
+#endif
+}
+
+void
+AESGCM::process(Job *jobs, int n, bool encrypt)
+{
+    static const uint8_t zero[BLOCK_SIZE] = {0};
+
+    for (; n > 0; jobs += MAX_JOBS, n -= MAX_JOBS) {
+	int m = n < MAX_JOBS ? n : MAX_JOBS;
+	uint8_t base[MAX_JOBS][BLOCK_SIZE];
+	uint8_t x[MAX_JOBS][BLOCK_SIZE];
+	uint8_t ekj0[MAX_JOBS][BLOCK_SIZE];
+	int pos[MAX_JOBS];
+	Lane lanes[LANES];
+
+	// counter block J0 of every job, and GHASH of the AAD
+	for (int j = 0; j < m; ++j) {
+	    const Job &job = jobs[j];
+	    memcpy(base[j], job.gcm->_salt, SALT_SIZE);
+	    memcpy(base[j] + SALT_SIZE, job.iv, IV_SIZE);
+	    memset(base[j] + SALT_SIZE + IV_SIZE, 0, 4);
+	    memset(x[j], 0, BLOCK_SIZE);
+	    job.gcm->ghash(x[j], job.aad, job.aad_len);
+	    pos[j] = 0;
+	}
+	for (int j = 0; j < m; j += LANES) {
+	    int nl = 0;
+	    for (int k = j; k < m && nl < LANES; ++k, ++nl) {
+		Lane &l = lanes[nl];
+		l.gcm = jobs[k].gcm;
+		l.base = base[k];
+		l.ctr = 1;
+		l.in = zero;
+		l.out = ekj0[k];
+		l.len = BLOCK_SIZE;
+	    }
+	    ctr_lanes(lanes, nl);
+	}
+
+	// payloads in lockstep: every step shares the lanes among the jobs
+	// that have data left
+	for (;;) {
+	    int active = 0;
+	    for (int j = 0; j < m; ++j)
+		active += pos[j] < jobs[j].len;
+	    if (!active)
+		break;
+	    int quota = active < LANES ? LANES / active : 1;
+
+	    int nl = 0, start[MAX_JOBS];
+	    for (int j = 0; j < m; ++j) {
+		const Job &job = jobs[j];
+		start[j] = pos[j];
+		for (int q = 0; q < quota && pos[j] < job.len && nl < LANES; ++q, ++nl) {
+		    int len = job.len - pos[j];
+		    Lane &l = lanes[nl];
+		    l.gcm = job.gcm;
+		    l.base = base[j];
+		    l.ctr = 2 + pos[j] / BLOCK_SIZE;
+		    l.in = job.in + pos[j];
+		    l.out = job.out + pos[j];
+		    l.len = len < LANE_BYTES ? len : LANE_BYTES;
+		    pos[j] += l.len;
+		}
+	    }
+	    if (!encrypt)
+		for (int j = 0; j < m; ++j)
+		    if (pos[j] > start[j])
+			jobs[j].gcm->ghash(x[j], jobs[j].in + start[j], pos[j] - start[j]);
+	    ctr_lanes(lanes, nl);
+	    if (encrypt)
+		for (int j = 0; j < m; ++j)
+		    if (pos[j] > start[j])
+			jobs[j].gcm->ghash(x[j], jobs[j].out + start[j], pos[j] - start[j]);
+	}
+
+	// lengths block, then ICV = E(J0) ^ GHASH
+	for (int j = 0; j < m; ++j) {
+	    Job &job = jobs[j];
+	    uint8_t lens[BLOCK_SIZE], s[BLOCK_SIZE];
+	    uint64_t abits = (uint64_t) job.aad_len * 8, cbits = (uint64_t) job.len * 8;
+	    for (int k = 7; k >= 0; --k, abits >>= 8, cbits >>= 8) {
+		lens[k] = abits;
+		lens[8 + k] = cbits;
+	    }
+	    job.gcm->ghash(x[j], lens, BLOCK_SIZE);
+	    ghash_final(x[j], s);
+	    if (encrypt) {
+		for (int k = 0; k < ICV_SIZE; ++k)
+		    job.icv[k] = s[k] ^ ekj0[j][k];
+		job.ok = true;
+	    } else {
+		uint8_t diff = 0;
+		for (int k = 0; k < ICV_SIZE; ++k)
+		    diff |= job.icv[k] ^ s[k] ^ ekj0[j][k];
+		job.ok = (diff == 0);
+	    }
+	}
+    }
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(AESGCM)
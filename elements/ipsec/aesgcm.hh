@@ -0,0 +1,78 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSEC_AESGCM_HH
+#define CLICK_IPSEC_AESGCM_HH
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+ * AESGCM -- AES-GCM authenticated encryption of ESP payloads (RFC 4106)
+ *
+ * An AESGCM holds the expanded AES-128 or AES-256 key of a security
+ * association, the powers of its GHASH key H, and its 4-byte salt. The nonce
+ * of a packet is the salt followed by the 8-byte IV carried in the packet.
+ * It is plain old data, so SADataTuple can hold and copy it; it is not
+ * initialized() until set_key() is called on zeroed memory.
+ *
+ * seal() and open() process a batch of independent jobs, possibly under
+ * different keys, in lockstep: the counter blocks of several packets go
+ * through the AES rounds together and GHASH aggregates four or sixteen
+ * blocks per reduction, so the latency of one packet's rounds is hidden by
+ * the others. The code is chosen at compile time: VAES and VPCLMULQDQ on
+ * AVX-512 registers, AES-NI and PCLMULQDQ, or a portable fallback.
+ */
+
+class AESGCM { public:
+
+    enum { SALT_SIZE = 4, IV_SIZE = 8, ICV_SIZE = 16, BLOCK_SIZE = 16,
+	   MAX_ROUNDS = 14, HPOWERS = 16, MAX_JOBS = 8 };
+
+    struct Job {
+	const AESGCM *gcm;
+	const uint8_t *iv;	// IV_SIZE bytes
+	const uint8_t *aad;	// at most BLOCK_SIZE bytes
+	int aad_len;
+	const uint8_t *in;
+	uint8_t *out;		// may be in
+	int len;
+	uint8_t *icv;		// ICV_SIZE bytes, written by seal, checked by open
+	bool ok;		// result of open
+    };
+
+    /** @brief Set the key, of 16 or 32 bytes, and the SALT_SIZE-byte salt.
+     * @return 0 on success, -1 if @a key_len is not supported */
+    int set_key(const uint8_t *key, int key_len, const uint8_t *salt);
+    bool initialized() const {
+	return _rounds != 0;
+    }
+
+    /** @brief Encrypt and authenticate @a n jobs. */
+    static void seal(Job *jobs, int n) {
+	process(jobs, n, true);
+    }
+    /** @brief Decrypt and verify @a n jobs, setting their ok member. */
+    static void open(Job *jobs, int n) {
+	process(jobs, n, false);
+    }
+
+    /** @brief Name of the compiled implementation. */
+    static const char *implementation();
+
+  private:
+
+    uint8_t _rk[MAX_ROUNDS + 1][BLOCK_SIZE];
+    uint8_t _hpow[HPOWERS][BLOCK_SIZE];	// H^16 ... H^1
+    uint8_t _salt[SALT_SIZE];
+    int _rounds;
+
+    struct Lane;
+
+    static void process(Job *jobs, int n, bool encrypt);
+    static void ctr_lanes(const Lane *lanes, int n);
+    void ghash(uint8_t *x, const uint8_t *data, int len) const;
+    static void ghash_final(const uint8_t *x, uint8_t *s);
+    void init_hpowers(const uint8_t *h);
+
+};
+
+CLICK_ENDDECLS
+#endif
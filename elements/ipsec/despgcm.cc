@@ -0,0 +1,182 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * despgcm.{cc,hh} -- IPsec ESP unencapsulation with AES-GCM (RFC 4106)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "despgcm.hh"
+#include "esp.hh"
+#include "aesgcm.hh"
+#include "sadatatuple.hh"
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecESPGCMUnencap::IPsecESPGCMUnencap()
+{
+    _drops = 0;
+    _replay_drops = 0;
+    _auth_drops = 0;
+}
+
+IPsecESPGCMUnencap::~IPsecESPGCMUnencap()
+{
+}
+
+inline void
+IPsecESPGCMUnencap::drop(Packet *p)
+{
+    _drops++;
+    p->kill();
+}
+
+/* Checks the association, the length and the sequence number, and makes the
+ * packet writable for in-place decryption. */
+inline Packet *
+IPsecESPGCMUnencap::check(Packet *p)
+{
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    if (!sa || !sa->gcm.initialized()
+	|| p->length() < sizeof(esp_new) + 2 + AESGCM::ICV_SIZE) {
+	drop(p);
+	return 0;
+    }
+    const esp_new *esp = reinterpret_cast<const esp_new *>(p->data());
+    if (!sa->replay_check(ntohl(esp->esp_rpl))) {
+	_replay_drops++;
+	drop(p);
+	return 0;
+    }
+    WritablePacket *q = p->uniqueify();
+    if (!q)
+	_drops++;
+    return q;
+}
+
+static inline void
+make_job(AESGCM::Job &job, Packet *p)
+{
+    WritablePacket *q = static_cast<WritablePacket *>(p);
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(q);
+    job.gcm = &sa->gcm;
+    job.iv = q->data() + 8;
+    job.aad = q->data();
+    job.aad_len = 8;
+    job.in = job.out = q->data() + sizeof(esp_new);
+    job.len = q->length() - sizeof(esp_new) - AESGCM::ICV_SIZE;
+    job.icv = q->end_data() - AESGCM::ICV_SIZE;
+}
+
+/* Runs once the packet is decrypted; the association annotation is cleared
+ * if authentication failed. */
+inline Packet *
+IPsecESPGCMUnencap::unencap(Packet *p)
+{
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    if (!sa) {
+	if (_auth_drops == 0)
+	    click_chatter("%p{element}: invalid ICV", this);
+	_auth_drops++;
+	drop(p);
+	return 0;
+    }
+
+    // check again: the batch may hold two packets with this sequence number
+    uint32_t seq = ntohl(reinterpret_cast<const esp_new *>(p->data())->esp_rpl);
+    if (!sa->replay_check(seq)) {
+	_replay_drops++;
+	drop(p);
+	return 0;
+    }
+    sa->replay_update(seq);
+
+    int len = p->length() - AESGCM::ICV_SIZE;
+    int padding = p->data()[len - 2];
+    if (sizeof(esp_new) + padding + 2 > (unsigned) len) {
+	drop(p);
+	return 0;
+    }
+    p->pull(sizeof(esp_new));
+    p->take(padding + 2 + AESGCM::ICV_SIZE);
+    return p;
+}
+
+Packet *
+IPsecESPGCMUnencap::simple_action(Packet *p)
+{
+    if (!(p = check(p)))
+	return 0;
+    AESGCM::Job job;
+    make_job(job, p);
+    AESGCM::open(&job, 1);
+    if (!job.ok)
+	SET_IPSEC_SA_DATA_REFERENCE_ANNO(p, 0);
+    return unencap(p);
+}
+
+#if HAVE_BATCH
+PacketBatch *
+IPsecESPGCMUnencap::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(check, batch, [](Packet *){});
+    if (!batch)
+	return 0;
+
+    AESGCM::Job jobs[AESGCM::MAX_JOBS];
+    Packet *packets[AESGCM::MAX_JOBS];
+    int n = 0;
+    FOR_EACH_PACKET(batch, p) {
+	make_job(jobs[n], p);
+	packets[n] = p;
+	if (++n == AESGCM::MAX_JOBS || !p->next()) {
+	    AESGCM::open(jobs, n);
+	    for (int i = 0; i < n; ++i)
+		if (!jobs[i].ok)
+		    SET_IPSEC_SA_DATA_REFERENCE_ANNO(packets[i], 0);
+	    n = 0;
+	}
+    }
+
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(unencap, batch, [](Packet *){});
+    return batch;
+}
+#endif
+
+String
+IPsecESPGCMUnencap::read_handler(Element *e, void *thunk)
+{
+    IPsecESPGCMUnencap *u = static_cast<IPsecESPGCMUnencap *>(e);
+    switch ((intptr_t) thunk) {
+    case 1:
+	return String(u->_replay_drops.value());
+    case 2:
+	return String(u->_auth_drops.value());
+    default:
+	return String(u->_drops.value());
+    }
+}
+
+void
+IPsecESPGCMUnencap::add_handlers()
+{
+    add_read_handler("drops", read_handler, 0);
+    add_read_handler("replay_drops", read_handler, 1);
+    add_read_handler("auth_drops", read_handler, 2);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM)
+EXPORT_ELEMENT(IPsecESPGCMUnencap)
+ELEMENT_MT_SAFE(IPsecESPGCMUnencap)
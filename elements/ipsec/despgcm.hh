@@ -0,0 +1,77 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSEC_DESPGCM_HH
+#define CLICK_IPSEC_DESPGCM_HH
+#include <click/batchelement.hh>
+#include <click/atomic.hh>
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+=c
+
+IPsecESPGCMUnencap()
+
+=s ipsec
+
+remove IPsec ESP encapsulation with AES-GCM
+
+=d
+
+Verifies, decrypts, and removes the AES-GCM ESP encapsulation added by
+IPsecESPGCMEncap, as in RFC 4106. The Security Association annotation must
+have been set, for instance by RadixIPsecLookup.
+
+The sequence number of each packet is checked against the anti-replay window
+of the association before the ICV is verified, and the window only moves
+once the packet is authenticated. The window size is the OOSIZE of the
+association, up to 1024 packets. Packets that are replayed, too old, fail
+authentication, or have a bad trailer are dropped.
+
+Packets are handled a batch at a time, with the AES rounds and GHASH of
+several packets interleaved, like IPsecESPGCMEncap.
+
+=h drops read-only
+
+Number of packets dropped.
+
+=h replay_drops read-only
+
+Number of packets dropped by the anti-replay check.
+
+=h auth_drops read-only
+
+Number of packets dropped because their ICV did not match.
+
+=a IPsecESPGCMEncap, IPsecESPUnencap, RadixIPsecLookup */
+
+class IPsecESPGCMUnencap : public BatchElement { public:
+
+    IPsecESPGCMUnencap() CLICK_COLD;
+    ~IPsecESPGCMUnencap() CLICK_COLD;
+
+    const char *class_name() const override	{ return "IPsecESPGCMUnencap"; }
+    const char *port_count() const override	{ return PORTS_1_1; }
+
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
+
+  private:
+
+    atomic_uint32_t _drops;
+    atomic_uint32_t _replay_drops;
+    atomic_uint32_t _auth_drops;
+
+    inline Packet *check(Packet *p);
+    inline Packet *unencap(Packet *p);
+    inline void drop(Packet *p);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -18,7 +18,9 @@ CLICK_DECLS
  * RFC 2406: pad[0] = 1, pad[1] = 2, pad[2] = 3, etc.
  *
  * The ESP header added to the packet includes the 32 bit SPI, 32 bit replay
- * counter, and 64 bit Integrity Vector (IV).
+ * counter, and 64 bit Integrity Vector (IV). Packets are dropped once the
+ * replay counter of their Security Association is exhausted, as it may not
+ * wrap.
  *
  * =a IPsecESPUnencap, IPsecAuthSHA1, IPsecDES
  */
@@ -0,0 +1,145 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * espgcm.{cc,hh} -- IPsec ESP encapsulation with AES-GCM (RFC 4106)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "espgcm.hh"
+#include "esp.hh"
+#include "aesgcm.hh"
+#include "sadatatuple.hh"
+#include <clicknet/ip.h>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecESPGCMEncap::IPsecESPGCMEncap()
+{
+    _drops = 0;
+}
+
+IPsecESPGCMEncap::~IPsecESPGCMEncap()
+{
+}
+
+inline Packet *
+IPsecESPGCMEncap::encap(Packet *p)
+{
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(p);
+    uint32_t seq;
+    if (!sa || !sa->gcm.initialized() || !(seq = sa->next_seq())) {
+	if (_drops == 0)
+	    click_chatter("%p{element}: no Security Association, or sequence number exhausted", this);
+	_drops++;
+	p->kill();
+	return 0;
+    }
+    uint8_t ip_p = p->has_network_header() ? p->ip_header()->ip_p : 0;
+    uint32_t spi = IPSEC_SPI_ANNO(p);
+
+    // pad the payload and its 2 trailer bytes to a multiple of 4 bytes
+    int plen = p->length();
+    int padding = ((4 - ((plen + 2) & 3)) & 3) + 2;
+
+    WritablePacket *q = p->push(sizeof(esp_new));
+    if (q)
+	q = q->put(padding + AESGCM::ICV_SIZE);
+    if (!q) {
+	_drops++;
+	return 0;
+    }
+
+    esp_new *esp = reinterpret_cast<esp_new *>(q->data());
+    esp->esp_spi = htonl(spi);
+    esp->esp_rpl = htonl(seq);
+    memcpy(&esp->esp_iv[0], &esp->esp_spi, 4);
+    memcpy(&esp->esp_iv[4], &esp->esp_rpl, 4);
+
+    uint8_t *pad = q->data() + sizeof(esp_new) + plen;
+    for (int i = 0; i < padding - 2; i++)
+	pad[i] = i + 1;
+    pad[padding - 2] = padding - 2;
+    pad[padding - 1] = ip_p;
+    return q;
+}
+
+static inline void
+make_job(AESGCM::Job &job, Packet *p)
+{
+    WritablePacket *q = static_cast<WritablePacket *>(p);
+    SADataTuple *sa = (SADataTuple *) IPSEC_SA_DATA_REFERENCE_ANNO(q);
+    job.gcm = &sa->gcm;
+    job.iv = q->data() + 8;
+    job.aad = q->data();
+    job.aad_len = 8;
+    job.in = job.out = q->data() + sizeof(esp_new);
+    job.len = q->length() - sizeof(esp_new) - AESGCM::ICV_SIZE;
+    job.icv = q->end_data() - AESGCM::ICV_SIZE;
+}
+
+Packet *
+IPsecESPGCMEncap::simple_action(Packet *p)
+{
+    if ((p = encap(p))) {
+	AESGCM::Job job;
+	make_job(job, p);
+	AESGCM::seal(&job, 1);
+    }
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+IPsecESPGCMEncap::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(encap, batch, [](Packet *){});
+    if (!batch)
+	return 0;
+
+    AESGCM::Job jobs[AESGCM::MAX_JOBS];
+    int n = 0;
+    FOR_EACH_PACKET(batch, p) {
+	make_job(jobs[n], p);
+	if (++n == AESGCM::MAX_JOBS) {
+	    AESGCM::seal(jobs, n);
+	    n = 0;
+	}
+    }
+    if (n)
+	AESGCM::seal(jobs, n);
+    return batch;
+}
+#endif
+
+String
+IPsecESPGCMEncap::read_handler(Element *e, void *thunk)
+{
+    IPsecESPGCMEncap *ee = static_cast<IPsecESPGCMEncap *>(e);
+    if (thunk)
+	return AESGCM::implementation();
+    return String(ee->_drops.value());
+}
+
+void
+IPsecESPGCMEncap::add_handlers()
+{
+    add_read_handler("drops", read_handler, 0);
+    add_read_handler("implementation", read_handler, 1);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(AESGCM)
+EXPORT_ELEMENT(IPsecESPGCMEncap)
+ELEMENT_MT_SAFE(IPsecESPGCMEncap)
@@ -0,0 +1,78 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPSEC_ESPGCM_HH
+#define CLICK_IPSEC_ESPGCM_HH
+#include <click/batchelement.hh>
+#include <click/atomic.hh>
+#include <click/glue.hh>
+CLICK_DECLS
+
+/*
+=c
+
+IPsecESPGCMEncap()
+
+=s ipsec
+
+apply IPsec ESP encapsulation with AES-GCM
+
+=d
+
+Encapsulates and encrypts packets with IPsec ESP using AES-GCM, as in RFC
+4106. Like IPsecESPEncap, it expects the SPI and Security Association
+annotations set by an IPsecRouteTable element such as RadixIPsecLookup.
+
+The ESP header holds the SPI, the sequence number of the association, and an
+8-byte IV made of the SPI and the sequence number, so IVs never repeat while
+the association lives. The payload is padded to a multiple of 4 bytes with
+the default padding of RFC 4303, followed by the pad length and the next
+header, then encrypted with the association's ENCRYPT_KEY as AES-128 key and
+the first 4 bytes of its AUTH_KEY as salt. A 16-byte ICV is appended.
+
+Packets are handled a batch at a time: the AES rounds and GHASH of several
+packets are interleaved, with AES-NI and PCLMULQDQ, or VAES and VPCLMULQDQ
+on AVX-512 registers, when Click is compiled for a CPU that supports them.
+
+Packets without a Security Association are dropped, as are packets once the
+sequence number of their association is exhausted: the association must be
+rekeyed.
+
+IPsecESPGCMEncap is thread safe if each Security Association is only used
+by one thread.
+
+=h drops read-only
+
+Number of packets dropped.
+
+=h implementation read-only
+
+AES-GCM implementation in use: "vaes", "aesni", or "generic".
+
+=a IPsecESPGCMUnencap, IPsecESPEncap, RadixIPsecLookup */
+
+class IPsecESPGCMEncap : public BatchElement { public:
+
+    IPsecESPGCMEncap() CLICK_COLD;
+    ~IPsecESPGCMEncap() CLICK_COLD;
+
+    const char *class_name() const override	{ return "IPsecESPGCMEncap"; }
+    const char *port_count() const override	{ return PORTS_1_1; }
+
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
+
+  private:
+
+    atomic_uint32_t _drops;
+
+    inline Packet *encap(Packet *p);
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
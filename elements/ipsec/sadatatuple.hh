@@ -5,6 +5,7 @@
 #include <click/etheraddress.hh>
 #include <click/bighashmap.hh>
 #include <click/glue.hh>
+#include "aesgcm.hh"
 CLICK_DECLS
 
 /*
@@ -77,25 +78,71 @@ class SADataTuple {
     /*These fields below deal with replay protection*/
     uint32_t replay_start_counter;
     uint32_t cur_rpl;
-    uint8_t  ooowin;	/* out-of-order window size */
-    uint32_t bitmap;	/* Support out-of-order receive support */
+    uint32_t ooowin;	/* out-of-order window size */
     uint32_t lastseq;	/* in host order */
+    /* Sequence numbers seen, a ring of bits indexed by sequence number
+       (RFC 6479), so sliding the window only clears whole words */
+    enum { REPLAY_WORDS = 32, REPLAY_WINDOW_MAX = 1024 };
+    uint64_t bitmap[REPLAY_WORDS];
+    /* AES-GCM context: Encryption_key, salted with the first 4 bytes of
+       Authentication_key */
+    AESGCM gcm;
 
     SADataTuple() {
 	memset(this, 0, sizeof(*this));
     }
 
-    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint8_t o_oowin)
+    SADataTuple(const void * enc_key , const void * Auth_key, uint32_t counter, uint32_t o_oowin)
      {
 		memset(this, 0, sizeof(*this));
 		memcpy(Encryption_key, enc_key, KEY_SIZE);
 		memcpy(Authentication_key, Auth_key, KEY_SIZE);
 		replay_start_counter = counter;
-		ooowin = o_oowin;
-	        bitmap=0;
+		ooowin = o_oowin < (uint32_t) REPLAY_WINDOW_MAX ? o_oowin : (uint32_t) REPLAY_WINDOW_MAX;
 		lastseq=cur_rpl=counter;
+		gcm.set_key(Encryption_key, KEY_SIZE, Authentication_key);
      }
 
+    /* Take the next outbound sequence number. Encapsulators may run on
+       several threads for the same SA, so it is taken atomically. Returns 0
+       once all numbers were used: they must not wrap, as the receiver would
+       drop them as replays, and GCM nonces would repeat. */
+    uint32_t next_seq()
+    {
+	uint32_t seq = cur_rpl;
+	while (seq && !__atomic_compare_exchange_n(&cur_rpl, &seq, seq + 1, false,
+						   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    /* seq was reloaded */;
+	return seq;
+    }
+
+    /* Anti-replay check of RFC 4303 section 3.4.3. replay_check() tells
+       whether sequence number seq is new and not too old; call
+       replay_update() once the packet is authenticated. */
+    bool replay_check(uint32_t seq) const
+    {
+	if (seq == 0)
+	    return false;
+	if (seq > lastseq)
+	    return true;
+	if (lastseq - seq >= ooowin)
+	    return false;
+	return !(bitmap[(seq >> 6) % REPLAY_WORDS] & (1ULL << (seq & 63)));
+    }
+
+    void replay_update(uint32_t seq)
+    {
+	if (seq > lastseq) {
+	    uint32_t w = lastseq >> 6, diff = (seq >> 6) - w;
+	    if (diff > REPLAY_WORDS)
+		diff = REPLAY_WORDS;
+	    for (uint32_t i = 1; i <= diff; ++i)
+		bitmap[(w + i) % REPLAY_WORDS] = 0;
+	    lastseq = seq;
+	}
+	bitmap[(seq >> 6) % REPLAY_WORDS] |= 1ULL << (seq & 63);
+    }
+
      operator bool() const
      {
          return ((cur_rpl != 0));
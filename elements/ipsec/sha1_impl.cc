@@ -57,6 +57,9 @@
  */
 #include <click/config.h>
 #include "sha1_impl.hh"
+#if defined(__SHA__) && defined(__SSE4_1__)
+# include <immintrin.h>
+#endif
 CLICK_DECLS
 
 
@@ -476,7 +479,192 @@ SHA1_transform (SHA1_ctx *c, unsigned char *b)
   sha1_block (c, p, 64);
 }
 
-#ifndef SHA1_ASM
+#if !defined(SHA1_ASM) && defined(__SHA__) && defined(__SSE4_1__)
+
+static inline __m128i
+sha1_load (const unsigned long *W)
+{
+#if SIZEOF_LONG == 8
+  __m128 lo = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) W));
+  __m128 hi = _mm_castsi128_ps (_mm_loadu_si128 ((const __m128i *) (W + 2)));
+  /* W[0] in the most significant lane, W[3] in the least */
+  return _mm_castps_si128 (_mm_shuffle_ps (hi, lo, _MM_SHUFFLE (0, 2, 0, 2)));
+#else
+  return _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *) W), 0x1B);
+#endif
+}
+
+/* SHA-NI version. W holds the 16 words of each block, already in host order
+ * but in unsigned longs, so the low halves are gathered with shuffles rather
+ * than byte swapped; so is the state, h0 to h3 being consecutive. The
+ * gathering is explicit: left to the vectorizer it goes through 256-bit
+ * registers, and the SHA instructions, which have no VEX form, then pay an
+ * SSE/AVX transition on every block. */
+void
+sha1_block (SHA1_ctx *c, unsigned long *W, int num)
+{
+  __m128i ABCD, E0, E1, MSG0, MSG1, MSG2, MSG3, ABCD_SAVE, E0_SAVE;
+
+  ABCD = sha1_load (&c->h0);
+  E0 = _mm_slli_si128 (_mm_cvtsi32_si128 ((int) c->h4), 12);
+
+  for (;;)
+    {
+      ABCD_SAVE = ABCD;
+      E0_SAVE = E0;
+
+      /* rounds 0-3 */
+      MSG0 = sha1_load (W + 0);
+      E0 = _mm_add_epi32 (E0, MSG0);
+      E1 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 0);
+      /* rounds 4-7 */
+      MSG1 = sha1_load (W + 4);
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 0);
+      MSG0 = _mm_sha1msg1_epu32 (MSG0, MSG1);
+      /* rounds 8-11 */
+      MSG2 = sha1_load (W + 8);
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 0);
+      MSG1 = _mm_sha1msg1_epu32 (MSG1, MSG2);
+      MSG0 = _mm_xor_si128 (MSG0, MSG2);
+      /* rounds 12-15 */
+      MSG3 = sha1_load (W + 12);
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      MSG0 = _mm_sha1msg2_epu32 (MSG0, MSG3);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 0);
+      MSG2 = _mm_sha1msg1_epu32 (MSG2, MSG3);
+      MSG1 = _mm_xor_si128 (MSG1, MSG3);
+      /* rounds 16-19 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG0);
+      E1 = ABCD;
+      MSG1 = _mm_sha1msg2_epu32 (MSG1, MSG0);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 0);
+      MSG3 = _mm_sha1msg1_epu32 (MSG3, MSG0);
+      MSG2 = _mm_xor_si128 (MSG2, MSG0);
+      /* rounds 20-23 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      MSG2 = _mm_sha1msg2_epu32 (MSG2, MSG1);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 1);
+      MSG0 = _mm_sha1msg1_epu32 (MSG0, MSG1);
+      MSG3 = _mm_xor_si128 (MSG3, MSG1);
+      /* rounds 24-27 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      MSG3 = _mm_sha1msg2_epu32 (MSG3, MSG2);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 1);
+      MSG1 = _mm_sha1msg1_epu32 (MSG1, MSG2);
+      MSG0 = _mm_xor_si128 (MSG0, MSG2);
+      /* rounds 28-31 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      MSG0 = _mm_sha1msg2_epu32 (MSG0, MSG3);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 1);
+      MSG2 = _mm_sha1msg1_epu32 (MSG2, MSG3);
+      MSG1 = _mm_xor_si128 (MSG1, MSG3);
+      /* rounds 32-35 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG0);
+      E1 = ABCD;
+      MSG1 = _mm_sha1msg2_epu32 (MSG1, MSG0);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 1);
+      MSG3 = _mm_sha1msg1_epu32 (MSG3, MSG0);
+      MSG2 = _mm_xor_si128 (MSG2, MSG0);
+      /* rounds 36-39 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      MSG2 = _mm_sha1msg2_epu32 (MSG2, MSG1);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 1);
+      MSG0 = _mm_sha1msg1_epu32 (MSG0, MSG1);
+      MSG3 = _mm_xor_si128 (MSG3, MSG1);
+      /* rounds 40-43 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      MSG3 = _mm_sha1msg2_epu32 (MSG3, MSG2);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 2);
+      MSG1 = _mm_sha1msg1_epu32 (MSG1, MSG2);
+      MSG0 = _mm_xor_si128 (MSG0, MSG2);
+      /* rounds 44-47 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      MSG0 = _mm_sha1msg2_epu32 (MSG0, MSG3);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 2);
+      MSG2 = _mm_sha1msg1_epu32 (MSG2, MSG3);
+      MSG1 = _mm_xor_si128 (MSG1, MSG3);
+      /* rounds 48-51 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG0);
+      E1 = ABCD;
+      MSG1 = _mm_sha1msg2_epu32 (MSG1, MSG0);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 2);
+      MSG3 = _mm_sha1msg1_epu32 (MSG3, MSG0);
+      MSG2 = _mm_xor_si128 (MSG2, MSG0);
+      /* rounds 52-55 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      MSG2 = _mm_sha1msg2_epu32 (MSG2, MSG1);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 2);
+      MSG0 = _mm_sha1msg1_epu32 (MSG0, MSG1);
+      MSG3 = _mm_xor_si128 (MSG3, MSG1);
+      /* rounds 56-59 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      MSG3 = _mm_sha1msg2_epu32 (MSG3, MSG2);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 2);
+      MSG1 = _mm_sha1msg1_epu32 (MSG1, MSG2);
+      MSG0 = _mm_xor_si128 (MSG0, MSG2);
+      /* rounds 60-63 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      MSG0 = _mm_sha1msg2_epu32 (MSG0, MSG3);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 3);
+      MSG2 = _mm_sha1msg1_epu32 (MSG2, MSG3);
+      MSG1 = _mm_xor_si128 (MSG1, MSG3);
+      /* rounds 64-67 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG0);
+      E1 = ABCD;
+      MSG1 = _mm_sha1msg2_epu32 (MSG1, MSG0);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 3);
+      MSG3 = _mm_sha1msg1_epu32 (MSG3, MSG0);
+      MSG2 = _mm_xor_si128 (MSG2, MSG0);
+      /* rounds 68-71 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG1);
+      E0 = ABCD;
+      MSG2 = _mm_sha1msg2_epu32 (MSG2, MSG1);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 3);
+      MSG3 = _mm_xor_si128 (MSG3, MSG1);
+      /* rounds 72-75 */
+      E0 = _mm_sha1nexte_epu32 (E0, MSG2);
+      E1 = ABCD;
+      MSG3 = _mm_sha1msg2_epu32 (MSG3, MSG2);
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E0, 3);
+      /* rounds 76-79 */
+      E1 = _mm_sha1nexte_epu32 (E1, MSG3);
+      E0 = ABCD;
+      ABCD = _mm_sha1rnds4_epu32 (ABCD, E1, 3);
+
+
+      E0 = _mm_sha1nexte_epu32 (E0, E0_SAVE);
+      ABCD = _mm_add_epi32 (ABCD, ABCD_SAVE);
+
+      num -= 64;
+      if (num <= 0)
+	break;
+
+      W += 16;
+    }
+
+  c->h0 = (uint32_t) _mm_extract_epi32 (ABCD, 3);
+  c->h1 = (uint32_t) _mm_extract_epi32 (ABCD, 2);
+  c->h2 = (uint32_t) _mm_extract_epi32 (ABCD, 1);
+  c->h3 = (uint32_t) _mm_extract_epi32 (ABCD, 0);
+  c->h4 = (uint32_t) _mm_extract_epi32 (E0, 3);
+}
+
+#elif !defined(SHA1_ASM)
 
 void
 sha1_block (SHA1_ctx *c, register unsigned long *W, int num)
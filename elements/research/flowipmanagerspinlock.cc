@@ -223,6 +223,6 @@ void FlowIPManagerSpinlock::add_handlers()
 
 CLICK_ENDDECLS
 
-ELEMENT_REQUIRES(FlowIPManager)
+ELEMENT_REQUIRES(dpdk FlowIPManager)
 EXPORT_ELEMENT(FlowIPManagerSpinlock)
 ELEMENT_MT_SAFE(FlowIPManagerSpinlock)
@@ -23,6 +23,10 @@
 #include <click/error.hh>
 #include <click/straccum.hh>
 #include <click/standard/alignmentinfo.hh>
+#if CLICK_CLASSIFICATION_JIT
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 CLICK_DECLS
 namespace Classification {
 namespace Wordwise {
@@ -1138,6 +1142,235 @@ CompressedProgram::unparse() const
 }
 
 
+#if CLICK_CLASSIFICATION_JIT
+//
+// NATIVE CODE GENERATION
+//
+
+namespace {
+// Emits x86-64 code for JITProgram. The generated function follows the
+// SysV calling convention: the three base pointers are in %rdi, %rsi and
+// %rdx, the packet word is loaded in %eax, and the output is returned in
+// %eax. Jumps are always encoded with 32-bit displacements, and patched
+// once the code is complete.
+class JITAssembler { public:
+
+    int new_label() {
+	_labels.push_back(-1);
+	return _labels.size() - 1;
+    }
+    void bind(int label) {
+	_labels[label] = _code.size();
+    }
+
+    void load(int base, int disp) {
+	static const uint8_t rm[] = {7, 6, 2}; // %rdi, %rsi, %rdx
+	byte(0x8B);		// mov disp(base), %eax
+	if (disp >= -128 && disp < 128) {
+	    byte(0x40 | rm[base]);
+	    byte(disp);
+	} else {
+	    byte(0x80 | rm[base]);
+	    imm32(disp);
+	}
+    }
+    void and_imm(uint32_t mask) {
+	byte(0x25);		// and $mask, %eax
+	imm32(mask);
+    }
+    void cmp_imm(uint32_t value) {
+	if (value == 0) {
+	    byte(0x85);		// test %eax, %eax
+	    byte(0xC0);
+	} else {
+	    byte(0x3D);		// cmp $value, %eax
+	    imm32(value);
+	}
+    }
+    void jmp(int label) {
+	byte(0xE9);
+	fixup(label);
+    }
+    void je(int label) {
+	byte(0x0F);
+	byte(0x84);
+	fixup(label);
+    }
+    void ja(int label) {
+	byte(0x0F);
+	byte(0x87);
+	fixup(label);
+    }
+    void ret(uint32_t value) {
+	byte(0xB8);		// mov $value, %eax
+	imm32(value);
+	byte(0xC3);		// ret
+    }
+
+    size_t size() const {
+	return _code.size();
+    }
+    void link(unsigned char *out) const {
+	memcpy(out, _code.begin(), _code.size());
+	for (int i = 0; i < _fixups.size(); i += 2) {
+	    int32_t rel = _labels[_fixups[i + 1]] - (_fixups[i] + 4);
+	    memcpy(out + _fixups[i], &rel, 4);
+	}
+    }
+
+  private:
+
+    Vector<unsigned char> _code;
+    Vector<int> _labels;
+    Vector<int> _fixups;	// pairs of (position, label)
+
+    void byte(uint8_t b) {
+	_code.push_back(b);
+    }
+    void imm32(uint32_t v) {
+	for (int i = 0; i < 4; ++i)
+	    byte(v >> (8 * i));
+    }
+    void fixup(int label) {
+	_fixups.push_back(_code.size());
+	_fixups.push_back(label);
+	imm32(0);
+    }
+
+};
+
+// Compare %eax with the sorted values[lo, hi), jumping to yes on a match and
+// to no otherwise. The last leaf falls through instead of jumping to no.
+void
+jit_search(JITAssembler &a, const uint32_t *values, int lo, int hi,
+	   int yes, int no, bool last)
+{
+    if (hi - lo < JITProgram::min_binary_search) {
+	for (int i = lo; i < hi; ++i) {
+	    a.cmp_imm(values[i]);
+	    a.je(yes);
+	}
+	if (!last)
+	    a.jmp(no);
+	return;
+    }
+    int mid = lo + (hi - lo) / 2;
+    int upper = a.new_label();
+    a.cmp_imm(values[mid]);
+    a.je(yes);
+    a.ja(upper);
+    jit_search(a, values, lo, mid, yes, no, false);
+    a.bind(upper);
+    jit_search(a, values, mid + 1, hi, yes, no, last);
+}
+}
+
+JITProgram::~JITProgram()
+{
+    if (_code)
+	munmap(_code, _size);
+    if (_old_code)
+	munmap(_old_code, _old_size);
+}
+
+void
+JITProgram::retire(void *code, size_t size)
+{
+    if (_old_code)
+	munmap(_old_code, _old_size);
+    _old_code = _code;
+    _old_size = _size;
+    _code = code;
+    _size = size;
+}
+
+bool
+JITProgram::compile(const CompressedProgram &zprog, int split1, int split2)
+{
+    const uint32_t *begin = zprog.begin(), *end = zprog.end();
+    if (zprog.output_everything() >= 0 || begin == end) {
+	clear();
+	return false;
+    }
+
+    JITAssembler a;
+    Vector<int> test_label(end - begin, -1);
+    for (const uint32_t *pr = begin; pr < end; pr += 4 + (pr[0] >> 17))
+	test_label[pr - begin] = a.new_label();
+    Vector<int> outputs, output_label;
+    Vector<uint32_t> values;
+
+    // Return the label of the jump target 'j' of the test at 'pos'
+    auto target = [&](int pos, int32_t j) -> int {
+	if (j > 0)
+	    return pos + j < test_label.size() ? test_label[pos + j] : -1;
+	for (int i = 0; i < outputs.size(); ++i)
+	    if (outputs[i] == -j)
+		return output_label[i];
+	outputs.push_back(-j);
+	output_label.push_back(a.new_label());
+	return output_label.back();
+    };
+
+    for (const uint32_t *pr = begin; pr < end; ) {
+	int pos = pr - begin, nvalues = pr[0] >> 17;
+	const uint32_t *next = pr + 4 + nvalues;
+	int32_t no = pr[1];
+	int yes_label = target(pos, pr[2]), no_label = target(pos, no);
+	if (next > end || yes_label < 0 || no_label < 0) {
+	    clear();
+	    return false;
+	}
+
+	a.bind(test_label[pos]);
+	int off = (uint16_t) pr[0], base = 0;
+	if (off >= split2)
+	    base = 2, off -= split2;
+	else if (off >= split1)
+	    base = 1, off -= split1;
+	a.load(base, off);
+	if (pr[3] != 0xFFFFFFFFU)
+	    a.and_imm(pr[3]);
+
+	values.clear();
+	for (const uint32_t *pv = pr + 4; pv < next; ++pv)
+	    values.push_back(*pv);
+	click_qsort(values.begin(), nvalues);
+	jit_search(a, values.begin(), 0, nvalues, yes_label, no_label, true);
+
+	// fall through to the next test if that is the "no" branch
+	if (no <= 0)
+	    a.ret(-no);
+	else if (pr + no != next)
+	    a.jmp(no_label);
+	pr = next;
+    }
+    for (int i = 0; i < outputs.size(); ++i) {
+	a.bind(output_label[i]);
+	a.ret(outputs[i]);
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (a.size() + page - 1) & ~(page - 1);
+    void *code = mmap(0, size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+	clear();
+	return false;
+    }
+    a.link((unsigned char *) code);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) < 0) {
+	munmap(code, size);
+	clear();
+	return false;
+    }
+    retire(code, size);
+    _f = (function_type) code;
+    return true;
+}
+#endif
+
+
 //
 // RUNNING
 //
@@ -1,6 +1,9 @@
 #ifndef CLICK_CLASSIFICATION_HH
 #define CLICK_CLASSIFICATION_HH 1
 #define CLICK_CLASSIFICATION_WORDWISE_DOMINATOR_FASTPRED 1
+#if CLICK_USERLEVEL && defined(__x86_64__)
+# define CLICK_CLASSIFICATION_JIT 1
+#endif
 #include <click/packet.hh>
 #include <click/vector.hh>
 CLICK_DECLS
@@ -276,6 +279,77 @@ class CompressedProgram { public:
 };
 
 
+#if CLICK_CLASSIFICATION_JIT
+/** @brief Native code translation of a CompressedProgram.
+ *
+ * compile() translates every test of a compressed program into x86-64
+ * compare-and-branch instructions, in the spirit of click-fastclassifier but
+ * at run time, so a packet is classified without decoding any instruction.
+ * The generated function does not check the packet length: callers must use
+ * the interpreter for packets shorter than the program's safe_length(), and
+ * for programs that output everything.
+ *
+ * A test reads the packet word at its offset from one of three base
+ * pointers: the first one for offsets below @a split1, the second one (at
+ * offset minus @a split1) for offsets below @a split2, and the third one (at
+ * offset minus @a split2) otherwise. Classifier uses a single base pointer,
+ * IPFilter uses one per header.
+ *
+ * Compiling again keeps the previous code mapped until the next compile(),
+ * so a thread still running it during a live reconfiguration is safe. */
+class JITProgram { public:
+
+    typedef int (*function_type)(const unsigned char *, const unsigned char *,
+				 const unsigned char *);
+
+    JITProgram()
+	: _f(0), _code(0), _size(0), _old_code(0), _old_size(0) {
+    }
+    ~JITProgram();
+
+    /** @brief Compile @a zprog, replacing the current code.
+     * @return true on success. On failure, function() is null. */
+    bool compile(const CompressedProgram &zprog,
+		 int split1 = offset_max, int split2 = offset_max);
+    /** @brief Stop using the current code, without unmapping it. */
+    void clear() {
+	_f = 0;
+    }
+
+    /** @brief Return the compiled function, or null.
+     *
+     * The function takes the three base pointers and returns the output
+     * port, like Program::match(). Load it once per packet, as it may be
+     * cleared concurrently. */
+    function_type function() const {
+	return _f;
+    }
+    bool compiled() const {
+	return _f;
+    }
+    size_t code_size() const {
+	return _size;
+    }
+
+    enum { min_binary_search = 4 };
+
+  private:
+
+    function_type volatile _f;
+    void *_code;
+    size_t _size;
+    void *_old_code;
+    size_t _old_size;
+
+    void retire(void *code, size_t size);
+
+    JITProgram(const JITProgram &) = delete;
+    JITProgram &operator=(const JITProgram &) = delete;
+
+};
+#endif
+
+
 class DominatorOptimizer { public:
 
     DominatorOptimizer(Program *p);
@@ -230,7 +230,16 @@ Classifier::configure(Vector<String> &conf, ErrorHandler *errh)
 
     if (!errh->nerrors()) {
 	prog.warn_unused_outputs(noutputs(), errh);
+#if CLICK_CLASSIFICATION_JIT
+	// the old code assumes the old program's safe length
+	_jit.clear();
+#endif
 	_prog = prog;
+#if CLICK_CLASSIFICATION_JIT
+	Classification::Wordwise::CompressedProgram zprog;
+	zprog.compile(_prog, false, 0);
+	_jit.compile(zprog);
+#endif
 	return 0;
     } else
 	return -1;
@@ -243,10 +252,23 @@ Classifier::program_string(Element *element, void *)
     return c->_prog.unparse();
 }
 
+String
+Classifier::jit_handler(Element *element, void *)
+{
+#if CLICK_CLASSIFICATION_JIT
+    Classifier *c = static_cast<Classifier *>(element);
+    return String(c->_jit.compiled());
+#else
+    (void) element;
+    return String(false);
+#endif
+}
+
 void
 Classifier::add_handlers()
 {
     add_read_handler("program", Classifier::program_string, 0, Handler::CALM);
+    add_read_handler("jit", Classifier::jit_handler, 0, Handler::CALM);
 }
 
 #if HAVE_BATCH
@@ -254,7 +276,7 @@ void
 Classifier::push_batch(int, PacketBatch * batch)
 {
 	CLASSIFY_EACH_PACKET(	(noutputs() + 1),
-							_prog.match,
+							match,
 							batch,
 							checked_output_push_batch);
 
@@ -264,7 +286,7 @@ Classifier::push_batch(int, PacketBatch * batch)
 inline void
 Classifier::push(int, Packet *p)
 {
-    checked_output_push(_prog.match(p), p);
+    checked_output_push(match(p), p);
 }
 
 CLICK_ENDDECLS
@@ -71,6 +71,12 @@ CLICK_DECLS
  *   safe length 22
  *   alignment offset 0
  *
+ * =h jit read-only
+ * Returns true if the program was compiled to native code. At user level on
+ * x86-64, Classifier translates its program into machine code whenever it is
+ * configured, including on live reconfiguration. Packets shorter than the
+ * program's safe length still go through the interpreter.
+ *
  * =a IPClassifier, IPFilter */
 
 class Classifier : public BatchElement { public:
@@ -92,6 +98,8 @@ class Classifier : public BatchElement { public:
 #endif
     void push(int, Packet *);
 
+    inline int match(const Packet *p);
+
     Classification::Wordwise::Program empty_program(ErrorHandler *errh) const;
     static void parse_program(Classification::Wordwise::Program &prog,
 			      Vector<String> &conf, ErrorHandler *errh);
@@ -99,10 +107,25 @@ class Classifier : public BatchElement { public:
   protected:
 
     Classification::Wordwise::Program _prog;
+#if CLICK_CLASSIFICATION_JIT
+    Classification::Wordwise::JITProgram _jit;
+#endif
 
     static String program_string(Element *, void *);
+    static String jit_handler(Element *, void *);
 
 };
 
+inline int
+Classifier::match(const Packet *p)
+{
+#if CLICK_CLASSIFICATION_JIT
+    Classification::Wordwise::JITProgram::function_type f = _jit.function();
+    if (f && p->length() >= _prog.safe_length())
+	return f(p->data() - _prog.align_offset(), 0, 0);
+#endif
+    return _prog.match(p);
+}
+
 CLICK_ENDDECLS
 #endif
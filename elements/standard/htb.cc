@@ -0,0 +1,536 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * htb.{cc,hh} -- hierarchical token bucket shaper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "htb.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/heap.hh>
+CLICK_DECLS
+
+#define HTB_MAX_ID	(1 << 20)
+
+HTB::HTB()
+    : _default(-1), _active_head(-1), _active_tail(-1), _len(0), _drops(0),
+      _timer(this)
+{
+}
+
+HTB::~HTB()
+{
+}
+
+void *
+HTB::cast(const char *n)
+{
+    if (strcmp(n, "HTB") == 0)
+	return this;
+    else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else
+	return BatchElement::cast(n);
+}
+
+int
+HTB::parse_class(const String &spec, HashTable<String, int> &names,
+		 Vector<int> &ids, uint32_t limit, int quantum,
+		 ErrorHandler *errh)
+{
+    Vector<String> words;
+    cp_spacevec(spec, words);
+    if (!words.size())
+	return errh->error("empty CLASS");
+    String name = words[0];
+    if (words.size() % 2 == 0)
+	return errh->error("CLASS %s: missing value for %s", name.c_str(), words.back().c_str());
+    Vector<String> conf;
+    for (int i = 1; i < words.size(); i += 2)
+	conf.push_back(words[i] + " " + words[i + 1]);
+
+    String parent_name;
+    uint32_t rate, ceil, burst, cburst;
+    int id = -1, count = 1;
+    bool has_parent, has_ceil, has_burst, has_cburst, has_count;
+    PrefixErrorHandler perrh(errh, "CLASS " + name + ": ");
+    if (Args(conf, this, &perrh)
+	.read("PARENT", WordArg(), parent_name).read_status(has_parent)
+	.read_m("RATE", BandwidthArg(), rate)
+	.read("CEIL", BandwidthArg(), ceil).read_status(has_ceil)
+	.read("BURST", burst).read_status(has_burst)
+	.read("CBURST", cburst).read_status(has_cburst)
+	.read("ID", id)
+	.read("COUNT", count).read_status(has_count)
+	.read("LIMIT", limit)
+	.read("QUANTUM", quantum)
+	.complete() < 0)
+	return -1;
+
+    if (rate == 0)
+	return perrh.error("RATE must be positive");
+    if (!has_ceil)
+	ceil = rate;
+    else if (ceil < rate)
+	return perrh.error("CEIL must be at least RATE");
+    if (!has_burst)
+	burst = rate / 50 > 3028 ? rate / 50 : 3028;
+    if (!has_cburst)
+	cburst = ceil / 50 > 3028 ? ceil / 50 : 3028;
+    if (count < 1)
+	return perrh.error("COUNT must be positive");
+    if (quantum <= 0)
+	return perrh.error("QUANTUM must be positive");
+
+    int parent = -1;
+    if (has_parent) {
+	HashTable<String, int>::iterator it = names.find(parent_name);
+	if (!it)
+	    return perrh.error("unknown PARENT %<%s%>, it must be declared before", parent_name.c_str());
+	parent = it.value();
+	_classes[parent].leaf = false;
+    }
+
+    for (int i = 0; i < count; i++) {
+	Class c;
+	c.name = has_count ? name + String(i) : name;
+	if (names.find(c.name))
+	    return perrh.error("class %<%s%> declared twice", c.name.c_str());
+	names.set(c.name, _classes.size());
+	c.parent = parent;
+	c.leaf = true;
+	c.rate.assign(rate, burst);
+	c.ceil.assign(ceil, cburst);
+	c.head = c.tail = 0;
+	c.qlen = 0;
+	c.limit = limit;
+	c.quantum = quantum;
+	c.deficit = 0;
+	c.state = st_idle;
+	c.next = -1;
+	c.parked = c.parked_tail = -1;
+	c.heap_pos = -1;
+	c.wake = 0;
+	c.packets = c.bytes = c.drops = c.borrows = 0;
+	_classes.push_back(c);
+	ids.push_back(id >= 0 ? id + i : -1);
+    }
+    return 0;
+}
+
+int
+HTB::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Vector<String> specs;
+    String default_name;
+    uint32_t limit = 1000;
+    int quantum = 1514;
+    _anno = AGGREGATE_ANNO_OFFSET;
+
+    if (Args(conf, this, errh)
+	.read_all("CLASS", AnyArg(), specs)
+	.read("DEFAULT", WordArg(), default_name)
+	.read("ANNO", AnnoArg(4), _anno)
+	.read("LIMIT", limit)
+	.read("QUANTUM", quantum)
+	.complete() < 0)
+	return -1;
+
+    if (!specs.size())
+	return errh->error("no CLASS");
+
+    HashTable<String, int> names;
+    Vector<int> ids;
+    _classes.clear();
+    for (int i = 0; i < specs.size(); i++)
+	if (parse_class(specs[i], names, ids, limit, quantum, errh) < 0)
+	    return -1;
+
+    // leaves not given an ID follow the previous one
+    int next_id = 0;
+    _leaf_by_id.clear();
+    for (int i = 0; i < _classes.size(); i++) {
+	if (!_classes[i].leaf)
+	    continue;
+	int id = ids[i] >= 0 ? ids[i] : next_id;
+	if (id >= HTB_MAX_ID)
+	    return errh->error("class %<%s%>: ID must be below %d", _classes[i].name.c_str(), HTB_MAX_ID);
+	if (id >= _leaf_by_id.size())
+	    _leaf_by_id.resize(id + 1, -1);
+	if (_leaf_by_id[id] >= 0)
+	    return errh->error("classes %<%s%> and %<%s%> have the same ID %d", _classes[_leaf_by_id[id]].name.c_str(), _classes[i].name.c_str(), id);
+	_leaf_by_id[id] = i;
+	next_id = id + 1;
+    }
+
+    if (default_name) {
+	HashTable<String, int>::iterator it = names.find(default_name);
+	if (!it || !_classes[it.value()].leaf)
+	    return errh->error("DEFAULT must be a leaf class");
+	_default = it.value();
+    }
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    return 0;
+}
+
+int
+HTB::initialize(ErrorHandler *)
+{
+    _timer.initialize(this);
+    click_jiffies_t now = click_jiffies();
+    for (int i = 0; i < _classes.size(); i++) {
+	_classes[i].rate.tb.set_full();
+	_classes[i].rate.tb.set_time_point(now);
+	_classes[i].ceil.tb.set_full();
+	_classes[i].ceil.tb.set_time_point(now);
+    }
+    return 0;
+}
+
+void
+HTB::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _classes.size(); i++)
+	while (Packet *p = _classes[i].head) {
+	    _classes[i].head = p->next();
+	    p->kill();
+	}
+}
+
+inline void
+HTB::active_push(int li)
+{
+    Class &l = _classes[li];
+    l.state = st_active;
+    l.next = -1;
+    if (_active_tail < 0)
+	_active_head = li;
+    else
+	_classes[_active_tail].next = li;
+    _active_tail = li;
+}
+
+inline void
+HTB::active_pop()
+{
+    Class &l = _classes[_active_head];
+    _active_head = l.next;
+    if (_active_head < 0)
+	_active_tail = -1;
+    l.next = -1;
+}
+
+inline void
+HTB::drop(Class *c, Packet *p)
+{
+    if (c)
+	c->drops++;
+    _drops++;
+    checked_output_push(1, p);
+}
+
+inline void
+HTB::enqueue(Packet *p)
+{
+    uint32_t id = p->anno_u32(_anno);
+    int li = id < (uint32_t) _leaf_by_id.size() ? _leaf_by_id.unchecked_at(id) : -1;
+    if (li < 0 && (li = _default) < 0) {
+	drop(0, p);
+	return;
+    }
+
+    Class &l = _classes[li];
+    if (l.qlen >= l.limit) {
+	drop(&l, p);
+	return;
+    }
+    p->set_next(0);
+    if (l.tail)
+	l.tail->set_next(p);
+    else
+	l.head = p;
+    l.tail = p;
+    l.qlen++;
+    _len++;
+
+    if (l.state == st_idle) {
+	active_push(li);
+	_empty_note.wake();
+    }
+}
+
+/* Returns the class that lends the tokens to send @a len bytes from leaf
+ * @a li, which is @a li itself if it is under its rate, or -1 if the leaf
+ * cannot send. In that case, @a blocker is the class whose bucket will be
+ * the first to have enough tokens, at time @a wake. */
+inline int
+HTB::find_lender(int li, uint32_t len, click_jiffies_t now, int &blocker, click_jiffies_t &wake)
+{
+    Class &l = _classes[li];
+    l.rate.refill(now);
+    l.ceil.refill(now);
+    if (l.rate.contains(len))
+	return li;
+
+    TokenBucket::ticks_type best;
+    blocker = li;
+    if (!l.ceil.contains(len))
+	best = l.ceil.time_until_contains(len);
+    else {
+	best = l.rate.time_until_contains(len);
+	for (int ai = l.parent; ai >= 0; ai = _classes[ai].parent) {
+	    Class &a = _classes[ai];
+	    a.rate.refill(now);
+	    a.ceil.refill(now);
+	    TokenBucket::ticks_type t;
+	    if (!a.ceil.contains(len)) {
+		if ((t = a.ceil.time_until_contains(len)) < best) {
+		    best = t;
+		    blocker = ai;
+		}
+		break;
+	    }
+	    if (a.rate.contains(len))
+		return ai;
+	    if ((t = a.rate.time_until_contains(len)) < best) {
+		best = t;
+		blocker = ai;
+	    }
+	}
+    }
+    wake = now + (best ? best : 1);
+    return -1;
+}
+
+inline void
+HTB::charge(int li, int lender, uint32_t len)
+{
+    bool lending = false;
+    for (int ci = li; ci >= 0; ci = _classes[ci].parent) {
+	Class &c = _classes[ci];
+	if (ci == lender)
+	    lending = true;
+	if (lending)
+	    c.rate.charge(len);
+	c.ceil.charge(len);
+	c.packets++;
+	c.bytes += len;
+    }
+    if (lender != li) {
+	_classes[li].borrows++;
+	_classes[lender].borrows++;
+    }
+}
+
+void
+HTB::park(int li, int blocker, click_jiffies_t wake)
+{
+    Class &l = _classes[li];
+    Class &b = _classes[blocker];
+    l.state = st_parked;
+    l.next = -1;
+    if (b.parked_tail < 0)
+	b.parked = li;
+    else
+	_classes[b.parked_tail].next = li;
+    b.parked_tail = li;
+    if (b.heap_pos < 0) {
+	b.wake = wake;
+	_wait.push_back(blocker);
+	push_heap(_wait.begin(), _wait.end(),
+		  wait_less(_classes.begin()), wait_place(_classes.begin()));
+    } else if (click_jiffies_less(wake, b.wake)) {
+	b.wake = wake;
+	change_heap(_wait.begin(), _wait.end(), _wait.begin() + b.heap_pos,
+		    wait_less(_classes.begin()), wait_place(_classes.begin()));
+    }
+}
+
+void
+HTB::wake_classes(click_jiffies_t now)
+{
+    while (_wait.size() && !click_jiffies_less(now, _classes[_wait[0]].wake)) {
+	int bi = _wait[0];
+	Class &b = _classes[bi];
+
+	// Every packet of the subtree is charged to the CEIL bucket of b, so
+	// its tokens bound how many parked leaves may send. The first one
+	// always wakes, it may have been waiting for another bucket.
+	b.ceil.refill(now);
+	uint32_t budget = b.ceil.debt ? 0 : b.ceil.tb.size(), spent = 0;
+	do {
+	    int li = b.parked;
+	    b.parked = _classes[li].next;
+	    spent += b.ceil.clamp(_classes[li].head->length());
+	    active_push(li);
+	} while (b.parked >= 0
+		 && spent + b.ceil.clamp(_classes[b.parked].head->length()) <= budget);
+
+	if (b.parked >= 0) {
+	    // the others wait for the tokens the woken leaves will leave
+	    TokenBucket::ticks_type t = b.ceil.time_until_contains(spent + _classes[b.parked].head->length());
+	    b.wake = now + (t ? t : 1);
+	    change_heap(_wait.begin(), _wait.end(), _wait.begin(),
+			wait_less(_classes.begin()), wait_place(_classes.begin()));
+	} else {
+	    b.parked_tail = -1;
+	    pop_heap(_wait.begin(), _wait.end(),
+		     wait_less(_classes.begin()), wait_place(_classes.begin()));
+	    _wait.pop_back();
+	    b.heap_pos = -1;
+	}
+    }
+}
+
+inline Packet *
+HTB::dequeue(click_jiffies_t now)
+{
+    while (_active_head >= 0) {
+	int li = _active_head;
+	Class &l = _classes[li];
+	Packet *p = l.head;
+	uint32_t len = p->length();
+
+	if (l.deficit < (int) len) {
+	    l.deficit += l.quantum;
+	    active_pop();
+	    active_push(li);
+	    continue;
+	}
+
+	int blocker;
+	click_jiffies_t wake;
+	int lender = find_lender(li, len, now, blocker, wake);
+	if (lender < 0) {
+	    active_pop();
+	    park(li, blocker, wake);
+	    continue;
+	}
+
+	l.head = p->next();
+	if (!l.head)
+	    l.tail = 0;
+	p->set_next(0);
+	l.qlen--;
+	_len--;
+	l.deficit -= len;
+	charge(li, lender, len);
+	if (!l.qlen) {
+	    active_pop();
+	    l.state = st_idle;
+	    l.deficit = 0;
+	}
+	return p;
+    }
+    return 0;
+}
+
+void
+HTB::sleep_until_wakeup()
+{
+    _empty_note.sleep();
+    if (_wait.size()) {
+	click_jiffies_t now = click_jiffies();
+	click_jiffies_t wake = _classes[_wait[0]].wake;
+	if (click_jiffies_less(now, wake))
+	    _timer.schedule_after(Timestamp::make_jiffies(wake - now));
+	else
+	    _timer.schedule_now();
+    }
+}
+
+void
+HTB::run_timer(Timer *)
+{
+    _empty_note.wake();
+}
+
+void
+HTB::push(int, Packet *p)
+{
+    enqueue(p);
+}
+
+Packet *
+HTB::pull(int)
+{
+    click_jiffies_t now = click_jiffies();
+    wake_classes(now);
+    Packet *p = dequeue(now);
+    if (!p)
+	sleep_until_wakeup();
+    return p;
+}
+
+#if HAVE_BATCH
+void
+HTB::push_batch(int, PacketBatch *batch)
+{
+    FOR_EACH_PACKET_SAFE(batch, p)
+	enqueue(p);
+}
+
+PacketBatch *
+HTB::pull_batch(int, unsigned max)
+{
+    click_jiffies_t now = click_jiffies();
+    wake_classes(now);
+    PacketBatch *batch;
+    MAKE_BATCH(dequeue(now), batch, max);
+    if (!batch)
+	sleep_until_wakeup();
+    return batch;
+}
+#endif
+
+enum { h_length, h_drops, h_waiting, h_classes };
+
+String
+HTB::read_handler(Element *e, void *thunk)
+{
+    HTB *htb = static_cast<HTB *>(e);
+    switch ((intptr_t) thunk) {
+    case h_length:
+	return String(htb->_len);
+    case h_drops:
+	return String(htb->_drops);
+    case h_waiting:
+	return String(htb->_wait.size());
+    case h_classes: {
+	StringAccum sa;
+	for (int i = 0; i < htb->_classes.size(); i++) {
+	    const Class &c = htb->_classes[i];
+	    sa << c.name << ' ' << c.packets << ' ' << c.bytes << ' '
+	       << c.drops << ' ' << c.borrows << ' ' << c.qlen << '\n';
+	}
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+void
+HTB::add_handlers()
+{
+    add_read_handler("length", read_handler, h_length);
+    add_read_handler("drops", read_handler, h_drops);
+    add_read_handler("waiting", read_handler, h_waiting);
+    add_read_handler("classes", read_handler, h_classes);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(HTB)
@@ -0,0 +1,289 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_HTB_HH
+#define CLICK_HTB_HH
+#include <click/batchelement.hh>
+#include <click/tokenbucket.hh>
+#include <click/notifier.hh>
+#include <click/timer.hh>
+#include <click/vector.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+
+/*
+=c
+
+HTB(CLASS I<spec>, [CLASS I<spec> ...], [I<keywords> DEFAULT, ANNO, LIMIT, QUANTUM])
+
+=s shaping
+
+hierarchical token bucket shaper
+
+=d
+
+Queues packets into the leaves of a tree of classes, and emits them at the
+rate each class is guaranteed, borrowing unused bandwidth from the parent
+classes up to a ceiling, as the Linux HTB queueing discipline.
+
+HTB has one push input and one pull output. Each packet is queued in the
+leaf class whose ID is the value of the ANNO annotation (by default the
+aggregate annotation, see for instance AggregateIPFlows or SetAggregate), or
+in the DEFAULT class. Packets that match no class, or find their leaf full,
+are dropped, or emitted on output 1 if it exists.
+
+Every CLASS argument declares a class, as a space-separated list starting with
+the class name followed by keywords:
+
+=over 8
+
+=item PARENT
+
+Name of the parent class, which must be declared before. Classes without a
+parent are roots.
+
+=item RATE
+
+Bandwidth. The rate guaranteed to the class. Mandatory.
+
+=item CEIL
+
+Bandwidth. The maximum rate of the class, including what it borrows from its
+ancestors. Defaults to RATE.
+
+=item BURST, CBURST
+
+Integers. Sizes in bytes of the RATE and CEIL token buckets. Default to 20ms
+of traffic at that rate, and at least 3028 bytes.
+
+=item ID
+
+Integer. The annotation value of the packets of this leaf class. Defaults to
+one more than the ID of the previous leaf, starting at 0. IDs must be below
+2^20.
+
+=item COUNT
+
+Integer. Declares COUNT identical leaf classes named I<name>0, I<name>1, etc.,
+with consecutive IDs. Useful for per-subscriber classes.
+
+=item LIMIT, QUANTUM
+
+Integers. Override the element-wide LIMIT and QUANTUM for this class.
+
+=back
+
+A leaf sends when its own RATE bucket has enough tokens. Otherwise, if its
+CEIL bucket has enough tokens, it borrows from the closest ancestor that has
+RATE tokens, provided the CEIL of every class on the way allows it. A packet
+is charged to the CEIL bucket of all the classes up to the root, and to the
+RATE bucket of the lender and its ancestors. Leaves that can send are served
+with deficit round robin. A leaf that cannot is parked on the class that
+blocks it, which waits in a heap ordered by the time its bucket will have
+enough tokens, so dequeuing costs O(log n) in the number of blocked classes.
+When that time comes, the class only wakes, in order, as many of its parked
+leaves as its CEIL tokens can serve, and waits again for the others, so
+thousands of leaves parked on a parent do not all wake for a few packets.
+When all backlogged leaves are blocked, HTB sleeps its empty notifier and
+arms a timer for the first wakeup.
+
+HTB is not thread-safe: one thread should push and pull. Rates are measured
+in bytes per second, up to about 34 Gbps.
+
+Keyword arguments are:
+
+=over 8
+
+=item DEFAULT
+
+Name of the leaf class of packets whose annotation matches no leaf.
+
+=item ANNO
+
+Annotation holding the leaf ID, 4 bytes wide. Default is the aggregate
+annotation.
+
+=item LIMIT
+
+Integer. Default capacity of the leaf queues in packets. Default is 1000.
+
+=item QUANTUM
+
+Integer. Default number of bytes a leaf may send at each round robin turn.
+Default is 1514.
+
+=back
+
+=e
+
+  SetAggregate(...)
+    -> HTB(CLASS link RATE 10Gbps,
+           CLASS gold PARENT link RATE 6Gbps CEIL 10Gbps,
+           CLASS best PARENT link RATE 4Gbps CEIL 10Gbps,
+           CLASS voip PARENT gold RATE 1Gbps ID 0,
+           CLASS sub PARENT best RATE 100kbps CEIL 100Mbps COUNT 20000 ID 1)
+    -> ToDevice(eth0);
+
+=h length read-only
+
+Number of packets in all the leaf queues.
+
+=h drops read-only
+
+Number of packets dropped so far.
+
+=h waiting read-only
+
+Number of classes waiting for tokens.
+
+=h classes read-only
+
+Statistics of the classes, one per line: name, packets and bytes sent,
+drops, number of packets borrowed (for leaves) or lent, and backlog in
+packets (for leaves).
+
+=a BandwidthShaper, DRRSched, PrioSched, FQCoDel */
+
+class HTB : public BatchElement { public:
+
+    HTB() CLICK_COLD;
+    ~HTB() CLICK_COLD;
+
+    const char *class_name() const override	{ return "HTB"; }
+    const char *port_count() const override	{ return PORTS_1_1X2; }
+    const char *processing() const override	{ return "h/lh"; }
+    void *cast(const char *) override;
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+    PacketBatch *pull_batch(int port, unsigned max);
+#endif
+
+    void run_timer(Timer *);
+
+  private:
+
+    enum { st_idle = 0, st_active, st_parked };
+
+    /* A token bucket that may go in debt, as ancestors are charged for the
+     * packets their children send on their own rate. */
+    struct Bucket {
+	TokenBucket tb;
+	uint32_t debt;
+
+	void assign(uint32_t rate, uint32_t capacity) {
+	    tb.assign(rate, capacity);
+	    debt = 0;
+	}
+	void refill(click_jiffies_t now) {
+	    tb.refill(now);
+	    if (debt) {
+		uint32_t pay = tb.size() < debt ? tb.size() : debt;
+		tb.remove(pay);
+		debt -= pay;
+	    }
+	}
+	// a packet larger than the bucket only needs it to be full
+	uint32_t clamp(uint32_t len) const {
+	    return len < tb.capacity() ? len : tb.capacity();
+	}
+	bool contains(uint32_t len) const {
+	    return !debt && tb.contains(clamp(len));
+	}
+	TokenBucket::ticks_type time_until_contains(uint32_t len) const {
+	    return tb.time_until_contains(clamp(len + debt));
+	}
+	void charge(uint32_t len) {
+	    uint32_t s = tb.size();
+	    if (s >= len)
+		tb.remove(len);
+	    else {
+		tb.remove(s);
+		debt += len - s;
+	    }
+	}
+    };
+
+    struct Class {
+	String name;
+	int parent;
+	bool leaf;
+	Bucket rate;
+	Bucket ceil;
+
+	// leaf queue
+	Packet *head;
+	Packet *tail;
+	uint32_t qlen;
+	uint32_t limit;
+	int quantum;
+	int deficit;
+	int state;
+	int next;		// next leaf of the active or a parked list
+
+	// wakeup of the leaves this class blocks, in parking order
+	int parked;
+	int parked_tail;
+	int heap_pos;		// -1 when not waiting
+	click_jiffies_t wake;
+
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t drops;
+	uint64_t borrows;
+    };
+
+    struct wait_less {
+	const Class *c;
+	wait_less(const Class *c_) : c(c_) { }
+	inline bool operator()(int a, int b) const {
+	    return click_jiffies_less(c[a].wake, c[b].wake);
+	}
+    };
+    struct wait_place {
+	Class *c;
+	wait_place(Class *c_) : c(c_) { }
+	inline void operator()(int *begin, int *x) const {
+	    c[*x].heap_pos = x - begin;
+	}
+    };
+
+    Vector<Class> _classes;
+    Vector<int> _leaf_by_id;
+    int _default;
+    int _anno;
+
+    int _active_head;
+    int _active_tail;
+    Vector<int> _wait;
+
+    uint32_t _len;
+    uint64_t _drops;
+
+    ActiveNotifier _empty_note;
+    Timer _timer;
+
+    int parse_class(const String &spec, HashTable<String, int> &names, Vector<int> &ids,
+		    uint32_t limit, int quantum, ErrorHandler *errh);
+    inline void drop(Class *c, Packet *p);
+    inline void enqueue(Packet *p);
+    inline Packet *dequeue(click_jiffies_t now);
+    inline int find_lender(int li, uint32_t len, click_jiffies_t now, int &blocker, click_jiffies_t &wake);
+    inline void charge(int li, int lender, uint32_t len);
+    void park(int li, int blocker, click_jiffies_t wake);
+    void wake_classes(click_jiffies_t now);
+    inline void active_push(int li);
+    inline void active_pop();
+    void sleep_until_wakeup();
+
+    static String read_handler(Element *, void *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -9,6 +9,7 @@
 #include <click/ring.hh>
 #include <click/args.hh>
 #include <click/error.hh>
+#include <click/straccum.hh>
 
 CLICK_DECLS
 
@@ -22,6 +23,9 @@ Pipeliner::Pipeliner()
         _active(true),_nouseless(false),_always_up(false),
         _allow_direct_traversal(true), _verbose(true),
         sleepiness(0),_sleep_threshold(0), _highwater(0),
+        _adaptive(false), _min_burst(1), _max_burst(0), _cur_burst(0),
+        _latency(0), _packet_cycles(0),
+        _high_watermark(0), _low_watermark(0),
         _task(this), _last_start(0)
 {
 #if HAVE_BATCH
@@ -34,6 +38,14 @@ Pipeliner::~Pipeliner()
 
 }
 
+void *
+Pipeliner::cast(const char *n)
+{
+    if (_high_watermark && strcmp(n, Notifier::FULL_NOTIFIER) == 0)
+        return static_cast<Notifier *>(&_full_note);
+    return BatchElement::cast(n);
+}
+
 bool
 Pipeliner::get_spawning_threads(Bitvector& b, bool, int port) {
     unsigned int thisthread = router()->home_thread_id(this);
@@ -64,6 +76,8 @@ void Pipeliner::cleanup(CleanupStage) {
 int
 Pipeliner::configure(Vector<String> & conf, ErrorHandler * errh)
 {
+    Timestamp latency;
+    int low_watermark = -1;
 
     if (Args(conf, this, errh)
     .read_p("CAPACITY", _ring_size)
@@ -75,6 +89,12 @@ Pipeliner::configure(Vector<String> & conf, ErrorHandler * errh)
     .read("NOUSELESS",_nouseless)
     .read("VERBOSE",_verbose)
     .read_or_set("PREFETCH",_prefetch, true)
+    .read("ADAPTIVE",_adaptive)
+    .read("MIN_BURST",_min_burst)
+    .read("MAX_BURST",_max_burst)
+    .read("LATENCY",latency)
+    .read("HIGH_WATERMARK",_high_watermark)
+    .read("LOW_WATERMARK",low_watermark)
     .complete() < 0)
         return -1;
 
@@ -90,6 +110,27 @@ Pipeliner::configure(Vector<String> & conf, ErrorHandler * errh)
         _burst = INT_MAX;
     }
 
+    if (_adaptive) {
+        if (_burst == INT_MAX)
+            return errh->error("ADAPTIVE requires a finite BURST");
+        if (_max_burst <= 0)
+            _max_burst = _burst * 8;
+        if (_min_burst <= 0 || _min_burst > _burst || _burst > _max_burst)
+            return errh->error("MIN_BURST <= BURST <= MAX_BURST required");
+        _cur_burst = _burst;
+        _latency = (click_cycles_t) latency.usecval() * cycles_hz() / 1000000;
+    }
+
+    if (_high_watermark) {
+        if (_high_watermark >= (unsigned) _ring_size)
+            return errh->error("HIGH_WATERMARK must be smaller than CAPACITY");
+        _low_watermark = low_watermark < 0 ? _high_watermark / 2 : low_watermark;
+        if (_low_watermark >= _high_watermark)
+            return errh->error("LOW_WATERMARK must be smaller than HIGH_WATERMARK");
+        _full_note.initialize(Notifier::FULL_NOTIFIER, router());
+        _full_note.set_active(true, false);
+    }
+
     //Amount of empty run of task after which it unschedule
 #if HAVE_BATCH
     _sleep_threshold = _ring_size / 2;
@@ -117,6 +158,7 @@ Pipeliner::thread_configure(ThreadReconfigurationStage stage, ErrorHandler* errh
         if (!storage.get_value(i).initialized())
             storage.get_value(i).initialize(_ring_size);
     }
+    _occupancy.resize(storage.weight(), occupancy());
 
     for (int i = 0; i < passing.size(); i++) {
         if (passing[i] && i != _home_thread_id) {
@@ -174,7 +216,10 @@ void Pipeliner::push_batch(int,PacketBatch* head) {
     //CLWB did not prove helpful here
     if (storage->insert(head->first())) {
         stats->count += count;
-        if (sleepiness >= _sleep_threshold)
+        if (unlikely(_high_watermark) && storage->count() >= _high_watermark) {
+            _full_note.sleep();
+            _task.reschedule(); // to wake the producers
+        } else if (sleepiness >= _sleep_threshold)
             _task.reschedule();
     } else {
         if (_block) {
@@ -205,6 +250,10 @@ Pipeliner::push(int,Packet* p)
 retry:
     if (storage->insert(p)) {
         stats->count++;
+        if (unlikely(_high_watermark) && storage->count() >= _high_watermark) {
+            _full_note.sleep();
+            _task.reschedule(); // to wake the producers
+        }
     } else {
         if (_block) {
             if (!_always_up && sleepiness >= _sleep_threshold)
@@ -226,11 +275,42 @@ retry:
         _task.reschedule();
 }
 
+/**
+ * Adapt the burst size after @a n packets were dequeued from a ring, leaving
+ * @a left entries in it, and pushed downstream in @a cycles.
+ */
+inline void
+Pipeliner::adapt_burst(int n, unsigned left, click_cycles_t cycles)
+{
+    if (n > 0 && _latency) {
+        // EWMA with a 1/8 weight, in 1/256th of cycles
+        click_cycles_t c = (cycles << 8) / n;
+        _packet_cycles = _packet_cycles ? _packet_cycles - (_packet_cycles >> 3) + (c >> 3) : c;
+    }
+    int burst = _cur_burst;
+    if (left >= (unsigned) _ring_size / 4)
+        burst *= 2;
+    else if (left == 0 && n < burst / 2)
+        burst -= burst / 4;
+    if (_latency && _packet_cycles) {
+        click_cycles_t cap = (_latency << 8) / _packet_cycles;
+        if ((click_cycles_t) burst > cap)
+            burst = cap;
+    }
+    if (burst > _max_burst)
+        burst = _max_burst;
+    else if (burst < _min_burst)
+        burst = _min_burst;
+    _cur_burst = burst;
+}
+
 #define HINT_THRESHOLD 32
 bool
 Pipeliner::run_task(Task* t)
 {
     bool r = false;
+    bool below_low = true;
+    int burst = _adaptive ? _cur_burst : _burst;
     _last_start++; //Used to RR the balancing of revert storage
     for (unsigned j = 0; j < storage.weight(); j++) {
         int i = (_last_start + j) % storage.weight();
@@ -239,7 +319,13 @@ Pipeliner::run_task(Task* t)
         PacketBatch* out = NULL;
 #endif
         int n = 0;
-        while (!s.is_empty() && n < _burst) {
+        click_cycles_t start = 0;
+        if (_adaptive) {
+            _occupancy[i].bucket[s.count() * occupancy_buckets / _ring_size]++;
+            if (_latency)
+                start = click_get_cycles();
+        }
+        while (!s.is_empty() && n < burst) {
 #if HAVE_BATCH
             PacketBatch* b = reinterpret_cast<PacketBatch*>(s.extract());
 
@@ -275,8 +361,11 @@ Pipeliner::run_task(Task* t)
             r = true;
 #endif
         }
-        if (s.count() > _highwater)
-            _highwater = s.count();
+        unsigned left = s.count();
+        if (left > _highwater)
+            _highwater = left;
+        if (left > _low_watermark)
+            below_low = false;
 
 #if HAVE_BATCH
         if (out) {
@@ -285,7 +374,22 @@ Pipeliner::run_task(Task* t)
         }
 #endif
 
+        if (_adaptive) {
+            adapt_burst(n, left, start ? click_get_cycles() - start : 0);
+            burst = _cur_burst;
+        }
+    }
+
+    // Producers sleeping on the full notifier are woken once all rings
+    // drained to the low watermark, so keep running until then
+    bool producers_waiting = false;
+    if (unlikely(_high_watermark) && !_full_note.active()) {
+        if (below_low)
+            _full_note.wake();
+        else
+            producers_waiting = true;
     }
+
     if (unlikely(!_active))
         return r;
 
@@ -294,7 +398,7 @@ Pipeliner::run_task(Task* t)
     } else {
         if (!r) {
             sleepiness++;
-            if (sleepiness < _sleep_threshold) {
+            if (sleepiness < _sleep_threshold || producers_waiting) {
                 t->fast_reschedule();
             }
         } else {
@@ -319,6 +423,29 @@ Pipeliner::write_handler(const String &conf, Element* e, void*, ErrorHandler* er
     return 0;
 }
 
+String
+Pipeliner::occupancy_handler(Element *e, void *)
+{
+    Pipeliner *p = static_cast<Pipeliner *>(e);
+    StringAccum sa;
+    for (int i = 0; i < p->_occupancy.size(); i++) {
+        sa << p->storage.get_mapping(i);
+        for (int b = 0; b < occupancy_buckets; b++)
+            sa << ' ' << p->_occupancy[i].bucket[b];
+        sa << '\n';
+    }
+    return sa.take_string();
+}
+
+int
+Pipeliner::reset_occupancy_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    Pipeliner *p = static_cast<Pipeliner *>(e);
+    for (int i = 0; i < p->_occupancy.size(); i++)
+        p->_occupancy[i] = occupancy();
+    return 0;
+}
+
 void
 Pipeliner::add_handlers()
 {
@@ -327,6 +454,9 @@ Pipeliner::add_handlers()
     add_data_handlers("active", Handler::OP_READ, &_active);
     add_write_handler("active", write_handler, 0);
     add_data_handlers("highwater", Handler::OP_READ, &_highwater);
+    add_data_handlers("burst", Handler::OP_READ, _adaptive ? &_cur_burst : &_burst);
+    add_read_handler("occupancy", occupancy_handler, 0);
+    add_write_handler("reset_occupancy", reset_occupancy_handler, 0, Handler::BUTTON);
 }
 
 CLICK_ENDDECLS
@@ -6,6 +6,7 @@
 #include <click/task.hh>
 #include <click/ring.hh>
 #include <click/multithread.hh>
+#include <click/notifier.hh>
 
 CLICK_DECLS
 
@@ -25,6 +26,61 @@ of packets pushed to this element to another core, without the inherent
 scheduling cost of normal queues. Multiple thread can push packets to
 this queue, and the home thread of this element will push packet out.
 
+In ADAPTIVE mode, the number of packets pushed out of each ring at once
+follows the load. It doubles when the ring is still a quarter full after a
+burst, and shrinks by a quarter when the ring empties with less than half a
+burst. If LATENCY is set, it is also capped so that pushing a burst downstream
+takes about LATENCY, as measured on the previous bursts.
+
+If HIGH_WATERMARK is set, Pipeliner provides a full notifier: upstream
+elements that listen to it, such as InfiniteSource and RatedSource, stop
+pushing when a ring holds HIGH_WATERMARK entries, and resume when all rings
+are back to LOW_WATERMARK, instead of spinning or dropping.
+
+Keyword arguments include:
+
+=over 8
+
+=item ADAPTIVE
+
+Boolean. Adapt the burst size to ring occupancy and downstream service time.
+Default is false.
+
+=item MIN_BURST, MAX_BURST
+
+Integers. Bounds of the burst size in ADAPTIVE mode, which starts at BURST.
+Defaults are 1 and 8 times BURST.
+
+=item LATENCY
+
+Time. Target time to push a burst downstream in ADAPTIVE mode. Default is 0
+(no target).
+
+=item HIGH_WATERMARK
+
+Integer. Ring occupancy, in entries, at which the full notifier goes inactive.
+With batching, entries are batches. Default is 0 (no notifier).
+
+=item LOW_WATERMARK
+
+Integer. Occupancy of all rings at which the full notifier goes active again.
+Default is half of HIGH_WATERMARK.
+
+=back
+
+=h burst read-only
+
+Returns the current burst size.
+
+=h occupancy read-only
+
+Returns one line per ring, with the thread pushing to it, then a histogram of
+its occupancy, sampled each time the home thread visits the ring, in 8
+buckets of an eighth of the ring capacity each. Only sampled in ADAPTIVE mode.
+
+=h reset_occupancy write-only
+
+Clears the occupancy histograms.
 
 =a StaticThreadSched, Queue
 
@@ -41,6 +97,7 @@ public:
     const char *class_name() const override      { return "Pipeliner"; }
     const char *port_count() const override      { return "1-/1"; }
     const char *processing() const override      { return PUSH; }
+    void *cast(const char *) override;
 
     int configure(Vector<String>&, ErrorHandler*) override CLICK_COLD;
     int thread_configure(ThreadReconfigurationStage, ErrorHandler*, Bitvector threads) override CLICK_COLD;
@@ -84,6 +141,8 @@ public:
     }
 
     static int write_handler(const String &conf, Element* e, void*, ErrorHandler*);
+    static String occupancy_handler(Element *e, void *);
+    static int reset_occupancy_handler(const String &, Element *e, void *, ErrorHandler *);
     void add_handlers() CLICK_COLD;
 
     int _ring_size;
@@ -111,6 +170,28 @@ public:
     int _sleep_threshold;
     unsigned long _highwater; //Not volatile, if not exact we don't care much
 
+    bool _adaptive;
+    int _min_burst;
+    int _max_burst;
+    int _cur_burst;
+    click_cycles_t _latency;        // target cycles to push a burst, or 0
+    click_cycles_t _packet_cycles;  // EWMA of cycles to push a packet, scaled by 2^8
+
+    unsigned _high_watermark;
+    unsigned _low_watermark;
+    ActiveNotifier _full_note;
+
+    enum { occupancy_buckets = 8 };
+    struct occupancy {
+        occupancy() {
+            memset(bucket, 0, sizeof(bucket));
+        }
+        uint64_t bucket[occupancy_buckets];
+    };
+    Vector<occupancy> _occupancy;   // per ring, written by the home thread only
+
+    inline void adapt_burst(int n, unsigned left, click_cycles_t cycles);
+
   protected:
     Task _task;
     unsigned int _last_start;
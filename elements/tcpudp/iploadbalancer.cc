@@ -66,11 +66,19 @@ int IPLoadBalancer::initialize(ErrorHandler *errh) {
 
 #if HAVE_BATCH
 void IPLoadBalancer::push_batch(int, PacketBatch* batch) {
-
-    auto fnt = [this](Packet*&p) {
+    // servers are picked by chunks, while the next packets are still linked
+    enum { chunk = 64 };
+    int servers[chunk];
+    int i = chunk;
+
+    auto fnt = [this,&servers,&i](Packet*&p) {
+        if (i == chunk) {
+            pick_servers(p, chunk, servers);
+            i = 0;
+        }
         WritablePacket* q =p->uniqueify();
 
-        unsigned hash = pick_server(q);
+        unsigned hash = servers[i++];
         IPAddress srv = _dsts.unchecked_at(hash);
 	track_load(q, hash);
 
@@ -37,8 +37,46 @@ IP Address. Can be repeated multiple times, once per destination.
 =item VIP
 IP Address of this load-balancer.
 
+=item LB_MODE
+
+The load-balancing method: rr, wrr, awrr, hash, chash, hash_ip, hash_agg,
+cst_hash_agg, least, pow2, table or maglev. Default is rr.
+
+In maglev mode, flows are hashed into a Maglev lookup table of MAGLEV_SIZE
+entries, which spreads them evenly among the active servers according to their
+WEIGHTS. When a server is added or removed, only a small share of the flows of
+the other servers move. The table is rebuilt by the handler that changes the
+servers, and replaced under RCU.
+
+=item NSERVER
+
+Integer. Number of DST that are active at start, the following ones are
+spares. Default is all of them.
+
+=item MAGLEV_SIZE
+
+Integer. Size of the maglev table, which must be a prime number much larger
+than the number of servers. Default is 65537.
+
+=item WEIGHTS
+
+List of integers, one per DST, giving the relative weights of the servers in
+maglev mode. Default is 1 for all.
+
 =back
 
+=h add_server write-only
+
+In maglev mode, activate a spare server, given by its index in the DST list or
+its address.
+
+=h remove_server write-only
+
+In maglev mode, deactivate a server, given by its index or its address.
+
+=h weights read/write
+
+In maglev mode, the weights of the servers, as a space-separated list.
 
 =a
 
@@ -0,0 +1,158 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * cksumtest.{cc,hh} -- regression test element for Internet checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "cksumtest.hh"
+#include <click/error.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+CksumTest::CksumTest()
+{
+}
+
+// The RFC 1071 loop, one halfword at a time.
+static uint16_t
+reference_cksum(const unsigned char *x, int len)
+{
+    uint32_t sum = 0;
+    for (; len > 1; x += 2, len -= 2) {
+	uint16_t hw;
+	memcpy(&hw, x, 2);
+	sum += hw;
+    }
+    if (len == 1) {
+	uint16_t hw = 0;
+	*reinterpret_cast<unsigned char *>(&hw) = *x;
+	sum += hw;
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum += sum >> 16;
+    return ~sum & 0xFFFF;
+}
+
+#define CHECK(x, ...) if (!(x)) return errh->error("%s:%d: " __VA_ARGS__);
+
+int
+CksumTest::initialize(ErrorHandler *errh)
+{
+    enum { maxlen = 1600, nalign = 8 };
+    unsigned char *buf = new unsigned char[maxlen + nalign];
+    uint32_t seed = 0x2545F491;
+    for (int i = 0; i < maxlen + nalign; ++i) {
+	seed = seed * 1103515245 + 12345;
+	buf[i] = seed >> 16;
+    }
+
+    // single ranges, every length up to a full frame, every alignment
+    for (int align = 0; align < nalign; ++align)
+	for (int len = 0; len <= maxlen; ++len) {
+	    uint16_t expected = reference_cksum(buf + align, len);
+	    uint16_t got = click_in_cksum(buf + align, len);
+	    if (got != expected) {
+		delete[] buf;
+		return errh->error("%s:%d: click_in_cksum(+%d, %d) = %04x, expected %04x", __FILE__, __LINE__, align, len, got, expected);
+	    }
+	}
+
+#if !CLICK_LINUXMODULE
+    // every compiled kernel, not only the one this CPU selects
+    for (int k = 0; k < 8; ++k) {
+	uint16_t got;
+	const char *name = click_in_cksum_kernel(k, buf, 0, &got);
+	if (!name)
+	    continue;
+	for (int align = 0; align < nalign; ++align)
+	    for (int len = 0; len <= maxlen; ++len) {
+		uint16_t expected = reference_cksum(buf + align, len);
+		click_in_cksum_kernel(k, buf + align, len, &got);
+		if (got != expected) {
+		    delete[] buf;
+		    return errh->error("%s:%d: %s kernel (+%d, %d) = %04x, expected %04x", __FILE__, __LINE__, name, align, len, got, expected);
+		}
+	    }
+    }
+#endif
+
+    // all-ones data stresses the carries
+    memset(buf, 0xFF, maxlen);
+    for (int len = 0; len <= maxlen; len += 7) {
+	uint16_t expected = reference_cksum(buf, len);
+	uint16_t got = click_in_cksum(buf, len);
+	if (got != expected) {
+	    delete[] buf;
+	    return errh->error("%s:%d: click_in_cksum(0xFF x %d) = %04x, expected %04x", __FILE__, __LINE__, len, got, expected);
+	}
+#if !CLICK_LINUXMODULE
+	for (int k = 0; k < 8; ++k)
+	    if (const char *name = click_in_cksum_kernel(k, buf, len, &got))
+		if (got != expected) {
+		    delete[] buf;
+		    return errh->error("%s:%d: %s kernel (0xFF x %d) = %04x, expected %04x", __FILE__, __LINE__, name, len, got, expected);
+		}
+#endif
+    }
+    delete[] buf;
+
+    // many IP headers at once, with and without options
+    enum { nhdr = 37 };
+    unsigned char hdrs[nhdr][60];
+    const unsigned char *addrs[nhdr];
+    int lens[nhdr];
+    uint16_t csums[nhdr];
+    for (int i = 0; i < nhdr; ++i) {
+	for (int j = 0; j < 60; ++j) {
+	    seed = seed * 1103515245 + 12345;
+	    hdrs[i][j] = seed >> 16;
+	}
+	addrs[i] = hdrs[i];
+	lens[i] = (i % 3 ? 20 : 20 + 4 * (i % 11));
+    }
+    click_in_cksum_multi(addrs, lens, csums, nhdr);
+    for (int i = 0; i < nhdr; ++i)
+	CHECK(csums[i] == reference_cksum(hdrs[i], lens[i]), "click_in_cksum_multi header %d", __FILE__, __LINE__, i);
+
+    // a header with a correct checksum sums to 0
+    click_ip *iph = reinterpret_cast<click_ip *>(hdrs[1]);
+    iph->ip_v = 4;
+    iph->ip_hl = 5;
+    iph->ip_sum = 0;
+    iph->ip_sum = click_in_cksum(hdrs[1], 20);
+    CHECK(click_in_cksum(hdrs[1], 20) == 0, "checksummed header does not verify", __FILE__, __LINE__);
+
+    // incremental updates agree with full recomputation
+    for (int i = 0; i < 1000; ++i) {
+	seed = seed * 1103515245 + 12345;
+	uint32_t new_addr = seed ^ (seed << 7);
+	uint32_t old_addr = iph->ip_src.s_addr;
+	if (i % 100 == 0)
+	    new_addr = ~old_addr;
+	iph->ip_src.s_addr = new_addr;
+	click_update_in_cksum32(&iph->ip_sum, old_addr, new_addr);
+	CHECK(click_in_cksum(hdrs[1], 20) == 0, "click_update_in_cksum32 round %d", __FILE__, __LINE__, i);
+
+	uint16_t old_hw = reinterpret_cast<uint16_t *>(iph)[4];
+	uint16_t new_hw = seed >> 3;
+	reinterpret_cast<uint16_t *>(iph)[4] = new_hw;
+	click_update_in_cksum(&iph->ip_sum, old_hw, new_hw);
+	CHECK(click_in_cksum(hdrs[1], 20) == 0, "click_update_in_cksum round %d", __FILE__, __LINE__, i);
+    }
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+EXPORT_ELEMENT(CksumTest)
+CLICK_ENDDECLS
@@ -0,0 +1,38 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CKSUMTEST_HH
+#define CLICK_CKSUMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+CksumTest()
+
+=s test
+
+runs regression tests for Internet checksum functions
+
+=d
+
+CksumTest runs regression tests for Click's Internet checksum functions at
+initialization time. It checks click_in_cksum, click_in_cksum_multi and
+every summing kernel compiled in and supported by the CPU against a simple
+reference implementation, for many lengths and alignments,
+and checks that click_update_in_cksum and click_update_in_cksum32 agree with
+a full recomputation. It does not route packets.
+
+*/
+
+class CksumTest : public Element { public:
+
+    CksumTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "CksumTest"; }
+
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,291 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flowcuckootest.{cc,hh} -- regression test element for FlowCuckooTable
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowcuckootest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/hashtable.hh>
+#include <click/timestamp.hh>
+#include <click/flow/flowcuckoo.hh>
+#if HAVE_FLOW_RTE_HASH
+# include <rte_hash.h>
+# include <rte_lcore.h>
+#endif
+CLICK_DECLS
+
+namespace {
+typedef FlowCuckooTable<IPFlowID> Table;
+
+IPFlowID make_key(uint32_t i) {
+    return IPFlowID(IPAddress(htonl(0x0A000000 | (i >> 8))), htons(1024 + (i & 0xff)),
+		    IPAddress(htonl(0xC0A80001)), htons(80));
+}
+
+uint32_t key_hash(const IPFlowID &k) {
+    const uint32_t *w = reinterpret_cast<const uint32_t *>(&k);
+    return flow_crc32c_4byte(w[2], flow_crc32c_4byte(w[1], flow_crc32c_4byte(w[0], 0)));
+}
+
+void fill_batch(FlowKeyBatch &k, const uint32_t *ids, int n) {
+    k.count = n;
+    for (int i = 0; i < n; ++i) {
+	static_cast<IPFlowID &>(k.keys[i]) = make_key(ids[i]);
+	k.hashes[i] = key_hash(k.keys[i]);
+    }
+}
+}
+
+FlowCuckooTest::FlowCuckooTest()
+    : _benchmark(0), _capacity(1048576)
+{
+}
+
+int
+FlowCuckooTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.read("CAPACITY", _capacity)
+	.complete();
+}
+
+#define CHECK(x, ...) if (!(x)) return errh->error("%s:%d: " __VA_ARGS__);
+
+int
+FlowCuckooTest::regression_test(ErrorHandler *errh)
+{
+    // A capacity just under the 90% load the table is sized for
+    enum { n = 7300 };
+    Table t(n);
+    CHECK(t.initialized(), "allocation failed", __FILE__, __LINE__);
+    CHECK((uint64_t) n * 10 > (uint64_t) t.buckets() * Table::ways * 8, "table is oversized (%u buckets)", __FILE__, __LINE__, t.buckets());
+
+    for (uint32_t i = 0; i < n; ++i) {
+	IPFlowID k = make_key(i);
+	int pos = t.add(k, key_hash(k));
+	CHECK(pos >= 0, "add %u failed with %u keys", __FILE__, __LINE__, i, t.count());
+	CHECK(t.key(pos) == k, "key %u stored at the wrong position", __FILE__, __LINE__, i);
+	CHECK(t.add(k, key_hash(k)) == pos, "re-add %u moved the key", __FILE__, __LINE__, i);
+    }
+    CHECK(t.count() == n, "count %u", __FILE__, __LINE__, t.count());
+    IPFlowID extra = make_key(n);
+    CHECK(t.add(extra, key_hash(extra)) < 0, "add to a full table succeeded", __FILE__, __LINE__);
+
+    for (uint32_t i = 0; i < n; ++i) {
+	IPFlowID k = make_key(i);
+	int pos = t.lookup(k, key_hash(k));
+	CHECK(pos >= 0 && t.key(pos) == k, "lookup %u failed", __FILE__, __LINE__, i);
+    }
+
+    for (uint32_t i = 0; i < n; i += 2) {
+	IPFlowID k = make_key(i);
+	CHECK(t.del(k, key_hash(k)) >= 0, "del %u failed", __FILE__, __LINE__, i);
+	CHECK(t.del(k, key_hash(k)) < 0, "del %u twice succeeded", __FILE__, __LINE__, i);
+    }
+    CHECK(t.count() == n / 2, "count %u after del", __FILE__, __LINE__, t.count());
+
+    // remove one key out of four by sweeping, in several passes
+    int swept = 0;
+    for (uint32_t b = 0; b < t.buckets(); b += 100)
+	swept += t.sweep(100, [&t](int pos) {
+		return (ntohs(t.key(pos).sport()) & 3) == 1;
+	    });
+    CHECK(swept == n / 4, "swept %d", __FILE__, __LINE__, swept);
+
+    FlowKeyBatch batch;
+    uint32_t ids[FlowKeyBatch::max_size];
+    for (uint32_t i = 0; i < n; i += FlowKeyBatch::max_size) {
+	int count = 0;
+	for (uint32_t j = i; j < n && count < FlowKeyBatch::max_size; ++j)
+	    ids[count++] = j;
+	fill_batch(batch, ids, count);
+	t.lookup_bulk(batch);
+	for (int j = 0; j < count; ++j) {
+	    bool present = (ids[j] & 3) == 3;
+	    CHECK((batch.positions[j] >= 0) == present, "bulk lookup %u: %d", __FILE__, __LINE__, ids[j], batch.positions[j]);
+	    CHECK(!present || t.key(batch.positions[j]) == make_key(ids[j]), "bulk lookup %u: wrong key", __FILE__, __LINE__, ids[j]);
+	}
+    }
+
+    // refill up to the capacity with new keys
+    uint32_t next = n;
+    while (t.count() < n) {
+	IPFlowID k = make_key(next++);
+	CHECK(t.add(k, key_hash(k)) >= 0, "refill failed at %u keys", __FILE__, __LINE__, t.count());
+    }
+    for (uint32_t i = 0; i < next; ++i) {
+	IPFlowID k = make_key(i);
+	bool present = i >= n || (i & 3) == 3;
+	CHECK((t.lookup(k, key_hash(k)) >= 0) == present, "lookup %u after refill", __FILE__, __LINE__, i);
+    }
+    return 0;
+}
+
+int
+FlowCuckooTest::displacement_test(ErrorHandler *errh)
+{
+    // Signatures are chosen so that a new key finds both of its buckets
+    // full, as well as the alternative buckets of the keys of its primary
+    // bucket: one of those must move two steps away to make room.
+    Table t(1024);
+    CHECK(t.buckets() == 256, "%u buckets", __FILE__, __LINE__, t.buckets());
+    Vector<IPFlowID> keys;
+    Vector<uint32_t> sigs;
+    // bucket 0 holds tags 1 to 8, whose alternative buckets are 1 to 8
+    for (uint32_t k = 0; k < Table::ways; ++k) {
+	keys.push_back(make_key(k));
+	sigs.push_back((1 + k) << 16);
+    }
+    // buckets 1 to 8 are full, their keys can move to buckets 0x40-0x4f
+    for (uint32_t b = 1; b <= Table::ways; ++b)
+	for (uint32_t k = 0; k < Table::ways; ++k) {
+	    keys.push_back(make_key(100 + b * Table::ways + k));
+	    sigs.push_back(((0x140 + k) << 16) | b);
+	}
+    // bucket 9 is full
+    for (uint32_t k = 0; k < Table::ways; ++k) {
+	keys.push_back(make_key(200 + k));
+	sigs.push_back(((0x180 + k) << 16) | 9);
+    }
+    for (int i = 0; i < keys.size(); ++i)
+	CHECK(t.add(keys[i], sigs[i]) >= 0, "add %d failed", __FILE__, __LINE__, i);
+
+    // primary bucket 0, alternative bucket 9
+    keys.push_back(make_key(300));
+    sigs.push_back(9 << 16);
+    int pos = t.add(keys.back(), sigs.back());
+    CHECK(pos >= 0, "add with displacements failed", __FILE__, __LINE__);
+    for (int i = 0; i < keys.size(); ++i) {
+	int p = t.lookup(keys[i], sigs[i]);
+	CHECK(p >= 0 && t.key(p) == keys[i], "lookup %d after displacements", __FILE__, __LINE__, i);
+    }
+    CHECK(t.count() == (uint32_t) keys.size(), "count %u", __FILE__, __LINE__, t.count());
+
+    // the key can be removed and inserted again at once
+    CHECK(t.del(keys.back(), sigs.back()) == pos, "del failed", __FILE__, __LINE__);
+    CHECK(t.lookup(keys.back(), sigs.back()) < 0, "lookup after del", __FILE__, __LINE__);
+    CHECK(t.add(keys.back(), sigs.back()) >= 0, "re-add failed", __FILE__, __LINE__);
+    return 0;
+}
+
+int
+FlowCuckooTest::initialize(ErrorHandler *errh)
+{
+    if (regression_test(errh) < 0 || displacement_test(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+    if (_benchmark > 0)
+	benchmark(errh);
+    return 0;
+}
+
+void
+FlowCuckooTest::benchmark(ErrorHandler *errh)
+{
+    uint32_t n = _capacity * 9 / 10;
+    uint32_t *ids = new uint32_t[_benchmark];
+    for (uint32_t i = 0; i < _benchmark; ++i)
+	ids[i] = click_random(0, n - 1);
+    uint32_t *sigs = new uint32_t[n];
+    for (uint32_t i = 0; i < n; ++i)
+	sigs[i] = key_hash(make_key(i));
+    uint32_t found;
+    Timestamp start, single, bulk;
+    FlowKeyBatch batch;
+
+    {
+	Table t(_capacity);
+	for (uint32_t i = 0; i < n; ++i)
+	    t.add(make_key(i), sigs[i]);
+	found = 0;
+	start = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _benchmark; ++i)
+	    found += t.lookup(make_key(ids[i]), sigs[ids[i]]) >= 0;
+	single = Timestamp::now_steady();
+	for (uint32_t i = 0; i + FlowKeyBatch::max_size <= _benchmark; i += FlowKeyBatch::max_size) {
+	    fill_batch(batch, ids + i, FlowKeyBatch::max_size);
+	    t.lookup_bulk(batch);
+	    for (int j = 0; j < batch.count; ++j)
+		found += batch.positions[j] >= 0;
+	}
+	bulk = Timestamp::now_steady();
+	Timestamp ts = single - start, tb = bulk - single;
+	errh->message("FlowCuckooTable: %u flows, %u lookups: single %s, bulk %s (%u found)",
+		      n, _benchmark, ts.unparse_interval().c_str(), tb.unparse_interval().c_str(), found);
+    }
+
+#if HAVE_FLOW_RTE_HASH
+    if (dpdk_enabled) {
+	struct rte_hash_parameters params = {0};
+	String name = this->name() + "-bench";
+	params.name = name.c_str();
+	params.entries = _capacity;
+	params.key_len = sizeof(IPFlowID);
+	params.hash_func = rte_hash_crc;
+	params.socket_id = rte_socket_id();
+	rte_hash *h = rte_hash_create(&params);
+	if (!h) {
+	    errh->error("could not create rte_hash");
+	    goto out;
+	}
+	for (uint32_t i = 0; i < n; ++i) {
+	    IPFlowID k = make_key(i);
+	    rte_hash_add_key_with_hash(h, &k, sigs[i]);
+	}
+	found = 0;
+	start = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _benchmark; ++i) {
+	    IPFlowID k = make_key(ids[i]);
+	    found += rte_hash_lookup_with_hash(h, &k, sigs[ids[i]]) >= 0;
+	}
+	single = Timestamp::now_steady();
+	for (uint32_t i = 0; i + FlowKeyBatch::max_size <= _benchmark; i += FlowKeyBatch::max_size) {
+	    fill_batch(batch, ids + i, FlowKeyBatch::max_size);
+	    rte_hash_lookup_bulk(h, batch.key_ptrs, batch.count, batch.positions);
+	    for (int j = 0; j < batch.count; ++j)
+		found += batch.positions[j] >= 0;
+	}
+	bulk = Timestamp::now_steady();
+	rte_hash_free(h);
+	Timestamp ts = single - start, tb = bulk - single;
+	errh->message("rte_hash: %u flows, %u lookups: single %s, bulk %s (%u found)",
+		      n, _benchmark, ts.unparse_interval().c_str(), tb.unparse_interval().c_str(), found);
+	goto out;
+    }
+#endif
+    {
+	HashTable<IPFlowID, int> t;
+	for (uint32_t i = 0; i < n; ++i)
+	    t.set(make_key(i), i);
+	found = 0;
+	start = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _benchmark; ++i)
+	    found += t.find(make_key(ids[i])) != t.end();
+	single = Timestamp::now_steady();
+	Timestamp ts = single - start;
+	errh->message("HashTable: %u flows, %u lookups: single %s (%u found)",
+		      n, _benchmark, ts.unparse_interval().c_str(), found);
+    }
+#if HAVE_FLOW_RTE_HASH
+  out:
+#endif
+    delete[] ids;
+    delete[] sigs;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(FlowCuckooTest)
@@ -0,0 +1,66 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWCUCKOOTEST_HH
+#define CLICK_FLOWCUCKOOTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlowCuckooTest([I<keywords>])
+
+=s test
+
+runs regression tests for FlowCuckooTable
+
+=d
+
+Without other arguments, FlowCuckooTest runs regression tests for Click's
+FlowCuckooTable class at initialization time: the table is filled to its
+capacity, keys are removed, swept and added again, and single and bulk
+lookups must always find the keys that are in the table. Keys with chosen
+signatures then check that entries are moved away to make room for a key
+whose buckets are full. FlowCuckooTest does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Integer.  If set to a positive number, then FlowCuckooTest measures, at
+installation time, the time taken by BENCHMARK lookups of random existing
+flows, one by one and in bursts of 64, in a table of CAPACITY flows. If
+Click runs with DPDK, the same is measured with rte_hash. Otherwise, the
+comparison is made with Click's HashTable. Default is 0 (don't benchmark).
+
+=item CAPACITY
+
+Integer.  Number of flows of the benchmark. Default is 1048576.
+
+=back
+
+=a FlowIPManager */
+
+class FlowCuckooTest : public Element { public:
+
+    FlowCuckooTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "FlowCuckooTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    uint32_t _benchmark;
+    uint32_t _capacity;
+
+    int regression_test(ErrorHandler *errh);
+    int displacement_test(ErrorHandler *errh);
+    void benchmark(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
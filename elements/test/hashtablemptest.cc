@@ -17,23 +17,97 @@
 #include <click/config.h>
 #include "hashtablemptest.hh"
 #include <click/hashtablemp.hh>
+#include <click/args.hh>
 #include <click/error.hh>
 #include <click/etheraddress.hh>
 #include <click/ipaddress.hh>
+#include <click/timestamp.hh>
 #if CLICK_USERLEVEL
 # include <sys/time.h>
 # include <sys/resource.h>
 # include <unistd.h>
+# if HAVE_MULTITHREAD
+#  include <pthread.h>
+# endif
 #endif
 CLICK_DECLS
 
 HashTableMPTest::HashTableMPTest()
+    : _benchmark(0), _threads(0), _keys(65536), _reads(90)
 {
 }
 
+int
+HashTableMPTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _threads = click_max_cpu_ids();
+    if (Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.read("THREADS", _threads)
+	.read("KEYS", _keys)
+	.read("READS", _reads)
+	.complete() < 0)
+	return -1;
+    if (_threads < 1 || _threads > (int) click_max_cpu_ids())
+	return errh->error("THREADS must be between 1 and the number of Click threads (%d)", click_max_cpu_ids());
+    if (_reads > 100)
+	return errh->error("READS must be a percentage");
+    if (_keys == 0)
+	return errh->error("KEYS must be positive");
+    return 0;
+}
+
 #define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
 #define CHECK_DATA(x, y, l) CHECK(memcmp((x), (y), (l)) == 0)
 
+int
+HashTableMPTest::rcu_regression_test(ErrorHandler *errh)
+{
+    HashContainerRCU<uint32_t, uint32_t> h;
+    uint32_t v;
+    CHECK(h.empty());
+    CHECK(!h.find(1, v));
+    CHECK(h.insert(1, 10));
+    CHECK(h.find(1, v) && v == 10);
+    CHECK(!h.insert(1, 11));
+    CHECK(h.find(1, v) && v == 11);
+    v = 12;
+    CHECK(!h.find_insert(1, v) && v == 11);
+    v = 20;
+    CHECK(h.find_insert(2, v) && v == 20);
+    CHECK(h.size() == 2);
+    CHECK(h.erase(1));
+    CHECK(!h.erase(1));
+    CHECK(!h.contains(1));
+    CHECK(h.contains(2));
+    CHECK(h.size() == 1);
+
+    // Grow the table, checking lookups while buckets are being migrated
+    enum { n = 20000 };
+    uint32_t initial_buckets = h.buckets();
+    bool seen_resizing = false;
+    for (uint32_t i = 0; i < n; i++) {
+	h.insert(i, i * 3);
+	seen_resizing |= h.resizing();
+	if ((i & 127) == 0)
+	    for (uint32_t j = 0; j <= i; j += 7)
+		CHECK(h.find(j, v) && v == j * 3);
+    }
+    CHECK(seen_resizing);
+    CHECK(h.buckets() > initial_buckets);
+    CHECK(h.size() == n);
+    for (uint32_t i = 0; i < n; i += 2)
+	CHECK(h.erase(i));
+    for (uint32_t i = 0; i < n; i++)
+	CHECK(h.contains(i) == (i & 1));
+    CHECK(h.size() == n / 2);
+    h.clear();
+    CHECK(h.empty());
+    CHECK(!h.contains(1));
+    h.collect();
+    return 0;
+}
+
 int
 HashTableMPTest::initialize(ErrorHandler *errh)
 {
@@ -59,9 +133,119 @@ HashTableMPTest::initialize(ErrorHandler *errh)
 	CHECK(cache.find(ip,32,lookup,true));
 	CHECK(cache.size() == 1);
 
+    if (rcu_regression_test(errh) < 0)
+	return -1;
+
     errh->message("All tests pass!");
+
+    if (_benchmark > 0)
+	benchmark(errh);
     return 0;
 }
 
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+namespace {
+typedef HashTableMP<uint32_t, uint32_t> BenchMP;
+typedef HashContainerRCU<uint32_t, uint32_t> BenchRCU;
+
+inline bool bench_find(BenchMP &h, uint32_t k) {
+    return h.find(k);
+}
+inline bool bench_find(BenchRCU &h, uint32_t k) {
+    uint32_t v;
+    return h.find(k, v);
+}
+inline void bench_insert(BenchMP &h, uint32_t k) {
+    h.insert(k, k);
+}
+inline void bench_insert(BenchRCU &h, uint32_t k) {
+    h.insert(k, k);
+}
+
+template <typename T>
+struct BenchState {
+    T *table;
+    int id;
+    uint32_t nops;
+    uint32_t keys;
+    unsigned reads;
+    volatile bool *go;
+    uint32_t found;
+};
+
+template <typename T>
+void *bench_thread(void *arg)
+{
+    BenchState<T> *s = static_cast<BenchState<T> *>(arg);
+    click_current_thread_id = s->id;
+    uint32_t r = 2463534242U + s->id * 7919;
+    uint32_t found = 0;
+    while (!*s->go)
+	click_relax_fence();
+    for (uint32_t i = 0; i < s->nops; i++) {
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	uint32_t k = r % s->keys;
+	unsigned op = (r >> 16) % 200;
+	if (op < 2 * s->reads)
+	    found += bench_find(*s->table, k);
+	else if (op & 1)
+	    bench_insert(*s->table, k);
+	else
+	    s->table->erase(k);
+    }
+    s->found = found;
+    return 0;
+}
+
+template <typename T>
+double run_bench(T &table, int nthreads, uint32_t nops, uint32_t keys, unsigned reads)
+{
+    for (uint32_t k = 0; k < keys; k += 2)
+	bench_insert(table, k);
+    volatile bool go = false;
+    BenchState<T> *states = new BenchState<T>[nthreads];
+    pthread_t *threads = new pthread_t[nthreads];
+    for (int i = 0; i < nthreads; i++) {
+	BenchState<T> s = {&table, i, nops, keys, reads, &go, 0};
+	states[i] = s;
+	pthread_create(&threads[i], 0, bench_thread<T>, &states[i]);
+    }
+    Timestamp start = Timestamp::now_steady();
+    go = true;
+    for (int i = 0; i < nthreads; i++)
+	pthread_join(threads[i], 0);
+    Timestamp elapsed = Timestamp::now_steady() - start;
+    delete[] states;
+    delete[] threads;
+    return (double) nops * nthreads / elapsed.doubleval();
+}
+}
+#endif
+
+void
+HashTableMPTest::benchmark(ErrorHandler *errh)
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    // The benchmark threads take the identity of Click threads 0..THREADS-1
+    int saved_id = click_current_thread_id;
+    double mp, rcu;
+    {
+	BenchMP h;
+	mp = run_bench(h, _threads, _benchmark, _keys, _reads);
+    }
+    {
+	BenchRCU h;
+	rcu = run_bench(h, _threads, _benchmark, _keys, _reads);
+    }
+    click_current_thread_id = saved_id;
+    errh->message("%d threads, %u%% reads: HashTableMP %.0f op/s, HashContainerRCU %.0f op/s (x%.2f)",
+		  _threads, _reads, mp, rcu, rcu / mp);
+#else
+    errh->warning("BENCHMARK requires multithreaded userlevel Click");
+#endif
+}
+
 EXPORT_ELEMENT(HashTableMPTest)
 CLICK_ENDDECLS
@@ -7,16 +7,45 @@ CLICK_DECLS
 /*
 =c
 
-HashTableMPTest()
+HashTableMPTest([I<keywords>])
 
 =s test
 
-runs regression tests for HashTable<K, V>
+runs regression tests for HashTableMP<K, V>
 
 =d
 
-HashTableMPTest runs HashTable regression tests at initialization time. It
-does not route packets.
+HashTableMPTest runs AgingTable and HashContainerRCU regression tests at
+initialization time. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Integer.  If set to a positive number, then HashTableMPTest compares, at
+installation time, the throughput of HashTableMP and HashContainerRCU with
+THREADS threads running concurrently. Each thread runs BENCHMARK operations on
+a table pre-filled with KEYS keys, of which READS percent are lookups, the
+others being insertions and removals in equal parts. The number of operations
+per second of each table is printed. Default is 0 (don't benchmark).
+
+=item THREADS
+
+Integer.  Number of threads of the benchmark. Click must be started with at
+least that many threads (B<-j>). Default is the number of Click threads.
+
+=item KEYS
+
+Integer.  Number of keys of the benchmark. Default is 65536.
+
+=item READS
+
+Integer between 0 and 100.  Percentage of lookups of the benchmark. Default is
+90.
+
+=back
 
 */
 
@@ -26,8 +55,19 @@ class HashTableMPTest : public Element { public:
 
     const char *class_name() const override		{ return "HashTableMPTest"; }
 
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
     int initialize(ErrorHandler *) CLICK_COLD;
 
+  private:
+
+    uint32_t _benchmark;
+    int _threads;
+    uint32_t _keys;
+    unsigned _reads;
+
+    int rcu_regression_test(ErrorHandler *errh);
+    void benchmark(ErrorHandler *errh);
+
 };
 
 CLICK_ENDDECLS
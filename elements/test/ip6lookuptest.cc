@@ -0,0 +1,258 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ip6lookuptest.{cc,hh} -- regression test and benchmark element for
+ * PoptrieIP6Lookup
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "ip6lookuptest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+#include "elements/ip6/poptrieip6lookup.hh"
+CLICK_DECLS
+
+namespace {
+// Prefix lengths of the synthetic table, in routes per thousand
+const struct {
+    int len;
+    int weight;
+} length_distribution[] = {
+    { 16, 2 }, { 19, 3 }, { 20, 5 }, { 24, 5 }, { 28, 10 }, { 29, 30 },
+    { 30, 5 }, { 31, 5 }, { 32, 120 }, { 33, 20 }, { 34, 15 }, { 35, 10 },
+    { 36, 40 }, { 38, 10 }, { 40, 70 }, { 42, 20 }, { 44, 90 }, { 45, 20 },
+    { 46, 30 }, { 47, 25 }, { 48, 442 }, { 56, 10 }, { 64, 10 }, { 128, 3 }
+};
+
+int random_length() {
+    int r = click_random(0, 999);
+    for (unsigned i = 0; ; i++) {
+	r -= length_distribution[i].weight;
+	if (r < 0 || i == sizeof(length_distribution) / sizeof(length_distribution[0]) - 1)
+	    return length_distribution[i].len;
+    }
+}
+
+IP6Address random_bits() {
+    IP6Address a;
+    for (int i = 0; i < 4; i++)
+	a.data32()[i] = click_random(0, 0xFFFFFFFFU);
+    return a;
+}
+}
+
+IP6LookupTest::IP6LookupTest()
+    : _table(0), _prefixes(200000), _benchmark(0), _gateways(32)
+{
+}
+
+int
+IP6LookupTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *e;
+    if (Args(conf, this, errh)
+	.read_mp("TABLE", ElementCastArg("PoptrieIP6Lookup"), e)
+	.read("PREFIXES", _prefixes)
+	.read("BENCHMARK", _benchmark)
+	.read("GATEWAYS", _gateways)
+	.complete() < 0)
+	return -1;
+    _table = static_cast<PoptrieIP6Lookup *>(e);
+    if (_table->noutputs() == 0)
+	return errh->error("TABLE has no output");
+    if (_gateways == 0)
+	return errh->error("GATEWAYS must be positive");
+    return 0;
+}
+
+/**
+ * Generate _prefixes routes in 2000::/3. Routes up to /32 are spread over
+ * the whole space, longer ones are more specifics of a shorter route.
+ */
+void
+IP6LookupTest::generate()
+{
+    IP6Address global = IP6Address::make_prefix(3);
+    IP6Address global_addr("2000::");
+    Vector<int> allocations;
+    while ((uint32_t) _routes.size() < _prefixes) {
+	Route r;
+	r.len = random_length();
+	IP6Address base = global_addr;
+	IP6Address base_mask = global;
+	if (r.len > 32 && allocations.size()) {
+	    const Route &a = _routes[allocations[click_random(0, allocations.size() - 1)]];
+	    base = a.addr;
+	    base_mask = IP6Address::make_prefix(a.len);
+	}
+	IP6Address mask = IP6Address::make_prefix(r.len);
+	r.addr = (base & base_mask) | (random_bits() & ~base_mask & mask);
+	if (_ref[r.len].find(r.addr) != _ref[r.len].end())
+	    continue;
+	uint32_t g = click_random(0, _gateways - 1);
+	if (g > 0) {
+	    r.gw = IP6Address("fe80::");
+	    r.gw.data32()[3] = htonl(g);
+	}
+	r.port = g % _table->noutputs();
+	_ref[r.len].set(r.addr, _routes.size());
+	if (r.len >= 29 && r.len <= 32)
+	    allocations.push_back(_routes.size());
+	_routes.push_back(r);
+    }
+}
+
+/** Return a random address of route @a i, or of 2000::/3 if @a i < 0 */
+IP6Address
+IP6LookupTest::random_address(int i) const
+{
+    IP6Address bits = random_bits();
+    if (i < 0)
+	return IP6Address("2000::") | (bits & IP6Address::make_inverted_prefix(3));
+    const Route &r = _routes[i];
+    return r.addr | (bits & IP6Address::make_inverted_prefix(r.len));
+}
+
+int
+IP6LookupTest::reference_lookup(const IP6Address &a) const
+{
+    for (int len = 128; len >= 0; len--)
+	if (_ref[len].size()) {
+	    HashTable<IP6Address, int>::const_iterator it = _ref[len].find(a & IP6Address::make_prefix(len));
+	    if (it != _ref[len].end())
+		return it.value();
+	}
+    return -1;
+}
+
+#define CHECK(x, ...) if (!(x)) return errh->error("%s:%d: " __VA_ARGS__);
+
+int
+IP6LookupTest::check(const char *what, ErrorHandler *errh)
+{
+    enum { burst = 64 };
+    IP6Address addr[burst], gw[burst];
+    int port[burst];
+    int n = _routes.size() < 50000 ? _routes.size() * 4 : 200000;
+    for (int b = 0; b < n; b += burst) {
+	for (int i = 0; i < burst; i++)
+	    addr[i] = random_address(i % 4 ? (int) click_random(0, _routes.size() - 1) : -1);
+	_table->lookup_routes(addr, burst, port, gw);
+	for (int i = 0; i < burst; i++) {
+	    int ri = reference_lookup(addr[i]);
+	    int expected = ri < 0 ? -1 : _routes[ri].port;
+	    IP6Address g;
+	    int p = _table->lookup_route(addr[i], g);
+	    CHECK(p == expected && (p < 0 || g == _routes[ri].gw),
+		  "%s: lookup %s returned %d %s, expected %d", __FILE__, __LINE__,
+		  what, addr[i].unparse().c_str(), p, g.unparse().c_str(), expected);
+	    CHECK(port[i] == p && (p < 0 || gw[i] == g),
+		  "%s: burst lookup %s returned %d %s, expected %d", __FILE__, __LINE__,
+		  what, addr[i].unparse().c_str(), port[i], gw[i].unparse().c_str(), p);
+	}
+    }
+    return 0;
+}
+
+int
+IP6LookupTest::regression_test(ErrorHandler *errh)
+{
+    IP6Address none("::");
+    int nroutes = _table->nroutes();
+    for (int i = 0; i < _routes.size(); i++) {
+	const Route &r = _routes[i];
+	CHECK(_table->add_route(r.addr, IP6Address::make_prefix(r.len), r.gw, r.port, errh) >= 0,
+	      "add %d failed", __FILE__, __LINE__, i);
+    }
+    CHECK(_table->nroutes() == nroutes + _routes.size(), "nroutes %d after add", __FILE__, __LINE__, _table->nroutes());
+    if (check("full table", errh) < 0)
+	return -1;
+
+    for (int i = 0; i < _routes.size(); i += 2) {
+	const Route &r = _routes[i];
+	CHECK(_table->remove_route(r.addr, IP6Address::make_prefix(r.len), errh) >= 0,
+	      "remove %d failed", __FILE__, __LINE__, i);
+	_ref[r.len].erase(r.addr);
+    }
+    if (check("half table", errh) < 0)
+	return -1;
+
+    for (int i = 0; i < _routes.size(); i += 2) {
+	const Route &r = _routes[i];
+	CHECK(_table->add_route(r.addr, IP6Address::make_prefix(r.len), r.gw, r.port, errh) >= 0,
+	      "add %d again failed", __FILE__, __LINE__, i);
+	_ref[r.len].set(r.addr, i);
+    }
+    if (check("table refilled", errh) < 0)
+	return -1;
+
+    // A default route catches all the misses, and leaves with them
+    IP6Address gw;
+    IP6Address outside("8000::1");
+    CHECK(_table->lookup_route(outside, gw) < 0, "lookup outside of the table", __FILE__, __LINE__);
+    CHECK(_table->add_route(none, none, IP6Address("fe80::ff"), 0, errh) >= 0, "add default failed", __FILE__, __LINE__);
+    CHECK(_table->lookup_route(outside, gw) == 0 && gw == IP6Address("fe80::ff"), "lookup with a default route", __FILE__, __LINE__);
+    CHECK(_table->remove_route(none, none, errh) >= 0, "remove default failed", __FILE__, __LINE__);
+    CHECK(_table->lookup_route(outside, gw) < 0, "lookup after default removal", __FILE__, __LINE__);
+    return check("default route removed", errh);
+}
+
+int
+IP6LookupTest::initialize(ErrorHandler *errh)
+{
+    generate();
+    Timestamp start = Timestamp::now_steady();
+    if (regression_test(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+    if (_benchmark > 0) {
+	Timestamp t = Timestamp::now_steady() - start;
+	errh->message("PoptrieIP6Lookup: %d routes, %lu bytes, tests in %s",
+		      _table->nroutes(), (unsigned long) _table->memory_size(),
+		      t.unparse_interval().c_str());
+	benchmark(errh);
+    }
+    return 0;
+}
+
+void
+IP6LookupTest::benchmark(ErrorHandler *errh)
+{
+    enum { burst = PoptrieIP6Lookup::burst_size };
+    IP6Address *addr = new IP6Address[_benchmark + burst];
+    for (uint32_t i = 0; i < _benchmark + burst; ++i)
+	addr[i] = random_address(click_random(0, _routes.size() - 1));
+    IP6Address gw[burst];
+    int port[burst];
+    uint32_t found = 0;
+
+    Timestamp start = Timestamp::now_steady();
+    for (uint32_t i = 0; i < _benchmark; ++i)
+	found += _table->lookup_route(addr[i], gw[0]) >= 0;
+    Timestamp single = Timestamp::now_steady();
+    for (uint32_t i = 0; i < _benchmark; i += burst) {
+	_table->lookup_routes(addr + i, burst, port, gw);
+	for (int j = 0; j < burst; ++j)
+	    found += port[j] >= 0;
+    }
+    Timestamp bulk = Timestamp::now_steady();
+
+    Timestamp ts = single - start, tb = bulk - single;
+    errh->message("PoptrieIP6Lookup: %u lookups: single %s, burst %s (%u found)",
+		  _benchmark, ts.unparse_interval().c_str(), tb.unparse_interval().c_str(), found);
+    delete[] addr;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel PoptrieIP6Lookup)
+EXPORT_ELEMENT(IP6LookupTest)
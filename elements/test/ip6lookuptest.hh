@@ -0,0 +1,92 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IP6LOOKUPTEST_HH
+#define CLICK_IP6LOOKUPTEST_HH
+#include <click/element.hh>
+#include <click/ip6address.hh>
+#include <click/hashtable.hh>
+CLICK_DECLS
+class PoptrieIP6Lookup;
+
+/*
+=c
+
+IP6LookupTest(TABLE [, I<keywords>])
+
+=s test
+
+runs regression tests and benchmarks for PoptrieIP6Lookup
+
+=d
+
+At initialization time, IP6LookupTest loads a synthetic IPv6 routing table
+of PREFIXES routes into TABLE, a PoptrieIP6Lookup element. The prefix lengths
+follow the distribution of a BGP view, with most routes being /48s, /32s and
+/44s, and the longer prefixes are clustered in the shorter ones, as more
+specific routes are.
+
+Lookups of addresses inside the routes and of random addresses are checked
+against a reference table, one by one and in bursts. Half of the routes are
+then removed and the lookups checked again, before the removed routes are
+added back. The full table is left in TABLE, so the configuration can also
+measure the forwarding rate of packets through it. IP6LookupTest does not
+route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item PREFIXES
+
+Integer.  Number of routes of the synthetic table. Default is 200000.
+
+=item BENCHMARK
+
+Integer.  If set to a positive number, then IP6LookupTest measures the time
+taken by BENCHMARK lookups of random addresses of the table, one by one and
+in bursts. Default is 0 (don't benchmark).
+
+=item GATEWAYS
+
+Integer.  Number of different gateways of the routes. Default is 32.
+
+=back
+
+=a PoptrieIP6Lookup */
+
+class IP6LookupTest : public Element { public:
+
+    IP6LookupTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "IP6LookupTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    struct Route {
+	IP6Address addr;
+	int len;
+	IP6Address gw;
+	int port;
+    };
+
+    PoptrieIP6Lookup *_table;
+    uint32_t _prefixes;
+    uint32_t _benchmark;
+    uint32_t _gateways;
+
+    Vector<Route> _routes;
+    HashTable<IP6Address, int> _ref[129];	// route index by prefix length
+
+    void generate();
+    IP6Address random_address(int i) const;
+    int reference_lookup(const IP6Address &a) const;
+    int check(const char *what, ErrorHandler *errh);
+    int regression_test(ErrorHandler *errh);
+    void benchmark(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
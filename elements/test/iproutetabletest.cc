@@ -0,0 +1,297 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * iproutetabletest.{cc,hh} -- regression test and update benchmark element
+ * for IPv4 routing tables
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "iproutetabletest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+#include <click/standard/scheduleinfo.hh>
+CLICK_DECLS
+
+namespace {
+// Prefix lengths of the synthetic table, in routes per thousand
+const struct {
+    int len;
+    int weight;
+} length_distribution[] = {
+    { 8, 1 }, { 12, 2 }, { 13, 3 }, { 14, 5 }, { 15, 8 }, { 16, 20 },
+    { 17, 10 }, { 18, 18 }, { 19, 35 }, { 20, 40 }, { 21, 45 }, { 22, 90 },
+    { 23, 80 }, { 24, 590 }, { 25, 5 }, { 26, 5 }, { 27, 5 }, { 28, 5 },
+    { 29, 6 }, { 30, 10 }, { 32, 17 }
+};
+
+int random_length() {
+    int r = click_random(0, 999);
+    for (unsigned i = 0; ; i++) {
+	r -= length_distribution[i].weight;
+	if (r < 0 || i == sizeof(length_distribution) / sizeof(length_distribution[0]) - 1)
+	    return length_distribution[i].len;
+    }
+}
+}
+
+IPRouteTableTest::IPRouteTableTest()
+    : _table(0), _prefixes(100000), _updates(10000), _gateways(16),
+      _benchmark(false), _churn(0), _nupdates(0), _task(this)
+{
+}
+
+int
+IPRouteTableTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *e;
+    if (Args(conf, this, errh)
+	.read_mp("TABLE", ElementCastArg("IPRouteTable"), e)
+	.read("PREFIXES", _prefixes)
+	.read("UPDATES", _updates)
+	.read("GATEWAYS", _gateways)
+	.read("BENCHMARK", _benchmark)
+	.read("CHURN", _churn)
+	.complete() < 0)
+	return -1;
+    _table = static_cast<IPRouteTable *>(e->cast("IPRouteTable"));
+    if (_table->noutputs() == 0)
+	return errh->error("TABLE has no output");
+    if (_gateways == 0)
+	return errh->error("GATEWAYS must be positive");
+    return 0;
+}
+
+/**
+ * Generate _prefixes routes in 1.0.0.0 to 223.255.255.255. Routes up to /24
+ * are spread over the whole space, longer ones are more specifics of a /24
+ * or shorter route.
+ */
+void
+IPRouteTableTest::generate()
+{
+    Vector<int> allocations;
+    while ((uint32_t) _routes.size() < _prefixes) {
+	int len = random_length();
+	uint32_t base = click_random(1, 223) << 24 | click_random(0, 0xFFFFFF);
+	if (len > 24 && allocations.size()) {
+	    const IPRoute &a = _routes[allocations[click_random(0, allocations.size() - 1)]];
+	    base = ntohl(a.addr.addr()) | (base & ~ntohl(a.mask.addr()));
+	}
+	uint32_t mask = ntohl(IPAddress::make_prefix(len).addr());
+	IPRoute r;
+	r.addr = IPAddress(htonl(base & mask));
+	r.mask = IPAddress(htonl(mask));
+	if (_ref[len].find(base & mask) != _ref[len].end())
+	    continue;
+	uint32_t g = click_random(0, _gateways - 1);
+	if (g > 0)
+	    r.gw = IPAddress(htonl(0x0A000000 | g));
+	r.port = g % _table->noutputs();
+	_ref[len].set(base & mask, _routes.size());
+	if (len >= 20 && len <= 24)
+	    allocations.push_back(_routes.size());
+	_routes.push_back(r);
+    }
+}
+
+/** Return a random address of route @a i, or of the whole space if @a i < 0 */
+IPAddress
+IPRouteTableTest::random_address(int i) const
+{
+    uint32_t bits = click_random(1, 223) << 24 | click_random(0, 0xFFFFFF);
+    if (i < 0)
+	return IPAddress(htonl(bits));
+    const IPRoute &r = _routes[i];
+    return IPAddress(r.addr.addr() | (htonl(bits) & ~r.mask.addr()));
+}
+
+int
+IPRouteTableTest::reference_lookup(IPAddress a) const
+{
+    uint32_t addr = ntohl(a.addr());
+    for (int len = 32; len >= 0; len--)
+	if (_ref[len].size()) {
+	    uint32_t mask = ntohl(IPAddress::make_prefix(len).addr());
+	    HashTable<uint32_t, int>::const_iterator it = _ref[len].find(addr & mask);
+	    if (it != _ref[len].end())
+		return it.value();
+	}
+    return -1;
+}
+
+#define CHECK(x, ...) if (!(x)) return errh->error("%s:%d: " __VA_ARGS__);
+
+int
+IPRouteTableTest::check(const char *what, ErrorHandler *errh)
+{
+    enum { burst = 64 };
+    IPAddress addr[burst], gw[burst];
+    int port[burst];
+    int n = _routes.size() < 50000 ? _routes.size() * 4 : 200000;
+    for (int b = 0; b < n; b += burst) {
+	for (int i = 0; i < burst; i++)
+	    addr[i] = random_address(i % 4 ? (int) click_random(0, _routes.size() - 1) : -1);
+	_table->lookup_routes(addr, burst, port, gw);
+	for (int i = 0; i < burst; i++) {
+	    int ri = reference_lookup(addr[i]);
+	    int expected = ri < 0 ? -1 : _routes[ri].port;
+	    IPAddress g;
+	    int p = _table->lookup_route(addr[i], g);
+	    CHECK(p == expected && (p < 0 || g == _routes[ri].gw),
+		  "%s: lookup %s returned %d %s, expected %d", __FILE__, __LINE__,
+		  what, addr[i].unparse().c_str(), p, g.unparse().c_str(), expected);
+	    CHECK(port[i] == p && (p < 0 || gw[i] == g),
+		  "%s: burst lookup %s returned %d %s, expected %d", __FILE__, __LINE__,
+		  what, addr[i].unparse().c_str(), port[i], gw[i].unparse().c_str(), p);
+	}
+    }
+    return 0;
+}
+
+/** Withdraw route @a i, and announce it again through another gateway */
+int
+IPRouteTableTest::update(int i, ErrorHandler *errh)
+{
+    IPRoute &r = _routes[i];
+    int r1 = _table->remove_route(r, 0, errh);
+    uint32_t g = click_random(0, _gateways - 1);
+    r.gw = g > 0 ? IPAddress(htonl(0x0A000000 | g)) : IPAddress();
+    r.port = g % _table->noutputs();
+    int r2 = _table->add_route(r, false, 0, errh);
+    return r1 < 0 ? r1 : r2;
+}
+
+int
+IPRouteTableTest::regression_test(ErrorHandler *errh)
+{
+    Timestamp start = Timestamp::now_steady();
+    CHECK(_table->load_routes(_routes, errh) >= 0, "load failed", __FILE__, __LINE__);
+    Timestamp loaded = Timestamp::now_steady();
+    if (check("loaded table", errh) < 0)
+	return -1;
+
+    Timestamp ustart = Timestamp::now_steady();
+    for (uint32_t u = 0; u < _updates; u++) {
+	int i = click_random(0, _routes.size() - 1);
+	CHECK(update(i, errh) >= 0, "update %d failed", __FILE__, __LINE__, i);
+    }
+    Timestamp updated = Timestamp::now_steady();
+    if (check("updated table", errh) < 0)
+	return -1;
+
+    for (int i = 0; i < _routes.size(); i += 2) {
+	const IPRoute &r = _routes[i];
+	CHECK(_table->remove_route(r, 0, errh) >= 0, "remove %d failed", __FILE__, __LINE__, i);
+	_ref[r.prefix_len()].erase(ntohl(r.addr.addr()));
+    }
+    if (check("half table", errh) < 0)
+	return -1;
+
+    CHECK(_table->load_routes(_routes, errh) >= 0, "reload failed", __FILE__, __LINE__);
+    for (int i = 0; i < _routes.size(); i += 2)
+	_ref[_routes[i].prefix_len()].set(ntohl(_routes[i].addr.addr()), i);
+    if (check("reloaded table", errh) < 0)
+	return -1;
+
+    // A default route catches all the misses, and leaves with them
+    IPAddress gw;
+    IPAddress outside(htonl(0xF0000001));
+    IPRoute dflt(IPAddress(), IPAddress(), IPAddress(htonl(0x0A0000FF)), 0);
+    CHECK(_table->lookup_route(outside, gw) < 0, "lookup outside of the table", __FILE__, __LINE__);
+    CHECK(_table->add_route(dflt, false, 0, errh) >= 0, "add default failed", __FILE__, __LINE__);
+    CHECK(_table->lookup_route(outside, gw) == 0 && gw == dflt.gw, "lookup with a default route", __FILE__, __LINE__);
+    CHECK(_table->remove_route(dflt, 0, errh) >= 0, "remove default failed", __FILE__, __LINE__);
+    CHECK(_table->lookup_route(outside, gw) < 0, "lookup after default removal", __FILE__, __LINE__);
+    if (check("default route removed", errh) < 0)
+	return -1;
+
+    if (_benchmark) {
+	Timestamp tl = loaded - start, tu = updated - ustart;
+	double rate = tu.doubleval() > 0 ? 2 * _updates / tu.doubleval() : 0;
+	errh->message("%s: %d routes loaded in %ss, %u updates in %ss (%.0f/s)",
+		      _table->declaration().c_str(), _routes.size(),
+		      tl.unparse().c_str(), 2 * _updates,
+		      tu.unparse().c_str(), rate);
+    }
+    return 0;
+}
+
+int
+IPRouteTableTest::initialize(ErrorHandler *errh)
+{
+    generate();
+    if (regression_test(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+    if (_benchmark)
+	benchmark(errh);
+    if (_churn > 0)
+	ScheduleInfo::initialize_task(this, &_task, errh);
+    return 0;
+}
+
+void
+IPRouteTableTest::benchmark(ErrorHandler *errh)
+{
+    enum { burst = IPRouteTable::burst_size, nlookups = 1000000 };
+    IPAddress *addr = new IPAddress[nlookups];
+    for (uint32_t i = 0; i < nlookups; ++i)
+	addr[i] = random_address(click_random(0, _routes.size() - 1));
+    IPAddress gw[burst];
+    int port[burst];
+    uint32_t found = 0, found_burst = 0;
+
+    Timestamp start = Timestamp::now_steady();
+    for (uint32_t i = 0; i < nlookups; ++i)
+	found += _table->lookup_route(addr[i], gw[0]) >= 0;
+    Timestamp single = Timestamp::now_steady();
+    for (uint32_t i = 0; i < nlookups; i += burst) {
+	_table->lookup_routes(addr + i, burst, port, gw);
+	for (int j = 0; j < burst; ++j)
+	    found_burst += port[j] >= 0;
+    }
+    Timestamp bulk = Timestamp::now_steady();
+
+    Timestamp ts = single - start, tb = bulk - single;
+    errh->message("%s: %u lookups: single %ss, burst %ss (%u/%u found)",
+		  _table->declaration().c_str(), (unsigned) nlookups,
+		  ts.unparse().c_str(), tb.unparse().c_str(), found, found_burst);
+    delete[] addr;
+}
+
+bool
+IPRouteTableTest::run_task(Task *)
+{
+    for (uint32_t u = 0; u < _churn; u++)
+	if (update(click_random(0, _routes.size() - 1), ErrorHandler::silent_handler()) >= 0)
+	    _nupdates += 2;
+    _task.fast_reschedule();
+    return true;
+}
+
+static String
+updates_handler(Element *e, void *)
+{
+    return String(static_cast<IPRouteTableTest *>(e)->nupdates());
+}
+
+void
+IPRouteTableTest::add_handlers()
+{
+    add_read_handler("updates", updates_handler, 0);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel IPRouteTable)
+EXPORT_ELEMENT(IPRouteTableTest)
@@ -0,0 +1,117 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_IPROUTETABLETEST_HH
+#define CLICK_IPROUTETABLETEST_HH
+#include <click/element.hh>
+#include <click/hashtable.hh>
+#include <click/task.hh>
+#include "elements/ip/iproutetable.hh"
+CLICK_DECLS
+
+/*
+=c
+
+IPRouteTableTest(TABLE [, I<keywords>])
+
+=s test
+
+runs regression tests and update benchmarks for IPv4 routing tables
+
+=d
+
+At initialization time, IPRouteTableTest loads a synthetic IPv4 routing table
+of PREFIXES routes into TABLE, an IPRouteTable element that supports the
+C<load> handler, such as DirectIPLookup, RadixIPLookup or RangeIPLookup. The
+prefix lengths follow the distribution of a BGP view, with most routes being
+/24s, and the routes longer than /24 are more specifics of shorter ones.
+
+Lookups of addresses inside the routes and of random addresses are checked
+against a reference table, one by one and in bursts. UPDATES routes are then
+withdrawn and announced again through a different gateway, and the lookups
+checked again. Half of the routes are removed, and the full table finally
+loaded back, with checks after each step. IPRouteTableTest does not route
+packets.
+
+If CHURN is positive, IPRouteTableTest keeps updating TABLE after
+initialization, withdrawing and announcing CHURN routes each time its task
+runs. Together with traffic routed by TABLE on other threads, this measures
+the forwarding rate under a given update rate, and checks that lookups do not
+stall or crash while the table changes.
+
+Keyword arguments are:
+
+=over 8
+
+=item PREFIXES
+
+Integer.  Number of routes of the synthetic table. Default is 100000.
+
+=item UPDATES
+
+Integer.  Number of routes updated by the regression test. Default is 10000.
+RangeIPLookup expands its whole table at each update, so use a small value
+with it.
+
+=item GATEWAYS
+
+Integer.  Number of different gateways of the routes. Default is 16.
+
+=item BENCHMARK
+
+Boolean.  If true, IPRouteTableTest reports the time taken to load the table,
+the update rate, and the time taken by 1000000 lookups of random addresses of
+the table, one by one and in bursts. Default is false.
+
+=item CHURN
+
+Integer.  Number of routes updated each time the task runs, after
+initialization. Default is 0 (no updates after initialization).
+
+=back
+
+=h updates read-only
+
+Returns the number of route updates done after initialization.
+
+=a DirectIPLookup, RadixIPLookup, RangeIPLookup, IP6LookupTest */
+
+class IPRouteTableTest : public Element { public:
+
+    IPRouteTableTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "IPRouteTableTest"; }
+    int configure_phase() const		{ return CONFIGURE_PHASE_LAST; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool run_task(Task *t);
+
+    uint64_t nupdates() const		{ return _nupdates; }
+
+  private:
+
+    IPRouteTable *_table;
+    uint32_t _prefixes;
+    uint32_t _updates;
+    uint32_t _gateways;
+    bool _benchmark;
+    uint32_t _churn;
+
+    Vector<IPRoute> _routes;
+    HashTable<uint32_t, int> _ref[33];	// route index by prefix length
+    uint64_t _nupdates;
+    Task _task;
+
+    void generate();
+    IPAddress random_address(int i) const;
+    int reference_lookup(IPAddress a) const;
+    int check(const char *what, ErrorHandler *errh);
+    int update(int i, ErrorHandler *errh);
+    int regression_test(ErrorHandler *errh);
+    void benchmark(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
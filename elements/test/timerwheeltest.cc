@@ -0,0 +1,236 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * timerwheeltest.{cc,hh} -- regression test and benchmark element for
+ * HierarchicalTimerWheel
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "timerwheeltest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/heap.hh>
+#include <click/timestamp.hh>
+#include <click/sync.hh>
+#include <click/timerwheel.hh>
+CLICK_DECLS
+
+namespace {
+struct TestFlow {
+    uint32_t expiry;
+    bool alive;
+    union {
+	uint32_t place;
+	TimerWheelLink<TestFlow> link;
+    };
+
+    TimerWheelLink<TestFlow> &wheel_link() {
+	return link;
+    }
+};
+
+struct flow_less {
+    inline bool operator()(TestFlow *a, TestFlow *b) {
+	return (int32_t) (a->expiry - b->expiry) < 0;
+    }
+};
+
+struct flow_place {
+    inline void operator()(TestFlow **begin, TestFlow **it) {
+	(*it)->place = it - begin;
+    }
+};
+}
+
+TimerWheelTest::TimerWheelTest()
+    : _benchmark(0)
+{
+}
+
+int
+TimerWheelTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.complete();
+}
+
+#define CHECK(x, ...) if (!(x)) { delete[] fs; return errh->error("%s:%d: " __VA_ARGS__); }
+
+int
+TimerWheelTest::regression_test(ErrorHandler *errh)
+{
+    enum { nflows = 5000 };
+    // start close to a wrap-around of the tick counter
+    uint32_t now = 0xFFFF0000U;
+    HierarchicalTimerWheel<TestFlow> w;
+    w.initialize(now);
+    TestFlow *fs = new TestFlow[nflows];
+    int nalive = 0;
+
+    for (int i = 0; i < nflows; ++i) {
+	fs[i].link.prev = 0;
+	// mostly short timeouts, a few needing every level
+	fs[i].expiry = now + (i % 16 ? click_random(0, 4000) : click_random(0, 1 << 27));
+	fs[i].alive = true;
+	w.schedule(&fs[i], fs[i].expiry);
+	++nalive;
+    }
+    CHECK(w.size() == (uint32_t) nalive, "size %u, expected %d", __FILE__, __LINE__, w.size(), nalive);
+
+    uint32_t late = 0;
+    for (int round = 0; round < 4000 && nalive; ++round) {
+	now += click_random(0, round < 3000 ? 200 : 50000);
+	for (int k = 0; k < 20; ++k) {
+	    TestFlow *f = &fs[click_random(0, nflows - 1)];
+	    if (!f->alive)
+		continue;
+	    uint32_t e = now + click_random(1, 100000);
+	    if ((int32_t) (e - f->expiry) < 0) // anticipated: must move
+		w.schedule(f, e);
+	    f->expiry = e;		// postponed: lazy
+	}
+	TestFlow *f = &fs[click_random(0, nflows - 1)];
+	if (f->alive) {
+	    w.unschedule(f);
+	    f->alive = false;
+	    --nalive;
+	}
+
+	w.run(now, [&](TestFlow *f) {
+		if ((int32_t) (f->expiry - now) > 0)
+		    w.schedule(f, f->expiry);
+		else {
+		    if ((int32_t) (f->expiry - w.now()) < -1)
+			++late;
+		    f->alive = false;
+		    --nalive;
+		}
+	    });
+	CHECK(late == 0, "round %d: %u objects expired late", __FILE__, __LINE__, round, late);
+	CHECK(w.size() == (uint32_t) nalive, "round %d: size %u, expected %d", __FILE__, __LINE__, round, w.size(), nalive);
+
+	if (TestFlow *first = w.first([](TestFlow *f) { return f->expiry; })) {
+	    // nothing may expire before the first one
+	    for (int i = 0; i < nflows; ++i)
+		CHECK(!fs[i].alive || (int32_t) (fs[i].expiry - first->expiry) >= 0,
+		      "round %d: first() is not the earliest", __FILE__, __LINE__, round);
+	} else
+	    CHECK(nalive == 0, "round %d: first() returned null", __FILE__, __LINE__, round);
+    }
+
+    for (int i = 0; i < nflows; ++i)
+	CHECK(!fs[i].alive || (int32_t) (fs[i].expiry - now) > 0, "flow %d not expired", __FILE__, __LINE__, i);
+    delete[] fs;
+    return 0;
+}
+
+void
+TimerWheelTest::benchmark(ErrorHandler *errh)
+{
+    int n = _benchmark;
+    const uint32_t timeout = 300 * CLICK_HZ;
+    const uint32_t gc_interval = CLICK_HZ;
+    uint32_t *refresh = new uint32_t[4 * n];
+    for (int i = 0; i < 4 * n; ++i)
+	refresh[i] = click_random(0, n - 1);
+    TestFlow *fs = new TestFlow[n];
+
+    for (int structure = 0; structure < 2; ++structure) {
+	Vector<TestFlow *> heap;
+	HierarchicalTimerWheel<TestFlow> wheel;
+	uint32_t now = 0;
+	wheel.initialize(now);
+	int expired = 0;
+	Timestamp start = Timestamp::now_steady();
+
+	for (int i = 0; i < n; ++i) {
+	    fs[i].link.prev = 0;
+	    fs[i].expiry = now + timeout;
+	    if (structure == 0) {
+		heap.push_back(&fs[i]);
+		push_heap(heap.begin(), heap.end(), flow_less(), flow_place());
+	    } else
+		wheel.schedule(&fs[i], fs[i].expiry);
+	}
+	Timestamp inserted = Timestamp::now_steady();
+
+	// refreshes are spread over one timeout, with a GC every second
+	int per_gc = 4 * n / (timeout / gc_interval);
+	for (int r = 0; r < 4 * n; ) {
+	    for (int end = r + per_gc; r < end && r < 4 * n; ++r) {
+		TestFlow *f = &fs[refresh[r]];
+		f->expiry = now + timeout;
+		if (structure == 0)
+		    change_heap(heap.begin(), heap.end(), heap.begin() + f->place,
+				flow_less(), flow_place());
+	    }
+	    now += gc_interval;
+	    if (structure == 0)
+		while (heap.size() && (int32_t) (heap[0]->expiry - now) <= 0) {
+		    pop_heap(heap.begin(), heap.end(), flow_less(), flow_place());
+		    heap.pop_back();
+		    ++expired;
+		}
+	    else
+		wheel.run(now, [&](TestFlow *f) {
+			if ((int32_t) (f->expiry - now) > 0)
+			    wheel.schedule(f, f->expiry);
+			else
+			    ++expired;
+		    });
+	}
+	Timestamp refreshed = Timestamp::now_steady();
+
+	// let everything expire
+	now += timeout;
+	if (structure == 0)
+	    while (heap.size()) {
+		pop_heap(heap.begin(), heap.end(), flow_less(), flow_place());
+		heap.pop_back();
+		++expired;
+	    }
+	else
+	    wheel.run(now, [&](TestFlow *f) {
+		    if ((int32_t) (f->expiry - now) > 0)
+			wheel.schedule(f, f->expiry);
+		    else
+			++expired;
+		});
+	Timestamp done = Timestamp::now_steady();
+
+	Timestamp t_insert = inserted - start, t_refresh = refreshed - inserted,
+	    t_expire = done - refreshed, t_total = done - start;
+	errh->message("%s, %d flows: insert %p{timestamp}, refresh %p{timestamp}, expire %p{timestamp}, total %p{timestamp} (%d expired)",
+		      structure == 0 ? "heap" : "wheel", n,
+		      &t_insert, &t_refresh, &t_expire, &t_total, expired);
+    }
+
+    delete[] fs;
+    delete[] refresh;
+}
+
+int
+TimerWheelTest::initialize(ErrorHandler *errh)
+{
+    if (_benchmark > 0) {
+	benchmark(errh);
+	return 0;
+    }
+    if (regression_test(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+    return 0;
+}
+
+EXPORT_ELEMENT(TimerWheelTest)
+CLICK_ENDDECLS
@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_TIMERWHEELTEST_HH
+#define CLICK_TIMERWHEELTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+TimerWheelTest([I<keywords>])
+
+=s test
+
+runs regression tests for HierarchicalTimerWheel
+
+=d
+
+Without other arguments, TimerWheelTest runs regression tests for Click's
+HierarchicalTimerWheel class at initialization time: objects are scheduled,
+postponed, anticipated and unscheduled at random, and must expire exactly when
+due. TimerWheelTest does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Integer.  If set to a positive number, then TimerWheelTest compares, at
+installation time, the cost of expiring BENCHMARK flows with a binary heap
+(as IPRewriter does by default) and with a timing wheel (as IPRewriter does
+with TIMER_WHEEL). Each flow has a 300 second timeout, and is refreshed on
+average 4 times before expiring. The time taken by each structure is printed.
+Default is 0 (don't benchmark).
+
+=back
+
+=a IPRewriter */
+
+class TimerWheelTest : public Element { public:
+
+    TimerWheelTest() CLICK_COLD;
+
+    const char *class_name() const override		{ return "TimerWheelTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    int _benchmark;
+
+    int regression_test(ErrorHandler *errh);
+    void benchmark(ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
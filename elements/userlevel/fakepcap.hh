@@ -46,6 +46,48 @@ struct fake_pcap_file_header {
 	uint32_t linktype;	/* data link type (DLT_*) */
 };
 
+/*
+ * pcapng files are a sequence of blocks, each starting with a type and a
+ * total length, and ending with the total length again. A section header
+ * block opens the file and sets its byte order; packets refer to interface
+ * description blocks, which hold the link type and timestamp resolution.
+ */
+#define FAKE_PCAPNG_SHB			0x0A0D0D0A	/* section header */
+#define FAKE_PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+#define FAKE_PCAPNG_VERSION_MAJOR	1
+#define FAKE_PCAPNG_IDB			1	/* interface description */
+#define FAKE_PCAPNG_SPB			3	/* simple packet */
+#define FAKE_PCAPNG_EPB			6	/* enhanced packet */
+#define FAKE_PCAPNG_OPT_ENDOFOPT	0
+#define FAKE_PCAPNG_IF_TSRESOL		9
+
+struct fake_pcapng_block_header {
+	uint32_t type;
+	uint32_t total_length;	/* including header and trailing length */
+};
+
+struct fake_pcapng_section_header {
+	struct fake_pcapng_block_header bh;
+	uint32_t byte_order_magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	uint32_t section_length[2];	/* unaligned 64-bit, often -1 */
+};
+
+struct fake_pcapng_interface_description {
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+struct fake_pcapng_enhanced_packet {
+	uint32_t interface_id;
+	uint32_t ts_high;	/* timestamp in if_tsresol units */
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
 struct fake_bpf_timeval {
 	int32_t tv_sec;
 	int32_t tv_usec;
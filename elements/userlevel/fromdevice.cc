@@ -56,6 +56,7 @@
 # include <net/if.h>
 # include <features.h>
 # include <linux/if_packet.h>
+# include <sys/mman.h>
 # if HAVE_DPDK
 #  define ether_addr ether_addr_undefined
 # endif
@@ -87,7 +88,7 @@ FromDevice::FromDevice()
 #if FROMDEVICE_ALLOW_PCAP
       _pcap(0), _pcap_complaints(0),
 #endif
-      _datalink(-1), _count(0), _promisc(0), _snaplen(0)
+      _datalink(-1), _count(0), _drops(0), _promisc(0), _snaplen(0)
 {
 #if FROMDEVICE_ALLOW_LINUX || FROMDEVICE_ALLOW_PCAP
     _fd = -1;
@@ -113,6 +114,11 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     _headroom += (4 - (_headroom + 2) % 4) % 4; // default 4/2 alignment
     _force_ip = false;
     _burst = 1;
+#if FROMDEVICE_ALLOW_LINUX
+    _ring.block_size = 1 << 20;
+    _ring.nblocks = 64;
+    _block_timeout = 10;
+#endif
     String bpf_filter, capture, encap_type;
     bool has_encap;
     if (Args(conf, this, errh)
@@ -131,6 +137,11 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("BURST", _burst)
         .read("TIMESTAMP", timestamp)
 		.read("ACTIVE", active)
+#if FROMDEVICE_ALLOW_LINUX
+        .read("BLOCK_SIZE", _ring.block_size)
+        .read("BLOCKS", _ring.nblocks)
+        .read("BLOCK_TIMEOUT", _block_timeout)
+#endif
         .complete() < 0)
         return -1;
     if (_snaplen > 65535 || _snaplen < 14)
@@ -165,6 +176,8 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX
     else if (capture == "LINUX")
         _method = method_linux;
+    else if (capture == "MMAP")
+        _method = method_mmap;
 #endif
 #if FROMDEVICE_ALLOW_PCAP
     else if (capture == "PCAP")
@@ -175,6 +188,12 @@ FromDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 
     if (bpf_filter && _method != method_pcap)
         errh->warning("not using METHOD PCAP, BPF filter ignored");
+#if FROMDEVICE_ALLOW_LINUX
+    if (_method == method_mmap
+        && (_ring.nblocks == 0 || _ring.block_size < (unsigned) getpagesize()
+            || _ring.block_size % getpagesize() != 0))
+        return errh->error("BLOCK_SIZE must be a non-zero multiple of the page size");
+#endif
 
     _sniffer = sniffer;
     _promisc = promisc;
@@ -264,6 +283,61 @@ FromDevice::set_promiscuous(int fd, String ifname, bool promisc)
 
     return was_promisc;
 }
+
+/**
+ * Set up a memory-mapped ring on packet socket @a fd. RX rings use
+ * TPACKET_V3, where the kernel retires whole blocks of variable-sized
+ * frames. TX rings use the frame-based TPACKET_V2 layout.
+ */
+int
+FromDevice::setup_packet_ring(int fd, bool tx, PacketRing &ring,
+                              unsigned block_timeout, ErrorHandler *errh)
+{
+    int version = tx ? TPACKET_V2 : TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        return errh->error("PACKET_VERSION: %s", strerror(errno));
+
+    if (ring.frame_size == 0)
+        ring.frame_size = TPACKET_ALIGNMENT << 7;
+    ring.nframes = (ring.block_size / ring.frame_size) * ring.nblocks;
+    if (tx) {
+        struct tpacket_req req;
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = ring.block_size;
+        req.tp_block_nr = ring.nblocks;
+        req.tp_frame_size = ring.frame_size;
+        req.tp_frame_nr = ring.nframes;
+        if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+            return errh->error("PACKET_TX_RING: %s", strerror(errno));
+    } else {
+        struct tpacket_req3 req;
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = ring.block_size;
+        req.tp_block_nr = ring.nblocks;
+        req.tp_frame_size = ring.frame_size;
+        req.tp_frame_nr = ring.nframes;
+        req.tp_retire_blk_tov = block_timeout;
+        req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+        if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+            return errh->error("PACKET_RX_RING: %s", strerror(errno));
+    }
+
+    ring.size = (size_t) ring.block_size * ring.nblocks;
+    void *map = mmap(0, ring.size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED)
+        return errh->error("mmap packet ring: %s", strerror(errno));
+    ring.map = (unsigned char *) map;
+    ring.cur = 0;
+    return 0;
+}
+
+void
+FromDevice::release_packet_ring(PacketRing &ring)
+{
+    if (ring.map)
+        munmap(ring.map, ring.size);
+    ring.map = 0;
+}
 #endif /* FROMDEVICE_ALLOW_LINUX */
 
 #if FROMDEVICE_ALLOW_PCAP
@@ -418,11 +492,14 @@ FromDevice::initialize(ErrorHandler *errh)
 
 
 #if FROMDEVICE_ALLOW_LINUX
-    if (_method == method_default || _method == method_linux) {
+    if (_method == method_default || _method == method_linux || _method == method_mmap) {
         _fd = open_packet_socket(_ifname, errh);
         if (_fd < 0)
             return -1;
 
+        if (_method == method_mmap && setup_packet_ring(_fd, false, _ring, _block_timeout, errh) < 0)
+            return -1;
+
         int promisc_ok = set_promiscuous(_fd, _ifname, _promisc);
         if (promisc_ok < 0) {
             if (_promisc)
@@ -432,7 +509,8 @@ FromDevice::initialize(ErrorHandler *errh)
             _was_promisc = promisc_ok;
 
         _datalink = FAKE_DLT_EN10MB;
-        _method = method_linux;
+        if (_method != method_mmap)
+            _method = method_linux;
     }
 #endif
 
@@ -460,9 +538,10 @@ FromDevice::cleanup(CleanupStage stage)
     if (stage >= CLEANUP_INITIALIZED && !_sniffer)
         KernelFilter::device_filter(_ifname, false, ErrorHandler::default_handler());
 #if FROMDEVICE_ALLOW_LINUX
-    if (_fd >= 0 && _method == method_linux) {
+    if (_fd >= 0 && (_method == method_linux || _method == method_mmap)) {
         if (_was_promisc >= 0)
             set_promiscuous(_fd, _ifname, _was_promisc);
+        release_packet_ring(_ring);
         close(_fd);
     }
 #endif
@@ -624,9 +703,85 @@ FromDevice::selected(int, int)
             checked_output_push_batch(1, batch_err);
 # endif
     }
+    if (_method == method_mmap)
+        selected_mmap();
 #endif
 }
 
+#if FROMDEVICE_ALLOW_LINUX
+/**
+ * Read the blocks retired by the kernel in the TPACKET_V3 ring. Each block
+ * holds many packets and is given back to the kernel as a whole.
+ */
+void
+FromDevice::selected_mmap()
+{
+# if HAVE_BATCH
+    BATCH_CREATE_INIT(batch);
+    BATCH_CREATE_INIT(batch_err);
+# endif
+    int nmmap = 0;
+    while (nmmap < _burst) {
+        struct tpacket_block_desc *pbd = (struct tpacket_block_desc *)
+            (_ring.map + (size_t) _ring.cur * _ring.block_size);
+        if (!(__atomic_load_n(&pbd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            break;
+
+        unsigned char *frame = (unsigned char *) pbd + pbd->hdr.bh1.offset_to_first_pkt;
+        for (unsigned i = 0; i < pbd->hdr.bh1.num_pkts; i++) {
+            struct tpacket3_hdr *h = (struct tpacket3_hdr *) frame;
+            frame += h->tp_next_offset;
+            const struct sockaddr_ll *sa = (const struct sockaddr_ll *)
+                ((unsigned char *) h + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+            if ((sa->sll_pkttype == PACKET_OUTGOING && !_outbound)
+                || (_protocol != 0 && _protocol != sa->sll_protocol))
+                continue;
+
+            uint32_t len = h->tp_snaplen;
+            if (len > (uint32_t) _snaplen)
+                len = _snaplen;
+            WritablePacket *p = Packet::make(_headroom, (unsigned char *) h + h->tp_mac, len, 0);
+            if (!p) {
+                ++_drops;
+                continue;
+            }
+            if (h->tp_len > len)
+                SET_EXTRA_LENGTH_ANNO(p, h->tp_len - len);
+            p->set_packet_type_anno((Packet::PacketType) sa->sll_pkttype);
+            if (_timestamp)
+                p->timestamp_anno() = Timestamp::make_nsec(h->tp_sec, h->tp_nsec);
+            p->set_mac_header(p->data());
+            ++nmmap;
+            ++_count;
+# if HAVE_BATCH
+            if (!_force_ip || fake_pcap_force_ip(p, _datalink)) {
+                BATCH_CREATE_APPEND(batch, p);
+            } else {
+                BATCH_CREATE_APPEND(batch_err, p);
+            }
+# else
+            if (!_force_ip || fake_pcap_force_ip(p, _datalink))
+                output(0).push(p);
+            else
+                checked_output_push(1, p);
+# endif
+        }
+
+        __atomic_store_n(&pbd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        if (++_ring.cur == _ring.nblocks)
+            _ring.cur = 0;
+    }
+# if HAVE_BATCH
+    BATCH_CREATE_FINISH(batch);
+    BATCH_CREATE_FINISH(batch_err);
+    if (batch)
+        output(0).push_batch(batch);
+    if (batch_err)
+        checked_output_push_batch(1, batch_err);
+# endif
+}
+#endif
+
 #if FROMDEVICE_ALLOW_PCAP
 bool
 FromDevice::run_task(Task *)
@@ -671,7 +826,7 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
     }
 #endif
 #if FROMDEVICE_ALLOW_LINUX && defined(PACKET_STATISTICS)
-    if (_method == method_linux) {
+    if (_method == method_linux || _method == method_mmap) {
         struct tpacket_stats stats;
         socklen_t statsize = sizeof(stats);
         if (getsockopt(_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &statsize) >= 0)
@@ -681,7 +836,7 @@ FromDevice::kernel_drops(bool& known, int& max_drops) const
 }
 
 
-enum {h_reset_count, h_rss_max, h_rss_reta_size, h_kernel_drops, h_count, h_encap};
+enum {h_reset_count, h_rss_max, h_rss_reta_size, h_kernel_drops, h_count, h_drops, h_encap};
 
 
 String
@@ -706,6 +861,8 @@ FromDevice::read_handler(Element* e, void *thunk)
         return String(fake_pcap_unparse_dlt(fd->_datalink));
     case h_count:
         return String(fd->_count);
+    case h_drops:
+        return String(fd->_drops);
     }
     return "<error>";
 }
@@ -728,6 +885,7 @@ FromDevice::write_handler(const String &input, Element *e, void *thunk, ErrorHan
         }
 		case h_reset_count:
 			fd->_count = 0;
+			fd->_drops = 0;
 			return 0;
 		default:
 			return -1;
@@ -851,6 +1009,7 @@ FromDevice::add_handlers()
     add_read_handler("kernel_drops", read_handler, h_kernel_drops);
     add_read_handler("encap", read_handler, h_encap);
     add_read_handler("count", read_handler, h_count);
+    add_read_handler("drops", read_handler, h_drops);
     add_write_handler("reset_counts", write_handler, h_reset_count, Handler::BUTTON);
 }
 
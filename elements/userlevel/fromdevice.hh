@@ -102,8 +102,28 @@ but the IP header annotation has been set appropriately.) Default is false.
 =item METHOD
 
 Word.  Defines the capture method FromDevice will use to read packets from the
-device.  Linux targets generally support PCAP and LINUX; other targets support
-only PCAP.  Defaults to PCAP.
+device.  Linux targets generally support PCAP, LINUX and MMAP; other targets
+support only PCAP.  Defaults to PCAP.
+
+METHOD MMAP uses a memory-mapped PACKET_RX_RING in TPACKET_V3 mode. The kernel
+fills blocks of packets and hands a block over when it is full or when
+BLOCK_TIMEOUT expires, so FromDevice reads a whole block into one batch
+without any system call per packet. BURST is then the minimal number of
+packets to read before yielding, whole blocks being always consumed.
+
+=item BLOCK_SIZE
+
+Unsigned.  Size of a ring block for METHOD MMAP, a multiple of the page size.
+Defaults to 1048576 (1 MB).
+
+=item BLOCKS
+
+Unsigned.  Number of ring blocks for METHOD MMAP. Defaults to 64.
+
+=item BLOCK_TIMEOUT
+
+Unsigned.  Milliseconds after which the kernel retires a block that is not
+full, for METHOD MMAP. Defaults to 10.
 
 =item BPF_FILTER
 
@@ -154,9 +174,14 @@ FromDevice sets packets' extra length annotations as appropriate.
 
 Returns the number of packets read by the device.
 
+=h drops read-only
+
+Returns the number of packets read from the MMAP ring but dropped, because no
+packet could be allocated for them.
+
 =h reset_counts write-only
 
-Resets "count" to zero.
+Resets "count" and "drops" to zero.
 
 =h kernel_drops read-only
 
@@ -206,8 +231,26 @@ class FromDevice : public BatchElement, public EthernetDevice { public:
 
 #if FROMDEVICE_ALLOW_LINUX
     int linux_fd() const		{ return _method == method_linux ? _fd : -1; }
+    bool mmap_ring() const		{ return _method == method_mmap; }
     static int open_packet_socket(String, ErrorHandler *);
     static int set_promiscuous(int, String, bool);
+
+    /** @brief A PACKET_RX_RING or PACKET_TX_RING mapped in memory */
+    struct PacketRing {
+        PacketRing() : map(0), size(0), block_size(0), nblocks(0),
+                       frame_size(0), nframes(0), cur(0) {
+        }
+        unsigned char *map;
+        size_t size;
+        unsigned block_size;
+        unsigned nblocks;
+        unsigned frame_size;
+        unsigned nframes;
+        unsigned cur;
+    };
+    static int setup_packet_ring(int fd, bool tx, PacketRing &ring,
+                                 unsigned block_timeout, ErrorHandler *errh);
+    static void release_packet_ring(PacketRing &ring);
 #endif
 
 #if FROMDEVICE_ALLOW_PCAP
@@ -246,6 +289,7 @@ class FromDevice : public BatchElement, public EthernetDevice { public:
     typedef uint32_t counter_t;
 #endif
     counter_t _count;
+    counter_t _drops;
 
     String _ifname;
     bool _sniffer : 1;
@@ -256,8 +300,13 @@ class FromDevice : public BatchElement, public EthernetDevice { public:
     int _snaplen;
     uint16_t _protocol;
     unsigned _headroom;
-    enum { method_default, method_pcap, method_linux };
+    enum { method_default, method_pcap, method_linux, method_mmap };
     int _method;
+#if FROMDEVICE_ALLOW_LINUX
+    PacketRing _ring;
+    unsigned _block_timeout;
+    void selected_mmap();
+#endif
 #if FROMDEVICE_ALLOW_PCAP
     String _bpf_filter;
 #endif
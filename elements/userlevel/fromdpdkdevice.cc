@@ -25,6 +25,7 @@
 #include <click/standard/scheduleinfo.hh>
 #include <click/etheraddress.hh>
 #include <click/straccum.hh>
+#include <click/routerthread.hh>
 #include <click/dpdk_glue.hh>
 
 #include "fromdpdkdevice.hh"
@@ -165,6 +166,10 @@ int FromDPDKDevice::configure(Vector<String> &conf, ErrorHandler *errh)
         _dev->set_rx_offload(DEV_RX_OFFLOAD_TCP_CKSUM);
     if (_uco)
         _dev->set_rx_offload(DEV_RX_OFFLOAD_UDP_CKSUM);
+#if HAVE_DPDK_INTERRUPT
+    if (_rx_intr >= 0)
+        _dev->set_init_rx_intr(true);
+#endif
 
     if (set_timestamp) {
 #if RTE_VERSION >= RTE_VERSION_NUM(18,02,0,0)
@@ -280,16 +285,16 @@ int FromDPDKDevice::initialize(ErrorHandler *errh)
 #if HAVE_DPDK_INTERRUPT
     if (_rx_intr >= 0) {
         for (int i = firstqueue; i <= lastqueue; i++) {
-            uint64_t data = _dev->port_id << CHAR_BIT | i;
-            ret = rte_eth_dev_rx_intr_ctl_q(_dev->port_id, i,
-                                            RTE_EPOLL_PER_THREAD,
-                                            RTE_INTR_EVENT_ADD,
-                                            (void *)((uintptr_t)data));
-            if (ret != 0) {
+            int fd = rte_eth_dev_rx_intr_ctl_q_get_fd(_dev->port_id, i);
+            if (fd < 0) {
                 return errh->error(
                     "Cannot initialize RX interrupt on this device"
                 );
             }
+            RouterThread *t = master()->thread(thread_for_queue_offset(i - firstqueue));
+            t->select_set().add_select(fd, this, SELECT_READ);
+            if (_rx_intr > 0 && t->poll_threshold() == 0)
+                t->set_poll_threshold(_rx_intr);
         }
     }
 #endif
@@ -299,6 +304,16 @@ int FromDPDKDevice::initialize(ErrorHandler *errh)
 
 void FromDPDKDevice::cleanup(CleanupStage)
 {
+#if HAVE_DPDK_INTERRUPT
+    if (_dev && _rx_intr >= 0 && _q_infos.size() == n_queues) {
+        for (int i = firstqueue; i <= lastqueue; i++) {
+            int fd = rte_eth_dev_rx_intr_ctl_q_get_fd(_dev->port_id, i);
+            if (fd >= 0)
+                master()->thread(thread_for_queue_offset(i - firstqueue))
+                    ->select_set().remove_select(fd, this, SELECT_READ);
+        }
+    }
+#endif
     DPDKDevice::cleanup(ErrorHandler::default_handler());
     cleanup_tasks();
 }
@@ -414,26 +429,30 @@ for (unsigned i = 0; i < n; ++i) {
     }
 
 #if HAVE_DPDK_INTERRUPT
-     if (ret == 0 && _rx_intr >= 0) {
-           for (int iqueue = queue_for_thisthread_begin();
-                iqueue<=queue_for_thisthread_end(); iqueue++) {
-               if (rte_eth_dev_rx_intr_enable(_dev->port_id, iqueue) != 0) {
-                   click_chatter("Could not enable interrupts");
-                   t->fast_reschedule();
-                   return 0;
-               }
-           }
-           struct rte_epoll_event event[queue_per_threads];
-           int n, i;
-           uint8_t port_id, queue_id;
-           void *data;
-           n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, event, queue_per_threads, -1);
-           for (i = 0; i < n; i++) {
-                   data = event[i].epdata.data;
-                   port_id = ((uintptr_t)data) >> CHAR_BIT;
-                   assert(port_id == _dev->port_id);
-           }
-           this->selected(0, SELECT_READ);
+    // Arm the interrupts once the thread is idle, so that it sleeps in its
+    // SelectSet until a packet arrives; disarm them as soon as it polls again
+    if (_rx_intr >= 0) {
+        if (ret == 0 && !_fdstate->armed && t->thread()->poll_idle()) {
+            _fdstate->armed = true;
+            for (int iqueue = queue_for_thisthread_begin();
+                 iqueue<=queue_for_thisthread_end(); iqueue++) {
+                if (rte_eth_dev_rx_intr_enable(_dev->port_id, iqueue) != 0) {
+                    click_chatter("Could not enable interrupts");
+                    break;
+                }
+            }
+            // A packet received before the interrupts were armed raises
+            // none, so look again, and keep the thread polling if one came
+            for (int iqueue = queue_for_thisthread_begin();
+                 iqueue<=queue_for_thisthread_end(); iqueue++) {
+                if (rte_eth_rx_queue_count(_dev->port_id, iqueue) > 0) {
+                    disarm_rx_intr();
+                    ret = 1;
+                    break;
+                }
+            }
+        } else if (ret && _fdstate->armed)
+            disarm_rx_intr();
     }
 #endif
 
@@ -442,7 +461,8 @@ for (unsigned i = 0; i < n; ++i) {
 }
 
 #if HAVE_DPDK_INTERRUPT
-void FromDPDKDevice::selected(int fd, int mask) {
+void FromDPDKDevice::disarm_rx_intr() {
+    _fdstate->armed = false;
     for (int iqueue = queue_for_thisthread_begin();
             iqueue<=queue_for_thisthread_end(); iqueue++) {
         if (rte_eth_dev_rx_intr_disable(_dev->port_id, iqueue) != 0) {
@@ -450,6 +470,14 @@ void FromDPDKDevice::selected(int fd, int mask) {
             return;
         }
     }
+}
+
+void FromDPDKDevice::selected(int fd, int) {
+    // The queue interrupt is an eventfd, which stays readable until read
+    uint64_t events;
+    ignore_result(read(fd, &events, sizeof(events)));
+    if (_fdstate->armed)
+        disarm_rx_intr();
     task_for_thread()->reschedule();
 }
 #endif
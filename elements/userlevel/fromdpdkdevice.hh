@@ -150,7 +150,12 @@ Integer. Specify the NUMA node to undertake packet processing.
 =item RX_INTR
 
 Integer. Enables Rx interrupts if non-negative value is given.
-Defaults to -1 (no interrupts).
+Defaults to -1 (no interrupts). The interrupt of each queue is then
+registered in the SelectSet of the thread serving it, and armed only when
+this thread is idle in hybrid polling, that is after it went through the
+number of empty iterations set by the global "poll_threshold" handler. The
+thread then sleeps until a packet arrives instead of polling. A positive
+value sets the poll threshold of the threads that have none.
 
 =item SCALE
 
@@ -422,6 +427,7 @@ public:
     bool run_task(Task *) override;
 #if HAVE_DPDK_INTERRUPT
     void selected(int fd, int mask) override;
+    void disarm_rx_intr();
 #endif
 
     void clear_buffers() CLICK_COLD;
@@ -459,8 +465,8 @@ protected:
 #if HAVE_DPDK_INTERRUPT
     int _rx_intr;
     class FDState { public:
-        FDState() : mustresched(0) {};
-        int mustresched;
+        FDState() : armed(false) {};
+        bool armed;
     };
     per_thread<FDState> _fdstate;
 #endif
@@ -274,6 +274,13 @@ FromDump::initialize(ErrorHandler *errh)
     if (!fh)
 	return _ff.error(errh, "not a tcpdump file (too short)");
 
+    _pcapng = false;
+    if (fh->magic == FAKE_PCAPNG_SHB) {
+	if (initialize_pcapng(reinterpret_cast<const fake_pcapng_section_header *>(fh), errh) < 0)
+	    return -1;
+	goto check_linktype;
+    }
+
     if (fh->magic == FAKE_PCAP_MAGIC || fh->magic == FAKE_PCAP_MAGIC_NANO || fh->magic == FAKE_MODIFIED_PCAP_MAGIC)
 	_swapped = false;
     else {
@@ -296,6 +303,7 @@ FromDump::initialize(ErrorHandler *errh)
     // map possible host link types to global link types
     _linktype = fake_pcap_canonical_dlt(fh->linktype, true);
 
+  check_linktype:
     // if forcing IP packets, check datalink type to ensure we understand it
     if (_force_ip) {
 	   if (!fake_pcap_dlt_force_ipable(_linktype))
@@ -357,6 +365,11 @@ FromDump::take_state(Element *e, ErrorHandler *errh)
     _extra_pkthdr_crap = o->_extra_pkthdr_crap;
     _minor_version = o->_minor_version;
 
+    _pcapng = o->_pcapng;
+    _pcapng_warned = o->_pcapng_warned;
+    _pcapng_ifs.swap(o->_pcapng_ifs);
+    _pcapng_last_ts = o->_pcapng_last_ts;
+
     _linktype = o->_linktype;
     if (_linktype == FAKE_DLT_RAW)
 	_force_ip = true;
@@ -408,6 +421,233 @@ FromDump::prepare_times(const Timestamp &ts)
      _have_any_times = true;
 }
 
+inline uint32_t
+FromDump::swapped(uint32_t x) const
+{
+    return _swapped ? SWAPLONG(x) : x;
+}
+
+int
+FromDump::initialize_pcapng(const fake_pcapng_section_header *sh, ErrorHandler *errh)
+{
+    _pcapng = true;
+    _pcapng_warned = false;
+    _extra_pkthdr_crap = 0;
+    _minor_version = FAKE_PCAP_VERSION_MINOR;
+    if (!read_pcapng_section(sh, errh))
+	return -1;
+
+    // the first interface sets the link type of the dump
+    fake_pcapng_block_header swapped_bh;
+    while (!_pcapng_ifs.size()) {
+	const fake_pcapng_block_header *bh = reinterpret_cast<const fake_pcapng_block_header *>(_ff.get_aligned(sizeof(*bh), &swapped_bh, errh));
+	if (!bh)
+	    return _ff.error(errh, "no interface description in pcapng file");
+	uint32_t type = swapped(bh->type), total = swapped(bh->total_length);
+	if (total < 12 || (total & 3))
+	    return _ff.error(errh, "bad pcapng block length");
+	if (type == FAKE_PCAPNG_IDB) {
+	    if (!read_pcapng_interface(total - 12, errh))
+		return -1;
+	} else if (type == FAKE_PCAPNG_SHB || type == FAKE_PCAPNG_EPB || type == FAKE_PCAPNG_SPB)
+	    return _ff.error(errh, "no interface description in pcapng section");
+	else
+	    _ff.shift_pos(total - 8);
+    }
+    _linktype = _pcapng_ifs[0].linktype;
+    return 0;
+}
+
+bool
+FromDump::read_pcapng_section(const fake_pcapng_section_header *sh, ErrorHandler *errh)
+{
+    if (sh->byte_order_magic == FAKE_PCAPNG_BYTE_ORDER_MAGIC)
+	_swapped = false;
+    else if (sh->byte_order_magic == SWAPLONG(FAKE_PCAPNG_BYTE_ORDER_MAGIC))
+	_swapped = true;
+    else {
+	_ff.error(errh, "not a pcapng file (bad byte order magic)");
+	return false;
+    }
+    int major = _swapped ? SWAPSHORT(sh->version_major) : sh->version_major;
+    if (major != FAKE_PCAPNG_VERSION_MAJOR) {
+	_ff.error(errh, "unknown pcapng major version %d", major);
+	return false;
+    }
+    uint32_t total = swapped(sh->bh.total_length);
+    if (total < sizeof(*sh) + 4 || (total & 3)) {
+	_ff.error(errh, "bad pcapng section header");
+	return false;
+    }
+    // skip options and trailing length; interfaces are numbered per section
+    _ff.shift_pos(total - sizeof(*sh));
+    _pcapng_ifs.clear();
+    return true;
+}
+
+bool
+FromDump::read_pcapng_interface(uint32_t body_length, ErrorHandler *errh)
+{
+    fake_pcapng_interface_description swapped_id;
+    const fake_pcapng_interface_description *id = reinterpret_cast<const fake_pcapng_interface_description *>(_ff.get_aligned(sizeof(*id), &swapped_id, errh));
+    if (!id || body_length < sizeof(*id)) {
+	_ff.error(errh, "bad pcapng interface description");
+	return false;
+    }
+    PcapngInterface pi;
+    pi.linktype = fake_pcap_canonical_dlt(_swapped ? SWAPSHORT(id->linktype) : id->linktype, true);
+    int tsresol = 6;
+
+    // look for the timestamp resolution in the options
+    String options = _ff.get_string(body_length - sizeof(*id), errh);
+    const uint8_t *o = reinterpret_cast<const uint8_t *>(options.data());
+    const uint8_t *end = o + options.length();
+    while (o + 4 <= end) {
+	uint16_t code, length;
+	memcpy(&code, o, 2);
+	memcpy(&length, o + 2, 2);
+	if (_swapped)
+	    code = SWAPSHORT(code), length = SWAPSHORT(length);
+	if (code == FAKE_PCAPNG_OPT_ENDOFOPT)
+	    break;
+	if (code == FAKE_PCAPNG_IF_TSRESOL && length >= 1 && o + 5 <= end)
+	    tsresol = o[4];
+	o += 4 + ((length + 3) & ~3);
+    }
+    _ff.shift_pos(4);
+
+    if (tsresol & 0x80) {
+	pi.ts_shift = tsresol & 0x7F;
+	pi.ts_units = 0;
+	if (pi.ts_shift > 63) {
+	    _ff.error(errh, "bad pcapng timestamp resolution");
+	    return false;
+	}
+    } else {
+	pi.ts_shift = -1;
+	pi.ts_units = 1;
+	if (tsresol > 19) {
+	    _ff.error(errh, "bad pcapng timestamp resolution");
+	    return false;
+	}
+	for (int i = 0; i < tsresol; i++)
+	    pi.ts_units *= 10;
+    }
+    _pcapng_ifs.push_back(pi);
+    return true;
+}
+
+static Timestamp
+pcapng_timestamp(uint64_t t, int ts_shift, uint64_t ts_units)
+{
+    uint64_t sec, frac;
+    uint32_t nsec;
+    if (ts_shift >= 0) {
+	sec = ts_shift ? t >> ts_shift : t;
+	frac = ts_shift ? t & ((uint64_t(1) << ts_shift) - 1) : 0;
+	nsec = (uint32_t) ((double) frac * 1000000000 / (double) (uint64_t(1) << ts_shift));
+    } else {
+	sec = t / ts_units;
+	frac = t % ts_units;
+	if (ts_units <= 1000000000)
+	    nsec = frac * (1000000000 / ts_units);
+	else
+	    nsec = frac / (ts_units / 1000000000);
+    }
+    return Timestamp::make_nsec(sec, nsec);
+}
+
+/* Read the pcapng blocks up to the next packet, and return its timestamp and
+   lengths. The file is left at the packet data, followed by @a skiplen bytes
+   of padding, options and trailing block length. */
+bool
+FromDump::read_pcapng_header(Timestamp &ts, int &caplen, int &len, int &skiplen,
+			     ErrorHandler *errh)
+{
+    fake_pcapng_section_header sh;
+    while (1) {
+	const fake_pcapng_block_header *bh = reinterpret_cast<const fake_pcapng_block_header *>(_ff.get_aligned(sizeof(*bh), &sh.bh, errh));
+	if (!bh)
+	    return false;
+	uint32_t type = swapped(bh->type);
+	if (type == FAKE_PCAPNG_SHB) {
+	    // a new section, maybe with another byte order
+	    sh.bh = *bh;
+	    const uint8_t *rest = _ff.get_aligned(sizeof(sh) - sizeof(sh.bh), &sh.byte_order_magic, errh);
+	    if (!rest)
+		return false;
+	    if (rest != reinterpret_cast<const uint8_t *>(&sh.byte_order_magic))
+		memcpy(&sh.byte_order_magic, rest, sizeof(sh) - sizeof(sh.bh));
+	    if (!read_pcapng_section(&sh, errh))
+		return false;
+	    continue;
+	}
+
+	uint32_t total = swapped(bh->total_length);
+	if (total < 12 || (total & 3)) {
+	    _ff.error(errh, "bad pcapng block length; giving up");
+	    return false;
+	}
+	uint32_t body = total - 12;
+	const PcapngInterface *pi;
+	if (type == FAKE_PCAPNG_EPB) {
+	    fake_pcapng_enhanced_packet swapped_ep;
+	    const fake_pcapng_enhanced_packet *ep = reinterpret_cast<const fake_pcapng_enhanced_packet *>(_ff.get_aligned(sizeof(*ep), &swapped_ep, errh));
+	    if (!ep)
+		return false;
+	    uint32_t interface_id = swapped(ep->interface_id);
+	    uint32_t ep_caplen = swapped(ep->caplen);
+	    if (interface_id >= (uint32_t) _pcapng_ifs.size() || body < sizeof(*ep)
+		|| ep_caplen > body - sizeof(*ep)) {
+		_ff.error(errh, "bad pcapng packet block; giving up");
+		return false;
+	    }
+	    pi = &_pcapng_ifs[interface_id];
+	    uint64_t t = (uint64_t) swapped(ep->ts_high) << 32 | swapped(ep->ts_low);
+	    ts = _pcapng_last_ts = pcapng_timestamp(t, pi->ts_shift, pi->ts_units);
+	    caplen = ep_caplen;
+	    len = swapped(ep->len);
+	    skiplen = body - sizeof(*ep) - caplen + 4;
+	} else if (type == FAKE_PCAPNG_SPB) {
+	    uint32_t swapped_len;
+	    const uint32_t *lp = reinterpret_cast<const uint32_t *>(_ff.get_aligned(sizeof(*lp), &swapped_len, errh));
+	    if (!lp)
+		return false;
+	    if (!_pcapng_ifs.size() || body < sizeof(*lp)) {
+		_ff.error(errh, "bad pcapng packet block; giving up");
+		return false;
+	    }
+	    // simple packets come from the first interface, without timestamp
+	    pi = &_pcapng_ifs[0];
+	    ts = _pcapng_last_ts;
+	    len = swapped(*lp);
+	    caplen = (uint32_t) len < body - sizeof(*lp) ? len : body - sizeof(*lp);
+	    skiplen = body - sizeof(*lp) - caplen + 4;
+	} else {
+	    if (type == FAKE_PCAPNG_IDB) {
+		if (!read_pcapng_interface(body, errh))
+		    return false;
+	    } else
+		_ff.shift_pos(body + 4);
+	    continue;
+	}
+
+	if (pi->linktype != _linktype) {
+	    if (!_pcapng_warned) {
+		_ff.warning(errh, "skipping packets from interfaces with link type %d", pi->linktype);
+		_pcapng_warned = true;
+	    }
+	    _ff.shift_pos(caplen + skiplen);
+	    continue;
+	}
+	if (caplen > len) {
+	    skiplen += caplen - len;
+	    caplen = len;
+	}
+	return true;
+    }
+}
+
 bool
 FromDump::read_packet(ErrorHandler *errh)
 {
@@ -427,6 +667,12 @@ FromDump::read_packet(ErrorHandler *errh)
     // record file position
     _packet_filepos = _ff.file_pos();
 
+    if (_pcapng) {
+	if (!read_pcapng_header(ts, caplen, len, skiplen, errh))
+	    return false;
+	goto check_times;
+    }
+
     // read the packet header
     if (!(ph = reinterpret_cast<const fake_pcap_pkthdr *>(_ff.get_aligned(sizeof(*ph), &swapped_ph))))
 	return false;
@@ -459,10 +705,10 @@ FromDump::read_packet(ErrorHandler *errh)
 
     // compensate for modified pcap versions
     _ff.shift_pos(_extra_pkthdr_crap);
+    ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, _have_nanosecond_timestamps);
 
     // check times
   check_times:
-    ts = fake_bpf_timeval_union::make_timestamp(&ph->ts, _have_nanosecond_timestamps);
     if (!_have_any_times)
 	prepare_times(ts);
     if (_have_first_time) {
@@ -650,54 +896,69 @@ FromDump::run_timer(Timer *)
 bool
 FromDump::run_task(Task *)
 {
-    Timestamp now_s = Timestamp::now_steady();
-    bool fresh = true;
-    unsigned n = 0;
-    int retry_count = 0;
-  again:
     if (!_active)
 	return false;
 
-    if (!_packet && !read_packet(0)) {
-	if (_end_h)
-	    _end_h->call_write(ErrorHandler::default_handler());
-	return false;
-    }
-    if (_packet && _timing) {
-        if (!check_timing(_packet, now_s, fresh)) {
-		return false;
-        }
+    Timestamp now_s = Timestamp::now_steady();
+    bool fresh = true, more = true, wait = false;
+    int retry_count = 0;
+    unsigned n = 0;
+#if HAVE_BATCH
+    PacketBatch *head = 0;
+    Packet *last = 0;
+#endif
+
+    // collect up to BURST packets, and push them as a single batch
+    while (n < _burst && _active) {
+	if (!_packet && !read_packet(0)) {
+	    more = false;
+	    break;
+	}
+	if (_packet && _timing && !check_timing(_packet, now_s, fresh)) {
+	    wait = true;
+	    break;
+	}
+	if (_packet && _force_ip && !fake_pcap_force_ip(_packet, _linktype)) {
+#if HAVE_BATCH
+	    if (in_batch_mode)
+		checked_output_push_batch(1, PacketBatch::make_from_packet(_packet));
+	    else
+#endif
+		checked_output_push(1, _packet);
+	    _packet = 0;
+	}
+	if (!_packet) {
+	    if (++retry_count >= 16)
+		break;
+	    fresh = false;
+	    continue;
+	}
+
+	_count++;
+#if HAVE_BATCH
+	if (in_batch_mode) {
+	    if (head)
+		last->set_next(_packet);
+	    else
+		head = PacketBatch::start_head(_packet);
+	    last = _packet;
+	} else
+#endif
+	    output(0).push(_packet);
+	_packet = 0;
+	n++;
     }
-    if (_packet && _force_ip && !fake_pcap_force_ip(_packet, _linktype)) {
+
 #if HAVE_BATCH
-        if (in_batch_mode) {
-            checked_output_push_batch(1, PacketBatch::make_from_packet(_packet));
-        } else
+    if (head)
+	output_push_batch(0, head->make_tail(last, n));
 #endif
-            checked_output_push(1, _packet);
-        _packet = 0;
-    }
-
-    if (!_packet && ++retry_count < 16) {
-        fresh = false;
-	    goto again;
-    }
-
-    _task.fast_reschedule();
-    if (_packet) {
-        #if HAVE_BATCH
-            if (in_batch_mode) {
-	            output(0).push_batch(PacketBatch::make_from_packet(_packet));
-            } else
-        #endif
-	            output(0).push(_packet);
-        _count++;
-        _packet = 0;
-        if (n++ < _burst)
-            goto again;
-        return true;
-    } else
-        return false;
+    if (!more) {
+	if (_end_h)
+	    _end_h->call_write(ErrorHandler::default_handler());
+    } else if (!wait && _active)
+	_task.fast_reschedule();
+    return n > 0;
 }
 
 #if HAVE_BATCH
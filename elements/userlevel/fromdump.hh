@@ -10,6 +10,7 @@
 
 CLICK_DECLS
 class HandlerCall;
+struct fake_pcapng_section_header;
 
 /*
 =c
@@ -24,7 +25,11 @@ reads packets from a tcpdump file
 
 Reads packets from a file produced by `tcpdump -w FILENAME' or ToDump and
 emits them from the output, optionally stopping the driver when there are no
-more packets.
+more packets. Both the pcap format, with microsecond or nanosecond
+timestamps, and the pcapng format are understood. pcapng timestamps keep
+the resolution of their interface, down to the nanosecond. Packets from
+pcapng interfaces whose link type differs from the first interface's are
+skipped.
 
 FromDump also transparently reads gzip- and bzip2-compressed tcpdump files, if
 you have zcat(1) and bzcat(1) installed.
@@ -115,9 +120,23 @@ FromDump will emit garbage.
 =item MMAP
 
 Boolean. If true, then FromDump will use mmap(2) to access the tcpdump file.
-This can result in slightly better performance on some machines. FromDump's
-regular file discipline is pretty optimized, so the difference is often small
-in practice. Default is true on most operating systems, but false on Linux.
+A regular file is then mapped at once, and emitted packets point straight
+into the mapping instead of being copied: their data is read-only and shared,
+so the first element that modifies a packet gets a private copy of it. The
+mapping is released once the element and all such packets are gone, so
+elements preloading packets, like Replay, MultiReplay or the PRELOAD keyword,
+keep references into the file instead of a second copy of the trace. Default
+is true.
+
+=item BURST
+
+Integer. Maximum number of packets emitted per task run, as a single batch.
+Default is 32.
+
+=item PRELOAD
+
+Integer. Read that many bytes of packets at initialization, or the whole
+file if negative. Default is 0.
 
 =back
 
@@ -244,6 +263,8 @@ class FromDump : public BatchElement { public:
     bool _last_time_relative : 1;
     bool _last_time_interval : 1;
     bool _have_nanosecond_timestamps : 1;
+    bool _pcapng : 1;
+    bool _pcapng_warned : 1;
     bool _active;
     unsigned _extra_pkthdr_crap;
     unsigned _sampling_prob;
@@ -278,6 +299,20 @@ class FromDump : public BatchElement { public:
 
     off_t _packet_filepos;
 
+    struct PcapngInterface {
+        int linktype;
+        int ts_shift;       // timestamps in 2^-ts_shift s, or -1 if decimal
+        uint64_t ts_units;  // decimal timestamp units per second
+    };
+    Vector<PcapngInterface> _pcapng_ifs;
+    Timestamp _pcapng_last_ts;
+
+    inline uint32_t swapped(uint32_t x) const;
+    int initialize_pcapng(const fake_pcapng_section_header *, ErrorHandler *);
+    bool read_pcapng_section(const fake_pcapng_section_header *, ErrorHandler *);
+    bool read_pcapng_interface(uint32_t body_length, ErrorHandler *);
+    bool read_pcapng_header(Timestamp &, int &caplen, int &len, int &skiplen,
+                            ErrorHandler *);
     bool read_packet(ErrorHandler *);
 
     void prepare_times(const Timestamp &);
@@ -0,0 +1,201 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * fromxdpdevice.{cc,hh} -- element reads packets from an AF_XDP socket
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fromxdpdevice.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <click/routerthread.hh>
+#if HAVE_BPF
+# include "xdploader.hh"
+#endif
+
+CLICK_DECLS
+
+FromXDPDevice::FromXDPDevice()
+    : _task(this), _dev(0), _poll_selecting(false), _loader(0), _count(0)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+}
+
+FromXDPDevice::~FromXDPDevice()
+{
+}
+
+int
+FromXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    int zerocopy = -1;
+    bool has_zerocopy;
+    bool zc = false;
+    _queue = 0;
+    _burst = 32;
+    _poll = true;
+    _timestamp = false;
+    _active = true;
+    _xskmap = "xsks_map";
+    if (Args(conf, this, errh)
+        .read_mp("DEVNAME", _ifname)
+        .read_p("QUEUE", _queue)
+        .read("BURST", _burst)
+#if HAVE_BPF
+        .read("LOADER", ElementCastArg("XDPLoader"), _loader)
+#endif
+        .read("XSKMAP", _xskmap)
+        .read("XSKMAP_PATH", _xskmap_path)
+        .read("FRAMES", _config.frames)
+        .read("FRAME_SIZE", _config.frame_size)
+        .read("RING_SIZE", _config.ring_size)
+        .read("ZEROCOPY", zc).read_status(has_zerocopy)
+        .read("NEED_WAKEUP", _config.need_wakeup)
+        .read("HUGEPAGES", _config.hugepages)
+        .read("POLL", _poll)
+        .read("TIMESTAMP", _timestamp)
+        .read("ACTIVE", _active)
+        .complete() < 0)
+        return -1;
+    if (has_zerocopy)
+        zerocopy = zc;
+    _config.zerocopy = zerocopy;
+    if (_burst == 0 || _burst > _config.ring_size)
+        return errh->error("BURST out of range");
+    if (!_loader && !_xskmap_path)
+        errh->warning("no LOADER nor XSKMAP_PATH, packets must be redirected to the socket by other means");
+    return 0;
+}
+
+int
+FromXDPDevice::initialize(ErrorHandler *errh)
+{
+    _dev = XDPDevice::open(_ifname, _queue, _config, errh);
+    if (!_dev)
+        return -1;
+
+#if HAVE_BPF
+    if (_loader) {
+        int map_fd = static_cast<XDPLoader *>(_loader)->get_map_fd(_xskmap);
+        if (_dev->register_xsk_map(map_fd, errh) < 0)
+            return -1;
+    } else
+#endif
+    if (_xskmap_path && _dev->register_xsk_map(_xskmap_path, errh) < 0)
+        return -1;
+
+    if (_active) {
+        ScheduleInfo::initialize_task(this, &_task, true, errh);
+        if (!_poll)
+            add_select(_dev->fd(), SELECT_READ);
+    }
+    return 0;
+}
+
+void
+FromXDPDevice::cleanup(CleanupStage)
+{
+    if (_dev) {
+        if (!_poll || _poll_selecting)
+            remove_select(_dev->fd(), SELECT_READ);
+        _dev->release();
+    }
+    _dev = 0;
+}
+
+bool
+FromXDPDevice::run_task(Task *)
+{
+    PacketBatch *batch = _dev->rx_burst(_burst);
+    if (!batch) {
+        if (_poll) {
+            // Let a hybrid polling thread sleep until the socket is readable
+            if (unlikely(!_poll_selecting) && _task.thread()->poll_idle()) {
+                add_select(_dev->fd(), SELECT_READ);
+                _poll_selecting = true;
+            }
+            _task.fast_reschedule();
+        }
+        return false;
+    }
+    if (unlikely(_poll_selecting)) {
+        remove_select(_dev->fd(), SELECT_READ);
+        _poll_selecting = false;
+    }
+
+    _count += batch->count();
+    if (_timestamp) {
+        Timestamp now = Timestamp::now();
+        FOR_EACH_PACKET(batch, p)
+            p->set_timestamp_anno(now);
+    }
+    output_push_batch(0, batch);
+    _task.fast_reschedule();
+    return true;
+}
+
+void
+FromXDPDevice::selected(int, int)
+{
+    _task.reschedule();
+}
+
+String
+FromXDPDevice::read_handler(Element *e, void *thunk)
+{
+    FromXDPDevice *fd = static_cast<FromXDPDevice *>(e);
+    switch ((intptr_t) thunk) {
+    case h_count:
+        return String(fd->_count);
+    case h_dropped: {
+        struct xdp_statistics stats;
+        if (!fd->_dev || !fd->_dev->statistics(stats))
+            return "??";
+        return String(stats.rx_dropped + stats.rx_ring_full + stats.rx_fill_ring_empty_descs);
+    }
+    case h_zerocopy:
+        return String(fd->_dev ? fd->_dev->zerocopy() : false);
+    default:
+        return "<error>";
+    }
+}
+
+int
+FromXDPDevice::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    FromXDPDevice *fd = static_cast<FromXDPDevice *>(e);
+    switch ((intptr_t) thunk) {
+    case h_reset_count:
+        fd->_count = 0;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void
+FromXDPDevice::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("dropped", read_handler, h_dropped);
+    add_read_handler("zerocopy", read_handler, h_zerocopy);
+    add_write_handler("reset_counts", write_handler, h_reset_count, Handler::BUTTON);
+    add_task_handlers(&_task);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel linux XDPDevice)
+EXPORT_ELEMENT(FromXDPDevice)
@@ -0,0 +1,181 @@
+#ifndef CLICK_FROMXDPDEVICE_HH
+#define CLICK_FROMXDPDEVICE_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include "xdpdevice.hh"
+CLICK_DECLS
+
+/*
+=title FromXDPDevice
+
+=c
+
+FromXDPDevice(DEVNAME [, QUEUE, I<keywords> BURST, LOADER, XSKMAP, XSKMAP_PATH, etc.])
+
+=s netdevices
+
+reads packets from a network device using an AF_XDP socket (user-level)
+
+=d
+
+Reads packets from queue QUEUE of the network device named DEVNAME through an
+AF_XDP socket. Packets are received in a UMEM shared with the kernel (and
+with the NIC when the driver supports zero-copy), and are emitted without any
+copy: the packet buffer is the UMEM frame itself, and it goes back to the
+FILL ring when the packet is killed.
+
+Packets reach the socket only if an XDP program attached to the device
+redirects them to an XSKMAP in which the socket is registered. The program
+can be loaded by an XDPLoader element given as LOADER, in which case the
+socket is inserted in its map named XSKMAP. Alternatively, the map can be
+pinned in the BPF filesystem by an external loader and given with
+XSKMAP_PATH. The map is indexed by queue number.
+
+If a ToXDPDevice uses the same DEVNAME and QUEUE, both elements share the
+same socket and UMEM, and packets received by this element are sent by
+ToXDPDevice without any copy.
+
+Keyword arguments are:
+
+=over 8
+
+=item QUEUE
+
+Integer.  The device queue to bind to. Default is 0.
+
+=item BURST
+
+Integer.  Maximal number of packets to read per scheduling. Default is 32.
+
+=item LOADER
+
+Element.  An XDPLoader element whose program redirects packets to this
+socket. Only available when Click is compiled with libbpf.
+
+=item XSKMAP
+
+String.  Name of the XSKMAP in the LOADER program. Default is "xsks_map".
+
+=item XSKMAP_PATH
+
+String.  Path of a pinned XSKMAP to register the socket in, if no LOADER is
+given.
+
+=item FRAMES
+
+Integer.  Number of frames in the UMEM. Default is 4096.
+
+=item FRAME_SIZE
+
+Integer.  Size of a UMEM frame, 2048 or 4096. Default is 4096.
+
+=item RING_SIZE
+
+Integer.  Number of descriptors of each ring. Default is 2048.
+
+=item ZEROCOPY
+
+Boolean.  If true, fail if the driver cannot use zero-copy mode. If false,
+force copy mode. By default, let the kernel choose.
+
+=item NEED_WAKEUP
+
+Boolean.  Use the need_wakeup feature, so the kernel is only kicked when it
+asks for it. Default is true.
+
+=item HUGEPAGES
+
+Boolean.  Try to allocate the UMEM on hugepages. Default is false.
+
+=item POLL
+
+Boolean.  If true, the task polls the socket continuously. If false, the
+task sleeps when there is no packet to read, and is woken up when the socket
+becomes readable. Default is true.
+
+A polling task also sleeps on the socket once its thread went through the
+number of empty iterations set by the global "poll_threshold" handler, and
+polls again as soon as the socket becomes readable.
+
+=item TIMESTAMP
+
+Boolean.  Set the timestamp annotation of received packets. Default is false.
+
+=item ACTIVE
+
+Boolean.  If false, do not read packets. Default is true.
+
+=back
+
+=e
+
+  xdp :: XDPLoader(PATH xdp_redirect.o, DEV veth0);
+  FromXDPDevice(veth0, LOADER xdp) -> ... -> ToXDPDevice(veth0);
+
+=h count read-only
+
+Returns the number of packets read.
+
+=h dropped read-only
+
+Returns the number of packets dropped by the kernel because the RX ring was
+full or no frame was available in the FILL ring.
+
+=h zerocopy read-only
+
+Returns true if the socket runs in zero-copy mode.
+
+=h reset_counts write-only
+
+Resets "count" to zero.
+
+=a ToXDPDevice, XDPLoader, FromDevice.u */
+
+class FromXDPDevice : public BatchElement { public:
+
+    FromXDPDevice() CLICK_COLD;
+    ~FromXDPDevice() CLICK_COLD;
+
+    const char *class_name() const override	{ return "FromXDPDevice"; }
+    const char *port_count() const override	{ return PORTS_0_1; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure_phase() const override	{ return CONFIGURE_PHASE_PRIVILEGED; }
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    bool run_task(Task *) override;
+    void selected(int fd, int mask) override;
+
+    XDPDevice *device() const		{ return _dev; }
+
+  private:
+
+    Task _task;
+    XDPDevice *_dev;
+    XDPDevice::Config _config;
+
+    String _ifname;
+    int _queue;
+    unsigned _burst;
+    bool _poll;
+    bool _poll_selecting;
+    bool _timestamp;
+    bool _active;
+
+    Element *_loader;
+    String _xskmap;
+    String _xskmap_path;
+
+    uint64_t _count;
+
+    enum { h_count, h_dropped, h_zerocopy, h_reset_count };
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
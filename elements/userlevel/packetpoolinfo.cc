@@ -0,0 +1,163 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * packetpoolinfo.{cc,hh} -- configure the packet arena and report statistics
+ * of the packet pools
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet.hh>
+#include <click/straccum.hh>
+#include "packetpoolinfo.hh"
+
+CLICK_DECLS
+
+int
+PacketPoolInfo::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+#if CLICK_PACKET_ARENA
+    bool arena = WritablePacket::pool_arena_enabled();
+    String page_size;
+    if (Args(conf, this, errh)
+	.read("ARENA", arena)
+	.read("HUGEPAGE_SIZE", AnyArg(), page_size)
+	.complete() < 0)
+	return -1;
+    uint32_t ps = WritablePacket::pool_arena_page_size();
+    if (page_size) {
+	page_size = page_size.lower();
+	if (page_size == "0")
+	    ps = 0;
+	else if (page_size == "2m" || page_size == "2mb")
+	    ps = 2 << 20;
+	else if (page_size == "1g" || page_size == "1gb")
+	    ps = 1 << 30;
+	else
+	    return errh->error("HUGEPAGE_SIZE must be 0, 2M or 1G");
+    }
+    if (WritablePacket::pool_arena_configure(arena, ps) < 0)
+	return errh->error("the packet arena is already in use with other settings");
+    return 0;
+#else
+    (void) conf;
+    return errh->error("packet pools do not use an arena in this build");
+#endif
+}
+
+String
+PacketPoolInfo::read_handler(Element *, void *thunk)
+{
+#if CLICK_PACKET_ARENA
+    int nnodes = WritablePacket::pool_arena_nodes();
+    WritablePacket::PoolNumaStats stats;
+    WritablePacket::PoolArenaStats astats;
+    uint64_t local = 0, remote = 0;
+    StringAccum sa;
+    for (int i = 0; i < nnodes; i++) {
+	WritablePacket::pool_numa_stats(i, stats);
+	local += stats.local_recycled;
+	remote += stats.remote_recycled;
+	if ((uintptr_t) thunk == h_stats) {
+	    WritablePacket::pool_arena_stats(i, astats);
+	    sa << i << ' ' << stats.local_recycled << ' ' << stats.remote_recycled
+	       << ' ' << astats.buffers << ' ' << astats.free_buffers + astats.cached_buffers << '\n';
+	}
+    }
+    switch ((uintptr_t) thunk) {
+    case h_nodes:
+	return String(nnodes);
+    case h_local_recycled:
+	return String(local);
+    case h_remote_recycled:
+	return String(remote);
+    default:
+	return sa.take_string();
+    }
+#else
+    (void) thunk;
+    return String();
+#endif
+}
+
+String
+PacketPoolInfo::arena_handler(Element *, void *thunk)
+{
+#if CLICK_PACKET_ARENA
+    if ((uintptr_t) thunk == h_arena)
+	return String(WritablePacket::pool_arena_enabled());
+    int nnodes = WritablePacket::pool_arena_nodes();
+    uint32_t page_size = WritablePacket::pool_arena_page_size();
+    WritablePacket::PoolArenaStats stats;
+    uint64_t mapped = 0, buffers = 0, idle = 0;
+    StringAccum sa;
+    for (int i = 0; i < nnodes; i++) {
+	WritablePacket::pool_arena_stats(i, stats);
+	mapped += stats.mapped_bytes;
+	buffers += stats.buffers;
+	idle += stats.free_buffers + stats.cached_buffers;
+	sa << i << ' ' << (stats.hugepages ? page_size : 0) << ' ' << stats.pages
+	   << ' ' << stats.hugepages << ' ' << stats.buffers << ' '
+	   << stats.free_buffers << ' ' << stats.cached_buffers << '\n';
+    }
+    if (idle > buffers)		// counts read while threads run
+	idle = buffers;
+    switch ((uintptr_t) thunk) {
+    case h_arena_usage:
+	if (!mapped)
+	    return "0";
+	sa.clear();
+	sa << (100. * (buffers - idle) * stats.buffer_size / mapped);
+	return sa.take_string();
+    case h_arena_fragmentation:
+	if (!buffers)
+	    return "0";
+	sa.clear();
+	sa << (100. * idle / buffers);
+	return sa.take_string();
+    default:
+	return sa.take_string();
+    }
+#else
+    (void) thunk;
+    return String();
+#endif
+}
+
+int
+PacketPoolInfo::reset_handler(const String &, Element *, void *, ErrorHandler *)
+{
+#if CLICK_PACKET_ARENA
+    WritablePacket::pool_numa_clear_stats();
+#endif
+    return 0;
+}
+
+void
+PacketPoolInfo::add_handlers()
+{
+    add_read_handler("nodes", read_handler, h_nodes);
+    add_read_handler("local_recycled", read_handler, h_local_recycled);
+    add_read_handler("remote_recycled", read_handler, h_remote_recycled);
+    add_read_handler("stats", read_handler, h_stats);
+    add_read_handler("arena", arena_handler, h_arena);
+    add_read_handler("arena_stats", arena_handler, h_arena_stats);
+    add_read_handler("arena_usage", arena_handler, h_arena_usage);
+    add_read_handler("arena_fragmentation", arena_handler, h_arena_fragmentation);
+    add_write_handler("reset_counts", reset_handler, 0, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(PacketPoolInfo)
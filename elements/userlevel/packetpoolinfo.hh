@@ -0,0 +1,138 @@
+#ifndef CLICK_PACKETPOOLINFO_HH
+#define CLICK_PACKETPOOLINFO_HH
+
+#include <click/element.hh>
+
+CLICK_DECLS
+
+/*
+=title PacketPoolInfo
+
+=c
+
+PacketPoolInfo([I<keywords> ARENA, HUGEPAGE_SIZE])
+
+=s information
+
+configures the packet arena and reports statistics of the packet pools
+
+=d
+
+Click keeps freed packets in per-thread pools for fast reuse, exchanging
+batches of them through global rings to even out imbalance between threads.
+
+Packet data buffers can be carved out of an arena of hugepages instead of the
+heap. The arena has one region of virtual memory per NUMA node, bound to the
+node, and mapped one page at a time as buffers are needed. Each thread takes
+buffers of its node from the region by batches of 64 into a free list of its
+own, and gives them back the same way. Buffers are never returned to the
+system. The arena is used by default when compiled with NUMA support or
+configured with C<--enable-packet-arena>.
+
+When compiled with NUMA support, there is one global ring per NUMA node. A
+buffer freed by a thread of another node is not recycled there: it is sent
+back to the global ring of its own node, by batches of 256. PacketPoolInfo
+reports how often each happens, which shows how much packet memory crosses
+sockets in a configuration.
+
+PacketPoolInfo is only available at user level, with multithreading, and when
+packet pools are not provided by DPDK or netmap. It is configured before the
+other elements, so its keywords apply to all the buffers of the
+configuration. They cannot change once the arena holds buffers.
+
+Keyword arguments are:
+
+=over 8
+
+=item ARENA
+
+Boolean. Whether packet data buffers are carved out of the arena. Default is
+true if compiled with NUMA support or C<--enable-packet-arena>, false
+otherwise.
+
+=item HUGEPAGE_SIZE
+
+Size of the explicit hugepages backing the arena: C<2M>, C<1G>, or C<0> for
+regular pages eligible for transparent hugepages. Explicit hugepages must be
+reserved by the system, e.g. through F</proc/sys/vm/nr_hugepages>; the arena
+falls back to regular pages when none is left. Default is the size given to
+C<--enable-packet-arena>, or 0.
+
+=back
+
+=h nodes read-only
+
+Returns the number of NUMA nodes with their own pools and arena region.
+
+=h local_recycled read-only
+
+Returns the number of data buffers recycled by a thread of the node they were
+allocated on.
+
+=h remote_recycled read-only
+
+Returns the number of data buffers recycled by a thread of another node, and
+sent back to their node.
+
+=h stats read-only
+
+Returns one line per NUMA node, with the node number, its local_recycled and
+remote_recycled counts (as seen by the threads of the node), the number of
+data buffers allocated from its region, and the number of those that
+overflowed the pools and wait in the free lists of the arena.
+
+=h arena read-only
+
+Returns whether packet data buffers are carved out of the arena.
+
+=h arena_stats read-only
+
+Returns one line per NUMA node, with the node number, the size of the pages of
+its region (0 for regular pages), the number of pages mapped, of which
+explicit hugepages, the number of buffers carved out of the region, and the
+number of those waiting in the region's free list and in thread free lists.
+
+=h arena_usage read-only
+
+Returns the percentage of the memory mapped by the arena that holds buffers in
+use by packets or packet pools.
+
+=h arena_fragmentation read-only
+
+Returns the percentage of the buffers carved out of the arena that are idle in
+its free lists. Those are reused before new memory is mapped, but a high value
+after a burst shows memory the arena will not give back.
+
+=h reset_counts write-only
+
+Resets the recycling counts to zero.
+
+=e
+
+  PacketPoolInfo(); // then read pp.stats, e.g. from a Script or ControlSocket
+
+  PacketPoolInfo(ARENA true, HUGEPAGE_SIZE 1G);
+
+=a DPDKInfo */
+
+class PacketPoolInfo : public Element { public:
+
+    const char *class_name() const override	{ return "PacketPoolInfo"; }
+    int configure_phase() const override	{ return CONFIGURE_PHASE_FIRST; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+  private:
+
+    enum { h_nodes, h_local_recycled, h_remote_recycled, h_stats };
+    enum { h_arena, h_arena_stats, h_arena_usage, h_arena_fragmentation };
+    static String read_handler(Element *e, void *thunk);
+    static String arena_handler(Element *e, void *thunk);
+    static int reset_handler(const String &, Element *e, void *, ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+
+#endif
@@ -30,9 +30,25 @@
 #include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <fcntl.h>
 #include "socket.hh"
 
+#if SOCKET_HAVE_MMSG
+# ifndef SOL_UDP
+#  define SOL_UDP 17
+# endif
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+# endif
+# ifndef UDP_GRO
+#  define UDP_GRO 104
+# endif
+// Largest number of segments the kernel accepts in one GSO message
+# define SOCKET_GSO_MAX_SEGMENTS 64
+# define SOCKET_GSO_MAX_SIZE 65507
+#endif
+
 #ifdef HAVE_PROPER
 #include <proper/prop.h>
 #endif
@@ -45,8 +61,12 @@ Socket::Socket()
     _local_port(0), _local_pathname(""),
     _timestamp(true), _sndbuf(-1), _rcvbuf(-1),
     _snaplen(2048), _headroom(Packet::default_headroom), _nodelay(1),
-    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0)
+    _verbose(false), _client(false), _proper(false), _allow(0), _deny(0),
+    _burst(1), _gso(false), _gro(false), _mmsg(false)
 {
+#if HAVE_BATCH
+  in_batch_mode = BATCH_MODE_YES;
+#endif
 }
 
 Socket::~Socket()
@@ -76,9 +96,15 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("PROPER", _proper)
       .read("ALLOW", allow)
       .read("DENY", deny)
+      .read("BURST", _burst)
+      .read("GSO", _gso)
+      .read("GRO", _gro)
       .consume() < 0)
     return -1;
 
+  if (_burst == 0)
+    return errh->error("BURST must be positive");
+
   if (allow && !(_allow = (IPRouteTable *)allow->cast("IPRouteTable")))
     return errh->error("%s is not an IPRouteTable", allow->name().c_str());
 
@@ -119,6 +145,16 @@ Socket::configure(Vector<String> &conf, ErrorHandler *errh)
   else
     return errh->error("unknown socket type `%s'", socktype.c_str());
 
+  if ((_gso || _gro) && _protocol != IPPROTO_UDP)
+    return errh->error("GSO and GRO require a UDP socket");
+  if (_socktype == SOCK_DGRAM && (_burst > 1 || _gso || _gro)) {
+#if SOCKET_HAVE_MMSG
+    _mmsg = true;
+#else
+    errh->warning("BURST, GSO and GRO are not supported on this platform");
+#endif
+  }
+
   return 0;
 }
 
@@ -189,6 +225,35 @@ Socket::initialize(ErrorHandler *errh)
     if (setsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &_rcvbuf, sizeof(_rcvbuf)) < 0)
       return initialize_socket_error(errh, "setsockopt(SO_RCVBUF)");
 
+#if SOCKET_HAVE_MMSG
+  if (_gso) {
+    // probe for kernel support, the segment size is set per message
+    int gso_size = 0;
+    if (setsockopt(_fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_SEGMENT)");
+  }
+
+  if (_gro) {
+    int one = 1;
+    if (setsockopt(_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0)
+      return initialize_socket_error(errh, "setsockopt(UDP_GRO)");
+  }
+
+  if (_mmsg) {
+    _rv.msgs.resize(_burst);
+    _rv.iovs.resize(_burst);
+    _rv.names.resize(_burst);
+    _rv.control.resize(_burst * CMSG_SPACE(sizeof(int)));
+    _rqs.resize(_burst, 0);
+    unsigned max_segs = _gso ? SOCKET_GSO_MAX_SEGMENTS : 1;
+    _sv.msgs.resize(_burst);
+    _sv.iovs.resize(_burst * max_segs);
+    _sv.names.resize(_burst);
+    _sv.control.resize(_burst * CMSG_SPACE(sizeof(uint16_t)));
+    _sv.npackets.resize(_burst);
+  }
+#endif
+
   // if a server, then the first arguments should be interpreted as
   // the address/port/file to bind() to, not to connect() to
   if (!_client) {
@@ -262,6 +327,20 @@ Socket::cleanup(CleanupStage)
   }
   if (_rq)
     _rq->kill();
+#if SOCKET_HAVE_MMSG
+  for (int i = 0; i < _rqs.size(); i++)
+    if (_rqs[i]) {
+      _rqs[i]->kill();
+      _rqs[i] = 0;
+    }
+  // in batched mode, _wq is a null-terminated list of unsent packets
+  if (_mmsg)
+    while (_wq) {
+      Packet *next = _wq->next();
+      _wq->kill();
+      _wq = next;
+    }
+#endif
   if (_wq)
     _wq->kill();
   if (_fd >= 0) {
@@ -346,6 +425,13 @@ Socket::selected(int fd, int)
       add_select(_active, SELECT_READ);
     }
 
+#if SOCKET_HAVE_MMSG
+    if (_mmsg) {
+      read_packets();
+      goto pull;
+    }
+#endif
+
     // read data from socket
     if (!_rq)
       _rq = Packet::make(_headroom, 0, _snaplen, 0);
@@ -400,10 +486,138 @@ Socket::selected(int fd, int)
     }
   }
 
+#if SOCKET_HAVE_MMSG
+ pull:
+#endif
   if (ninputs() && input_is_pull(0))
     run_task(0);
 }
 
+#if SOCKET_HAVE_MMSG
+/*
+ * Receive up to _burst datagrams with a single recvmmsg(), and push them
+ * as one batch. With GRO, a message may hold several coalesced datagrams
+ * of gso_size bytes each, which are split back into separate packets.
+ */
+void
+Socket::read_packets()
+{
+  // large enough for a coalesced GRO message
+  uint32_t buflen = _gro ? SOCKET_GSO_MAX_SIZE : _snaplen;
+  unsigned n;
+  for (n = 0; n < _burst; n++) {
+    if (!_rqs[n] && !(_rqs[n] = Packet::make(_headroom, 0, buflen, 0)))
+      break;
+    _rv.iovs[n].iov_base = _rqs[n]->data();
+    _rv.iovs[n].iov_len = _rqs[n]->length();
+    struct msghdr &h = _rv.msgs[n].msg_hdr;
+    memset(&h, 0, sizeof(h));
+    h.msg_iov = &_rv.iovs[n];
+    h.msg_iovlen = 1;
+    if (!_client) {
+      h.msg_name = &_rv.names[n];
+      h.msg_namelen = sizeof(sockaddr_any);
+    }
+    if (_gro) {
+      h.msg_control = &_rv.control[n * CMSG_SPACE(sizeof(int))];
+      h.msg_controllen = CMSG_SPACE(sizeof(int));
+    }
+  }
+  if (n == 0)
+    return;
+
+  int r = recvmmsg(_active, _rv.msgs.data(), n, MSG_DONTWAIT | MSG_TRUNC, 0);
+  if (r <= 0) {
+    // fatal error
+    if (r < 0 && errno != EAGAIN && errno != EINTR) {
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+    }
+    return;
+  }
+
+#if HAVE_BATCH
+  BATCH_CREATE_INIT(batch);
+#endif
+  Timestamp now;
+  if (_timestamp)
+    now.assign_now();
+  for (int i = 0; i < r; i++) {
+    WritablePacket *p = _rqs[i];
+    uint32_t len = _rv.msgs[i].msg_len;
+    struct msghdr &h = _rv.msgs[i].msg_hdr;
+
+    if (!_client) {
+      sockaddr_any &from = _rv.names[i];
+      if (_family == AF_INET && !allowed(IPAddress(from.in.sin_addr))) {
+	if (_verbose)
+	  click_chatter("%s: dropped datagram from %s:%d", declaration().c_str(),
+			IPAddress(from.in.sin_addr).unparse().c_str(), ntohs(from.in.sin_port));
+	continue; // keep the buffer for the next call
+      }
+      memcpy(&_remote, &from, h.msg_namelen);
+      _remote_len = h.msg_namelen;
+    }
+    _rqs[i] = 0;
+
+    if (len > buflen) {
+      SET_EXTRA_LENGTH_ANNO(p, len - buflen);
+      len = buflen;
+    } else
+      p->take(buflen - len);
+
+    uint32_t seg = 0;
+    if (_gro)
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&h); cm; cm = CMSG_NXTHDR(&h, cm))
+	if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+	  seg = *(int *) CMSG_DATA(cm);
+
+    // the first datagram stays in p, the others are copied out
+    uint32_t off = seg && seg < len ? seg : len;
+    for (; off < len; off += seg) {
+      uint32_t l = len - off < seg ? len - off : seg;
+      WritablePacket *q = Packet::make(_headroom, p->data() + off, l, 0);
+      if (!q)
+	break;
+      if (_timestamp)
+	q->timestamp_anno() = now;
+#if HAVE_BATCH
+      BATCH_CREATE_APPEND(batch, q);
+#else
+      output(0).push(q);
+#endif
+    }
+    if (seg && seg < len)
+      p->take(len - seg);
+    else if ((int) p->length() > _snaplen)
+      p->take(p->length() - _snaplen);
+
+    if (_timestamp)
+      p->timestamp_anno() = now;
+#if HAVE_BATCH
+    BATCH_CREATE_APPEND(batch, p);
+#else
+    output(0).push(p);
+#endif
+  }
+#if HAVE_BATCH
+  BATCH_CREATE_FINISH(batch);
+  if (batch)
+    output_push_batch(0, batch);
+#endif
+
+  // compact the receive queue so filled slots come first
+  int j = 0;
+  for (int i = 0; i < _rqs.size(); i++)
+    if (_rqs[i]) {
+      WritablePacket *p = _rqs[i];
+      _rqs[i] = 0;
+      _rqs[j++] = p;
+    }
+}
+#endif
+
 int
 Socket::write_packet(Packet *p)
 {
@@ -451,6 +665,101 @@ Socket::write_packet(Packet *p)
   return 0;
 }
 
+#if SOCKET_HAVE_MMSG
+/*
+ * Send the null-terminated list of datagrams starting at @a p with as few
+ * sendmmsg() calls as possible. With GSO, runs of packets with the same
+ * length and destination are sent as one message. Sent packets are
+ * killed. Returns the first unsent packet if the socket would block, with
+ * errno set, or null.
+ */
+Packet *
+Socket::write_packets(Packet *p)
+{
+  assert(_active >= 0);
+  bool anno_dst = !IPAddress(_remote_ip) && _client && _family == AF_INET;
+  unsigned max_segs = _gso ? SOCKET_GSO_MAX_SEGMENTS : 1;
+
+  while (p) {
+    unsigned nmsg = 0, niov = 0;
+    Packet *q = p;
+    while (q && nmsg < _burst) {
+      struct msghdr &h = _sv.msgs[nmsg].msg_hdr;
+      memset(&h, 0, sizeof(h));
+      sockaddr_any &to = _sv.names[nmsg];
+      memcpy(&to, &_remote, _remote_len);
+      if (anno_dst)
+	// If the IP address specified when the element was created is 0.0.0.0,
+	// send the packet to its IP destination annotation address
+	to.in.sin_addr = q->dst_ip_anno();
+      h.msg_name = &to;
+      h.msg_namelen = _remote_len;
+      h.msg_iov = &_sv.iovs[niov];
+
+      uint32_t seg = q->length(), total = 0;
+      int npkts = 0;
+      do {
+	_sv.iovs[niov].iov_base = (void *) q->data();
+	_sv.iovs[niov].iov_len = q->length();
+	total += q->length();
+	niov++;
+	npkts++;
+	q = q->next();
+	// only the last segment of a message may be shorter
+      } while (q && npkts < (int) max_segs && _sv.iovs[niov - 1].iov_len == seg
+	       && q->length() <= seg && total + q->length() <= SOCKET_GSO_MAX_SIZE
+	       && (!anno_dst || q->dst_ip_anno() == to.in.sin_addr));
+      h.msg_iovlen = npkts;
+      _sv.npackets[nmsg] = npkts;
+
+      if (npkts > 1) {
+	char *control = &_sv.control[nmsg * CMSG_SPACE(sizeof(uint16_t))];
+	h.msg_control = control;
+	h.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&h);
+	cm->cmsg_level = SOL_UDP;
+	cm->cmsg_type = UDP_SEGMENT;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t *) CMSG_DATA(cm) = seg;
+      }
+      nmsg++;
+    }
+
+    int r = sendmmsg(_active, _sv.msgs.data(), nmsg, MSG_DONTWAIT);
+    if (r < 0) {
+      // out of memory or would block
+      if (errno == ENOBUFS || errno == EAGAIN)
+	return p;
+      // interrupted by signal, try again immediately
+      else if (errno == EINTR)
+	continue;
+      // connection probably terminated or other fatal error
+      if (_verbose)
+	click_chatter("%s: %s", declaration().c_str(), strerror(errno));
+      close_active();
+      r = nmsg;
+    }
+
+    for (int i = 0; i < r; i++)
+      for (int j = 0; j < _sv.npackets[i]; j++) {
+	Packet *next = p->next();
+	p->kill();
+	p = next;
+      }
+    if (_active < 0)
+      break;
+  }
+
+  // the socket was closed, drop what remains
+  while (p) {
+    Packet *next = p->next();
+    p->kill();
+    p = next;
+  }
+  return 0;
+}
+#endif
+
 void
 Socket::push(int, Packet *p)
 {
@@ -481,6 +790,34 @@ Socket::push(int, Packet *p)
     p->kill();
 }
 
+#if HAVE_BATCH
+void
+Socket::push_batch(int port, PacketBatch *batch)
+{
+#if SOCKET_HAVE_MMSG
+  if (_mmsg && _active >= 0) {
+    Packet *p = batch->first();
+    fd_set fds;
+    while (p && _active >= 0) {
+      p = write_packets(p);
+      if (p) {
+	// block until the socket becomes writable
+	FD_ZERO(&fds);
+	FD_SET(_active, &fds);
+	if (select(_active + 1, NULL, &fds, NULL, NULL) < 0 && errno != EINTR)
+	  break;
+      }
+    }
+    if (p)
+      PacketBatch::make_from_simple_list(p)->kill();
+    return;
+  }
+#endif
+  FOR_EACH_PACKET_SAFE(batch, p)
+    push(port, p);
+}
+#endif
+
 bool
 Socket::run_task(Task *)
 {
@@ -491,6 +828,39 @@ Socket::run_task(Task *)
     Packet *p = 0;
     int err = 0;
 
+#if SOCKET_HAVE_MMSG
+    if (_mmsg) {
+      // write as much as we can, a batch at a time
+      do {
+	p = _wq;
+	_wq = 0;
+	if (!p) {
+#if HAVE_BATCH
+	  PacketBatch *batch = input_pull_batch(0, _burst);
+	  p = batch ? batch->first() : 0;
+#else
+	  Packet *tail = 0;
+	  for (unsigned i = 0; i < _burst; i++) {
+	    Packet *q = input(0).pull();
+	    if (!q)
+	      break;
+	    q->set_next(0);
+	    if (tail)
+	      tail->set_next(q);
+	    else
+	      p = q;
+	    tail = q;
+	  }
+#endif
+	}
+	if (!p)
+	  break;
+	any = true;
+	if ((p = write_packets(p)))
+	  err = -1;
+      } while (err >= 0 && _active >= 0);
+    } else
+#endif
     // write as much as we can
     do {
       p = _wq ? _wq : input(0).pull();
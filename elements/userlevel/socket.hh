@@ -1,12 +1,16 @@
 // -*- mode: c++; c-basic-offset: 2 -*-
 #ifndef CLICK_SOCKET_HH
 #define CLICK_SOCKET_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/string.hh>
 #include <click/task.hh>
 #include <click/notifier.hh>
 #include "../ip/iproutetable.hh"
 #include <sys/un.h>
+#if defined(__linux__)
+# include <sys/socket.h>
+# define SOCKET_HAVE_MMSG 1
+#endif
 CLICK_DECLS
 
 /*
@@ -141,6 +145,27 @@ Boolean. PlanetLab specific. If true and Click has been configured
 
 Integer. Per-packet headroom. Defaults to 28.
 
+=item BURST
+
+Unsigned integer. Applies to datagram sockets only. Maximum number of
+datagrams moved per system call. If greater than 1, datagrams are
+received with recvmmsg() and emitted as a batch, and input batches are
+sent with sendmmsg(). Only available on Linux. Default is 1.
+
+=item GSO
+
+Boolean. Applies to UDP sockets only. If set, consecutive packets of a
+batch with the same length and destination are sent as one UDP
+Generic Segmentation Offload message, segmented by the kernel or the
+NIC. Implies recvmmsg()/sendmmsg() I/O. Default is false.
+
+=item GRO
+
+Boolean. Applies to UDP sockets only. If set, the kernel may coalesce
+received datagrams of the same flow, and Socket splits them back into
+one packet per datagram. Implies recvmmsg()/sendmmsg() I/O. Default is
+false.
+
 =back
 
 =e
@@ -168,7 +193,7 @@ Integer. Per-packet headroom. Defaults to 28.
 
 =a RawSocket */
 
-class Socket : public Element { public:
+class Socket : public BatchElement { public:
 
   Socket() CLICK_COLD;
   ~Socket() CLICK_COLD;
@@ -188,10 +213,17 @@ class Socket : public Element { public:
   bool run_task(Task *);
   void selected(int fd, int mask);
   void push(int port, Packet*);
+#if HAVE_BATCH
+  void push_batch(int port, PacketBatch*);
+#endif
 
   bool allowed(IPAddress);
   void close_active(void);
   int write_packet(Packet*);
+#if SOCKET_HAVE_MMSG
+  Packet *write_packets(Packet*);
+  void read_packets();
+#endif
 
 protected:
   Task _task;
@@ -234,6 +266,26 @@ private:
   bool _proper;			// (PlanetLab only) use Proper to bind port
   IPRouteTable *_allow;		// lookup table of good hosts
   IPRouteTable *_deny;		// lookup table of bad hosts
+  unsigned _burst;		// datagrams per recvmmsg()/sendmmsg()
+  bool _gso;			// send with UDP_SEGMENT
+  bool _gro;			// receive with UDP_GRO
+  bool _mmsg;			// use recvmmsg()/sendmmsg()
+
+#if SOCKET_HAVE_MMSG
+  typedef union { struct sockaddr_in in; struct sockaddr_un un; } sockaddr_any;
+
+  // message vectors for recvmmsg() or sendmmsg()
+  struct MMsgVector {
+    Vector<struct mmsghdr> msgs;
+    Vector<struct iovec> iovs;
+    Vector<sockaddr_any> names;
+    Vector<char> control;
+    Vector<int> npackets;		// packets per message (sendmmsg() with GSO)
+  };
+  MMsgVector _rv;
+  MMsgVector _sv;
+  Vector<WritablePacket *> _rqs;	// queue to receive batched packets
+#endif
 
   int initialize_socket_error(ErrorHandler *, const char *);
 
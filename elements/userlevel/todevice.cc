@@ -46,13 +46,8 @@
 # include <sys/socket.h>
 # include <sys/ioctl.h>
 # include <net/if.h>
-# include <net/if_packet.h>
 # include <features.h>
-# if __GLIBC__ >= 2 && __GLIBC_MINOR__ >= 1
-#  include <netpacket/packet.h>
-# else
-#  include <linux/if_packet.h>
-# endif
+# include <linux/if_packet.h>
 #endif
 
 CLICK_DECLS
@@ -82,11 +77,17 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String method;
     _burst = 1;
+#if TODEVICE_ALLOW_LINUX
+    unsigned frames = 1024;
+#endif
     if (Args(conf, this, errh)
         .read_mp("DEVNAME", _ifname)
         .read("DEBUG", _debug)
         .read("METHOD", WordArg(), method)
         .read("BURST", _burst)
+#if TODEVICE_ALLOW_LINUX
+        .read("FRAMES", frames)
+#endif
         .complete() < 0)
         return -1;
     if (!_ifname)
@@ -108,6 +109,8 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
 #if TODEVICE_ALLOW_LINUX
     else if (method == "LINUX")
         _method = method_linux;
+    else if (method == "MMAP")
+        _method = method_mmap;
 #endif
 #if TODEVICE_ALLOW_DEVBPF
     else if (method == "DEVBPF")
@@ -120,6 +123,14 @@ ToDevice::configure(Vector<String> &conf, ErrorHandler *errh)
     else
         return errh->error("bad METHOD");
 
+#if TODEVICE_ALLOW_LINUX
+    // 2048-byte frames, 32 per block
+    _ring.frame_size = TPACKET_ALIGNMENT << 7;
+    _ring.block_size = _ring.frame_size * 32;
+    _ring.nblocks = (frames + 31) / 32;
+    if (_ring.nblocks == 0)
+        return errh->error("bad FRAMES");
+#endif
     return 0;
 }
 
@@ -149,6 +160,8 @@ ToDevice::initialize(ErrorHandler *errh)
 #if FROMDEVICE_ALLOW_LINUX && TODEVICE_ALLOW_LINUX
         if (fd->linux_fd() >= 0)
             _method = method_linux;
+        else if (fd->mmap_ring())
+            _method = method_mmap;
 #endif
     }
 
@@ -205,6 +218,19 @@ ToDevice::initialize(ErrorHandler *errh)
         }
         _method = method_linux;
     }
+
+    if (_method == method_mmap) {
+        _fd = FromDevice::open_packet_socket(_ifname, errh);
+        if (_fd < 0)
+            return -1;
+        _my_fd = true;
+        // Drop malformed frames instead of stalling the ring
+        int one = 1;
+        if (setsockopt(_fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) < 0)
+            return errh->error("PACKET_LOSS: %s", strerror(errno));
+        if (FromDevice::setup_packet_ring(_fd, true, _ring, 0, errh) < 0)
+            return -1;
+    }
 #endif
 
 #if TODEVICE_ALLOW_PCAPFD
@@ -237,6 +263,9 @@ ToDevice::cleanup(CleanupStage)
         pcap_close(_pcap);
     _pcap = 0;
 #endif
+#if TODEVICE_ALLOW_LINUX
+    FromDevice::release_packet_ring(_ring);
+#endif
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     if (_fd >= 0 && _my_fd)
         close(_fd);
@@ -274,6 +303,25 @@ ToDevice::send_packet(Packet *p)
 #if TODEVICE_ALLOW_LINUX
     if (_method == method_linux)
         r = send(_fd, p->data(), p->length(), 0);
+    else if (_method == method_mmap) {
+        // Frames are only queued here, run_task flushes the ring once per batch
+        struct tpacket2_hdr *h = (struct tpacket2_hdr *)
+            (_ring.map + (size_t) _ring.cur * _ring.frame_size);
+        const unsigned off = TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+        if (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            errno = ENOBUFS;
+            r = -1;
+        } else if (p->length() > _ring.frame_size - off) {
+            errno = EMSGSIZE;
+            r = -1;
+        } else {
+            memcpy((unsigned char *) h + off, p->data(), p->length());
+            h->tp_len = p->length();
+            __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+            if (++_ring.cur == _ring.nframes)
+                _ring.cur = 0;
+        }
+    }
 #endif
 
 #if TODEVICE_ALLOW_DEVBPF
@@ -347,6 +395,11 @@ ToDevice::run_task(Task *)
     } while (count < _burst);
 #endif
 
+#if TODEVICE_ALLOW_LINUX
+    if (_method == method_mmap && count > 0)
+        sendto(_fd, 0, 0, MSG_DONTWAIT, 0, 0);
+#endif
+
     if (r == -ENOBUFS || r == -EAGAIN) {
         assert(!_q);
         _q = p;
@@ -33,11 +33,20 @@ CLICK_DECLS
  * =item METHOD
  *
  * Word. Defines the method ToDevice will use to write packets to the
- * device. Linux targets generally support PCAP and LINUX; other targets
+ * device. Linux targets generally support PCAP, LINUX and MMAP; other targets
  * support PCAP or, occasionally, other methods. Defaults to the method
  * specified for a matching L<FromDevice(n)>, or the first supported
  * method among PCAP, DEVBPF, LINUX and PCAPFD otherwise.
  *
+ * METHOD MMAP copies packets into a memory-mapped PACKET_TX_RING (TPACKET_V2)
+ * and issues a single system call per pulled batch to have the kernel send
+ * them all.
+ *
+ * =item FRAMES
+ *
+ * Integer. Number of 2048-byte frames of the TX ring for METHOD MMAP, rounded
+ * up to a multiple of 32. Defaults to 1024.
+ *
  * =item DEBUG
  *
  * Boolean.  If true, print out debug messages.
@@ -114,8 +123,11 @@ class ToDevice : public BatchElement { public:
 #if TODEVICE_ALLOW_LINUX || TODEVICE_ALLOW_DEVBPF || TODEVICE_ALLOW_PCAPFD
     int _fd;
 #endif
-    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd };
+    enum { method_default, method_linux, method_pcap, method_devbpf, method_pcapfd, method_mmap };
     int _method;
+#if TODEVICE_ALLOW_LINUX
+    FromDevice::PacketRing _ring;
+#endif
     NotifierSignal _signal;
 
 #if HAVE_BATCH
@@ -32,6 +32,9 @@
 #include <click/packet_anno.hh>
 #include "fakepcap.hh"
 #include <click/userutils.hh>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
 #if HAVE_PCAP
 extern "C" {
 # include <pcap.h>
@@ -40,7 +43,12 @@ extern "C" {
 CLICK_DECLS
 
 ToDump::ToDump()
-    : _fp(0), _count(0), _task(this), _use_encap_from(0)
+    : _fp(0), _count(0), _dropped(0), _nfiles(0), _task(this),
+      _use_encap_from(0)
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    , _async(false), _buffers(0), _fill(0), _carry(0),
+      _writer_running(false), _wfd(-1)
+#endif
 {
 }
 
@@ -53,6 +61,12 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     String encap_type;
     String use_encap_from;
+    bool async = false;
+    bool direct = true;
+    uint32_t buffer_size = 4 << 20;
+    int nbuffers = 2;
+    uint64_t rotate_size = 0;
+    Timestamp rotate_interval;
     _snaplen = 2000;
     _extra_length = true;
     _unbuffered = false;
@@ -77,9 +91,41 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
         .read("PER_NODE", per_node)
 #endif
         .read("FORCE_TS", _force_ts)
+        .read("ASYNC", async)
+        .read("BUFFER_SIZE", buffer_size)
+        .read("BUFFERS", nbuffers)
+        .read("DIRECT", direct)
+        .read("ROTATE_SIZE", rotate_size)
+        .read("ROTATE_INTERVAL", rotate_interval)
         .complete() < 0)
             return -1;
 
+    if (!async && (rotate_size || rotate_interval))
+        return errh->error("ROTATE_SIZE and ROTATE_INTERVAL require ASYNC");
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    if (async) {
+        if (compressed_filename(_filename) > 0)
+            return errh->error("ASYNC cannot write compressed dumps");
+        if (_filename == "-" && (rotate_size || rotate_interval))
+            return errh->error("cannot rotate the standard output");
+        if (nbuffers < 2)
+            return errh->error("BUFFERS must be at least 2");
+        if (buffer_size < 65536 || buffer_size > 0x40000000)
+            return errh->error("BUFFER_SIZE must be between 64KB and 1GB");
+        // O_DIRECT transfers are page-aligned and a multiple of the page size
+        _buffer_size = (buffer_size + 4095) & ~4095U;
+        _nbuffers = nbuffers;
+        _direct = direct;
+        _rotate_size = rotate_size;
+        _rotate_interval = rotate_interval;
+    }
+    _async = async;
+#else
+    (void) direct, (void) buffer_size, (void) nbuffers;
+    if (async)
+        return errh->error("ASYNC requires multithreading support");
+#endif
+
     if (_snaplen == 0)
         _snaplen = 0xFFFFFFFFU;
 
@@ -116,10 +162,18 @@ ToDump::configure(Vector<String> &conf, ErrorHandler *errh)
 ToDump *
 ToDump::hotswap_element() const
 {
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    if (_async)
+        return 0;
+#endif
     if (Element *e = Element::hotswap_element())
     if (ToDump *td = (ToDump *)e->cast("ToDump"))
         if (td->_filename == _filename
-        && td->_linktype == _linktype)
+        && td->_linktype == _linktype
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+        && !td->_async
+#endif
+        )
         return td;
     return 0;
 }
@@ -153,6 +207,12 @@ ToDump::initialize(ErrorHandler *errh)
     }
     }
 
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    if (_async) {
+        if (initialize_async(errh) < 0)
+            return -1;
+    } else
+#endif
     // skip initialization if we're hotswapping later
     if (!hotswap_element()) {
 
@@ -174,15 +234,8 @@ ToDump::initialize(ErrorHandler *errh)
         setvbuf(_fp, (char *) 0, _IONBF, 0);
 
     struct fake_pcap_file_header h;
-
-    h.magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
-    h.version_major = FAKE_PCAP_VERSION_MAJOR;
-    h.version_minor = FAKE_PCAP_VERSION_MINOR;
-
-    h.thiszone = 0;        // timestamps are in GMT
-    h.sigfigs = 0;        // XXX accuracy of timestamps?
-    h.snaplen = _snaplen;
-    h.linktype = _linktype;
+    make_file_header(&h);
+    _nfiles = 1;
 
     size_t wrote_header = fwrite(&h, sizeof(h), 1, _fp);
     if (wrote_header != 1)
@@ -199,26 +252,46 @@ ToDump::initialize(ErrorHandler *errh)
     return 0;
 }
 
+void
+ToDump::make_file_header(void *x) const
+{
+    struct fake_pcap_file_header *h = (struct fake_pcap_file_header *) x;
+
+    h->magic = _nano ? FAKE_PCAP_MAGIC_NANO : FAKE_PCAP_MAGIC;
+    h->version_major = FAKE_PCAP_VERSION_MAJOR;
+    h->version_minor = FAKE_PCAP_VERSION_MINOR;
+
+    h->thiszone = 0;        // timestamps are in GMT
+    h->sigfigs = 0;        // XXX accuracy of timestamps?
+    h->snaplen = _snaplen;
+    h->linktype = _linktype;
+}
+
 void
 ToDump::take_state(Element *e, ErrorHandler *)
 {
     ToDump *td = static_cast<ToDump *>(e); // result of hotswap_element()
     _fp = td->_fp;
     td->_fp = 0;
+    _nfiles = td->_nfiles;
 }
 
 void
 ToDump::cleanup(CleanupStage)
 {
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    if (_async)
+        cleanup_async();
+#endif
     if (_fp && _fp != stdout)
         fclose(_fp);
     _fp = 0;
 }
 
-void
-ToDump::write_packet(Packet *p)
+inline unsigned
+ToDump::make_header(Packet *p, void *x)
 {
-    struct fake_pcap_pkthdr ph;
+    struct fake_pcap_pkthdr &ph = *(struct fake_pcap_pkthdr *) x;
 
     Timestamp ts = p->timestamp_anno();
     if (!ts && !_force_ts)
@@ -231,6 +304,22 @@ ToDump::write_packet(Packet *p)
     if (_snaplen && to_write > _snaplen)
         to_write = _snaplen;
     ph.caplen = to_write;
+    return to_write;
+}
+
+void
+ToDump::write_packet(Packet *p)
+{
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    if (_async) {
+        _lock.acquire();
+        append_async(p);
+        _lock.release();
+        return;
+    }
+#endif
+    struct fake_pcap_pkthdr ph;
+    unsigned to_write = make_header(p, &ph);
 
     if (_mt)
         _lock.acquire();
@@ -252,6 +341,16 @@ void
 ToDump::push_batch(int, PacketBatch *b)
 {
     if (_active) {
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+        if (_async) {
+            // one lock round trip per batch
+            _lock.acquire();
+            FOR_EACH_PACKET(b,p) {
+                append_async(p);
+            }
+            _lock.release();
+        } else
+#endif
         FOR_EACH_PACKET(b,p) {
             write_packet(p);
         }
@@ -291,7 +390,316 @@ ToDump::run_task(Task *)
     return p != 0;
 }
 
-enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2 };
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+int
+ToDump::initialize_async(ErrorHandler *errh)
+{
+    _align = 1;
+    if (_filename == "-") {
+        _wfd = STDOUT_FILENO;
+        _windex = 0;
+        _wpos = 0;
+        _filename = "<stdout>";
+        _direct = false;
+    } else {
+        int r = open_file(0);
+# ifdef O_DIRECT
+        if (r == -EINVAL && _direct) {
+            errh->warning("%s: O_DIRECT not supported, using buffered writes", _filename.c_str());
+            _direct = false;
+            r = open_file(0);
+        }
+# else
+        _direct = false;
+# endif
+        if (r < 0)
+            return errh->error("%s: %s", _filename.c_str(), strerror(-r));
+        if (_direct)
+            _align = 4096;
+    }
+
+    // each buffer has room to pad its last block
+    _buffers = new AsyncBuffer[_nbuffers]();
+    for (int i = 0; i < _nbuffers; ++i) {
+        void *data;
+        if (posix_memalign(&data, 4096, _buffer_size + 4096) != 0)
+            return errh->error("out of memory");
+        _buffers[i].data = (unsigned char *) data;
+        _buffers[i].state = B_FREE;
+    }
+    _carry = new unsigned char[4096];
+    _carry_len = 0;
+    _fill_index = 0;
+    _new_file = true;
+    _wstop = false;
+    _werror = false;
+    take_buffer();
+
+    pthread_mutex_init(&_wmutex, 0);
+    pthread_cond_init(&_wcond, 0);
+    if (pthread_create(&_writer, 0, writer_thread, this) != 0)
+        return errh->error("cannot start writer thread: %s", strerror(errno));
+    _writer_running = true;
+    return 0;
+}
+
+void
+ToDump::cleanup_async()
+{
+    if (_writer_running) {
+        pthread_mutex_lock(&_wmutex);
+        _wstop = true;
+        pthread_cond_signal(&_wcond);
+        pthread_mutex_unlock(&_wmutex);
+        pthread_join(_writer, 0);
+        _writer_running = false;
+        pthread_mutex_destroy(&_wmutex);
+        pthread_cond_destroy(&_wcond);
+
+        // The writer drained every full buffer; finish the file here.
+        if (!_fill && _carry_len)
+            take_buffer();
+        if (_fill) {
+            _fill->last_in_file = true;
+            write_buffer(_fill);
+            _fill = 0;
+        }
+    }
+    if (_wfd >= 0 && _wfd != STDOUT_FILENO)
+        close(_wfd);
+    _wfd = -1;
+    if (_buffers)
+        for (int i = 0; i < _nbuffers; ++i)
+            free(_buffers[i].data);
+    delete[] _buffers;
+    delete[] _carry;
+    _buffers = 0;
+    _carry = 0;
+}
+
+String
+ToDump::file_name(int index) const
+{
+    if (index == 0)
+        return _filename;
+    else
+        return _filename + String(index);
+}
+
+int
+ToDump::open_file(int index)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+# ifdef O_DIRECT
+    if (_direct)
+        flags |= O_DIRECT;
+# endif
+    int fd = open(file_name(index).c_str(), flags, 0666);
+    if (fd < 0)
+        return -errno;
+    _wfd = fd;
+    _windex = index;
+    _wpos = 0;
+    return 0;
+}
+
+/* Called with _lock held. Takes the next buffer if the writer is done with
+   it; otherwise packets are dropped until it is. */
+void
+ToDump::take_buffer()
+{
+    AsyncBuffer *b = &_buffers[_fill_index];
+    if (b->state.value() != B_FREE)
+        return;
+    click_read_fence();
+    b->flushed = 0;
+    b->last_in_file = false;
+    if (_new_file) {
+        make_file_header(b->data);
+        b->len = sizeof(struct fake_pcap_file_header);
+        _file_bytes = b->len;
+        _file_start = Timestamp::recent_steady();
+        _new_file = false;
+        ++_nfiles;
+    } else {
+        memcpy(b->data, _carry, _carry_len);
+        b->len = _carry_len;
+    }
+    _carry_len = 0;
+    _fill = b;
+}
+
+/* Called with _lock held. Hands the buffer being filled to the writer. Unless
+   it ends a file, the writer only writes whole blocks, so the unaligned tail
+   moves to the beginning of the next buffer. */
+void
+ToDump::close_buffer(bool last_in_file)
+{
+    AsyncBuffer *b = _fill;
+    b->last_in_file = last_in_file;
+    if (!last_in_file) {
+        _carry_len = b->len % _align;
+        memcpy(_carry, b->data + b->len - _carry_len, _carry_len);
+    }
+    click_write_fence();
+    b->state = B_FULL;
+    _fill = 0;
+    _fill_index = (_fill_index + 1) % _nbuffers;
+
+    pthread_mutex_lock(&_wmutex);
+    pthread_cond_signal(&_wcond);
+    pthread_mutex_unlock(&_wmutex);
+}
+
+/* Called with _lock held. */
+inline void
+ToDump::append_async(Packet *p)
+{
+    struct fake_pcap_pkthdr ph;
+    unsigned to_write = make_header(p, &ph);
+    uint32_t rlen = sizeof(ph) + to_write;
+
+    if (_fill && _file_bytes > sizeof(struct fake_pcap_file_header)
+        && ((_rotate_size && _file_bytes + rlen > _rotate_size)
+            || (_rotate_interval
+                && Timestamp::recent_steady() - _file_start >= _rotate_interval))) {
+        close_buffer(true);
+        _new_file = true;
+    }
+    if (_fill && _fill->len + rlen > _buffer_size)
+        close_buffer(false);
+    if (!_fill)
+        take_buffer();
+
+    if (likely(_fill && _fill->len + rlen <= _buffer_size)) {
+        unsigned char *x = _fill->data + _fill->len;
+        memcpy(x, &ph, sizeof(ph));
+        memcpy(x + sizeof(ph), p->data(), to_write);
+        _fill->len += rlen;
+        _file_bytes += rlen;
+        _count++;
+    } else
+        _dropped++;
+}
+
+bool
+ToDump::write_out(const unsigned char *data, size_t len)
+{
+    if (_werror)
+        return false;
+    if (_wfd < 0) {
+        int r = open_file(_windex + 1);
+        if (r < 0) {
+            click_chatter("%p{element}: %s: %s", this, file_name(_windex + 1).c_str(), strerror(-r));
+            _werror = true;
+            return false;
+        }
+    }
+    while (len > 0) {
+        ssize_t w = ::write(_wfd, data, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+# ifdef O_DIRECT
+        // some file systems accept O_DIRECT at open time only
+        if (w < 0 && errno == EINVAL) {
+            int flags = fcntl(_wfd, F_GETFL);
+            if (flags >= 0 && (flags & O_DIRECT)
+                && fcntl(_wfd, F_SETFL, flags & ~O_DIRECT) == 0)
+                continue;
+        }
+# endif
+        if (w <= 0) {
+            click_chatter("%p{element}: %s: %s, discarding further packets", this, file_name(_windex).c_str(), strerror(errno));
+            _werror = true;
+            return false;
+        }
+        data += w;
+        len -= w;
+        _wpos += w;
+    }
+    return true;
+}
+
+void
+ToDump::write_buffer(AsyncBuffer *b)
+{
+    uint32_t end = b->len, pad = 0;
+    if (!b->last_in_file)
+        end -= end % _align;
+    else if (end % _align) {
+        pad = _align - end % _align;
+        memset(b->data + end, 0, pad);
+    }
+    if (end + pad > b->flushed)
+        write_out(b->data + b->flushed, end + pad - b->flushed);
+    b->flushed = end + pad;
+
+    if (b->last_in_file && _wfd >= 0) {
+        if (_wfd != STDOUT_FILENO) {
+            if (pad && !_werror && ftruncate(_wfd, _wpos - pad) < 0)
+                click_chatter("%p{element}: %s: %s", this, file_name(_windex).c_str(), strerror(errno));
+            close(_wfd);
+        }
+        _wfd = -1;
+    }
+}
+
+/* Writes the whole blocks of the buffer being filled, so that a slow packet
+   stream still reaches the file. */
+void
+ToDump::flush_partial(AsyncBuffer *b)
+{
+    _lock.acquire();
+    uint32_t len = (_fill == b ? b->len : 0);
+    _lock.release();
+    len -= len % _align;
+    if (len > b->flushed) {
+        write_out(b->data + b->flushed, len - b->flushed);
+        b->flushed = len;
+    }
+}
+
+void *
+ToDump::writer_thread(void *arg)
+{
+    static_cast<ToDump *>(arg)->writer_loop();
+    return 0;
+}
+
+void
+ToDump::writer_loop()
+{
+    int index = 0;
+    pthread_mutex_lock(&_wmutex);
+    while (1) {
+        AsyncBuffer *b = &_buffers[index];
+        if (b->state.value() == B_FULL) {
+            pthread_mutex_unlock(&_wmutex);
+            click_read_fence();
+            write_buffer(b);
+            click_write_fence();
+            b->state = B_FREE;
+            index = (index + 1) % _nbuffers;
+            pthread_mutex_lock(&_wmutex);
+        } else if (_wstop)
+            break;
+        else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+            if (pthread_cond_timedwait(&_wcond, &_wmutex, &deadline) == ETIMEDOUT) {
+                pthread_mutex_unlock(&_wmutex);
+                flush_partial(b);
+                pthread_mutex_lock(&_wmutex);
+            }
+        }
+    }
+    pthread_mutex_unlock(&_wmutex);
+}
+#endif
+
+enum { H_FILENAME = 0, H_COUNT = 1, H_RESET_COUNTS = 2, H_DROPPED = 3,
+       H_FILES = 4 };
 
 String
 ToDump::read_handler(Element *e, void *thunk)
@@ -302,6 +710,10 @@ ToDump::read_handler(Element *e, void *thunk)
         return td->_filename;
       case H_COUNT:
         return String(td->_count);
+      case H_DROPPED:
+        return String(td->_dropped);
+      case H_FILES:
+        return String(td->_nfiles);
       default:
         return "<error>";
     }
@@ -312,6 +724,7 @@ ToDump::write_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToDump *td = static_cast<ToDump *>(e);
     td->_count = 0;
+    td->_dropped = 0;
     return 0;
 }
 
@@ -320,6 +733,8 @@ ToDump::add_handlers()
 {
     add_read_handler("filename", read_handler, H_FILENAME);
     add_read_handler("count", read_handler, H_COUNT);
+    add_read_handler("dropped", read_handler, H_DROPPED);
+    add_read_handler("files", read_handler, H_FILES);
     add_write_handler("reset_counts", write_handler, H_RESET_COUNTS, Handler::BUTTON);
     if (input_is_pull(0) && noutputs() == 0)
         add_task_handlers(&_task);
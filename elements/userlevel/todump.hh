@@ -7,12 +7,15 @@
 #include <click/notifier.hh>
 #include <click/sync.hh>
 #include <stdio.h>
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+# include <pthread.h>
+#endif
 CLICK_DECLS
 
 /*
 =c
 
-ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO])
+ToDump(FILENAME [, I<keywords> SNAPLEN, ENCAP, USE_ENCAP_FROM, EXTRA_LENGTH, NANO, ASYNC])
 
 =s traces
 
@@ -78,6 +81,45 @@ Boolean. Set to true to force writing a "zero" timestamp. This may be useful to
 write trace with offests relative to the first packet, that will be zero.
 Defaults to False for backward compatibility.
 
+=item ASYNC
+
+Boolean. Set to true to take disk writes off the packet path. Packets are then
+copied into one of BUFFERS large, page-aligned buffers, and a dedicated writer
+thread writes full buffers to the file. If every buffer is waiting for the
+writer, the packet is not recorded and the C<dropped> counter is incremented:
+ToDump never blocks in that mode. The writer also flushes whatever is buffered
+every second. FILENAME must be a regular file or `-'; compressed dumps are not
+supported. Requires multithreading support. Default is false.
+
+=item BUFFER_SIZE
+
+Integer. Size of each ASYNC buffer in bytes, rounded up to a multiple of the
+page size. Default is 4194304 (4MB).
+
+=item BUFFERS
+
+Integer. Number of ASYNC buffers, at least 2. Default is 2, so that ToDump
+fills one buffer while the writer flushes the other.
+
+=item DIRECT
+
+Boolean. In ASYNC mode, open the file with O_DIRECT, so that the dump bypasses
+the page cache. ToDump falls back to buffered writes, with a warning, when the
+file system does not support it. Default is true.
+
+=item ROTATE_SIZE
+
+Integer. In ASYNC mode, start a new file before the current one grows beyond
+ROTATE_SIZE bytes. Like C<tcpdump -C>, the first file is FILENAME and the
+following are FILENAME1, FILENAME2, and so on; each starts with a file header.
+Default is 0, meaning no rotation by size.
+
+=item ROTATE_INTERVAL
+
+Timestamp. In ASYNC mode, start a new file when a packet arrives more than
+ROTATE_INTERVAL after the current file was started. Default is 0, meaning no
+rotation by time.
+
 =back
 
 This element is only available at user level.
@@ -90,9 +132,19 @@ ToDump stores packets' true length annotations when available.
 
 Returns the number of packets emitted so far.
 
+=h dropped read-only
+
+Returns the number of packets that were not recorded because all ASYNC buffers
+were waiting for the writer.
+
+=h files read-only
+
+Returns the number of files ToDump has started writing, which is more than 1
+only with ASYNC rotation.
+
 =h reset_counts write-only
 
-Resets "count" to 0.
+Resets "count" and "dropped" to 0.
 
 =h filename read-only
 
@@ -146,6 +198,8 @@ class ToDump : public BatchElement { public:
     typedef uint32_t counter_t;
 #endif
     counter_t _count;
+    counter_t _dropped;
+    int _nfiles;
 
     Task _task;
     NotifierSignal _signal;
@@ -153,8 +207,62 @@ class ToDump : public BatchElement { public:
 
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+    void make_file_header(void *) const;
+    inline unsigned make_header(Packet *, void *);
     void write_packet(Packet *);
 
+#if CLICK_USERLEVEL && HAVE_USER_MULTITHREAD
+    // ASYNC mode: the data path fills _buffers in turn, the writer thread
+    // writes them out in the same order.
+    enum { B_FREE = 0, B_FULL = 1 };
+    struct AsyncBuffer {
+        unsigned char *data;
+        uint32_t len;		// bytes of the stream stored in data
+        uint32_t flushed;	// bytes already written by the writer
+        bool last_in_file;
+        atomic_uint32_t state;
+    };
+
+    bool _async;
+    bool _direct;
+    uint32_t _buffer_size;
+    int _nbuffers;
+    AsyncBuffer *_buffers;
+    AsyncBuffer *_fill;		// buffer being filled, null while dropping
+    int _fill_index;
+    uint32_t _align;
+    unsigned char *_carry;	// unaligned tail of the last full buffer
+    uint32_t _carry_len;
+    bool _new_file;
+    uint64_t _rotate_size;
+    Timestamp _rotate_interval;
+    uint64_t _file_bytes;
+    Timestamp _file_start;
+
+    pthread_t _writer;
+    bool _writer_running;
+    pthread_mutex_t _wmutex;
+    pthread_cond_t _wcond;
+    bool _wstop;
+    int _wfd;
+    int _windex;
+    off_t _wpos;
+    bool _werror;
+
+    int initialize_async(ErrorHandler *);
+    void cleanup_async();
+    inline void append_async(Packet *);
+    void take_buffer();
+    void close_buffer(bool last_in_file);
+    String file_name(int index) const;
+    int open_file(int index);
+    bool write_out(const unsigned char *data, size_t len);
+    void write_buffer(AsyncBuffer *b);
+    void flush_partial(AsyncBuffer *b);
+    static void *writer_thread(void *);
+    void writer_loop();
+#endif
+
 };
 
 CLICK_ENDDECLS
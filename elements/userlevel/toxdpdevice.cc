@@ -0,0 +1,136 @@
+// -*- mode: c++; c-basic-offset: 4 -*-
+/*
+ * toxdpdevice.{cc,hh} -- element sends packets through an AF_XDP socket
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "toxdpdevice.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+
+CLICK_DECLS
+
+ToXDPDevice::ToXDPDevice()
+    : _dev(0)
+{
+    _count = 0;
+    _dropped = 0;
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+}
+
+ToXDPDevice::~ToXDPDevice()
+{
+}
+
+int
+ToXDPDevice::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    bool has_zerocopy;
+    bool zc = false;
+    _queue = 0;
+    if (Args(conf, this, errh)
+        .read_mp("DEVNAME", _ifname)
+        .read_p("QUEUE", _queue)
+        .read("FRAMES", _config.frames)
+        .read("FRAME_SIZE", _config.frame_size)
+        .read("RING_SIZE", _config.ring_size)
+        .read("ZEROCOPY", zc).read_status(has_zerocopy)
+        .read("NEED_WAKEUP", _config.need_wakeup)
+        .read("HUGEPAGES", _config.hugepages)
+        .complete() < 0)
+        return -1;
+    _config.zerocopy = has_zerocopy ? zc : -1;
+    return 0;
+}
+
+int
+ToXDPDevice::initialize(ErrorHandler *errh)
+{
+    _dev = XDPDevice::open(_ifname, _queue, _config, errh);
+    if (!_dev)
+        return -1;
+    return 0;
+}
+
+void
+ToXDPDevice::cleanup(CleanupStage)
+{
+    if (_dev)
+        _dev->release();
+    _dev = 0;
+}
+
+#if HAVE_BATCH
+void
+ToXDPDevice::push_batch(int, PacketBatch *batch)
+{
+    unsigned count = batch->count();
+    unsigned dropped = _dev->tx_burst(batch);
+    _count += count - dropped;
+    if (dropped)
+        _dropped += dropped;
+}
+#endif
+
+void
+ToXDPDevice::push(int, Packet *p)
+{
+    unsigned dropped = _dev->tx_burst(PacketBatch::make_from_packet(p));
+    if (dropped)
+        _dropped += dropped;
+    else
+        _count++;
+}
+
+String
+ToXDPDevice::read_handler(Element *e, void *thunk)
+{
+    ToXDPDevice *td = static_cast<ToXDPDevice *>(e);
+    switch ((intptr_t) thunk) {
+    case h_count:
+        return String(td->_count.value());
+    case h_dropped:
+        return String(td->_dropped.value());
+    default:
+        return "<error>";
+    }
+}
+
+int
+ToXDPDevice::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+{
+    ToXDPDevice *td = static_cast<ToXDPDevice *>(e);
+    switch ((intptr_t) thunk) {
+    case h_reset_count:
+        td->_count = 0;
+        td->_dropped = 0;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void
+ToXDPDevice::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("dropped", read_handler, h_dropped);
+    add_write_handler("reset_counts", write_handler, h_reset_count, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel linux XDPDevice)
+EXPORT_ELEMENT(ToXDPDevice)
+ELEMENT_MT_SAFE(ToXDPDevice)
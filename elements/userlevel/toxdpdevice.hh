@@ -0,0 +1,91 @@
+#ifndef CLICK_TOXDPDEVICE_HH
+#define CLICK_TOXDPDEVICE_HH
+#include <click/batchelement.hh>
+#include "xdpdevice.hh"
+CLICK_DECLS
+
+/*
+=title ToXDPDevice
+
+=c
+
+ToXDPDevice(DEVNAME [, QUEUE, I<keywords> FRAMES, FRAME_SIZE, ZEROCOPY, etc.])
+
+=s netdevices
+
+sends packets to a network device using an AF_XDP socket (user-level)
+
+=d
+
+Sends packets to queue QUEUE of the network device named DEVNAME through an
+AF_XDP socket. Each batch of packets is queued in the TX ring and the kernel
+is kicked at most once per batch.
+
+Packets received by a FromXDPDevice bound to the same DEVNAME and QUEUE
+share the socket UMEM, and are sent without any copy if they are not shared.
+Other packets are copied into a free UMEM frame. Packets are dropped if the
+TX ring is full or if no frame is available.
+
+Keyword arguments FRAMES, FRAME_SIZE, RING_SIZE, ZEROCOPY, NEED_WAKEUP and
+HUGEPAGES are the same as for FromXDPDevice, and are ignored if the socket
+is already opened by a FromXDPDevice.
+
+This element is push only.
+
+=e
+
+  FromXDPDevice(veth0) -> EtherMirror -> ToXDPDevice(veth0);
+
+=h count read-only
+
+Returns the number of packets sent.
+
+=h dropped read-only
+
+Returns the number of packets dropped.
+
+=h reset_counts write-only
+
+Resets "count" and "dropped" to zero.
+
+=a FromXDPDevice, XDPLoader, ToDevice.u */
+
+class ToXDPDevice : public BatchElement { public:
+
+    ToXDPDevice() CLICK_COLD;
+    ~ToXDPDevice() CLICK_COLD;
+
+    const char *class_name() const override	{ return "ToXDPDevice"; }
+    const char *port_count() const override	{ return PORTS_1_0; }
+    const char *processing() const override	{ return PUSH; }
+
+    int configure_phase() const override	{ return CONFIGURE_PHASE_PRIVILEGED; }
+    int configure(Vector<String> &, ErrorHandler *) override CLICK_COLD;
+    int initialize(ErrorHandler *) override CLICK_COLD;
+    void cleanup(CleanupStage) override CLICK_COLD;
+    void add_handlers() override CLICK_COLD;
+
+    void push(int, Packet *) override;
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *) override;
+#endif
+
+  private:
+
+    XDPDevice *_dev;
+    XDPDevice::Config _config;
+
+    String _ifname;
+    int _queue;
+
+    atomic_uint64_t _count;
+    atomic_uint64_t _dropped;
+
+    enum { h_count, h_dropped, h_reset_count };
+    static String read_handler(Element *, void *) CLICK_COLD;
+    static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
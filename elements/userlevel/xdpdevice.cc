@@ -0,0 +1,452 @@
+// -*- c-basic-offset: 4; related-file-name: "xdpdevice.hh" -*-
+/*
+ * xdpdevice.{cc,hh} -- AF_XDP socket and UMEM shared by FromXDPDevice and
+ * ToXDPDevice
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/packetbatch.hh>
+#include "xdpdevice.hh"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <unistd.h>
+extern "C" {
+#include <linux/bpf.h>
+}
+
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+#ifndef MAP_HUGETLB
+# define MAP_HUGETLB 0x40000
+#endif
+
+CLICK_DECLS
+
+HashTable<String, XDPDevice *> XDPDevice::_devs;
+
+XDPDevice::XDPDevice(const String &ifname, int queue, const Config &config)
+    : _ifname(ifname), _queue(queue), _config(config), _fd(-1), _refcount(1),
+      _zerocopy(false), _umem(0), _umem_size(0), _umem_huge(false),
+      _held(0), _orphan(false), _tx_outstanding(0)
+{
+    memset(&_rx, 0, sizeof(XDPRing));
+    memset(&_tx, 0, sizeof(XDPRing));
+    memset(&_fq, 0, sizeof(XDPRing));
+    memset(&_cq, 0, sizeof(XDPRing));
+}
+
+XDPDevice::~XDPDevice()
+{
+    close_socket();
+    if (_umem)
+        munmap(_umem, _umem_size);
+}
+
+void
+XDPDevice::close_socket()
+{
+    unmap_ring(_rx);
+    unmap_ring(_tx);
+    unmap_ring(_fq);
+    unmap_ring(_cq);
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+}
+
+/**
+ * Return the socket bound to queue @a queue of device @a ifname, creating it
+ * if needed. The socket is reference counted, call release() when done.
+ */
+XDPDevice *
+XDPDevice::open(const String &ifname, int queue, const Config &config, ErrorHandler *errh)
+{
+    String key = ifname + ":" + String(queue);
+    XDPDevice *&dev = _devs[key];
+    if (dev) {
+        if (dev->_config.frame_size != config.frame_size
+            || dev->_config.frames != config.frames)
+            errh->warning("%s queue %d: reusing existing UMEM of %d frames of %d bytes",
+                          ifname.c_str(), queue, dev->_config.frames, dev->_config.frame_size);
+        dev->_refcount++;
+        return dev;
+    }
+
+    dev = new XDPDevice(ifname, queue, config);
+    if (dev->initialize(errh) < 0) {
+        delete dev;
+        _devs.erase(key);
+        return 0;
+    }
+    return dev;
+}
+
+/**
+ * Drop a reference to the socket. The last one closes it, but the UMEM stays
+ * mapped until the packets still pointing into it are freed: the last
+ * buffer_destructor() call then deletes the device.
+ */
+void
+XDPDevice::release()
+{
+    if (--_refcount == 0) {
+        _devs.erase(_ifname + ":" + String(_queue));
+        close_socket();
+        _frames_lock.acquire();
+        _orphan = _held != 0;
+        bool orphan = _orphan;
+        _frames_lock.release();
+        if (!orphan)
+            delete this;
+    }
+}
+
+int
+XDPDevice::map_ring(XDPRing &ring, uint32_t size, uint64_t off,
+                    const struct xdp_ring_offset &o, bool desc_ring,
+                    ErrorHandler *errh)
+{
+    ring.map_size = o.desc + size * (desc_ring ? sizeof(struct xdp_desc) : sizeof(uint64_t));
+    ring.map = mmap(0, ring.map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, off);
+    if (ring.map == MAP_FAILED) {
+        ring.map = 0;
+        return errh->error("%s: could not map ring: %s", _ifname.c_str(), strerror(errno));
+    }
+    unsigned char *base = (unsigned char *) ring.map;
+    ring.mask = size - 1;
+    ring.size = size;
+    ring.producer = (uint32_t *) (base + o.producer);
+    ring.consumer = (uint32_t *) (base + o.consumer);
+    ring.flags = (uint32_t *) (base + o.flags);
+    ring.ring = base + o.desc;
+    ring.cached_prod = *ring.producer;
+    ring.cached_cons = *ring.consumer;
+    return 0;
+}
+
+void
+XDPDevice::unmap_ring(XDPRing &ring)
+{
+    if (ring.map)
+        munmap(ring.map, ring.map_size);
+    ring.map = 0;
+}
+
+int
+XDPDevice::initialize(ErrorHandler *errh)
+{
+    if (_config.frame_size < 2048 || (_config.frame_size & (_config.frame_size - 1)))
+        return errh->error("frame size must be a power of 2, at least 2048");
+    if (_config.ring_size & (_config.ring_size - 1))
+        return errh->error("ring size must be a power of 2");
+    if (_config.frames < 2 * _config.ring_size)
+        return errh->error("at least %d frames are needed for rings of %d entries",
+                           2 * _config.ring_size, _config.ring_size);
+
+    int ifindex = if_nametoindex(_ifname.c_str());
+    if (!ifindex)
+        return errh->error("unknown interface %s", _ifname.c_str());
+
+    _fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (_fd < 0)
+        return errh->error("%s: AF_XDP socket: %s", _ifname.c_str(), strerror(errno));
+
+    // Allocate the UMEM, on hugepages if possible
+    _umem_size = (size_t) _config.frames * _config.frame_size;
+    void *umem = MAP_FAILED;
+    if (_config.hugepages) {
+        umem = mmap(0, _umem_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (umem == MAP_FAILED)
+            errh->warning("%s: could not allocate UMEM on hugepages (%s), using normal pages",
+                          _ifname.c_str(), strerror(errno));
+        else
+            _umem_huge = true;
+    }
+    if (umem == MAP_FAILED)
+        umem = mmap(0, _umem_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (umem == MAP_FAILED)
+        return errh->error("%s: could not allocate UMEM: %s", _ifname.c_str(), strerror(errno));
+    _umem = (unsigned char *) umem;
+
+    struct xdp_umem_reg mr;
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (uintptr_t) _umem;
+    mr.len = _umem_size;
+    mr.chunk_size = _config.frame_size;
+    mr.headroom = _config.headroom;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)))
+        return errh->error("%s: XDP_UMEM_REG: %s", _ifname.c_str(), strerror(errno));
+
+    uint32_t size = _config.ring_size;
+    if (setsockopt(_fd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size))
+        || setsockopt(_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size))
+        || setsockopt(_fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size))
+        || setsockopt(_fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)))
+        return errh->error("%s: could not set ring sizes: %s", _ifname.c_str(), strerror(errno));
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+        return errh->error("%s: XDP_MMAP_OFFSETS: %s", _ifname.c_str(), strerror(errno));
+
+    if (map_ring(_fq, size, XDP_UMEM_PGOFF_FILL_RING, off.fr, false, errh) < 0
+        || map_ring(_cq, size, XDP_UMEM_PGOFF_COMPLETION_RING, off.cr, false, errh) < 0
+        || map_ring(_rx, size, XDP_PGOFF_RX_RING, off.rx, true, errh) < 0
+        || map_ring(_tx, size, XDP_PGOFF_TX_RING, off.tx, true, errh) < 0)
+        return -1;
+    // Producer rings see the whole ring as free
+    _fq.cached_cons += size;
+    _tx.cached_cons += size;
+
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = _queue;
+    if (_config.need_wakeup)
+        sxdp.sxdp_flags |= XDP_USE_NEED_WAKEUP;
+    if (_config.zerocopy == 1)
+        sxdp.sxdp_flags |= XDP_ZEROCOPY;
+    else if (_config.zerocopy == 0)
+        sxdp.sxdp_flags |= XDP_COPY;
+    if (bind(_fd, (struct sockaddr *) &sxdp, sizeof(sxdp)))
+        return errh->error("%s: could not bind AF_XDP socket to queue %d: %s",
+                           _ifname.c_str(), _queue, strerror(errno));
+
+#ifdef XDP_OPTIONS
+    struct xdp_options opts;
+    optlen = sizeof(opts);
+    if (getsockopt(_fd, SOL_XDP, XDP_OPTIONS, &opts, &optlen) == 0)
+        _zerocopy = opts.flags & XDP_OPTIONS_ZEROCOPY;
+#endif
+
+    _free_frames.reserve(_config.frames);
+    for (uint32_t i = 0; i < _config.frames; i++)
+        _free_frames.push_back((uint64_t) (_config.frames - i - 1) * _config.frame_size);
+    fill();
+
+    return 0;
+}
+
+/**
+ * Register the socket in an XSKMAP, so the XDP program can redirect packets
+ * received on our queue to us. The map is indexed by queue number.
+ */
+int
+XDPDevice::register_xsk_map(int map_fd, ErrorHandler *errh)
+{
+    union bpf_attr attr;
+    uint32_t key = _queue;
+    uint32_t value = _fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd;
+    attr.key = (uintptr_t) &key;
+    attr.value = (uintptr_t) &value;
+    attr.flags = BPF_ANY;
+    if (syscall(__NR_bpf, BPF_MAP_UPDATE_ELEM, &attr, sizeof(attr)) < 0)
+        return errh->error("%s: could not insert socket in XSK map: %s",
+                           _ifname.c_str(), strerror(errno));
+    return 0;
+}
+
+int
+XDPDevice::register_xsk_map(const String &pinned_path, ErrorHandler *errh)
+{
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.pathname = (uintptr_t) pinned_path.c_str();
+    int map_fd = syscall(__NR_bpf, BPF_OBJ_GET, &attr, sizeof(attr));
+    if (map_fd < 0)
+        return errh->error("could not open pinned XSK map %s: %s",
+                           pinned_path.c_str(), strerror(errno));
+    int r = register_xsk_map(map_fd, errh);
+    close(map_fd);
+    return r;
+}
+
+void
+XDPDevice::buffer_destructor(unsigned char *buf, size_t, void *arg)
+{
+    XDPDevice *dev = static_cast<XDPDevice *>(arg);
+    dev->_frames_lock.acquire();
+    dev->free_frame(buf - dev->_umem);
+    bool last = --dev->_held == 0 && dev->_orphan;
+    dev->_frames_lock.release();
+    if (last)
+        delete dev;
+}
+
+unsigned
+XDPDevice::fill()
+{
+    // TX may be idle: reclaim its completed frames here as well so they
+    // can be used for reception
+    if (_tx_outstanding && _tx_lock.attempt()) {
+        tx_complete();
+        _tx_lock.release();
+    }
+
+    uint32_t idx;
+    _frames_lock.acquire();
+    uint32_t n = _fq.prod_reserve(_free_frames.size(), idx);
+    for (uint32_t i = 0; i < n; i++)
+        *_fq.addr(idx + i) = alloc_frame();
+    _frames_lock.release();
+    if (n)
+        _fq.prod_submit(n);
+    return n;
+}
+
+PacketBatch *
+XDPDevice::rx_burst(unsigned max)
+{
+    uint32_t idx;
+    unsigned n = _rx.cons_peek(max, idx);
+    if (n == 0) {
+        if (rx_needs_wakeup())
+            recvfrom(_fd, 0, 0, MSG_DONTWAIT, 0, 0);
+        fill();
+        return 0;
+    }
+
+    const uint64_t frame_mask = ~((uint64_t) _config.frame_size - 1);
+    // Count the frames given to packets first, as they may be freed by
+    // another thread as soon as they are pushed
+    _frames_lock.acquire();
+    _held += n;
+    _frames_lock.release();
+    BATCH_CREATE_INIT(batch);
+    for (unsigned i = 0; i < n; i++) {
+        const struct xdp_desc *desc = _rx.desc(idx + i);
+        unsigned char *data = _umem + desc->addr;
+        unsigned headroom = desc->addr - (desc->addr & frame_mask);
+        __builtin_prefetch(data);
+        WritablePacket *p = Packet::make(data, desc->len, buffer_destructor, this,
+                                         headroom, _config.frame_size - headroom - desc->len);
+        if (unlikely(!p)) {
+            buffer_destructor(data - headroom, 0, this);
+            continue;
+        }
+        p->set_mac_header(p->data());
+        BATCH_CREATE_APPEND(batch, p);
+    }
+    _rx.cons_release(n);
+    fill();
+    BATCH_CREATE_FINISH(batch);
+    return batch;
+}
+
+unsigned
+XDPDevice::tx_complete()
+{
+    uint32_t idx;
+    unsigned n = _cq.cons_peek(_config.ring_size, idx);
+    if (n == 0)
+        return 0;
+    _frames_lock.acquire();
+    for (unsigned i = 0; i < n; i++)
+        free_frame(*_cq.addr(idx + i));
+    _frames_lock.release();
+    _cq.cons_release(n);
+    _tx_outstanding -= n;
+    return n;
+}
+
+void
+XDPDevice::tx_kick()
+{
+    if (_config.need_wakeup && !_tx.needs_wakeup())
+        return;
+    if (sendto(_fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0
+        && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+        click_chatter("%s: AF_XDP sendto: %s", _ifname.c_str(), strerror(errno));
+}
+
+/**
+ * Packets whose buffer is an unshared frame of this UMEM are sent without
+ * copy: the frame ownership goes to the TX ring and comes back through the
+ * completion ring. Other packets are copied in a free frame.
+ */
+unsigned
+XDPDevice::tx_burst(PacketBatch *batch)
+{
+    unsigned dropped = 0;
+    _tx_lock.acquire();
+    tx_complete();
+
+    uint32_t idx;
+    uint32_t n = _tx.prod_reserve(batch->count(), idx);
+    uint32_t sent = 0;
+    FOR_EACH_PACKET_SAFE(batch, p) {
+        if (unlikely(sent == n || p->length() > _config.frame_size)) {
+            dropped++;
+            p->kill();
+            continue;
+        }
+        struct xdp_desc *desc = _tx.desc(idx + sent);
+        if (is_umem_packet(p) && !p->shared()) {
+            desc->addr = p->data() - _umem;
+            // The frame now belongs to the TX ring
+            static_cast<WritablePacket *>(p)->set_buffer_destructor(Packet::empty_destructor);
+            _frames_lock.acquire();
+            --_held;
+            _frames_lock.release();
+        } else {
+            _frames_lock.acquire();
+            uint64_t addr = alloc_frame();
+            _frames_lock.release();
+            if (unlikely(addr == (uint64_t) -1)) {
+                dropped++;
+                p->kill();
+                continue;
+            }
+            memcpy(_umem + addr, p->data(), p->length());
+            desc->addr = addr;
+        }
+        desc->len = p->length();
+        desc->options = 0;
+        sent++;
+        p->kill();
+    }
+    // Give back reserved slots we could not use
+    _tx.cached_prod -= n - sent;
+    if (sent) {
+        _tx.prod_submit(sent);
+        _tx_outstanding += sent;
+    }
+    if (_tx_outstanding)
+        tx_kick();
+    _tx_lock.release();
+    return dropped;
+}
+
+bool
+XDPDevice::statistics(struct xdp_statistics &stats) const
+{
+    socklen_t optlen = sizeof(stats);
+    memset(&stats, 0, sizeof(stats));
+    return getsockopt(_fd, SOL_XDP, XDP_STATISTICS, &stats, &optlen) == 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel linux !dpdk-packet)
+ELEMENT_PROVIDES(XDPDevice)
@@ -0,0 +1,247 @@
+// -*- c-basic-offset: 4; related-file-name: "xdpdevice.cc" -*-
+#ifndef CLICK_XDPDEVICE_HH
+#define CLICK_XDPDEVICE_HH
+#include <click/packetbatch.hh>
+#include <click/string.hh>
+#include <click/vector.hh>
+#include <click/hashtable.hh>
+#include <click/sync.hh>
+#include <click/error.hh>
+extern "C" {
+#include <linux/if_xdp.h>
+}
+
+CLICK_DECLS
+
+/**
+ * Producer or consumer view of one of the four AF_XDP rings (RX, TX, FILL,
+ * COMPLETION), as mapped in the process address space. The logic mirrors the
+ * one of libbpf's xsk_ring_prod/xsk_ring_cons, so we do not depend on libbpf
+ * (nor libxdp) to use AF_XDP sockets.
+ */
+struct XDPRing {
+    uint32_t cached_prod;
+    uint32_t cached_cons;
+    uint32_t mask;
+    uint32_t size;
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *ring;
+    void *map;
+    size_t map_size;
+
+    inline uint64_t *addr(uint32_t idx) const {
+        return &((uint64_t *) ring)[idx & mask];
+    }
+
+    inline struct xdp_desc *desc(uint32_t idx) const {
+        return &((struct xdp_desc *) ring)[idx & mask];
+    }
+
+    /** @brief Number of free entries for a producer ring */
+    inline uint32_t prod_nb_free(uint32_t n) {
+        uint32_t free_entries = cached_cons - cached_prod;
+        if (free_entries >= n)
+            return free_entries;
+        cached_cons = __atomic_load_n(consumer, __ATOMIC_ACQUIRE) + size;
+        return cached_cons - cached_prod;
+    }
+
+    inline uint32_t prod_reserve(uint32_t n, uint32_t &idx) {
+        n = prod_nb_free(n) < n ? prod_nb_free(n) : n;
+        idx = cached_prod;
+        cached_prod += n;
+        return n;
+    }
+
+    inline void prod_submit(uint32_t n) {
+        __atomic_store_n(producer, *producer + n, __ATOMIC_RELEASE);
+    }
+
+    /** @brief Number of available entries for a consumer ring */
+    inline uint32_t cons_nb_avail(uint32_t n) {
+        uint32_t entries = cached_prod - cached_cons;
+        if (entries == 0) {
+            cached_prod = __atomic_load_n(producer, __ATOMIC_ACQUIRE);
+            entries = cached_prod - cached_cons;
+        }
+        return entries > n ? n : entries;
+    }
+
+    inline uint32_t cons_peek(uint32_t n, uint32_t &idx) {
+        n = cons_nb_avail(n);
+        idx = cached_cons;
+        cached_cons += n;
+        return n;
+    }
+
+    inline void cons_release(uint32_t n) {
+        __atomic_store_n(consumer, *consumer + n, __ATOMIC_RELEASE);
+    }
+
+    inline bool needs_wakeup() const {
+        return *flags & XDP_RING_NEED_WAKEUP;
+    }
+};
+
+/**
+ * An AF_XDP socket bound to one queue of a device, with its UMEM.
+ *
+ * Sockets are shared per (device, queue) pair so a FromXDPDevice and a
+ * ToXDPDevice using the same queue share the same UMEM, allowing packets to
+ * be forwarded without any copy. Received frames are handed to Click as
+ * Packets whose buffer lives directly in the UMEM, freed through
+ * XDPDevice::buffer_destructor which puts the frame back in the free list,
+ * from which the FILL ring is refilled in bulk. The UMEM is only unmapped
+ * once all those packets are freed, even if the socket was closed before.
+ */
+class XDPDevice {
+  public:
+
+    struct Config {
+        Config() : frames(4096), frame_size(DEFAULT_FRAME_SIZE),
+                   ring_size(2048), headroom(0), zerocopy(-1),
+                   need_wakeup(true), hugepages(false) {
+        }
+        uint32_t frames;
+        uint32_t frame_size;
+        uint32_t ring_size;
+        uint32_t headroom;
+        int zerocopy; //-1 : let the kernel decide, 0 : force copy, 1: force zero-copy
+        bool need_wakeup;
+        bool hugepages;
+    };
+
+    enum { DEFAULT_FRAME_SIZE = 4096 };
+
+    static XDPDevice *open(const String &ifname, int queue, const Config &config, ErrorHandler *errh) CLICK_COLD;
+    void release() CLICK_COLD;
+
+    int register_xsk_map(int map_fd, ErrorHandler *errh) CLICK_COLD;
+    int register_xsk_map(const String &pinned_path, ErrorHandler *errh) CLICK_COLD;
+
+    inline int fd() const {
+        return _fd;
+    }
+
+    inline const String &ifname() const {
+        return _ifname;
+    }
+
+    inline int queue() const {
+        return _queue;
+    }
+
+    inline bool zerocopy() const {
+        return _zerocopy;
+    }
+
+    inline unsigned char *umem() const {
+        return _umem;
+    }
+
+    inline uint32_t frame_size() const {
+        return _config.frame_size;
+    }
+
+    /** @brief Receive up to @a max packets
+     *  @return a PacketBatch of packets pointing into the UMEM, or null */
+    PacketBatch *rx_burst(unsigned max);
+
+    /** @brief Queue the packets of @a batch in the TX ring
+     *  @return the number of packets that could not be sent. Those are killed. */
+    unsigned tx_burst(PacketBatch *batch);
+
+    /** @brief Reclaim frames whose transmission completed
+     *
+     * Called with the TX lock held by tx_burst(), and by fill() when that
+     * lock is free, so the completion ring is drained while TX is idle. */
+    unsigned tx_complete();
+
+    /** @brief Kick the kernel to process the TX ring if needed */
+    void tx_kick();
+
+    /** @brief Refill the FILL ring with frames of the free list */
+    unsigned fill();
+
+    inline bool rx_needs_wakeup() const {
+        return _config.need_wakeup && _fq.needs_wakeup();
+    }
+
+    /** @brief Is @a p a packet whose buffer is a frame of this UMEM? */
+    inline bool is_umem_packet(const Packet *p) const {
+        return p->buffer_destructor() == buffer_destructor
+            && p->destructor_argument() == this;
+    }
+
+    bool statistics(struct xdp_statistics &stats) const;
+
+    uint32_t free_frames() const {
+        return _free_frames.size();
+    }
+
+    static void buffer_destructor(unsigned char *buf, size_t sz, void *arg);
+
+  private:
+
+    XDPDevice(const String &ifname, int queue, const Config &config);
+    ~XDPDevice();
+
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void close_socket() CLICK_COLD;
+    int map_ring(XDPRing &ring, uint32_t size, uint64_t off,
+                 const struct xdp_ring_offset &o, bool desc_ring,
+                 ErrorHandler *errh) CLICK_COLD;
+    void unmap_ring(XDPRing &ring) CLICK_COLD;
+
+    inline uint64_t alloc_frame();
+    inline void free_frame(uint64_t addr);
+
+    String _ifname;
+    int _queue;
+    Config _config;
+    int _fd;
+    int _refcount;
+    bool _zerocopy;
+
+    unsigned char *_umem;
+    size_t _umem_size;
+    bool _umem_huge;
+
+    XDPRing _rx;
+    XDPRing _tx;
+    XDPRing _fq;
+    XDPRing _cq;
+
+    // Free frames, may be refilled from any thread through the destructor
+    Spinlock _frames_lock;
+    Vector<uint64_t> _free_frames;
+    uint32_t _held;     // frames owned by packets
+    bool _orphan;       // released, deleted when _held drops to 0
+
+    // Multiple threads may push to the same TX ring
+    Spinlock _tx_lock;
+    uint32_t _tx_outstanding;
+
+    static HashTable<String, XDPDevice *> _devs;
+};
+
+inline uint64_t
+XDPDevice::alloc_frame()
+{
+    if (_free_frames.size() == 0)
+        return (uint64_t) -1;
+    uint64_t addr = _free_frames.back();
+    _free_frames.pop_back();
+    return addr;
+}
+
+inline void
+XDPDevice::free_frame(uint64_t addr)
+{
+    _free_frames.push_back(addr & ~((uint64_t) _config.frame_size - 1));
+}
+
+CLICK_ENDDECLS
+#endif
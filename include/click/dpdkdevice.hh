@@ -91,7 +91,7 @@ public:
             rx_offload(0), tx_offload(0),	
 	    flow_isolate(false),
             vlan_filter(false), vlan_strip(false), vlan_extend(false), vf_vlan(),
-            lro(false), jumbo(false)
+            lro(false), jumbo(false), rx_intr(false)
         {
             rx_queues.reserve(128);
             tx_queues.reserve(128);
@@ -125,6 +125,7 @@ public:
             click_chatter("      Virtual Function VLAN: %d", vf_vlan.size());
             click_chatter("Large Receive Offload (LRO): %s", lro ? "true":"false");
             click_chatter("    Rx Jumbo Frames Offload: %s", jumbo ? "true":"false");
+            click_chatter("              Rx Interrupts: %s", rx_intr ? "true":"false");
         }
 
         uint16_t vendor_id;
@@ -152,6 +153,7 @@ public:
         Vector<int> vf_vlan;
         bool lro;
         bool jumbo;
+        bool rx_intr;
     };
 
 #if HAVE_FLOW_API
@@ -180,6 +182,7 @@ public:
     void set_init_fc_mode(FlowControlMode fc);
     void set_rx_offload(uint64_t offload);
     void set_tx_offload(uint64_t offload);
+    void set_init_rx_intr(bool rx_intr);
 
 #if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
     void set_init_flow_isolate(const bool &flow_isolate);
@@ -0,0 +1,405 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWCUCKOO_HH
+#define CLICK_FLOWCUCKOO_HH
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/algorithm.hh>
+#include <click/integers.hh>
+#include <click/sync.hh>
+#include <click/machine.hh>
+#include <click/ipflowid.hh>
+#include <click/flow/flowkeybatch.hh>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+CLICK_DECLS
+
+/**
+ * Bucketized cuckoo hash table mapping flow keys to positions, without
+ * DPDK.
+ *
+ * Its API mirrors the one of DPDK's rte_hash, so it can be used as a drop-in
+ * backend by the FlowIPManager family: every key gets a position between 0
+ * and capacity() - 1, used as an index in an array of FCBs, and the caller
+ * gives the signature of each key (see flow_hash_crc()) so a packet is
+ * hashed only once.
+ *
+ * Each bucket is one cache line, holding 8 entries made of a 16-bit tag
+ * (the high bits of the signature) and a position. Buckets are searched by
+ * comparing the 8 tags at once with SSE2, so keys are only read on tag
+ * match. A key lives in one of two buckets: its primary bucket given by the
+ * low bits of the signature, and its alternative bucket, the primary bucket
+ * XOR'ed with its tag. When both are full, entries are moved to their
+ * alternative bucket to make room (cuckoo displacement).
+ *
+ * In per-thread mode, the table must only be used by a single thread. In MP
+ * mode, writers are serialized by a spinlock and readers do not take any
+ * lock: an entry is copied to its new bucket before it is removed from its
+ * old one, and a change counter lets readers retry a lookup that missed
+ * while entries were moving. As with rte_hash, a reader racing with the
+ * removal of a key may still get its position.
+ *
+ * sweep() visits a few buckets per call and removes the entries for which a
+ * predicate returns true, so idle flows can be expired without any timer
+ * structure.
+ */
+template <typename K = IPFlow5ID>
+class FlowCuckooTable { public:
+
+    enum { ways = 8, max_depth = 8 };
+
+    /** @brief Construct a table that can hold @a capacity keys.
+     * @param mt if true, the table can be modified by multiple threads */
+    FlowCuckooTable(uint32_t capacity, bool mt = false);
+    ~FlowCuckooTable();
+
+    /** @brief Return true if the table could be allocated */
+    bool initialized() const {
+        return _buckets && _keys && _free;
+    }
+
+    uint32_t capacity() const {
+        return _capacity;
+    }
+
+    uint32_t buckets() const {
+        return _mask + 1;
+    }
+
+    /** @brief Number of keys in the table */
+    uint32_t count() const {
+        return _capacity - _nfree;
+    }
+
+    /** @brief Return the key at position @a pos */
+    const K &key(int pos) const {
+        return _keys[pos];
+    }
+
+    /** @brief Return the position of @a key with signature @a sig, or -1 */
+    inline int lookup(const K &key, uint32_t sig) const;
+
+    /** @brief Look up the @a n keys of @a k and set their positions, or -1
+     *
+     * The buckets of all keys are prefetched before any comparison. */
+    inline void lookup_bulk(FlowKeyBatch &k) const;
+
+    /** @brief Insert @a key with signature @a sig
+     * @return the position of @a key, which may already have been in the
+     * table, or -1 if the table is full */
+    int add(const K &key, uint32_t sig);
+
+    /** @brief Remove @a key. Return its old position, or -1 if not found */
+    int del(const K &key, uint32_t sig);
+
+    /** @brief Visit up to @a nbuckets buckets from where the last call
+     * stopped, and remove the entries for which @a expired(pos) is true.
+     * @return the number of removed entries */
+    template <typename F>
+    int sweep(uint32_t nbuckets, F expired);
+
+  private:
+
+    struct Bucket {
+        uint16_t tags[ways];
+        uint32_t pos[ways]; //Position + 1, 0 if empty
+    } CLICK_CACHE_ALIGN;
+
+    Bucket *_buckets;
+    uint32_t _mask;
+    K *_keys;
+    uint32_t *_free;
+    uint32_t _nfree;
+    uint32_t _capacity;
+    uint32_t _sweep_next;
+    unsigned _victim;
+    bool _mt;
+    volatile uint32_t _changes;
+    SimpleSpinlock _lock;
+
+    static inline uint16_t tag_of(uint32_t sig) {
+        uint16_t tag = sig >> 16;
+        return tag ? tag : 1;
+    }
+
+    inline uint32_t alt_bucket(uint32_t b, uint16_t tag) const {
+        return (b ^ tag) & _mask;
+    }
+
+    /** @brief Bitmask of the ways of @a b whose tag is @a tag */
+    static inline unsigned match(const Bucket &b, uint16_t tag) {
+#if defined(__SSE2__)
+        __m128i tags = _mm_load_si128((const __m128i *) b.tags);
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi16(tags, _mm_set1_epi16(tag)));
+        // Keep one bit per 16-bit lane
+        m &= 0x5555;
+        m = (m | (m >> 1)) & 0x3333;
+        m = (m | (m >> 2)) & 0x0f0f;
+        m = (m | (m >> 4)) & 0x00ff;
+        return m;
+#else
+        unsigned m = 0;
+        for (int i = 0; i < ways; i++)
+            m |= (b.tags[i] == tag) << i;
+        return m;
+#endif
+    }
+
+    inline int search(const Bucket &b, uint16_t tag, const K &key) const {
+        for (unsigned m = match(b, tag); m; m &= m - 1) {
+            int i = ffs_lsb(m) - 1;
+            uint32_t pos = b.pos[i];
+            if (pos && _keys[pos - 1] == key)
+                return pos - 1;
+        }
+        return -1;
+    }
+
+    inline int find_empty(const Bucket &b) const {
+        unsigned m = match(b, 0);
+        return m ? ffs_lsb(m) - 1 : -1;
+    }
+
+    inline void set(Bucket &b, int i, uint16_t tag, uint32_t pos) {
+        b.pos[i] = pos;
+        click_write_fence();
+        b.tags[i] = tag;
+    }
+
+    inline void clear(Bucket &b, int i) {
+        b.tags[i] = 0;
+        click_write_fence();
+        b.pos[i] = 0;
+    }
+
+    int make_room(uint32_t b, int depth);
+    int remove(uint32_t b, int i);
+
+    FlowCuckooTable(const FlowCuckooTable<K> &);
+    FlowCuckooTable<K> &operator=(const FlowCuckooTable<K> &);
+};
+
+template <typename K>
+FlowCuckooTable<K>::FlowCuckooTable(uint32_t capacity, bool mt)
+    : _capacity(capacity), _sweep_next(0), _victim(0), _mt(mt), _changes(0)
+{
+    // Keep the load under 90%, above which displacements often fail
+    uint32_t nb = next_pow2((capacity + ways - 1) / ways);
+    if (nb < 2)
+        nb = 2;
+    if ((uint64_t) capacity * 10 > (uint64_t) nb * ways * 9)
+        nb <<= 1;
+    _mask = nb - 1;
+    _buckets = (Bucket *) CLICK_ALIGNED_ALLOC(sizeof(Bucket) * nb);
+    _keys = (K *) CLICK_LALLOC(sizeof(K) * capacity);
+    _free = (uint32_t *) CLICK_LALLOC(sizeof(uint32_t) * capacity);
+    _nfree = 0;
+    if (!initialized())
+        return;
+    memset(_buckets, 0, sizeof(Bucket) * nb);
+    // Hand out low positions first
+    for (uint32_t i = 0; i < capacity; i++)
+        _free[_nfree++] = capacity - 1 - i;
+}
+
+template <typename K>
+FlowCuckooTable<K>::~FlowCuckooTable()
+{
+    if (_buckets)
+        CLICK_ALIGNED_FREE(_buckets, sizeof(Bucket) * (_mask + 1));
+    if (_keys)
+        CLICK_LFREE(_keys, sizeof(K) * _capacity);
+    if (_free)
+        CLICK_LFREE(_free, sizeof(uint32_t) * _capacity);
+}
+
+template <typename K>
+inline int
+FlowCuckooTable<K>::lookup(const K &key, uint32_t sig) const
+{
+    uint16_t tag = tag_of(sig);
+    uint32_t b1 = sig & _mask;
+    uint32_t b2 = alt_bucket(b1, tag);
+    uint32_t changes;
+    int pos;
+    do {
+        changes = _changes;
+        click_read_fence();
+        pos = search(_buckets[b1], tag, key);
+        if (pos >= 0)
+            return pos;
+        pos = search(_buckets[b2], tag, key);
+        if (pos >= 0)
+            return pos;
+        click_read_fence();
+    } while (unlikely(_mt && changes != _changes));
+    return -1;
+}
+
+template <typename K>
+inline void
+FlowCuckooTable<K>::lookup_bulk(FlowKeyBatch &k) const
+{
+    for (int i = 0; i < k.count; i++) {
+        uint32_t b1 = k.hashes[i] & _mask;
+        __builtin_prefetch(&_buckets[b1]);
+        __builtin_prefetch(&_buckets[alt_bucket(b1, tag_of(k.hashes[i]))]);
+    }
+    for (int i = 0; i < k.count; i++)
+        k.positions[i] = lookup(k.keys[i], k.hashes[i]);
+}
+
+/**
+ * Free one entry of bucket @a b by moving an entry to its alternative
+ * bucket, recursively. Return the free way, or -1.
+ */
+template <typename K>
+int
+FlowCuckooTable<K>::make_room(uint32_t b, int depth)
+{
+    Bucket &bucket = _buckets[b];
+    int e = find_empty(bucket);
+    if (e >= 0)
+        return e;
+    for (int i = 0; i < ways; i++) {
+        uint32_t alt = alt_bucket(b, bucket.tags[i]);
+        int j = find_empty(_buckets[alt]);
+        if (j >= 0) {
+            set(_buckets[alt], j, bucket.tags[i], bucket.pos[i]);
+            ++_changes;
+            click_write_fence();
+            clear(bucket, i);
+            return i;
+        }
+    }
+    if (depth >= max_depth)
+        return -1;
+    int i = _victim++ % ways;
+    uint16_t tag = bucket.tags[i];
+    uint32_t alt = alt_bucket(b, tag);
+    int j = make_room(alt, depth + 1);
+    //Deeper moves may have changed this bucket, the entry's alternative
+    //bucket would then be another one
+    if (j < 0 || bucket.tags[i] != tag)
+        return -1;
+    set(_buckets[alt], j, tag, bucket.pos[i]);
+    ++_changes;
+    click_write_fence();
+    clear(bucket, i);
+    return i;
+}
+
+template <typename K>
+int
+FlowCuckooTable<K>::add(const K &key, uint32_t sig)
+{
+    uint16_t tag = tag_of(sig);
+    uint32_t b1 = sig & _mask;
+    uint32_t b2 = alt_bucket(b1, tag);
+    int ret = -1;
+
+    if (_mt)
+        _lock.acquire();
+    int pos = search(_buckets[b1], tag, key);
+    if (pos < 0)
+        pos = search(_buckets[b2], tag, key);
+    if (pos >= 0) {
+        ret = pos;
+        goto out;
+    }
+    if (_nfree == 0)
+        goto out;
+    {
+        uint32_t b = b1;
+        int i = find_empty(_buckets[b1]);
+        if (i < 0) {
+            b = b2;
+            i = find_empty(_buckets[b2]);
+        }
+        if (i < 0) {
+            b = b1;
+            i = make_room(b1, 0);
+        }
+        if (i < 0) {
+            b = b2;
+            i = make_room(b2, 0);
+        }
+        if (i < 0)
+            goto out;
+        ret = _free[--_nfree];
+        _keys[ret] = key;
+        set(_buckets[b], i, tag, ret + 1);
+    }
+  out:
+    if (_mt)
+        _lock.release();
+    return ret;
+}
+
+template <typename K>
+int
+FlowCuckooTable<K>::remove(uint32_t b, int i)
+{
+    int pos = _buckets[b].pos[i] - 1;
+    clear(_buckets[b], i);
+    _free[_nfree++] = pos;
+    return pos;
+}
+
+template <typename K>
+int
+FlowCuckooTable<K>::del(const K &key, uint32_t sig)
+{
+    uint16_t tag = tag_of(sig);
+    uint32_t b[2];
+    b[0] = sig & _mask;
+    b[1] = alt_bucket(b[0], tag);
+    int ret = -1;
+
+    if (_mt)
+        _lock.acquire();
+    for (int k = 0; k < 2 && ret < 0; k++) {
+        Bucket &bucket = _buckets[b[k]];
+        for (unsigned m = match(bucket, tag); m; m &= m - 1) {
+            int i = ffs_lsb(m) - 1;
+            if (bucket.pos[i] && _keys[bucket.pos[i] - 1] == key) {
+                ret = remove(b[k], i);
+                break;
+            }
+        }
+    }
+    if (_mt)
+        _lock.release();
+    return ret;
+}
+
+template <typename K> template <typename F>
+int
+FlowCuckooTable<K>::sweep(uint32_t nbuckets, F expired)
+{
+    int n = 0;
+    if (nbuckets > _mask + 1)
+        nbuckets = _mask + 1;
+    for (; nbuckets > 0; --nbuckets) {
+        uint32_t b = _sweep_next;
+        _sweep_next = (_sweep_next + 1) & _mask;
+        Bucket &bucket = _buckets[b];
+        for (int i = 0; i < ways; i++) {
+            if (!bucket.tags[i] || !expired(bucket.pos[i] - 1))
+                continue;
+            if (_mt)
+                _lock.acquire();
+            //Check the entry did not move meanwhile
+            if (bucket.tags[i] && expired(bucket.pos[i] - 1)) {
+                remove(b, i);
+                ++n;
+            }
+            if (_mt)
+                _lock.release();
+        }
+    }
+    return n;
+}
+
+CLICK_ENDDECLS
+#endif
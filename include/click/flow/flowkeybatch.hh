@@ -0,0 +1,115 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLOWKEYBATCH_HH
+#define CLICK_FLOWKEYBATCH_HH
+#include <click/config.h>
+#include <click/ipflowid.hh>
+#include <click/packet.hh>
+#if HAVE_DPDK
+# include <rte_hash_crc.h>
+# include <rte_version.h>
+# if RTE_VERSION >= RTE_VERSION_NUM(19,0,0,0)
+/* Flow managers can use rte_hash as their table */
+#  define HAVE_FLOW_RTE_HASH 1
+# endif
+#elif defined(__SSE4_2__)
+# include <nmmintrin.h>
+#endif
+CLICK_DECLS
+
+/** @brief Return the CRC32C of @a v, continuing from @a crc.
+ *
+ * This is the hash used by the FlowIPManager family, equal to DPDK's
+ * rte_hash_crc_4byte(), so signatures computed without DPDK match the ones
+ * of rte_hash. */
+static inline uint32_t
+flow_crc32c_4byte(uint32_t v, uint32_t crc)
+{
+#if HAVE_DPDK
+    return rte_hash_crc_4byte(v, crc);
+#elif defined(__SSE4_2__)
+    return _mm_crc32_u32(crc, v);
+#else
+    crc ^= v;
+    for (int i = 0; i < 32; i++)
+        crc = (crc >> 1) ^ (0x82F63B78U & -(crc & 1));
+    return crc;
+#endif
+}
+
+/** @brief Hash a 5-tuple like ipv4_hash_crc() does */
+static inline uint32_t
+flow_hash_crc(const IPFlow5ID &k, uint32_t init_val = 0)
+{
+    const uint32_t *p = ((const uint32_t *) &k) + 2;
+    init_val = flow_crc32c_4byte(k.proto(), init_val);
+    init_val = flow_crc32c_4byte(k.saddr().addr(), init_val);
+    init_val = flow_crc32c_4byte(k.daddr().addr(), init_val);
+    return flow_crc32c_4byte(*p, init_val);
+}
+
+/**
+ * Flow keys of up to max_size packets of a batch, with their hash.
+ *
+ * Flow managers extract the 5-tuple of a whole burst of packets first, hash
+ * them all, then search the table with a single bulk lookup. Each array is
+ * contiguous so the hash table can prefetch all the buckets before comparing
+ * any key, and the CRC of independent keys are computed interleaved to hide
+ * the latency of the crc32 instruction.
+ */
+struct FlowKeyBatch {
+    enum { max_size = 64 }; // RTE_HASH_LOOKUP_BULK_MAX
+
+    Packet *packets[max_size];
+    IPFlow5ID keys[max_size];
+    const void *key_ptrs[max_size];
+    uint32_t hashes[max_size];
+    int32_t positions[max_size];
+    int count;
+
+    FlowKeyBatch() : count(0) {
+        for (int i = 0; i < max_size; i++)
+            key_ptrs[i] = &keys[i];
+    }
+
+    /** @brief Extract the keys of the packets starting at @a p, up to
+     * max_size packets, and compute their hash.
+     * @return the first packet that was not extracted, or null */
+    inline Packet *extract(Packet *p) {
+        int n = 0;
+        for (; p && n < max_size; p = p->next(), ++n) {
+            packets[n] = p;
+            keys[n] = IPFlow5ID(p);
+        }
+        count = n;
+        hash();
+        return p;
+    }
+
+    /** @brief Compute the hash of all keys */
+    inline void hash() {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            uint32_t h0 = flow_crc32c_4byte(keys[i].proto(), 0);
+            uint32_t h1 = flow_crc32c_4byte(keys[i + 1].proto(), 0);
+            uint32_t h2 = flow_crc32c_4byte(keys[i + 2].proto(), 0);
+            uint32_t h3 = flow_crc32c_4byte(keys[i + 3].proto(), 0);
+            h0 = flow_crc32c_4byte(keys[i].saddr().addr(), h0);
+            h1 = flow_crc32c_4byte(keys[i + 1].saddr().addr(), h1);
+            h2 = flow_crc32c_4byte(keys[i + 2].saddr().addr(), h2);
+            h3 = flow_crc32c_4byte(keys[i + 3].saddr().addr(), h3);
+            h0 = flow_crc32c_4byte(keys[i].daddr().addr(), h0);
+            h1 = flow_crc32c_4byte(keys[i + 1].daddr().addr(), h1);
+            h2 = flow_crc32c_4byte(keys[i + 2].daddr().addr(), h2);
+            h3 = flow_crc32c_4byte(keys[i + 3].daddr().addr(), h3);
+            hashes[i] = flow_crc32c_4byte(((const uint32_t *) &keys[i])[2], h0);
+            hashes[i + 1] = flow_crc32c_4byte(((const uint32_t *) &keys[i + 1])[2], h1);
+            hashes[i + 2] = flow_crc32c_4byte(((const uint32_t *) &keys[i + 2])[2], h2);
+            hashes[i + 3] = flow_crc32c_4byte(((const uint32_t *) &keys[i + 3])[2], h3);
+        }
+        for (; i < count; ++i)
+            hashes[i] = flow_hash_crc(keys[i]);
+    }
+};
+
+CLICK_ENDDECLS
+#endif
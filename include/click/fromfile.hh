@@ -77,8 +77,13 @@ class FromFile { public:
 
 #ifdef ALLOW_MMAP
     enum { WANT_MMAP_UNIT = 4194304 }; // 4 MB
+    enum { WANT_MAPPING_WINDOW = 1 << 30 }; // 1 GB
     size_t _mmap_unit;
     off_t _mmap_off;
+
+    // A regular file is mapped at once; buffers are windows into it
+    struct Mapping;
+    Mapping *_mapping;
 #endif
 
     String _filename;
@@ -89,6 +94,9 @@ class FromFile { public:
 
 #ifdef ALLOW_MMAP
     int read_buffer_mmap(ErrorHandler *);
+    void map_file(off_t size);
+    void release_mapping();
+    static void mapping_destructor(unsigned char *, size_t, void *);
 #endif
     int read_buffer(ErrorHandler *);
     bool read_packet(ErrorHandler *);
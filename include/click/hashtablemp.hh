@@ -931,6 +931,431 @@ class RWHashTableMP : public HashContainerMP<K,V,rwlock<V> > {
 
 };
 
+/** @class HashContainerRCU
+  @brief Hash table with lock-free readers, MT safe.
+
+  K is the type of the key, V the type of the value. Values are copied in
+  and out of the table, so V should be small (a pointer, an integer, ...).
+
+  Unlike HashContainerMP, readers never write to a shared cache line: they
+  only announce an epoch in a per-thread slot of an rcu_reclaimer, then walk
+  the bucket list without any lock nor reference count. Items are never
+  modified once published. Replacing a value publishes a new item, and
+  erased or replaced items are retired to the reclaimer, which frees them
+  when no reader can still see them.
+
+  Writers lock the bucket they modify with a spinlock. When the table grows
+  beyond twice its bucket count, a new table twice as large is published,
+  and buckets of the old table are migrated incrementally: each writer first
+  migrates the old bucket of the key it modifies, then a few more. Readers
+  look in the old table first, then in the new one, so an item being
+  migrated is always found. The world is never stopped.
+*/
+template <typename K, typename V>
+class HashContainerRCU { public:
+
+    typedef uint32_t size_type;
+
+    enum {
+        initial_bucket_count = 63,
+        migrate_per_write = 2
+    };
+
+    /** @brief Construct an empty table with at least @a n buckets. */
+    explicit HashContainerRCU(size_type n = initial_bucket_count);
+
+    ~HashContainerRCU();
+
+    /** @brief Copy the value of @a key in @a value and return true if found. */
+    inline bool find(const K &key, V &value);
+
+    /** @brief Test if an element with key @a key exists in the table. */
+    inline bool contains(const K &key) {
+        V v;
+        return find(key, v);
+    }
+
+    /** @brief Insert @a key, or replace its value if it exists.
+     * @return true if the key was not in the table */
+    bool insert(const K &key, const V &value);
+
+    /** @brief Insert @a key if it does not exist. Otherwise, copy the
+     * existing value in @a value.
+     * @return true if the key was inserted */
+    bool find_insert(const K &key, V &value);
+
+    /** @brief Remove @a key. Return true if it was found. */
+    bool erase(const K &key);
+
+    /** @brief Remove all elements. */
+    void clear();
+
+    /** @brief Return the number of elements stored.
+     *
+     * The count is the sum of per-thread counters, and is not exact while
+     * writers are running. */
+    size_type size() const {
+        int s = 0;
+        for (unsigned i = 0; i < _size.weight(); i++)
+            s += _size.get_value(i);
+        return s < 0 ? 0 : s;
+    }
+
+    /** @brief Return true iff size() == 0. */
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /** @brief Return the number of buckets. */
+    size_type buckets() const {
+        return _table->nbuckets;
+    }
+
+    /** @brief Return true if buckets of a previous table are still being
+     * migrated. */
+    bool resizing() const {
+        return _table->old != 0;
+    }
+
+    /** @brief Free retired items that no reader can access anymore. */
+    void collect() {
+        _rcu.collect();
+    }
+
+  private:
+
+    struct Item {
+        Item(const K &k, const V &v) : key(k), value(v), next(0) {
+        }
+        K key;
+        V value;
+        Item * volatile next;
+    };
+
+    struct Bucket {
+        Bucket() : head(0), migrated(false) {
+        }
+        Item * volatile head;
+        SimpleSpinlock lock;
+        volatile bool migrated;
+    };
+
+    struct Table {
+        Table(size_type n) : nbuckets(n), old(0) {
+            buckets = (Bucket *) CLICK_LALLOC(sizeof(Bucket) * n);
+            for (size_type i = 0; i < n; i++)
+                new(&buckets[i]) Bucket();
+            migrate_next = 0;
+            migrated = 0;
+        }
+        ~Table() {
+            for (size_type i = 0; i < nbuckets; i++)
+                buckets[i].~Bucket();
+            CLICK_LFREE(buckets, sizeof(Bucket) * nbuckets);
+        }
+        inline Bucket &bucket(size_type hash) const {
+            return buckets[hash % nbuckets];
+        }
+        size_type nbuckets;
+        Bucket *buckets;
+        Table * volatile old;
+        atomic_uint32_t migrate_next;
+        atomic_uint32_t migrated;
+    };
+
+    pool_allocator_mt<Item, false, 2048> _allocator;
+    rcu_reclaimer _rcu;
+    Table * volatile _table;
+    per_thread<int> _size;
+    SimpleSpinlock _resize_lock;
+
+    static inline size_type hash(const K &key) {
+        return (size_type) hashcode(key);
+    }
+
+    static inline Item *search(Item *it, const K &key) {
+        for (; it; it = it->next)
+            if (it->key == key)
+                return it;
+        return 0;
+    }
+
+    static void destroy_item(void *obj, void *arg) {
+        static_cast<HashContainerRCU<K,V> *>(arg)->_allocator.release(static_cast<Item *>(obj));
+    }
+
+    static void destroy_table(void *obj, void *) {
+        delete static_cast<Table *>(obj);
+    }
+
+    inline void retire(Item *it) {
+        _rcu.retire(it, destroy_item, this);
+    }
+
+    inline Bucket &lock_bucket(size_type h);
+    void migrate_bucket(Table *t, size_type i);
+    void maybe_grow();
+
+    HashContainerRCU(const HashContainerRCU<K,V> &);
+    HashContainerRCU<K,V> &operator=(const HashContainerRCU<K,V> &);
+};
+
+template <typename K, typename V>
+HashContainerRCU<K,V>::HashContainerRCU(size_type n)
+    : _size(0)
+{
+    size_type b = 1;
+    while (b < n)
+        b = ((b + 1) << 1) - 1;
+    _table = new Table(b);
+}
+
+template <typename K, typename V>
+HashContainerRCU<K,V>::~HashContainerRCU()
+{
+    Table *t = _table;
+    for (Table *tt = t; tt; tt = tt->old)
+        for (size_type i = 0; i < tt->nbuckets; i++)
+            for (Item *it = tt->buckets[i].head; it; ) {
+                Item *next = it->next;
+                _allocator.release(it);
+                it = next;
+            }
+    if (t->old)
+        delete t->old;
+    delete t;
+}
+
+template <typename K, typename V>
+inline bool
+HashContainerRCU<K,V>::find(const K &key, V &value)
+{
+    size_type h = hash(key);
+    bool found = false;
+    _rcu.read_begin();
+    Table *t;
+    do {
+        t = _table;
+        Item *it = 0;
+        Table *o = t->old;
+        //Migrated items are copied to the new table before they are removed
+        //from the old one, so the old table must be searched first
+        if (unlikely(o != 0))
+            it = search(o->bucket(h).head, key);
+        if (!it)
+            it = search(t->bucket(h).head, key);
+        if (it) {
+            value = it->value;
+            found = true;
+            break;
+        }
+        click_read_fence();
+        //If the table grew meanwhile, the item may have moved
+    } while (unlikely(_table != t));
+    _rcu.read_end();
+    return found;
+}
+
+/**
+ * Migrate the old bucket for @a h if needed, and return the locked bucket
+ * of the current table for @a h. Must be called in a read section.
+ */
+template <typename K, typename V>
+inline typename HashContainerRCU<K,V>::Bucket &
+HashContainerRCU<K,V>::lock_bucket(size_type h)
+{
+    while (1) {
+        Table *t = _table;
+        Table *o = t->old;
+        if (unlikely(o != 0)) {
+            migrate_bucket(t, h % o->nbuckets);
+            for (int i = 0; i < migrate_per_write; i++) {
+                uint32_t next = o->migrate_next.fetch_and_add(1);
+                if (next >= o->nbuckets)
+                    break;
+                migrate_bucket(t, next);
+            }
+        }
+        Bucket &b = t->bucket(h);
+        b.lock.acquire();
+        //A migrated bucket belongs to a table that has been replaced
+        if (likely(!b.migrated))
+            return b;
+        b.lock.release();
+    }
+}
+
+/**
+ * Copy the items of bucket @a i of the old table of @a t to @a t. Must be
+ * called in a read section.
+ */
+template <typename K, typename V>
+void
+HashContainerRCU<K,V>::migrate_bucket(Table *t, size_type i)
+{
+    Table *o = t->old;
+    if (!o)
+        return;
+    Bucket &ob = o->buckets[i];
+    if (ob.migrated)
+        return;
+    ob.lock.acquire();
+    if (ob.migrated) {
+        ob.lock.release();
+        return;
+    }
+    Item *head = ob.head;
+    for (Item *it = head; it; it = it->next) {
+        Item *copy = _allocator.allocate(Item(it->key, it->value));
+        Bucket &nb = t->bucket(hash(it->key));
+        nb.lock.acquire();
+        copy->next = nb.head;
+        click_write_fence();
+        nb.head = copy;
+        nb.lock.release();
+    }
+    click_write_fence();
+    ob.head = 0;
+    ob.migrated = true;
+    ob.lock.release();
+    while (head) {
+        Item *next = head->next;
+        retire(head);
+        head = next;
+    }
+    if (o->migrated.fetch_and_add(1) + 1 == o->nbuckets) {
+        t->old = 0;
+        _rcu.retire(o, destroy_table, 0);
+    }
+}
+
+template <typename K, typename V>
+void
+HashContainerRCU<K,V>::maybe_grow()
+{
+    Table *t = _table;
+    if (t->old || size() <= 2 * t->nbuckets || !_resize_lock.attempt())
+        return;
+    if (_table == t && !t->old) {
+        Table *n = new Table(((t->nbuckets + 1) << 1) - 1);
+        n->old = t;
+        click_write_fence();
+        _table = n;
+    }
+    _resize_lock.release();
+}
+
+template <typename K, typename V>
+bool
+HashContainerRCU<K,V>::insert(const K &key, const V &value)
+{
+    size_type h = hash(key);
+    Item *n = _allocator.allocate(Item(key, value));
+    _rcu.read_begin();
+    Bucket &b = lock_bucket(h);
+    Item * volatile *pprev = &b.head;
+    Item *it;
+    for (it = b.head; it; pprev = &it->next, it = it->next)
+        if (it->key == key)
+            break;
+    n->next = it ? it->next : b.head;
+    click_write_fence();
+    if (it)
+        *pprev = n;
+    else
+        b.head = n;
+    b.lock.release();
+    _rcu.read_end();
+    if (it) {
+        retire(it);
+        return false;
+    }
+    if ((++*_size & 63) == 0)
+        maybe_grow();
+    return true;
+}
+
+template <typename K, typename V>
+bool
+HashContainerRCU<K,V>::find_insert(const K &key, V &value)
+{
+    size_type h = hash(key);
+    if (find(key, value))
+        return false;
+    Item *n = _allocator.allocate(Item(key, value));
+    _rcu.read_begin();
+    Bucket &b = lock_bucket(h);
+    Item *it = search(b.head, key);
+    if (it)
+        value = it->value;
+    else {
+        n->next = b.head;
+        click_write_fence();
+        b.head = n;
+    }
+    b.lock.release();
+    _rcu.read_end();
+    if (it) {
+        _allocator.release(n);
+        return false;
+    }
+    if ((++*_size & 63) == 0)
+        maybe_grow();
+    return true;
+}
+
+template <typename K, typename V>
+bool
+HashContainerRCU<K,V>::erase(const K &key)
+{
+    size_type h = hash(key);
+    _rcu.read_begin();
+    Bucket &b = lock_bucket(h);
+    Item * volatile *pprev = &b.head;
+    Item *it;
+    for (it = b.head; it; pprev = &it->next, it = it->next)
+        if (it->key == key) {
+            *pprev = it->next;
+            break;
+        }
+    b.lock.release();
+    _rcu.read_end();
+    if (!it)
+        return false;
+    --*_size;
+    retire(it);
+    return true;
+}
+
+template <typename K, typename V>
+void
+HashContainerRCU<K,V>::clear()
+{
+    _rcu.read_begin();
+    Table *t = _table;
+    if (t->old)
+        for (size_type i = 0; i < t->old->nbuckets; i++)
+            migrate_bucket(t, i);
+    Vector<Item *> heads;
+    for (size_type i = 0; i < t->nbuckets; i++) {
+        Bucket &b = t->buckets[i];
+        b.lock.acquire();
+        if (!b.migrated && b.head) {
+            heads.push_back(b.head);
+            b.head = 0;
+        }
+        b.lock.release();
+    }
+    _rcu.read_end();
+    for (int i = 0; i < heads.size(); i++)
+        for (Item *it = heads[i]; it; ) {
+            Item *next = it->next;
+            --*_size;
+            retire(it);
+            it = next;
+        }
+}
+
 
 template <typename K, typename Vin, typename Time = click_jiffies_t, template <typename> class Protector = shared>
 class AgingTableMP {
@@ -344,7 +344,9 @@ IP6Address::operator=(const struct in_addr &a)
 inline uint32_t
 IP6Address::hashcode() const
 {
-    return (data32()[2] << 1) + data32()[3];
+    // Prefixes up to /64 only differ in their first words
+    const uint32_t *ai = data32();
+    return ((ai[0] * 31 + ai[1]) * 31 + (ai[2] << 1)) * 31 + ai[3];
 }
 
 #if !CLICK_TOOL
@@ -12,12 +12,17 @@
 #include <click/tcphelper.hh>
 #include <click/straccum.hh>
 #include <click/args.hh>
+#include <click/error.hh>
 #include <click/timer.hh>
 #include <click/algorithm.hh>
+#include <click/multithread.hh>
+#if HAVE_BATCH
+#include <click/packetbatch.hh>
+#endif
 
 class LoadBalancer { public:
 
-    LoadBalancer() : _current(0), _dsts(), _weights_helper(), _mode_case(round_robin) {
+    LoadBalancer() : _current(0), _dsts(), _weights_helper(), _mode_case(round_robin), _maglev_size(65537) {
         modetrans.find_insert("rr",round_robin);
         modetrans.find_insert("hash",direct_hash);
         modetrans.find_insert("chash",direct_chash);
@@ -32,6 +37,7 @@ class LoadBalancer { public:
         modetrans.find_insert("least",least_load);
         modetrans.find_insert("pow2",pow2);
         modetrans.find_insert("table",table);
+        modetrans.find_insert("maglev",maglev);
         lsttrans.find_insert("conn",connections);
         lsttrans.find_insert("packets",packets);
         lsttrans.find_insert("bytes",bytes);
@@ -50,7 +56,8 @@ class LoadBalancer { public:
         direct_hash_agg,
         direct_hash_ip,
         least_load,
-        table
+        table,
+        maglev
 
     };
 
@@ -99,6 +106,9 @@ protected:
     bool _force_track_load;
     int _awrr_interval;
     float _alpha;
+    unsigned _maglev_size;
+    Vector <unsigned> _maglev_weights;
+    fast_rcu<Vector <unsigned> > _maglev_table;
 
     uint64_t get_load_metric(int idx) {
         return get_load_metric(idx, _lst_case);
@@ -177,6 +187,87 @@ protected:
         _cst_hash.swap(new_hash);
     }
 
+    static bool is_prime(unsigned n) {
+        if (n < 2)
+            return false;
+        for (unsigned i = 2; i * i <= n; i++)
+            if (n % i == 0)
+                return false;
+        return true;
+    }
+
+    static uint32_t maglev_hash(uint32_t x, uint32_t seed) {
+        // murmur3 finalizer
+        x ^= seed;
+        x ^= x >> 16;
+        x *= 0x85ebca6b;
+        x ^= x >> 13;
+        x *= 0xc2b2ae35;
+        x ^= x >> 16;
+        return x;
+    }
+
+    /* Builds the Maglev lookup table of the active servers, and swaps it in.
+     *
+     * Each server walks its own permutation of the table, given by an offset
+     * and a skip derived from its address, and takes the first free entry at
+     * each turn. A server with weight w takes a turn every max_weight / w
+     * rounds, so the table is shared according to the weights. As
+     * permutations only depend on the server itself, adding or removing a
+     * server moves few entries of the other servers.
+     */
+    void build_maglev() {
+        Vector<unsigned> table;
+        unsigned m = _maglev_size;
+        table.resize(m, (unsigned) -1);
+        Vector<unsigned> servers;
+        unsigned max_weight = 0;
+        for (int i = 0; i < _selector.size(); i++) {
+            if (_maglev_weights[_selector[i]] == 0)
+                continue;
+            servers.push_back(_selector[i]);
+            if (_maglev_weights[_selector[i]] > max_weight)
+                max_weight = _maglev_weights[_selector[i]];
+        }
+        if (servers.size() == 0) {
+            for (unsigned j = 0; j < m; j++)
+                table[j] = _selector.size() ? _selector[0] : 0;
+        } else {
+            int n = servers.size();
+            Vector<uint32_t> offset(n, 0), skip(n, 0), next(n, 0);
+            Vector<uint64_t> credit(n, 0);
+            for (int i = 0; i < n; i++) {
+                // switches have no addresses, their outputs identify them
+                uint32_t a = _dsts[servers[i]].addr();
+                if (!a)
+                    a = servers[i] + 1;
+                offset[i] = maglev_hash(a, 0x4d61676c) % m;
+                skip[i] = maglev_hash(a, 0x65764c42) % (m - 1) + 1;
+            }
+            unsigned filled = 0;
+            while (filled < m) {
+                for (int i = 0; i < n && filled < m; i++) {
+                    credit[i] += _maglev_weights[servers[i]];
+                    if (credit[i] < max_weight)
+                        continue;
+                    credit[i] -= max_weight;
+                    uint32_t c;
+                    do {
+                        c = (offset[i] + (uint64_t) next[i] * skip[i]) % m;
+                        next[i]++;
+                    } while (table[c] != (unsigned) -1);
+                    table[c] = servers[i];
+                    filled++;
+                }
+            }
+        }
+
+        int rcu;
+        Vector<unsigned> &t = _maglev_table.write_begin(rcu);
+        t.swap(table);
+        _maglev_table.write_commit(rcu);
+    }
+
     static void atc(Timer *timer, void *user_data) {
         LoadBalancer* lb = (LoadBalancer*)user_data;
         uint64_t metric_tot = 0;
@@ -242,6 +333,8 @@ protected:
         int cst_buckets;
         int nserver;
         bool force_track_load;
+        String weights_str;
+        Vector<unsigned> weights;
         int ret = Args(lb, errh).bind(conf)
             .read_or_set("LB_MODE", lb_mode,"rr")
             .read_or_set("LST_MODE",lst_mode,"conn")
@@ -249,11 +342,31 @@ protected:
             .read_or_set("FORCE_TRACK_LOAD", force_track_load, false)
             .read_or_set("NSERVER", nserver, 0)
             .read("CST_BUCKETS", cst_buckets).read_status(has_cst_buckets)
-            .read_or_set("AWRR_ALPHA", alpha, 0).consume();
+            .read_or_set("AWRR_ALPHA", alpha, 0)
+            .read_or_set("MAGLEV_SIZE", _maglev_size, 65537)
+            .read("WEIGHTS", AnyArg(), weights_str).consume();
 
         if (ret < 0)
             return -1;
 
+        if (weights_str) {
+            Vector<String> words;
+            cp_spacevec(weights_str, words);
+            weights.resize(words.size());
+            for (int i = 0; i < words.size(); i++)
+                if (!IntArg().parse(words[i], weights[i]))
+                    return errh->error("WEIGHTS must be a list of integers");
+        }
+        if (!modetrans.find(lb_mode))
+            return errh->error("unknown LB_MODE %<%s%>", lb_mode.c_str());
+        if (!is_prime(_maglev_size))
+            return errh->error("MAGLEV_SIZE must be a prime number");
+        if (weights.size() && weights.size() != _dsts.size())
+            return errh->error("WEIGHTS must give one weight per DST");
+        _maglev_weights = weights;
+        if (!_maglev_weights.size())
+            _maglev_weights.resize(_dsts.size(), 1);
+
         _alpha = alpha;
         _force_track_load = force_track_load;
 
@@ -267,7 +380,7 @@ protected:
     }
 
     enum {
-            h_load,h_load_raw,h_nb_total_servers,h_nb_active_servers,h_load_conn,h_load_packets,h_load_bytes,h_add_server,h_remove_server,h_lb_max
+            h_load,h_load_raw,h_nb_total_servers,h_nb_active_servers,h_load_conn,h_load_packets,h_load_bytes,h_add_server,h_remove_server,h_weights,h_lb_max
     };
 
 
@@ -335,17 +448,66 @@ protected:
     }
 
 
+    /* Returns the index of the server named by @a s, which is either an
+     * index in the DST list or one of its addresses, or -1. */
+    int parse_server(const String &s) {
+        int idx;
+        IPAddress a;
+        if (IntArg().parse(s, idx) && idx >= 0 && idx < _dsts.size())
+            return idx;
+        if (IPAddressArg().parse(s, a))
+            for (int i = 0; i < _dsts.size(); i++)
+                if (_dsts[i] == a)
+                    return i;
+        return -1;
+    }
+
     int lb_write_handler(
             const String &input, void *thunk, ErrorHandler *errh) {
         LoadBalancer *cs = this;
+        if (cs->_mode_case != maglev)
+            return errh->error("only supported with LB_MODE maglev");
         switch((uintptr_t) thunk) {
             case h_add_server: {
-                //add_server();
-                break;
+                int idx = cs->parse_server(input);
+                if (idx < 0)
+                    return errh->error("unknown server %<%s%>", input.c_str());
+                for (int i = 0; i < cs->_spares.size(); i++)
+                    if ((int) cs->_spares[i] == idx) {
+                        cs->_spares.erase(cs->_spares.begin() + i);
+                        cs->_selector.push_back(idx);
+                        cs->build_maglev();
+                        return 0;
+                    }
+                return errh->error("server %<%s%> is already active", input.c_str());
             }
             case h_remove_server: {
-                //remove_server();
-                break;
+                int idx = cs->parse_server(input);
+                if (idx < 0)
+                    return errh->error("unknown server %<%s%>", input.c_str());
+                if (cs->_selector.size() == 1)
+                    return errh->error("cannot remove the last server");
+                for (int i = 0; i < cs->_selector.size(); i++)
+                    if ((int) cs->_selector[i] == idx) {
+                        cs->_selector.erase(cs->_selector.begin() + i);
+                        cs->_spares.push_back(idx);
+                        cs->build_maglev();
+                        return 0;
+                    }
+                return errh->error("server %<%s%> is not active", input.c_str());
+            }
+            case h_weights: {
+                Vector<String> words;
+                cp_spacevec(input, words);
+                if (words.size() != cs->_dsts.size())
+                    return errh->error("expected %d weights", cs->_dsts.size());
+                Vector<unsigned> weights(words.size(), 0);
+                for (int i = 0; i < words.size(); i++)
+                    if (!IntArg().parse(words[i], weights[i]))
+                        return errh->error("bad weight %<%s%>", words[i].c_str());
+                cs->_maglev_weights.swap(weights);
+                cs->build_maglev();
+                return 0;
             }
         }
         return -1;
@@ -381,6 +543,12 @@ protected:
                     acc << cs->get_load_metric(i,bytes) << (i == cs->_dsts.size() -1?"":" ");
                 }
                 return acc.take_string();}
+            case h_weights: {
+                StringAccum acc;
+                for (int i = 0; i < cs->_maglev_weights.size(); i++)
+                    acc << cs->_maglev_weights[i] << (i == cs->_maglev_weights.size() - 1 ? "" : " ");
+                return acc.take_string();
+            }
             default:
                 return "<none>";
         }
@@ -397,8 +565,10 @@ protected:
         e->add_read_handler("load_conn", e->read_handler, h_load_conn);
         e->add_read_handler("load_bytes", e->read_handler, h_load_bytes);
         e->add_read_handler("load_packets", e->read_handler, h_load_packets);
-        //e->add_write_handler("remove_server", e->write_handler, h_remove_server);
-        //e->add_write_handler("add_server", e->write_handler, h_add_server);
+        e->add_write_handler("remove_server", e->write_handler, h_remove_server);
+        e->add_write_handler("add_server", e->write_handler, h_add_server);
+        e->add_read_handler("weights", e->read_handler, h_weights);
+        e->add_write_handler("weights", e->write_handler, h_weights);
     }
 
     void set_mode(String mode, String metric="cpu", Element* owner=0,int awrr_timer_interval = -1, int nserver = 0) {
@@ -442,6 +612,9 @@ protected:
         for (int i = 0; i < nserver; i++)
             _selector.push_back(i);
 
+        if (_mode_case == maglev)
+            build_maglev();
+
         if (_mode_case == constant_hash_agg) {
             if (_cst_hash.size() == 0)
                 _cst_hash.resize(_dsts.size() * 100);
@@ -581,6 +754,13 @@ protected:
             case direct_chash: {
                 return hash_4tuple(p, _selector.size());
             }
+            case maglev: {
+                int rcu;
+                const Vector<unsigned> &t = _maglev_table.read_begin(rcu);
+                unsigned server = t.unchecked_at(IPFlowID(p, false).hashcode() % _maglev_size);
+                _maglev_table.read_end(rcu);
+                return server;
+            }
             case table: {
 
                 auto & wh = _weights_helper.read_begin();
@@ -596,6 +776,26 @@ protected:
             }
         } //switch _lb_mode
     }
+
+#if HAVE_BATCH
+    /* Picks the server of @a p and of the packets following it, up to @a n
+     * of them, in order, into @a servers. In maglev mode the table is read
+     * once for all of them.
+     */
+    inline void pick_servers(Packet *p, int n, int *servers) {
+        int i = 0;
+        if (_mode_case == maglev) {
+            int rcu;
+            const Vector<unsigned> &t = _maglev_table.read_begin(rcu);
+            for (; p && i < n; p = p->next())
+                servers[i++] = t.unchecked_at(IPFlowID(p, false).hashcode() % _maglev_size);
+            _maglev_table.read_end(rcu);
+        } else {
+            for (; p && i < n; p = p->next())
+                servers[i++] = pick_server(p);
+        }
+    }
+#endif
 };
 
 #endif
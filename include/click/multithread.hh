@@ -48,6 +48,11 @@ class per_thread_oread : public per_thread<T> { public:
         per_thread<T>::storage[mapping[i]].v = v;
     }
 
+    /** @brief Return the thread id of the i-th used variable */
+    inline unsigned get_mapping(int i) const {
+        return mapping[i];
+    }
+
 private:
     Vector<unsigned int> mapping;
 };
@@ -1517,5 +1522,127 @@ protected:
 
 };
 
+
+/**
+ * Deferred reclamation for lock-free data structures, using the same
+ * per-thread epoch scheme than fast_rcu.
+ *
+ * fast_rcu and click_rcu protect a value by keeping two copies of it, which
+ * does not fit linked structures where a writer unlinks one node and must
+ * free it only when no reader can still be walking on it. With rcu_reclaimer
+ * readers announce the global epoch in their own cache line, without any
+ * atomic operation. A writer that unlinked an object calls retire(), which
+ * stamps it with the current epoch and queues it in a per-thread list.
+ * collect() advances the global epoch and frees the objects retired before
+ * the oldest epoch still announced by a reader.
+ *
+ * Read sections cannot be nested, and must not last long as they prevent
+ * any reclamation.
+ */
+class rcu_reclaimer { public:
+    typedef void (*destroy_f)(void *obj, void *arg);
+
+    rcu_reclaimer() : _epochs(0) {
+        _epoch = 1;
+    }
+
+    ~rcu_reclaimer() {
+        for (unsigned i = 0; i < _retired.weight(); i++) {
+            Vector<Retired> &r = _retired.get_value(i);
+            for (int j = 0; j < r.size(); j++)
+                r[j].destroy(r[j].obj, r[j].arg);
+            r.clear();
+        }
+    }
+
+    inline void read_begin() {
+        *_epochs = _epoch;
+        click_fence(); //The epoch must be visible before any pointer is read
+    }
+
+    inline void read_end() {
+        click_compiler_fence(); //No load after the epoch is set back to 0
+        *_epochs = 0;
+    }
+
+    /**
+     * Free @a obj by calling @a destroy(@a obj, @a arg) when no reader can
+     * have a reference to it anymore. @a obj must already be unreachable.
+     */
+    inline void retire(void *obj, destroy_f destroy, void *arg) {
+        click_fence(); //Unlink must be visible before reading the epoch
+        Vector<Retired> &r = *_retired;
+        r.push_back(Retired(obj, destroy, arg, _epoch));
+        if (unlikely(r.size() >= collect_threshold))
+            collect();
+    }
+
+    /**
+     * Free the objects retired by the current thread that no reader can
+     * still access. Return the number of objects that are still pending.
+     */
+    int collect() {
+        uint32_t safe = _epoch.fetch_and_add(1) + 1;
+        click_fence();
+        for (unsigned i = 0; i < _epochs.weight(); i++) {
+            uint32_t e = _epochs.get_value(i);
+            if (e != 0 && e < safe)
+                safe = e;
+        }
+        Vector<Retired> &r = *_retired;
+        int j = 0;
+        for (int i = 0; i < r.size(); i++) {
+            if (r[i].epoch < safe)
+                r[i].destroy(r[i].obj, r[i].arg);
+            else
+                r[j++] = r[i];
+        }
+        r.resize(j);
+        return j;
+    }
+
+    /**
+     * Wait until all the read sections started before the call are over.
+     * Readers may still be in read sections started after it, but those
+     * cannot have seen anything unlinked before the call.
+     */
+    void synchronize() {
+        uint32_t e = _epoch.fetch_and_add(1) + 1;
+        click_fence();
+        for (unsigned i = 0; i < _epochs.weight(); i++) {
+            uint32_t te;
+            while ((te = _epochs.get_value(i)) != 0 && te < e)
+                click_relax_fence();
+        }
+    }
+
+    /** @brief Number of objects waiting to be freed by all threads */
+    unsigned pending() const {
+        unsigned n = 0;
+        for (unsigned i = 0; i < _retired.weight(); i++)
+            n += _retired.get_value(i).size();
+        return n;
+    }
+
+    enum { collect_threshold = 64 };
+
+private:
+    struct Retired {
+        Retired() {
+        }
+        Retired(void *o, destroy_f d, void *a, uint32_t e)
+            : obj(o), destroy(d), arg(a), epoch(e) {
+        }
+        void *obj;
+        destroy_f destroy;
+        void *arg;
+        uint32_t epoch;
+    };
+
+    atomic_uint32_t _epoch;
+    per_thread<volatile uint32_t> _epochs;
+    per_thread<Vector<Retired> > _retired;
+};
+
 CLICK_ENDDECLS
 #endif
@@ -41,6 +41,17 @@ CLICK_DECLS
 #define HAVE_BATCH_RECYCLE 1
 #endif
 
+// Pool data buffers can be carved out of an arena of (huge) pages. With NUMA,
+// the arena has one region per node, and buffers go back to the node they
+// were allocated on when they are freed elsewhere
+#if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD && CLICK_USERLEVEL && !HAVE_DPDK_PACKET_POOL && !HAVE_NETMAP_PACKET_POOL && !HAVE_VECTOR_PACKET_POOL
+# define CLICK_PACKET_ARENA 1
+# if HAVE_NUMA
+#  define CLICK_PACKET_POOL_NUMA 1
+#  define CLICK_PACKET_POOL_NUMA_NODES 8
+# endif
+#endif
+
 class IP6Address;
 class WritablePacket;
 class PacketBatch;
@@ -947,6 +958,19 @@ private:
             p(0), pcount(0), pd(0), pdcount(0)
 #endif
         {
+#if CLICK_PACKET_ARENA
+            node = 0;
+            ab = 0;
+            abcount = 0;
+            local_recycled = remote_recycled = 0;
+#endif
+#if CLICK_PACKET_POOL_NUMA
+            for (int i = 0; i < CLICK_PACKET_POOL_NUMA_NODES; i++) {
+                rpd[i] = 0;
+                rpdcount[i] = 0;
+                rpdseen[i] = 0;
+            }
+#endif
         }
 #if HAVE_VECTOR_PACKET_POOL
         Stack<Packet*> p;
@@ -960,6 +984,18 @@ private:
     #  if HAVE_MULTITHREAD
         PacketPool* thread_pool_next; // link to next per-thread pool
     #  endif
+#if CLICK_PACKET_ARENA
+        int node;                   // NUMA node of the thread
+        unsigned char* ab;          // free arena buffers of the node, linked by their first word
+        unsigned abcount;           // # buffers in `ab` list
+        uint64_t local_recycled;    // # data buffers recycled on their node
+        uint64_t remote_recycled;   // # data buffers recycled on another node
+#endif
+#if CLICK_PACKET_POOL_NUMA
+        WritablePacket* rpd[CLICK_PACKET_POOL_NUMA_NODES]; // data buffers of other nodes, going back home
+        unsigned rpdcount[CLICK_PACKET_POOL_NUMA_NODES];
+        unsigned rpdseen[CLICK_PACKET_POOL_NUMA_NODES]; // rpdcount at the last pool_flush_remote()
+#endif
     };
 #endif
 
@@ -994,6 +1030,39 @@ class WritablePacket : public Packet { public:
 # if HAVE_CLICK_PACKET_POOL
     static void initialize_local_packet_pool();
 # endif
+# if CLICK_PACKET_ARENA
+    struct PoolArenaStats {
+        uint32_t buffer_size;       ///< size of the data buffers
+        uint32_t pages;             ///< pages mapped in the node's region
+        uint32_t hugepages;         ///< of which are explicit hugepages
+        uint64_t mapped_bytes;      ///< bytes mapped in the node's region
+        uint64_t buffers;           ///< data buffers carved out of the node's region
+        uint64_t free_buffers;      ///< of which are in the region's free list
+        uint64_t cached_buffers;    ///< of which are in thread freelists
+    };
+    static int pool_arena_configure(bool enable, uint32_t page_size);
+    static bool pool_arena_enabled();
+    static uint32_t pool_arena_page_size();
+    static int pool_arena_nodes();
+    static void pool_arena_stats(int node, PoolArenaStats &stats);
+
+    static unsigned char *arena_begin;
+    static unsigned char *arena_end;
+    static inline bool is_arena_buffer(const unsigned char *head) {
+        return head >= arena_begin && head < arena_end;
+    }
+    static void free_arena_buffer(unsigned char *head);
+
+    struct PoolNumaStats {
+        uint64_t local_recycled;    ///< data buffers recycled by the node's threads, allocated on the node
+        uint64_t remote_recycled;   ///< data buffers recycled by the node's threads, allocated on another node
+    };
+    static void pool_numa_stats(int node, PoolNumaStats &stats);
+    static void pool_numa_clear_stats();
+# endif
+# if CLICK_PACKET_POOL_NUMA
+    static void pool_flush_remote(bool all);
+# endif
 
     static void pool_transfer(int from, int to);
     static WritablePacket * pool_prepare_data_burst(uint16_t count);
@@ -1055,6 +1124,12 @@ class WritablePacket : public Packet { public:
     static void recycle_packet_batch(WritablePacket *head, Packet* tail, unsigned count);
     static void recycle_data_batch(WritablePacket *head, Packet* tail, unsigned count);
 #endif
+#if CLICK_PACKET_ARENA
+    static unsigned char *alloc_arena_buffer();
+#endif
+#if CLICK_PACKET_POOL_NUMA
+    static void recycle_remote(PacketPool &packet_pool, WritablePacket *p, int node);
+#endif
 
     friend class Packet;
     friend class PacketBatch;
@@ -3125,6 +3200,11 @@ Packet::delete_buffer(unsigned char* head, unsigned char* end
     if (head && NetmapBufQ::is_valid_netmap_buffer(head)) {
         NetmapBufQ::local_pool()->insert_p(head);
     } else
+#  endif
+#  if CLICK_PACKET_ARENA
+    if (WritablePacket::is_arena_buffer(head)) {
+        WritablePacket::free_arena_buffer(head);
+    } else
 #  endif
     if (head) {
             delete[] head;
@@ -262,6 +262,30 @@ CLICK_DECLS
         }\
     }
 
+/**
+ * Equivalent to CLASSIFY_EACH_PACKET, but the outputs are computed by bursts.
+ *
+ * @args burst_fnt Function called as burst_fnt(p, outputs) with the next
+ *  packet to classify. It must set the outputs of p and of up to burst - 1
+ *  of the packets that follow it, and return how many it set. The packets
+ *  after p are still linked to it when it is called, so they can all be
+ *  looked up, and their memory prefetched, at once.
+ * @args burst Maximal number of packets per call to burst_fnt
+ */
+#define CLASSIFY_EACH_PACKET_BURST(nbatches,burst_fnt,burst,cep_batch,on_finish)\
+    {\
+        int cepb_outputs[(burst)];\
+        int cepb_i = 0, cepb_n = 0;\
+        auto cepb_fnt = [&](Packet *cepb_p) {\
+            if (cepb_i == cepb_n) {\
+                cepb_n = burst_fnt(cepb_p, cepb_outputs);\
+                cepb_i = 0;\
+            }\
+            return cepb_outputs[cepb_i++];\
+        };\
+        CLASSIFY_EACH_PACKET(nbatches,cepb_fnt,cep_batch,on_finish);\
+    }
+
 /**
  * Equivalent to CLASSIFY_EACH_PACKET but ignore the packet if fnt returns -1
  */
@@ -642,6 +666,18 @@ public :
      */
     inline void kill();
 
+#if !CLICK_LINUXMODULE
+    /**
+     * @brief Set the IP header checksum of every packet of the batch
+     *
+     * The IP header starts at the network header, or at the data if no
+     * network header is set, and must be complete. The packets must be
+     * writable. Headers are summed by click_in_cksum_multi() in chunks of
+     * up to 64.
+     */
+    void set_ip_checksums();
+#endif
+
     /**
      * Clone the batch
      */
@@ -88,6 +88,17 @@ class alignas(CLICK_CACHE_LINE_SIZE) RouterThread { public:
 
 #if CLICK_USERLEVEL
     inline void run_signals();
+
+    // Hybrid polling
+    unsigned poll_threshold() const     { return _poll_threshold; }
+    inline void set_poll_threshold(unsigned empty_iters);
+    const Timestamp &poll_max_sleep() const { return _poll_max_sleep; }
+    void set_poll_max_sleep(const Timestamp &t) { _poll_max_sleep = t; }
+    inline bool poll_idle() const;
+    uint64_t poll_sleeps() const        { return _poll_sleeps; }
+    Timestamp poll_wakeup_latency() const;
+    Timestamp poll_wakeup_latency_max() const;
+    void poll_reset_stats();
 #endif
 
     enum { S_PAUSED, S_BLOCKED, S_TIMERWAIT,
@@ -197,6 +208,18 @@ class alignas(CLICK_CACHE_LINE_SIZE) RouterThread { public:
     unsigned _iters_per_os;
   private:
 
+#if CLICK_USERLEVEL
+    unsigned _poll_threshold;   // empty iterations before blocking, or 0
+    unsigned _poll_empty;       // consecutive iterations without work
+    Timestamp _poll_max_sleep;
+    bool _poll_sleeping;
+    click_cycles_t _poll_woken; // when the last hybrid wait returned, or 0
+    uint64_t _poll_sleeps;
+    uint64_t _poll_latency_count;
+    click_cycles_t _poll_latency_sum;
+    click_cycles_t _poll_latency_max;
+#endif
+
 #if CLICK_NS
     Timestamp _ns_scheduled;
     Timestamp _ns_last_active;
@@ -254,9 +277,13 @@ class alignas(CLICK_CACHE_LINE_SIZE) RouterThread { public:
 #endif
     }
 
-    inline void run_tasks(int ntasks);
+    inline bool run_tasks(int ntasks);
     inline void process_pending();
     inline void run_os();
+#if CLICK_USERLEVEL
+    inline void update_poll_state(bool work_done);
+    int select_delay(Timestamp &t);
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     void client_set_tickets(int client, int tickets);
     inline void client_update_pass(int client, const Timestamp &before);
@@ -540,6 +567,31 @@ RouterThread::set_thread_state_for_blocking(int delay_type)
         set_thread_state(delay_type ? S_TIMERWAIT : S_PAUSED);
 }
 
+#if CLICK_USERLEVEL
+/** @brief Set the number of consecutive driver iterations without work after
+ * which this thread blocks in its SelectSet although tasks are scheduled.
+ *
+ * The thread then sleeps until a file descriptor of its SelectSet is ready,
+ * a timer expires, or poll_max_sleep() elapses, and polls again. A task
+ * rescheduled from another thread also wakes it, as it goes through the
+ * pending list, and add_pending() wakes the SelectSet. 0 disables hybrid
+ * polling. */
+inline void
+RouterThread::set_poll_threshold(unsigned empty_iters)
+{
+    _poll_threshold = empty_iters;
+    _poll_empty = 0;
+}
+
+/** @brief Return true if this thread polled poll_threshold() times without
+ * work, and will block in its SelectSet at the next occasion. */
+inline bool
+RouterThread::poll_idle() const
+{
+    return _poll_threshold && _poll_empty >= _poll_threshold;
+}
+#endif
+
 #if CLICK_DEBUG_SCHEDULING > 1
 inline Timestamp
 RouterThread::thread_state_time(int state) const
@@ -7,7 +7,7 @@
 #include <click/vector.hh>
 #include <click/sync.hh>
 #include <unistd.h>
-#if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE
+#if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE && !HAVE_ALLOW_EPOLL
 # define HAVE_ALLOW_SELECT 1
 #endif
 #if defined(__APPLE__) && HAVE_ALLOW_SELECT && HAVE_ALLOW_POLL
@@ -24,10 +24,20 @@
 #endif
 #if !HAVE_SYS_EVENT_H || !HAVE_KQUEUE
 # undef HAVE_ALLOW_KQUEUE
-# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL
+# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_EPOLL
 #  error "kqueue is not supported on this system, try --enable-select"
 # endif
 #endif
+#if !defined(__linux__)
+# undef HAVE_ALLOW_EPOLL
+# if !HAVE_ALLOW_SELECT && !HAVE_ALLOW_POLL && !HAVE_ALLOW_KQUEUE
+#  error "epoll is not supported on this system, try --enable-select"
+# endif
+#endif
+#if HAVE_ALLOW_EPOLL && !HAVE_ALLOW_POLL && !HAVE_ALLOW_SELECT
+// the poll() or select() fallback is used for fds epoll does not support
+# define HAVE_ALLOW_SELECT 1
+#endif
 CLICK_DECLS
 class Element;
 class Router;
@@ -51,6 +61,11 @@ class SelectSet { public:
 
     void kill_router(Router *router);
 
+    /** @brief Number of file descriptor events delivered to elements */
+    inline uint64_t wakeups() const {
+	return _wakeups;
+    }
+
     inline void fence();
 
   private:
@@ -70,6 +85,10 @@ class SelectSet { public:
 #if HAVE_ALLOW_KQUEUE
     int _kqueue;
 #endif
+#if HAVE_ALLOW_EPOLL
+    int _epoll;
+#endif
+    uint64_t _wakeups;
 #if !HAVE_ALLOW_POLL
     struct pollfd {
 	int fd;
@@ -88,11 +107,15 @@ class SelectSet { public:
 
     void register_select(int fd, bool add_read, bool add_write);
     void remove_pollfd(int pi, int event);
-    inline void call_selected(int fd, int mask) const;
+    inline void call_selected(int fd, int mask);
     inline bool post_select(RouterThread *thread, bool acquire);
 #if HAVE_ALLOW_KQUEUE
     void run_selects_kqueue(RouterThread *thread);
 #endif
+#if HAVE_ALLOW_EPOLL
+    void update_epoll(int fd, int old_events);
+    void run_selects_epoll(RouterThread *thread);
+#endif
 #if HAVE_ALLOW_POLL
     void run_selects_poll(RouterThread *thread);
 #else
@@ -2,6 +2,7 @@
 #define CLICK_TIMERWHEEL_HH 1
 
 #include <click/algorithm.hh>
+#include <click/integers.hh>
 
 CLICK_DECLS
 
@@ -56,5 +57,295 @@ class TimerWheel {
         Spinlock _writers_lock;
 };
 
+/** @brief Position of an object in a HierarchicalTimerWheel.
+ *
+ * Objects stored in a HierarchicalTimerWheel embed one of these, and return
+ * it from a wheel_link() member function. */
+template <typename T>
+struct TimerWheelLink {
+    T *next;
+    T *prev;		// the head's prev is the tail, null if not scheduled
+    uint32_t expires;
+    uint16_t bucket;
+
+    bool scheduled() const {
+        return prev != 0;
+    }
+};
+
+/**
+ * A hierarchical timing wheel, for objects that are rescheduled much more
+ * often than they expire, such as flows.
+ *
+ * The wheel has LEVELS levels of 2^BITS buckets. Level k buckets span
+ * 2^(k*BITS) ticks, so the wheel covers 2^31 ticks into the future.
+ * Scheduling and unscheduling are O(1): objects are kept in intrusive
+ * doubly-linked lists and need no allocation. Buckets of upper levels are
+ * cascaded to lower levels when the wheel reaches them. Buckets are FIFO, so
+ * objects of a bucket stay sorted by expiration if they all share the same
+ * timeout.
+ *
+ * Postponing an object does not need to move it: the wheel keeps the
+ * expiration it was scheduled with, and the callback given to run() is
+ * expected to check the object's real expiration and reschedule it if it was
+ * postponed. Only anticipated expirations must be rescheduled eagerly.
+ *
+ * T must have a member function "TimerWheelLink<T> &wheel_link()". A wheel
+ * is not thread safe.
+ */
+template <typename T, int BITS = 8, int LEVELS = 4>
+class HierarchicalTimerWheel {
+    public:
+        enum { nslots = 1 << BITS, mask = nslots - 1, nwords = (nslots + 63) / 64 };
+
+        HierarchicalTimerWheel() : _slots(0), _detached(0), _now(0), _size(0) {
+        }
+
+        ~HierarchicalTimerWheel() {
+            delete[] _slots;
+        }
+
+        /** @brief Allocate buckets and set the current time to @a now. */
+        void initialize(uint32_t now) {
+            if (!_slots)
+                _slots = new T *[LEVELS * nslots];
+            memset(_slots, 0, sizeof(T *) * LEVELS * nslots);
+            memset(_bitmap, 0, sizeof(_bitmap));
+            _now = now;
+            _size = 0;
+        }
+
+        bool initialized() const {
+            return _slots != 0;
+        }
+
+        /** @brief Number of scheduled objects */
+        uint32_t size() const {
+            return _size;
+        }
+
+        /** @brief Next tick that run() will process */
+        uint32_t now() const {
+            return _now;
+        }
+
+        /** @brief Schedule @a obj to expire at tick @a expires.
+         *
+         * If @a obj is already scheduled, it is moved. */
+        inline void schedule(T *obj, uint32_t expires) {
+            TimerWheelLink<T> &l = obj->wheel_link();
+            if (l.prev)
+                unlink(obj);
+            l.expires = expires;
+            link(obj, bucket_for(expires));
+        }
+
+        /** @brief Remove @a obj from the wheel, if scheduled. */
+        inline void unschedule(T *obj) {
+            if (obj->wheel_link().prev)
+                unlink(obj);
+        }
+
+        /** @brief Process all ticks up to @a now included.
+         *
+         * Each object scheduled to expire at or before @a now is removed from
+         * the wheel and passed to @a expire, which may reschedule it. */
+        template <typename F>
+        void run(uint32_t now, F expire) {
+            while ((int32_t) (now - _now) >= 0) {
+                unsigned idx = _now & mask;
+                if (idx == 0)
+                    cascade(1);
+                if (test_bit(0, idx)) {
+                    // Detach the bucket and move to the next tick first, so
+                    // objects rescheduled in the past by @a expire are
+                    // handled at the next tick. The detached list stays
+                    // valid if @a expire unschedules other objects.
+                    _detached = _slots[idx];
+                    _slots[idx] = 0;
+                    clear_bit(0, idx);
+                    for (T *obj = _detached; obj; obj = obj->wheel_link().next)
+                        obj->wheel_link().bucket = detached_bucket;
+                    ++_now;
+                    while (T *obj = _detached) {
+                        unlink(obj);
+                        expire(obj);
+                    }
+                } else {
+                    // Skip empty buckets, but stop at the end of the level
+                    // to cascade the upper levels
+                    uint32_t step = next_bit(0, idx + 1, nslots) - idx;
+                    if (step > now - _now + 1)
+                        step = now - _now + 1;
+                    _now += step;
+                }
+            }
+        }
+
+        /** @brief Return the object that will expire first.
+         *
+         * @a expiry gives the real expiration of an object. The earliest
+         * non-empty bucket of each level is scanned, and objects found in a
+         * bucket that is too early for them are moved on the way. Later
+         * buckets of a level only hold later expirations, so the result is
+         * exact, but the cost grows with the size of the scanned buckets. */
+        template <typename F>
+        T *first(F expiry) {
+            T *best = 0;
+            uint32_t best_e = 0;
+            for (int level = 0; level < LEVELS; ++level) {
+                // A bucket whose objects were all postponed says nothing
+                // about the level: try the next one
+                bool kept = false;
+                int b;
+                while (!kept && (b = first_bucket(level)) >= 0) {
+                    T *obj = _slots[level * nslots + b];
+                    while (obj) {
+                        TimerWheelLink<T> &l = obj->wheel_link();
+                        T *next = l.next;
+                        uint32_t e = expiry(obj);
+                        uint16_t nb = bucket_for(e);
+                        l.expires = e;
+                        if (nb == l.bucket)
+                            kept = true;
+                        else {
+                            unlink(obj);
+                            link(obj, nb);
+                        }
+                        if (!best || (int32_t) (e - best_e) < 0) {
+                            best = obj;
+                            best_e = e;
+                        }
+                        obj = next;
+                    }
+                }
+            }
+            return best;
+        }
+
+        /** @brief Call @a f on every scheduled object. @a f must not
+         * modify the wheel. */
+        template <typename F>
+        void for_each(F f) const {
+            for (int b = 0; _slots && b < LEVELS * nslots; ++b)
+                for (T *obj = _slots[b]; obj; obj = obj->wheel_link().next)
+                    f(obj);
+            for (T *obj = _detached; obj; obj = obj->wheel_link().next)
+                f(obj);
+        }
+
+    private:
+        enum { detached_bucket = LEVELS * nslots };
+
+        T **_slots;
+        T *_detached;
+        uint64_t _bitmap[LEVELS][nwords];
+        uint32_t _now;
+        uint32_t _size;
+
+        inline uint16_t bucket_for(uint32_t expires) const {
+            int32_t delta = expires - _now;
+            if (delta < 0)
+                return _now & mask;
+            for (int level = 0; level < LEVELS - 1; ++level)
+                if ((uint32_t) delta < (1U << ((level + 1) * BITS)))
+                    return level * nslots + ((expires >> (level * BITS)) & mask);
+            return (LEVELS - 1) * nslots + ((expires >> ((LEVELS - 1) * BITS)) & mask);
+        }
+
+        inline T *&head(uint16_t b) {
+            return b == detached_bucket ? _detached : _slots[b];
+        }
+
+        // Append obj to bucket b
+        inline void link(T *obj, uint16_t b) {
+            TimerWheelLink<T> &l = obj->wheel_link();
+            T *&h = _slots[b];
+            l.bucket = b;
+            l.next = 0;
+            if (h) {
+                T *tail = h->wheel_link().prev;
+                tail->wheel_link().next = obj;
+                l.prev = tail;
+                h->wheel_link().prev = obj;
+            } else {
+                h = obj;
+                l.prev = obj;
+                _bitmap[b / nslots][(b & mask) / 64] |= (uint64_t) 1 << (b & 63);
+            }
+            ++_size;
+        }
+
+        inline void unlink(T *obj) {
+            TimerWheelLink<T> &l = obj->wheel_link();
+            T *&h = head(l.bucket);
+            if (h == obj) {
+                h = l.next;
+                if (h)
+                    h->wheel_link().prev = l.prev;
+                else if (l.bucket != detached_bucket)
+                    clear_bit(l.bucket / nslots, l.bucket & mask);
+            } else {
+                l.prev->wheel_link().next = l.next;
+                if (l.next)
+                    l.next->wheel_link().prev = l.prev;
+                else
+                    h->wheel_link().prev = l.prev;
+            }
+            l.prev = 0;
+            --_size;
+        }
+
+        inline bool test_bit(int level, unsigned idx) const {
+            return _bitmap[level][idx / 64] & ((uint64_t) 1 << (idx & 63));
+        }
+
+        inline void clear_bit(int level, unsigned idx) {
+            _bitmap[level][idx / 64] &= ~((uint64_t) 1 << (idx & 63));
+        }
+
+        // First set bit of level in [from, to), or to
+        inline unsigned next_bit(int level, unsigned from, unsigned to) const {
+            while (from < to) {
+                uint64_t w = _bitmap[level][from / 64] >> (from & 63);
+                if (w) {
+                    from += ffs_lsb(w) - 1;
+                    return from < to ? from : to;
+                }
+                from = (from | 63) + 1;
+            }
+            return to;
+        }
+
+        void cascade(int level) {
+            if (level >= LEVELS)
+                return;
+            unsigned idx = (_now >> (level * BITS)) & mask;
+            if (idx == 0)
+                cascade(level + 1);
+            if (!test_bit(level, idx))
+                return;
+            T *obj = _slots[level * nslots + idx];
+            _slots[level * nslots + idx] = 0;
+            clear_bit(level, idx);
+            while (obj) {
+                TimerWheelLink<T> &l = obj->wheel_link();
+                T *next = l.next;
+                --_size;
+                link(obj, bucket_for(l.expires));
+                obj = next;
+            }
+        }
+
+        // Earliest non-empty bucket of level, or -1
+        int first_bucket(int level) const {
+            unsigned idx = (_now >> (level * BITS)) & mask;
+            unsigned b = next_bit(level, idx, nslots);
+            if (b == nslots)
+                b = next_bit(level, 0, idx);
+            return b < nslots && test_bit(level, b) ? (int) b : -1;
+        }
+};
+
 CLICK_ENDDECLS
 #endif
@@ -130,12 +130,39 @@ struct click_ip {
  * @param x data to checksum
  * @param len number of bytes to checksum
  *
- * @a x must be two-byte aligned. */
+ * At user level, long ranges are summed with SSE2, AVX2 or NEON, selected
+ * according to the running CPU. */
 uint16_t click_in_cksum(const unsigned char *x, int len);
+/** @brief Calculate the Internet checksums of several data ranges.
+ * @param x data ranges to checksum
+ * @param len number of bytes of each range
+ * @param[out] csum checksum of each range
+ * @param n number of ranges
+ *
+ * Equivalent to calling click_in_cksum() on each range, with a fast path
+ * for option-less IP headers. */
+void click_in_cksum_multi(const unsigned char * const *x, const int *len, uint16_t *csum, int n);
+/** @brief Calculate an Internet checksum with one summing kernel.
+ * @param kernel kernel number: 0 is the scalar loop, then the vector kernels
+ * @param x data to checksum
+ * @param len number of bytes to checksum
+ * @param[out] csum checksum
+ * @return the kernel's name, or null if it is not compiled in or the
+ * running CPU lacks it
+ *
+ * For tests: click_in_cksum() picks the kernel itself. */
+const char *click_in_cksum_kernel(int kernel, const unsigned char *x, int len, uint16_t *csum);
 uint16_t click_in_cksum_pseudohdr_raw(uint32_t csum, uint32_t src, uint32_t dst, int proto, int packet_len);
 #else
 # define click_in_cksum(addr, len) \
 		ip_compute_csum((unsigned char *)(addr), (len))
+static inline void
+click_in_cksum_multi(const unsigned char * const *x, const int *len, uint16_t *csum, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+	csum[i] = click_in_cksum(x[i], len[i]);
+}
 # define click_in_cksum_pseudohdr_raw(csum, src, dst, proto, transport_len) \
 		csum_tcpudp_magic((src), (dst), (transport_len), (proto), ~(csum) & 0xFFFF)
 #endif
@@ -185,6 +212,23 @@ click_update_in_cksum(uint16_t *csum, uint16_t old_hw, uint16_t new_hw)
     *csum = ~(sum + (sum >> 16));
 }
 
+/** @brief Incrementally adjust an Internet checksum for a 32-bit change.
+ * @param[in, out] csum points to checksum
+ * @param old_w old word, such as an IP address, in network byte order
+ * @param new_w new word, in network byte order
+ *
+ * Equivalent to calling click_update_in_cksum() on both halfwords, with the
+ * same caveat about ~+0 (RFC 1624). */
+static inline void
+click_update_in_cksum32(uint16_t *csum, uint32_t old_w, uint32_t new_w)
+{
+    uint32_t sum = (~*csum & 0xFFFF)
+	+ (~old_w & 0xFFFF) + (~old_w >> 16)
+	+ (new_w & 0xFFFF) + (new_w >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *csum = ~(sum + (sum >> 16));
+}
+
 /** @brief Potentially fix a zero-valued Internet checksum.
  * @param[in, out] csum points to checksum
  * @param x data to checksum
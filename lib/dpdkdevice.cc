@@ -541,6 +541,7 @@ int DPDKDevice::initialize_device(ErrorHandler *errh)
     dev_conf.rxmode.offloads = DEV_RX_OFFLOAD_CRC_STRIP;
     dev_conf.txmode.offloads = 0;
 #endif
+    dev_conf.intr_conf.rxq = info.rx_intr;
 
     if (info.mq_mode & ETH_MQ_RX_VMDQ_FLAG) {
 
@@ -980,6 +981,11 @@ void DPDKDevice::set_rx_offload(uint64_t offload) {
     info.rx_offload |= offload;
 }
 
+void DPDKDevice::set_init_rx_intr(bool rx_intr) {
+    assert(!_is_initialized);
+    info.rx_intr |= rx_intr;
+}
+
 void DPDKDevice::set_tx_offload(uint64_t offload) {
     assert(!_is_initialized);
     info.tx_offload |= offload;
@@ -24,6 +24,7 @@
 #include <click/element.hh>
 #include <click/straccum.hh>
 #include <click/userutils.hh>
+#include <click/atomic.hh>
 #if CLICK_PACKET_USE_DPDK
 #include <click/dpdkdevice.hh>
 #endif
@@ -43,7 +44,7 @@ FromFile::FromFile()
     _data_packet(0),
 #endif
 #ifdef ALLOW_MMAP
-      _mmap(true),
+      _mmap(true), _mapping(0),
 #endif
       _filename(), _pipe(0), _landmark_pattern("%f"), _lineno(0)
 {
@@ -131,33 +132,103 @@ munmap_destructor(unsigned char *data, size_t amount, void*)
 	click_chatter("FromFile: munmap: %s", strerror(errno));
 }
 
+struct FromFile::Mapping {
+    unsigned char *data;
+    size_t size;
+    atomic_uint32_t refcount;
+};
+
+void
+FromFile::mapping_destructor(unsigned char *, size_t, void *arg)
+{
+    Mapping *m = reinterpret_cast<Mapping *>(arg);
+    if (m->refcount.dec_and_test()) {
+	if (munmap((caddr_t)m->data, m->size) < 0)
+	    click_chatter("FromFile: munmap: %s", strerror(errno));
+	delete m;
+    }
+}
+
+/* Map a regular file of @a size bytes at once. Buffers are then windows into
+   the mapping holding a reference on it, so packets made from them point
+   straight into the file and the mapping lives as long as any of them.
+   Reading falls back to mmap units if the mapping fails. */
+void
+FromFile::map_file(off_t size)
+{
+    release_mapping();
+    if (size <= 0 || (uint64_t) size > (size_t) -1)
+	return;
+    void *data = mmap(0, size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+	return;
+# ifdef HAVE_MADVISE
+    // don't care about errors
+    (void) madvise((caddr_t)data, size, MADV_SEQUENTIAL);
+# endif
+    _mapping = new Mapping;
+    _mapping->data = (unsigned char *)data;
+    _mapping->size = size;
+    _mapping->refcount = 1;
+    _mmap_unit = WANT_MAPPING_WINDOW;
+}
+
+void
+FromFile::release_mapping()
+{
+    if (_mapping)
+	mapping_destructor(0, 0, _mapping);
+    _mapping = 0;
+}
+
 int
 FromFile::read_buffer_mmap(ErrorHandler *errh)
 {
+    // get length of file
+    struct stat statbuf;
+    if (fstat(_fd, &statbuf) < 0)
+	return error(_mmap_unit ? errh : ErrorHandler::silent_handler(),
+		     "stat: %s", strerror(errno));
+
     if (_mmap_unit == 0) {
 	size_t page_size = getpagesize();
 	_mmap_unit = (WANT_MMAP_UNIT / page_size) * page_size;
 	_mmap_off = 0;
+	if (S_ISREG(statbuf.st_mode))
+	    map_file(statbuf.st_size);
 	// don't report most errors on the first time through
 	errh = ErrorHandler::silent_handler();
     }
 
-    // get length of file
-    struct stat statbuf;
-    if (fstat(_fd, &statbuf) < 0)
-	return error(errh, "stat: %s", strerror(errno));
-
     // check for end of file
     // But return -1 if we have not mmaped before: it might be a pipe, not
     // true EOF.
     if (_mmap_off >= statbuf.st_size)
 	return (_mmap_off == 0 ? -1 : 0);
 
-    // actually mmap
     _len = _mmap_unit;
     if ((off_t)(_mmap_off + _len) > statbuf.st_size)
 	_len = statbuf.st_size - _mmap_off;
 
+    // use the file mapping, unless the file grew beyond it
+    if (_mapping && (off_t)(_mmap_off + _len) <= (off_t) _mapping->size) {
+	_mapping->refcount++;
+	_data_packet = Packet::make(_mapping->data + _mmap_off, _len, mapping_destructor, _mapping);
+	if (!_data_packet) {
+	    _mapping->refcount--;
+	    return error(errh, strerror(ENOMEM));
+	}
+	_buffer = _data_packet->data();
+	_file_offset = _mmap_off;
+	_mmap_off += _len;
+	return 1;
+    } else if (_mapping) {
+	release_mapping();
+	size_t page_size = getpagesize();
+	_mmap_unit = (WANT_MMAP_UNIT / page_size) * page_size;
+    }
+
+    // actually mmap
     void *mmap_data = mmap(0, _len, PROT_READ, MAP_SHARED, _fd, _mmap_off);
 
     if (mmap_data == MAP_FAILED)
@@ -488,6 +559,9 @@ FromFile::take_state(FromFile &o, ErrorHandler *errh)
     _mmap = o._mmap;
     _mmap_unit = o._mmap_unit;
     _mmap_off = o._mmap_off;
+    release_mapping();
+    _mapping = o._mapping;
+    o._mapping = 0;
 #else
     (void) errh;
 #endif
@@ -513,6 +587,9 @@ FromFile::cleanup()
 	_data_packet->kill();
     _data_packet = 0;
 #endif
+#ifdef ALLOW_MMAP
+    release_mapping();
+#endif
 }
 
 const uint8_t *
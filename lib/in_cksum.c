@@ -16,38 +16,213 @@
 # include <string.h>
 #endif
 
+#if CLICK_USERLEVEL && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <immintrin.h>
+# define CLICK_CKSUM_X86 1
+#elif CLICK_USERLEVEL && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define CLICK_CKSUM_NEON 1
+#endif
+
 #if !CLICK_LINUXMODULE
-uint16_t
-click_in_cksum(const unsigned char *addr, int len)
+/*
+ * The Internet checksum is the one's-complement sum of the data's 16-bit
+ * words. One's-complement addition is commutative and 2^16 == 1 modulo
+ * 0xFFFF, so we may add larger words (32 bits here) in a wide accumulator
+ * and fold the carries back at the end. The word byte order does not
+ * matter either, as long as the result is stored in the same order.
+ * The *_partial() functions return such an unfolded sum.
+ */
+
+static inline uint64_t
+in_cksum_scalar_partial(const unsigned char *addr, int len)
 {
-    int nleft = len;
-    const uint16_t *w = (const uint16_t *)addr;
-    uint32_t sum = 0;
-    uint16_t answer = 0;
-
-    /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
-     */
-    while (nleft > 1)  {
-	sum += *w++;
-	nleft -= 2;
+    uint64_t sum = 0;
+    uint32_t w;
+    uint16_t hw;
+
+    while (len >= 16) {
+	uint32_t w0, w1, w2, w3;
+	memcpy(&w0, addr, 4);
+	memcpy(&w1, addr + 4, 4);
+	memcpy(&w2, addr + 8, 4);
+	memcpy(&w3, addr + 12, 4);
+	sum += (uint64_t) w0 + w1 + w2 + w3;
+	addr += 16;
+	len -= 16;
+    }
+    while (len >= 4) {
+	memcpy(&w, addr, 4);
+	sum += w;
+	addr += 4;
+	len -= 4;
+    }
+    if (len >= 2) {
+	memcpy(&hw, addr, 2);
+	sum += hw;
+	addr += 2;
+	len -= 2;
     }
 
     /* mop up an odd byte, if necessary */
-    if (nleft == 1) {
-	*(unsigned char *)(&answer) = *(const unsigned char *)w ;
-	sum += answer;
+    if (len == 1) {
+	hw = 0;
+	*(unsigned char *)(&hw) = *addr;
+	sum += hw;
+    }
+    return sum;
+}
+
+static inline uint16_t
+in_cksum_fold(uint64_t sum)
+{
+    /* add back carry outs until the sum fits in 16 bits */
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum & 0xFFFF;
+}
+
+/* Below this length the scalar loop beats the vector setup. */
+#define IN_CKSUM_VECTOR_MIN	64
+
+# if CLICK_CKSUM_X86
+__attribute__((target("sse2"))) static uint64_t
+in_cksum_sse2_partial(const unsigned char *addr, int len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+    uint64_t lanes[2];
+
+    /* zero-extend 32-bit words to 64-bit lanes, which cannot overflow */
+    for (; len >= 32; addr += 32, len -= 32) {
+	__m128i v0 = _mm_loadu_si128((const __m128i *) addr);
+	__m128i v1 = _mm_loadu_si128((const __m128i *) (addr + 16));
+	acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+	acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+	acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+	acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
     }
+    _mm_storeu_si128((__m128i *) lanes, _mm_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + in_cksum_scalar_partial(addr, len);
+}
+
+__attribute__((target("avx2"))) static uint64_t
+in_cksum_avx2_partial(const unsigned char *addr, int len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero;
+    uint64_t lanes[4];
+
+    for (; len >= 64; addr += 64, len -= 64) {
+	__m256i v0 = _mm256_loadu_si256((const __m256i *) addr);
+	__m256i v1 = _mm256_loadu_si256((const __m256i *) (addr + 32));
+	acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+	acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+	acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+	acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    }
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+	+ in_cksum_scalar_partial(addr, len);
+}
 
-    /* add back carry outs from top 16 bits to low 16 bits */
-    sum = (sum & 0xffff) + (sum >> 16);
-    sum += (sum >> 16);
-    /* guaranteed now that the lower 16 bits of sum are correct */
+typedef uint64_t (*in_cksum_partial_t)(const unsigned char *, int);
 
-    answer = ~sum;              /* truncate to 16 bits */
-    return answer;
+static uint64_t in_cksum_resolve_partial(const unsigned char *, int);
+static in_cksum_partial_t in_cksum_vector_partial = in_cksum_resolve_partial;
+
+/* Pick the best kernel for this CPU on first use. Racing threads all
+   store the same pointer. */
+static uint64_t
+in_cksum_resolve_partial(const unsigned char *addr, int len)
+{
+    in_cksum_partial_t f = in_cksum_scalar_partial;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	f = in_cksum_avx2_partial;
+    else if (__builtin_cpu_supports("sse2"))
+	f = in_cksum_sse2_partial;
+    in_cksum_vector_partial = f;
+    return f(addr, len);
+}
+# elif CLICK_CKSUM_NEON
+static uint64_t
+in_cksum_vector_partial(const unsigned char *addr, int len)
+{
+    uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+
+    /* pairwise add 32-bit words into 64-bit lanes */
+    for (; len >= 32; addr += 32, len -= 32) {
+	acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(addr)));
+	acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(addr + 16)));
+    }
+    acc0 = vaddq_u64(acc0, acc1);
+    return vgetq_lane_u64(acc0, 0) + vgetq_lane_u64(acc0, 1)
+	+ in_cksum_scalar_partial(addr, len);
+}
+# else
+#  define in_cksum_vector_partial in_cksum_scalar_partial
+# endif
+
+uint16_t
+click_in_cksum(const unsigned char *addr, int len)
+{
+    if (len < IN_CKSUM_VECTOR_MIN)
+	return in_cksum_fold(in_cksum_scalar_partial(addr, len));
+    return in_cksum_fold(in_cksum_vector_partial(addr, len));
+}
+
+const char *
+click_in_cksum_kernel(int kernel, const unsigned char *x, int len, uint16_t *csum)
+{
+    switch (kernel) {
+    case 0:
+	*csum = in_cksum_fold(in_cksum_scalar_partial(x, len));
+	return "scalar";
+# if CLICK_CKSUM_X86
+    case 1:
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("sse2"))
+	    return 0;
+	*csum = in_cksum_fold(in_cksum_sse2_partial(x, len));
+	return "sse2";
+    case 2:
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2"))
+	    return 0;
+	*csum = in_cksum_fold(in_cksum_avx2_partial(x, len));
+	return "avx2";
+# elif CLICK_CKSUM_NEON
+    case 1:
+	*csum = in_cksum_fold(in_cksum_vector_partial(x, len));
+	return "neon";
+# endif
+    default:
+	return 0;
+    }
+}
+
+void
+click_in_cksum_multi(const unsigned char * const *addrs, const int *lens,
+		     uint16_t *csums, int n)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+	const unsigned char *addr = addrs[i];
+	int len = lens[i];
+	if (len == 20) {
+	    /* option-less IP header: five 32-bit words */
+	    uint32_t w[5];
+	    memcpy(w, addr, 20);
+	    csums[i] = in_cksum_fold((uint64_t) w[0] + w[1] + w[2] + w[3] + w[4]);
+	} else if (len < IN_CKSUM_VECTOR_MIN)
+	    csums[i] = in_cksum_fold(in_cksum_scalar_partial(addr, len));
+	else
+	    csums[i] = in_cksum_fold(in_cksum_vector_partial(addr, len));
+    }
 }
 
 uint16_t
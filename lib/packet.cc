@@ -38,6 +38,13 @@
 # include <rte_lcore.h>
 # include <rte_mempool.h>
 #endif
+#if CLICK_PACKET_ARENA
+# include <sys/mman.h>
+#endif
+#if CLICK_PACKET_POOL_NUMA
+# include <sched.h>
+# include <numa.h>
+#endif
 CLICK_DECLS
 
 /** @file packet.hh
@@ -271,7 +278,11 @@ typedef MPMCRing<WritablePacket*,CLICK_GLOBAL_PACKET_DATA_POOL_COUNT> BatchPDRin
 struct GlobalPacketPool {
     BatchPRing pbatch;     // batches of free packets, linked by p->prev()
                                 //   p->anno_u32(0) is # packets in batch
+#if CLICK_PACKET_POOL_NUMA
+    BatchPDRing pdbatch[CLICK_PACKET_POOL_NUMA_NODES]; // batches of packet with data buffers, per NUMA node
+#else
     BatchPDRing pdbatch;        // batches of packet with data buffers
+#endif
 
     PacketPool* thread_pools;   // all thread packet pools
 
@@ -293,6 +304,387 @@ static CLICK_ALWAYS_INLINE inline PacketPool& local_packet_pool() {
 #  endif
 }
 
+#  if HAVE_MULTITHREAD
+/** @brief Return the global ring of data buffers @a packet_pool exchanges
+    batches with. */
+static CLICK_ALWAYS_INLINE inline BatchPDRing& global_data_ring(PacketPool &packet_pool) {
+#   if CLICK_PACKET_POOL_NUMA
+    return global_packet_pool.pdbatch[packet_pool.node];
+#   else
+    (void) packet_pool;
+    return global_packet_pool.pdbatch;
+#   endif
+}
+#  endif
+
+#  if CLICK_PACKET_ARENA
+// ** Packet arena **
+
+// Data buffers can be carved out of one region of virtual memory per NUMA
+// node. All regions are reserved at once, contiguous, and bound to their
+// node, so the node of a buffer is known from its address. Regions are mapped
+// page by page as they fill up, with explicit hugepages of 2MB or 1GB when
+// asked to and available, or else with pages eligible for transparent
+// hugepages. Buffers never go back to the system: each thread keeps a free
+// list of buffers of its node, refilled from and drained to the free list of
+// the region in bulk.
+
+#   define CLICK_PACKET_ARENA_REGION_SHIFT	32	// 4GB of buffers per node
+#   define CLICK_PACKET_ARENA_REFILL	64	// buffers moved at once from/to threads
+#   define CLICK_PACKET_NUMA_RETURN_BATCH	256	// buffers sent home at once
+#   if CLICK_PACKET_POOL_NUMA
+#    define CLICK_PACKET_ARENA_NODES	CLICK_PACKET_POOL_NUMA_NODES
+#   else
+#    define CLICK_PACKET_ARENA_NODES	1
+#   endif
+#   ifndef PACKET_ARENA_PAGE_SIZE
+#    define PACKET_ARENA_PAGE_SIZE	0
+#   endif
+
+struct PacketArena {
+    int nnodes;
+    bool enabled;
+    bool initialized;
+    uint32_t page_size;         // explicit hugepage size, or 0
+    struct Node {
+        volatile uint32_t lock;
+        size_t used;            // bytes carved out of the region
+        size_t mapped;          // bytes mapped in the region
+        uint32_t pages;         // # pages mapped
+        uint32_t hugepages;     // # of which are explicit hugepages
+        bool no_hugepages;      // explicit hugepages ran out on this node
+        uint64_t nfree;         // # buffers in `free` list
+        unsigned char *free;    // freed buffers, linked by their first word
+    } node[CLICK_PACKET_ARENA_NODES];
+};
+static PacketArena arena = {
+    0,
+#   if HAVE_PACKET_ARENA || CLICK_PACKET_POOL_NUMA
+    true,
+#   else
+    false,
+#   endif
+    false, PACKET_ARENA_PAGE_SIZE, {}
+};
+unsigned char *WritablePacket::arena_begin = 0;
+unsigned char *WritablePacket::arena_end = 0;
+
+static inline void
+arena_lock(PacketArena::Node &an)
+{
+    while (atomic_uint32_t::swap(an.lock, 1) == 1)
+        click_relax_fence();
+}
+
+static inline void
+arena_unlock(PacketArena::Node &an)
+{
+    click_compiler_fence();
+    an.lock = 0;
+}
+
+/** @brief Return the number of nodes with their own region. */
+static int
+arena_node_count()
+{
+    int nnodes = 1;
+#   if CLICK_PACKET_POOL_NUMA
+    if (numa_available() >= 0)
+        nnodes = numa_max_node() + 1;
+    // Threads of nodes beyond the limit share the last node's region
+    if (nnodes > CLICK_PACKET_ARENA_NODES)
+        nnodes = CLICK_PACKET_ARENA_NODES;
+#   endif
+    return nnodes;
+}
+
+/** @brief Reserve the regions of the arena.
+    @pre the global packet pool lock is held */
+static void
+initialize_arena()
+{
+    arena.initialized = true;
+    if (!arena.enabled)
+        return;
+    size_t size = (size_t) arena.nnodes << CLICK_PACKET_ARENA_REGION_SHIFT;
+    size_t align = 1 << 30;
+    void *m = mmap(0, size + align, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED) {
+        click_chatter("Could not reserve the packet arena, using the heap");
+        return;
+    }
+    unsigned char *begin = (unsigned char *) (((uintptr_t) m + align - 1) & ~(align - 1));
+    WritablePacket::arena_end = begin + size;
+    click_compiler_fence();
+    WritablePacket::arena_begin = begin;
+}
+
+/** @brief Map one more page at the end of the region of @a node.
+    @pre the lock of @a node is held
+    @return false if the region is full or the page cannot be mapped */
+static bool
+arena_map_page(int node)
+{
+    PacketArena::Node &an = arena.node[node];
+    uint32_t huge = an.no_hugepages ? 0 : arena.page_size;
+    size_t page = huge ? huge : (2 << 20);
+    if (an.mapped + page > ((size_t) 1 << CLICK_PACKET_ARENA_REGION_SHIFT))
+        return false;
+    unsigned char *addr = WritablePacket::arena_begin
+        + ((size_t) node << CLICK_PACKET_ARENA_REGION_SHIFT) + an.mapped;
+    void *m = MAP_FAILED;
+#   ifdef MAP_HUGETLB
+    if (huge) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB;
+#    ifdef MAP_HUGE_SHIFT
+        flags |= (huge == (1U << 30) ? 30 : 21) << MAP_HUGE_SHIFT;
+#    endif
+        m = mmap(addr, page, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (m == MAP_FAILED) {
+            click_chatter("No %uMB hugepages left for the packet arena on node %d, using transparent hugepages",
+                          huge >> 20, node);
+            an.no_hugepages = true;
+            page = 2 << 20;
+            if (an.mapped + page > ((size_t) 1 << CLICK_PACKET_ARENA_REGION_SHIFT))
+                return false;
+        } else
+            an.hugepages++;
+    }
+#   endif
+    if (m == MAP_FAILED) {
+        m = mmap(addr, page, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (m == MAP_FAILED)
+            return false;
+#   ifdef MADV_HUGEPAGE
+        madvise(addr, page, MADV_HUGEPAGE);
+#   endif
+    }
+#   if CLICK_PACKET_POOL_NUMA
+    if (arena.nnodes > 1)
+        numa_tonode_memory(addr, page, node);
+#   endif
+    an.mapped += page;
+    an.pages++;
+    return true;
+}
+
+static inline int
+arena_buffer_node(const unsigned char *head)
+{
+    if (!WritablePacket::is_arena_buffer(head))
+        return -1;
+    return (head - WritablePacket::arena_begin) >> CLICK_PACKET_ARENA_REGION_SHIFT;
+}
+
+/** @brief Move up to CLICK_PACKET_ARENA_REFILL buffers of the region of the
+    node of @a pp to its free list.
+    @pre @a pp's free list is empty */
+static void
+arena_refill(PacketPool &pp)
+{
+    PacketArena::Node &an = arena.node[pp.node];
+    unsigned n = 0;
+    arena_lock(an);
+    while (an.free && n < CLICK_PACKET_ARENA_REFILL) {
+        unsigned char *head = an.free;
+        an.free = *reinterpret_cast<unsigned char **>(head);
+        *reinterpret_cast<unsigned char **>(head) = pp.ab;
+        pp.ab = head;
+        ++n;
+    }
+    an.nfree -= n;
+    while (n < CLICK_PACKET_ARENA_REFILL) {
+        if (an.used + CLICK_PACKET_POOL_BUFSIZ > an.mapped
+            && !arena_map_page(pp.node))
+            break;
+        unsigned char *head = WritablePacket::arena_begin
+            + ((size_t) pp.node << CLICK_PACKET_ARENA_REGION_SHIFT) + an.used;
+        an.used += CLICK_PACKET_POOL_BUFSIZ;
+        *reinterpret_cast<unsigned char **>(head) = pp.ab;
+        pp.ab = head;
+        ++n;
+    }
+    arena_unlock(an);
+    pp.abcount = n;
+}
+
+/** @brief Give up to @a n buffers of @a pp's free list back to the region of
+    its node. */
+static void
+arena_drain(PacketPool &pp, unsigned n)
+{
+    if (!pp.ab)
+        return;
+    unsigned char *head = pp.ab, *tail = head;
+    unsigned count = 1;
+    for (; count < n; ++count) {
+        unsigned char *next = *reinterpret_cast<unsigned char **>(tail);
+        if (!next)
+            break;
+        tail = next;
+    }
+    pp.ab = *reinterpret_cast<unsigned char **>(tail);
+    pp.abcount -= count;
+    PacketArena::Node &an = arena.node[pp.node];
+    arena_lock(an);
+    *reinterpret_cast<unsigned char **>(tail) = an.free;
+    an.free = head;
+    an.nfree += count;
+    arena_unlock(an);
+}
+
+/** @brief Allocate a pool data buffer from the arena, on the NUMA node of
+    this thread.
+    @return the buffer, or null if the arena is disabled or exhausted */
+unsigned char *
+WritablePacket::alloc_arena_buffer()
+{
+    PacketPool *pp = thread_packet_pool;
+    if (unlikely(!pp))
+        return 0;
+    if (unlikely(!pp->ab)) {
+        if (!arena_begin) {
+            if (arena.initialized)
+                return 0;
+            while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+                click_relax_fence();
+            if (!arena.initialized)
+                initialize_arena();
+            click_compiler_fence();
+            global_packet_pool.lock = 0;
+            if (!arena_begin)
+                return 0;
+        }
+#   if HAVE_DPDK
+        if (dpdk_enabled)
+            return 0;
+#   endif
+        arena_refill(*pp);
+        if (!pp->ab)
+            return 0;
+    }
+    unsigned char *head = pp->ab;
+    pp->ab = *reinterpret_cast<unsigned char **>(head);
+    --pp->abcount;
+    return head;
+}
+
+/** @brief Give @a head back to the free list of this thread if it belongs to
+    its node, or else to the free list of its region. */
+void
+WritablePacket::free_arena_buffer(unsigned char *head)
+{
+    int node = arena_buffer_node(head);
+    PacketPool *pp = thread_packet_pool;
+    if (likely(pp && pp->node == node)) {
+        *reinterpret_cast<unsigned char **>(head) = pp->ab;
+        pp->ab = head;
+        if (unlikely(++pp->abcount > 2 * CLICK_PACKET_ARENA_REFILL))
+            arena_drain(*pp, CLICK_PACKET_ARENA_REFILL);
+        return;
+    }
+    PacketArena::Node &an = arena.node[node];
+    arena_lock(an);
+    *reinterpret_cast<unsigned char **>(head) = an.free;
+    an.free = head;
+    ++an.nfree;
+    arena_unlock(an);
+}
+
+/** @brief Enable or disable the arena, and set the size of its pages.
+    @param enable whether pool data buffers come from the arena
+    @param page_size size of the explicit hugepages backing the arena, 2MB
+    or 1GB, or 0 to use transparent hugepages
+    @return 0 on success, or -1 if the arena is already in use with other
+    settings */
+int
+WritablePacket::pool_arena_configure(bool enable, uint32_t page_size)
+{
+    int r = 0;
+    while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
+        click_relax_fence();
+    if (!arena.initialized) {
+        arena.enabled = enable;
+        arena.page_size = page_size;
+    } else if (arena.enabled != enable
+               || (enable && arena.page_size != page_size && arena.node[0].pages))
+        r = -1;
+    else
+        arena.page_size = page_size;
+    click_compiler_fence();
+    global_packet_pool.lock = 0;
+    return r;
+}
+
+bool
+WritablePacket::pool_arena_enabled()
+{
+    return arena.enabled && (!arena.initialized || arena_begin);
+}
+
+uint32_t
+WritablePacket::pool_arena_page_size()
+{
+    return arena.page_size;
+}
+
+int
+WritablePacket::pool_arena_nodes()
+{
+    return arena.nnodes;
+}
+
+void
+WritablePacket::pool_arena_stats(int node, PoolArenaStats &stats)
+{
+    PacketArena::Node &an = arena.node[node];
+    stats.buffer_size = CLICK_PACKET_POOL_BUFSIZ;
+    arena_lock(an);
+    stats.pages = an.pages;
+    stats.hugepages = an.hugepages;
+    stats.mapped_bytes = an.mapped;
+    stats.buffers = an.used / CLICK_PACKET_POOL_BUFSIZ;
+    stats.free_buffers = an.nfree;
+    arena_unlock(an);
+    stats.cached_buffers = 0;
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp; pp = pp->thread_pool_next)
+        if (pp->node == node)
+            stats.cached_buffers += pp->abcount;
+}
+
+void
+WritablePacket::pool_numa_stats(int node, PoolNumaStats &stats)
+{
+    stats.local_recycled = stats.remote_recycled = 0;
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp; pp = pp->thread_pool_next)
+        if (pp->node == node) {
+            stats.local_recycled += pp->local_recycled;
+            stats.remote_recycled += pp->remote_recycled;
+        }
+}
+
+void
+WritablePacket::pool_numa_clear_stats()
+{
+    for (PacketPool *pp = global_packet_pool.thread_pools; pp; pp = pp->thread_pool_next)
+        pp->local_recycled = pp->remote_recycled = 0;
+}
+#  endif /* CLICK_PACKET_ARENA */
+
+/** @brief Free the data buffer of a packet leaving the pools. */
+static inline void
+free_pool_buffer(unsigned char *head)
+{
+#  if CLICK_PACKET_ARENA
+    if (WritablePacket::is_arena_buffer(head))
+        WritablePacket::free_arena_buffer(head);
+    else
+#  endif
+        ::operator delete[](head);
+}
+
 /** @brief Create and return a local packet pool for this thread. */
 void WritablePacket::initialize_local_packet_pool() {
 #  if HAVE_MULTITHREAD
@@ -301,12 +693,30 @@ void WritablePacket::initialize_local_packet_pool() {
         pp = new PacketPool();
         while (atomic_uint32_t::swap(global_packet_pool.lock, 1) == 1)
             /* do nothing */;
+#   if CLICK_PACKET_ARENA
+        if (!arena.nnodes)
+            arena.nnodes = arena_node_count();
+#   endif
         pp->thread_pool_next = global_packet_pool.thread_pools;
         global_packet_pool.thread_pools = pp;
         thread_packet_pool = pp;
         click_compiler_fence();
         global_packet_pool.lock = 0;
     }
+#   if CLICK_PACKET_POOL_NUMA
+    // The thread may have been pinned since its pool was created
+    int cpu = sched_getcpu();
+    int node = cpu >= 0 && numa_available() >= 0 ? numa_node_of_cpu(cpu) : 0;
+    if (node < 0)
+        node = 0;
+    else if (node >= arena.nnodes)
+        node = arena.nnodes - 1;
+    if (node != pp->node) {
+        // Its free buffers belong to its former node
+        arena_drain(*pp, pp->abcount);
+        pp->node = node;
+    }
+#   endif
 #  endif
 }
 
@@ -428,7 +838,7 @@ WritablePacket::pool_data_allocate()
 #else
 #  if HAVE_MULTITHREAD
     if (unlikely(!packet_pool.pd)) {
-        WritablePacket *pd = global_packet_pool.pdbatch.extract();
+        WritablePacket *pd = global_data_ring(packet_pool).extract();
         if (pd) {
             packet_pool.pd = pd;
             packet_pool.pdcount = pd->anno_u32(0);
@@ -503,7 +913,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool, unsigned n) {
     if (unlikely(packet_pool.pd.count() + n >= CLICK_PACKET_DATA_POOL_SIZE)) {
         WritablePacket** ps = new WritablePacket*[CLICK_PACKET_POOL_SIZE / 2];
         memcpy(ps, packet_pool.pd.extract_burst(CLICK_PACKET_POOL_SIZE / 2), sizeof(WritablePacket*) * CLICK_PACKET_POOL_SIZE / 2);
-        global_packet_pool.pdbatch.insert(ps);
+        global_data_ring(packet_pool).insert(ps);
     }
 }
 #else
@@ -536,7 +946,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool, unsigned n) {
 #  if HAVE_MULTITHREAD
     if (unlikely(packet_pool.pd && packet_pool.pdcount + n > CLICK_PACKET_DATA_POOL_SIZE)) {
         packet_pool.pd->set_anno_u32(0, packet_pool.pdcount);
-        if (!global_packet_pool.pdbatch.insert(packet_pool.pd)) {
+        if (!global_data_ring(packet_pool).insert(packet_pool.pd)) {
             while (WritablePacket *pd = packet_pool.pd) {
                 packet_pool.pd = static_cast<WritablePacket *>(pd->next());
 #if HAVE_DPDK_PACKET_POOL
@@ -548,7 +958,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool, unsigned n) {
                 else
 # endif
                 {
-                    ::operator delete[]((unsigned char *) pd->buffer());
+                    free_pool_buffer(pd->buffer());
                 }
 #endif
                 ::operator delete((void *) pd);
@@ -598,6 +1008,63 @@ inline bool WritablePacket::is_from_data_pool(WritablePacket *p) {
 
 }
 
+#if CLICK_PACKET_POOL_NUMA
+/** @brief Give the buffers of @a node kept by @a packet_pool back to the
+    global ring of @a node, in one batch. */
+static void
+flush_remote(PacketPool &packet_pool, int node)
+{
+    WritablePacket *pd = packet_pool.rpd[node];
+    pd->set_anno_u32(0, packet_pool.rpdcount[node]);
+    if (!global_packet_pool.pdbatch[node].insert(pd)) {
+        while (pd) {
+            WritablePacket *next = static_cast<WritablePacket *>(pd->next());
+            WritablePacket::free_arena_buffer(pd->buffer());
+            ::operator delete((void *) pd);
+            pd = next;
+        }
+    }
+    packet_pool.rpd[node] = 0;
+    packet_pool.rpdcount[node] = 0;
+    packet_pool.rpdseen[node] = 0;
+}
+
+/**
+ * Keep @a p, a data packet whose buffer was allocated on @a node, until
+ * enough of them can be given back to the global ring of their node at once.
+ */
+void
+WritablePacket::recycle_remote(PacketPool &packet_pool, WritablePacket *p, int node)
+{
+    ++packet_pool.remote_recycled;
+    p->set_next(packet_pool.rpd[node]);
+    packet_pool.rpd[node] = p;
+    if (++packet_pool.rpdcount[node] == CLICK_PACKET_NUMA_RETURN_BATCH)
+        flush_remote(packet_pool, node);
+}
+
+/**
+ * Give the data buffers of other nodes kept by this thread back to their
+ * node. If @a all is false, only those of the nodes no buffer was kept for
+ * since the last call are given back.
+ *
+ * Called by idle threads, so buffers do not wait for a batch that may never
+ * fill up.
+ */
+void
+WritablePacket::pool_flush_remote(bool all)
+{
+    PacketPool *pp = thread_packet_pool;
+    if (!pp)
+        return;
+    for (int i = 0; i < CLICK_PACKET_POOL_NUMA_NODES; i++)
+        if (pp->rpdcount[i] && (all || pp->rpdcount[i] == pp->rpdseen[i]))
+            flush_remote(*pp, i);
+        else
+            pp->rpdseen[i] = pp->rpdcount[i];
+}
+#endif
+
 /**
  * @Precond _use_count == 1
  */
@@ -608,6 +1075,16 @@ WritablePacket::recycle(WritablePacket *p)
     bool data = is_from_data_pool(p);
 
     if (likely(data)) {
+#if CLICK_PACKET_POOL_NUMA
+        int node = arena_buffer_node(p->buffer());
+        if (unlikely(node != packet_pool.node && node >= 0)) {
+            recycle_remote(packet_pool, p, node);
+            return;
+        }
+#endif
+#if CLICK_PACKET_ARENA
+        ++packet_pool.local_recycled;
+#endif
         check_data_pool_size(packet_pool, 1);
 #if HAVE_VECTOR_PACKET_POOL
         packet_pool.pd.insert(p);
@@ -668,6 +1145,38 @@ WritablePacket::recycle_data_batch(WritablePacket *head, Packet* tail, unsigned
 #if HAVE_VECTOR_PACKET_POOL
     assert(false);
 #else
+# if CLICK_PACKET_POOL_NUMA
+    if (unlikely(arena.nnodes > 1)) {
+        // Send the buffers of other nodes back home, keep the others
+        WritablePacket *local = 0;
+        Packet *local_tail = 0;
+        unsigned nlocal = 0;
+        Packet *next;
+        for (Packet *p = head; p; p = next) {
+            next = p->next();
+            int node = arena_buffer_node(p->buffer());
+            if (unlikely(node != packet_pool.node && node >= 0))
+                recycle_remote(packet_pool, static_cast<WritablePacket *>(p), node);
+            else {
+                if (!local_tail)
+                    local_tail = p;
+                p->set_next(local);
+                local = static_cast<WritablePacket *>(p);
+                ++nlocal;
+            }
+            if (p == tail)
+                break;
+        }
+        if (!local)
+            return;
+        head = local;
+        tail = local_tail;
+        count = nlocal;
+    }
+# endif
+# if CLICK_PACKET_ARENA
+    packet_pool.local_recycled += count;
+# endif
     check_data_pool_size(packet_pool, count);
     packet_pool.pdcount += count;
     tail->set_next(packet_pool.pd);
@@ -706,6 +1215,10 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
         click_chatter("Warning : buffer of size %d bigger than DPDK buffer size", n);
 # endif
     }
+# if CLICK_PACKET_ARENA
+    if (n == CLICK_PACKET_POOL_BUFSIZ)
+        d = WritablePacket::alloc_arena_buffer();
+# endif
     if (!d) {
 # if HAVE_DPDK
       if (dpdk_enabled)
@@ -1407,10 +1920,21 @@ cleanup_pool(PacketPool *pp, int global)
         rte_free(reinterpret_cast<unsigned char *>(pd->buffer()));
     else
 #  endif
-        delete[] reinterpret_cast<unsigned char *>(pd->buffer());
+        free_pool_buffer(pd->buffer());
 # endif
     ::operator delete((void *) pd);
     }
+# if CLICK_PACKET_POOL_NUMA
+    for (int i = 0; i < CLICK_PACKET_POOL_NUMA_NODES; i++)
+        while (WritablePacket *pd = pp->rpd[i]) {
+            pp->rpd[i] = static_cast<WritablePacket *>(pd->next());
+            WritablePacket::free_arena_buffer(pd->buffer());
+            ::operator delete((void *) pd);
+        }
+# endif
+# if CLICK_PACKET_ARENA
+    arena_drain(*pp, pp->abcount);
+# endif
 # if !HAVE_BATCH_RECYCLE
     assert(pcount <= CLICK_PACKET_POOL_SIZE);
     assert(pdcount <= CLICK_PACKET_DATA_POOL_SIZE);
@@ -1435,6 +1959,10 @@ Packet::static_cleanup()
 {
 #if HAVE_CLICK_PACKET_POOL
 	# if HAVE_MULTITHREAD
+    #  if CLICK_PACKET_ARENA
+		// Freed arena buffers must not go to the pools being deleted
+		thread_packet_pool = 0;
+    #  endif
 		while (PacketPool* pp = global_packet_pool.thread_pools) {
 		global_packet_pool.thread_pools = pp->thread_pool_next;
 		cleanup_pool(pp, 0);
@@ -1445,7 +1973,11 @@ Packet::static_cleanup()
 		PacketPool fake_pool;
 		do {
 			fake_pool.p = global_packet_pool.pbatch.extract();
-			fake_pool.pd = global_packet_pool.pdbatch.extract();
+			fake_pool.pd = global_data_ring(fake_pool).extract();
+#  if CLICK_PACKET_POOL_NUMA
+			for (int i = 1; i < CLICK_PACKET_POOL_NUMA_NODES && !fake_pool.pd; i++)
+				fake_pool.pd = global_packet_pool.pdbatch[i].extract();
+#  endif
 			if (!fake_pool.p && !fake_pool.pd) break;
 			cleanup_pool(&fake_pool, 1);
 		} while(true);
@@ -107,6 +107,33 @@ PacketBatch::make_batch(unsigned char *data, uint16_t count, uint16_t *length,
 #endif
 }
 
+#if !CLICK_LINUXMODULE
+void
+PacketBatch::set_ip_checksums()
+{
+    enum { CHUNK = 64 };
+    click_ip *iphs[CHUNK];
+    const unsigned char *addrs[CHUNK];
+    int lens[CHUNK];
+    uint16_t csums[CHUNK];
+    Packet *p = first();
+    while (p) {
+        int n = 0;
+        for (; p && n < CHUNK; p = p->next(), ++n) {
+            WritablePacket *q = static_cast<WritablePacket *>(p);
+            click_ip *iph = reinterpret_cast<click_ip *>(q->has_network_header() ? q->network_header() : q->data());
+            iph->ip_sum = 0;
+            iphs[n] = iph;
+            addrs[n] = reinterpret_cast<const unsigned char *>(iph);
+            lens[n] = iph->ip_hl << 2;
+        }
+        click_in_cksum_multi(addrs, lens, csums, n);
+        for (int i = 0; i < n; ++i)
+            iphs[i]->ip_sum = csums[i];
+    }
+}
+#endif
+
 #endif //HAVE_BATCH
 
 CLICK_ENDDECLS
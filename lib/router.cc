@@ -2463,7 +2463,8 @@ Router::configuration_string() const
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_LOAD, GH_LOAD_CYCLES, GH_USEFUL_CYCLES, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES, GH_SELECT_WAKEUPS,
+       GH_POLL_THRESHOLD, GH_POLL_MAX_SLEEP, GH_POLL_SLEEPS, GH_POLL_WAKEUP_LATENCY };
 
 #if CLICK_STATS >= 2
 struct stats_info {
@@ -2505,6 +2506,80 @@ Router::router_handler(int operation, String &data, Element *e,
         }
         break;
         }
+#endif
+#if CLICK_USERLEVEL
+      case GH_SELECT_WAKEUPS: {
+        int index;
+        IntArg arg;
+        if (data && arg.parse(data, index, errh)) {
+            sa << r->master()->thread(index)->select_set().wakeups();
+        } else {
+            int n = r->master()->nthreads();
+            for (int i = 0; i < n; i++) {
+                sa << r->master()->thread(i)->select_set().wakeups();
+                if (i < n - 1)
+                    sa << " ";
+            }
+        }
+        break;
+      }
+      case GH_POLL_THRESHOLD:
+      case GH_POLL_MAX_SLEEP:
+      case GH_POLL_SLEEPS:
+      case GH_POLL_WAKEUP_LATENCY: {
+        Master *m = r->master();
+        int index = -1, n = m->nthreads();
+        String arg = data;
+        if (operation == Handler::f_write) {
+            // "VALUE" sets all threads, "THREAD VALUE" a single one
+            String word = cp_shift_spacevec(arg);
+            if (arg) {
+                if (!IntArg().parse(word, index) || index < 0 || index >= n)
+                    return errh->error("bad thread %<%s%>", word.c_str());
+            } else
+                arg = word;
+            unsigned threshold = 0;
+            Timestamp max_sleep;
+            bool ok;
+            if (opt == GH_POLL_THRESHOLD)
+                ok = IntArg().parse(arg, threshold);
+            else if (opt == GH_POLL_MAX_SLEEP)
+                ok = cp_time(arg, &max_sleep) && max_sleep > Timestamp();
+            else
+                ok = arg.equals("reset");
+            if (!ok)
+                return errh->error("syntax error");
+            for (int i = (index < 0 ? 0 : index); i < (index < 0 ? n : index + 1); i++) {
+                RouterThread *t = m->thread(i);
+                if (opt == GH_POLL_THRESHOLD)
+                    t->set_poll_threshold(threshold);
+                else if (opt == GH_POLL_MAX_SLEEP)
+                    t->set_poll_max_sleep(max_sleep);
+                else
+                    t->poll_reset_stats();
+            }
+            return 0;
+        }
+        if (arg) {
+            if (!IntArg().parse(arg, index) || index < 0 || index >= n)
+                return errh->error("bad thread %<%s%>", arg.c_str());
+            n = index + 1;
+        }
+        for (int i = (index < 0 ? 0 : index); i < n; i++) {
+            RouterThread *t = m->thread(i);
+            if (opt == GH_POLL_THRESHOLD)
+                sa << t->poll_threshold();
+            else if (opt == GH_POLL_MAX_SLEEP)
+                sa << t->poll_max_sleep();
+            else if (opt == GH_POLL_SLEEPS)
+                sa << t->poll_sleeps();
+            else
+                sa << t->poll_wakeup_latency() << '/' << t->poll_wakeup_latency_max();
+            if (i < n - 1)
+                sa << " ";
+        }
+        break;
+      }
 #endif
         default:
           data = "<error>";
@@ -2742,6 +2817,13 @@ Router::static_initialize()
         set_handler(0, "useful_kcycles", Handler::h_read | Handler::f_read_param, router_handler, (void *)GH_USEFUL_CYCLES, (void *)0);
 #endif
         add_write_handler(0, "stop", router_write_handler, (void *)GH_STOP);
+#if CLICK_USERLEVEL
+        set_handler(0, "select_wakeups", Handler::h_read | Handler::f_read_param, router_handler, (void *)GH_SELECT_WAKEUPS, (void *)0);
+        set_handler(0, "poll_threshold", Handler::h_read | Handler::f_read_param | Handler::h_write, router_handler, (void *)GH_POLL_THRESHOLD, (void *)GH_POLL_THRESHOLD);
+        set_handler(0, "poll_max_sleep", Handler::h_read | Handler::f_read_param | Handler::h_write, router_handler, (void *)GH_POLL_MAX_SLEEP, (void *)GH_POLL_MAX_SLEEP);
+        set_handler(0, "poll_sleeps", Handler::h_read | Handler::f_read_param, router_handler, (void *)GH_POLL_SLEEPS, (void *)0);
+        set_handler(0, "poll_wakeup_latency", Handler::h_read | Handler::f_read_param | Handler::h_write, router_handler, (void *)GH_POLL_WAKEUP_LATENCY, (void *)GH_POLL_WAKEUP_LATENCY);
+#endif
 #if CLICK_STATS >= 1
         add_read_handler(0, "active_ports", router_read_handler, (void *)GH_ACTIVE_PORTS);
         add_read_handler(0, "active_port_stats", router_read_handler, (void *)GH_ACTIVE_PORT_STATS);
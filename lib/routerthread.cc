@@ -106,6 +106,15 @@ RouterThread::RouterThread(Master *master, int id)
     _iters_per_os = 2;          // userlevel: iterations per select()
                                 // kernel: iterations per OS schedule()
 
+#if CLICK_USERLEVEL
+    _poll_threshold = 0;
+    _poll_empty = 0;
+    _poll_max_sleep = Timestamp::make_msec(1);
+    _poll_sleeping = false;
+    _poll_woken = 0;
+    poll_reset_stats();
+#endif
+
 #if CLICK_LINUXMODULE || CLICK_BSDMODULE
     _greedy = false;
 #endif
@@ -340,8 +349,8 @@ RouterThread::task_reheapify_from(int pos, Task* t)
 }
 #endif
 
-/* Run at most 'ntasks' tasks. */
-inline void
+/* Run at most 'ntasks' tasks. Return true if any of them did work. */
+inline bool
 RouterThread::run_tasks(int ntasks)
 {
     set_thread_state(S_RUNTASK);
@@ -377,6 +386,7 @@ RouterThread::run_tasks(int ntasks)
     int runs;
 #endif
     bool work_done;
+    bool any_work = false;
 
 #if HAVE_CLICK_LOAD
     click_cycles_t useful = 0;
@@ -409,6 +419,7 @@ RouterThread::run_tasks(int ntasks)
 
         t->_status.is_scheduled = false;
         work_done = t->fire();
+        any_work |= work_done;
 
 #if HAVE_CLICK_LOAD
         if (work_done) {
@@ -504,8 +515,84 @@ RouterThread::run_tasks(int ntasks)
 #if HAVE_ADAPTIVE_SCHEDULER
     client_update_pass(C_CLICK, t_before);
 #endif
+    return any_work;
+}
+
+#if CLICK_USERLEVEL
+/* Account for a driver iteration for hybrid polling. */
+inline void
+RouterThread::update_poll_state(bool work_done)
+{
+    if (work_done) {
+        if (_poll_woken) {
+            click_cycles_t latency = click_get_cycles() - _poll_woken;
+            _poll_latency_sum += latency;
+            if (latency > _poll_latency_max)
+                _poll_latency_max = latency;
+            ++_poll_latency_count;
+            _poll_woken = 0;
+        }
+        _poll_empty = 0;
+    } else {
+        // A wakeup without work (timeout, timer) is not a wakeup latency,
+        // and the thread goes back to sleep without polling again
+        _poll_woken = 0;
+        if (_poll_empty < _poll_threshold)
+            ++_poll_empty;
+    }
 }
 
+/* Return how long SelectSet may block, as TimerSet::next_timer_delay():
+   0 not at all, -1 forever, 1 for @a t. An idle hybrid polling thread blocks
+   for at most poll_max_sleep() although tasks are scheduled. */
+int
+RouterThread::select_delay(Timestamp &t)
+{
+    bool more_tasks = active();
+    if (likely(!poll_idle()) || !more_tasks)
+        return _timers.next_timer_delay(more_tasks, t);
+    int delay_type = _timers.next_timer_delay(false, t);
+    if (delay_type < 0 || (delay_type > 0 && t > _poll_max_sleep)) {
+        t = _poll_max_sleep;
+        delay_type = 1;
+    }
+    if (delay_type) {
+        _poll_sleeping = true;
+        ++_poll_sleeps;
+    }
+    return delay_type;
+}
+
+/** @brief Return the average time between the return of a hybrid polling
+ * wait and the first task that did work after it. */
+Timestamp
+RouterThread::poll_wakeup_latency() const
+{
+    if (!_poll_latency_count)
+        return Timestamp();
+    return Timestamp::make_nsec((Timestamp::value_type)
+        ((double) _poll_latency_sum / _poll_latency_count * 1000000000 / cycles_hz()));
+}
+
+/** @brief Return the maximum time between the return of a hybrid polling
+ * wait and the first task that did work after it. */
+Timestamp
+RouterThread::poll_wakeup_latency_max() const
+{
+    return Timestamp::make_nsec((Timestamp::value_type)
+        ((double) _poll_latency_max * 1000000000 / cycles_hz()));
+}
+
+void
+RouterThread::poll_reset_stats()
+{
+    _poll_sleeps = 0;
+    _poll_latency_count = 0;
+    _poll_latency_sum = 0;
+    _poll_latency_max = 0;
+}
+#endif
+
 
 #if HAVE_CLICK_LOAD
 float
@@ -545,7 +632,16 @@ RouterThread::run_os()
 #endif
 
 #if CLICK_USERLEVEL
+# if CLICK_PACKET_POOL_NUMA
+    // Data buffers freed here for other nodes go back home when they stop
+    // coming, or at once when the thread has nothing left to do
+    WritablePacket::pool_flush_remote(!active());
+# endif
     select_set().run_selects(this);
+    if (_poll_sleeping) {
+        _poll_sleeping = false;
+        _poll_woken = click_get_cycles();
+    }
 #elif CLICK_MINIOS
     /*
      * MiniOS uses a cooperative scheduler. By schedule() we'll give a chance
@@ -691,7 +787,13 @@ RouterThread::driver()
             if (PASS_GT(_clients[C_CLICK].pass, _clients[C_KERNEL].pass))
                 break;
 #endif
+#if CLICK_USERLEVEL
+            bool work_done = run_tasks(_tasks_per_iter);
+            if (_poll_threshold)
+                update_poll_state(work_done);
+#else
             run_tasks(_tasks_per_iter);
+#endif
         } while (0);
 
 #if CLICK_USERLEVEL
@@ -715,8 +817,13 @@ RouterThread::driver()
         // run operating system
         do {
 #if !HAVE_ADAPTIVE_SCHEDULER && !BSD_NETISRSCHED
+# if CLICK_USERLEVEL
+            if (iter % _iters_per_os && !poll_idle())
+                break;
+# else
             if (iter % _iters_per_os)
                 break;
+# endif
 #elif HAVE_ADAPTIVE_SCHEDULER
             if (!PASS_GT(_clients[C_CLICK].pass, _clients[C_KERNEL].pass))
                 break;
@@ -33,6 +33,9 @@
 #  define EV_SET_UDATA_CAST	/* nothing */
 # endif
 #endif
+#if HAVE_ALLOW_EPOLL
+# include <sys/epoll.h>
+#endif
 CLICK_DECLS
 
 namespace {
@@ -46,6 +49,7 @@ SelectSet::SelectSet()
 {
     _wake_pipe_pending = false;
     _wake_pipe[0] = _wake_pipe[1] = -1;
+    _wakeups = 0;
 
 #if HAVE_ALLOW_KQUEUE
 # if defined(__APPLE__) && (HAVE_ALLOW_SELECT || HAVE_ALLOW_POLL)
@@ -58,6 +62,10 @@ SelectSet::SelectSet()
 # endif
 #endif
 
+#if HAVE_ALLOW_EPOLL
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
 #if !HAVE_ALLOW_POLL
     FD_ZERO(&_read_select_fd_set);
     FD_ZERO(&_write_select_fd_set);
@@ -85,6 +93,10 @@ SelectSet::~SelectSet()
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0)
 	close(_kqueue);
+#endif
+#if HAVE_ALLOW_EPOLL
+    if (_epoll >= 0)
+	close(_epoll);
 #endif
     if (_wake_pipe[0] >= 0) {
 	close(_wake_pipe[0]);
@@ -138,6 +150,9 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
 	_pollfds.back().events = 0;
     }
     int pi = _selinfo[fd].pollfd;
+#if HAVE_ALLOW_EPOLL
+    int old_events = _pollfds[pi].events;
+#endif
 
     // add the elements
     if (add_read)
@@ -145,6 +160,11 @@ SelectSet::register_select(int fd, bool add_read, bool add_write)
     if (add_write)
 	_pollfds[pi].events |= POLLOUT;
 
+#if HAVE_ALLOW_EPOLL
+    if (_epoll >= 0)
+	update_epoll(fd, old_events);
+#endif
+
 #if HAVE_ALLOW_KQUEUE
     if (_kqueue >= 0) {
 	// Add events to the kqueue
@@ -252,6 +272,9 @@ SelectSet::remove_pollfd(int pi, int event)
 
     // remove event
     int fd = _pollfds[pi].fd;
+#if HAVE_ALLOW_EPOLL
+    int old_events = _pollfds[pi].events;
+#endif
     _pollfds[pi].events &= ~event;
     if (event == POLLIN)
 	_selinfo[fd].read = 0;
@@ -268,6 +291,10 @@ SelectSet::remove_pollfd(int pi, int event)
 	    click_chatter("SelectSet::remove_pollfd(fd %d): kevent: %s", _pollfds[pi].fd, strerror(errno));
     }
 #endif
+#if HAVE_ALLOW_EPOLL
+    if (_epoll >= 0)
+	update_epoll(fd, old_events);
+#endif
 #if !HAVE_ALLOW_POLL
     // remove event from select list
     if (fd < FD_SETSIZE) {
@@ -353,7 +380,7 @@ SelectSet::post_select(RouterThread *thread, bool acquire)
 }
 
 inline void
-SelectSet::call_selected(int fd, int mask) const
+SelectSet::call_selected(int fd, int mask)
 {
     Element *read = 0, *write = 0;
     if ((unsigned) fd < (unsigned) _selinfo.size()) {
@@ -363,6 +390,8 @@ SelectSet::call_selected(int fd, int mask) const
 	if (mask & Element::SELECT_WRITE)
 	    write = es.write;
     }
+    if (read || write)
+	++_wakeups;
     if (read)
 	read->selected(fd, write == read ? mask : Element::SELECT_READ);
     if (write && write != read)
@@ -390,7 +419,7 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
     // Decide how long to wait.
     struct timespec wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	wait.tv_sec = wait.tv_nsec = 0;
     else if (delay_type > 0)
@@ -424,6 +453,81 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
 }
 #endif /* HAVE_ALLOW_KQUEUE */
 
+#if HAVE_ALLOW_EPOLL
+/*
+ * Keep the epoll interest list in sync with the pollfd of @a fd, whose
+ * events were @a old_events. The interest list is only touched when
+ * selectors are added or removed, so run_selects_epoll() does not have to
+ * walk every registered file descriptor.
+ */
+void
+SelectSet::update_epoll(int fd, int old_events)
+{
+    int pi = _selinfo[fd].pollfd;
+    int events = pi >= 0 ? _pollfds[pi].events : 0;
+    if (events == old_events)
+	return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (events & POLLIN ? (uint32_t) EPOLLIN : 0) | (events & POLLOUT ? (uint32_t) EPOLLOUT : 0);
+    ev.data.fd = fd;
+    int op = !old_events ? EPOLL_CTL_ADD : (!events ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    if (epoll_ctl(_epoll, op, fd, &ev) < 0) {
+	// The file descriptor may have been closed before its selectors were
+	// removed, in which case the kernel already forgot it.
+	if (op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))
+	    return;
+	// Not all file descriptors are epollable (regular files, for
+	// instance). So if we encounter a problem, fall back to select() or
+	// poll(), which always know about every selector.
+	close(_epoll);
+	_epoll = -1;
+    }
+}
+
+void
+SelectSet::run_selects_epoll(RouterThread *thread)
+{
+# if HAVE_MULTITHREAD
+    click_fence();
+    _select_lock.release();
+# endif
+
+    // Decide how long to wait.
+    int timeout;
+    Timestamp t;
+    int delay_type = thread->select_delay(t);
+    if (delay_type == 0)
+	timeout = 0;
+    else if (delay_type > 0)
+	timeout = (t.sec() >= INT_MAX / 1000 ? INT_MAX - 1000 : t.msecval());
+    else
+	timeout = -1;
+    thread->set_thread_state_for_blocking(delay_type);
+
+    struct epoll_event ev[256];
+    int n = epoll_wait(_epoll, &ev[0], 256, timeout);
+    int was_errno = errno;
+
+    if (post_select(thread, true))
+	return;
+
+    thread->set_thread_state(RouterThread::S_RUNSELECT);
+    if (n < 0 && was_errno != EINTR)
+	perror("epoll_wait");
+    else
+	// call_selected() looks the selectors up again, so an event for a
+	// selector removed by an earlier selected() call is ignored
+	for (int i = 0; i < n; i++) {
+	    uint32_t events = ev[i].events;
+	    int mask = (events & ~EPOLLOUT ? Element::SELECT_READ : 0)
+		+ (events & ~EPOLLIN ? Element::SELECT_WRITE : 0);
+	    call_selected(ev[i].data.fd, mask);
+	}
+}
+#endif /* HAVE_ALLOW_EPOLL */
+
 #if HAVE_ALLOW_POLL
 void
 SelectSet::run_selects_poll(RouterThread *thread)
@@ -441,7 +545,7 @@ SelectSet::run_selects_poll(RouterThread *thread)
     // Decide how long to wait.
     int timeout;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	timeout = 0;
     else if (delay_type > 0)
@@ -497,7 +601,7 @@ SelectSet::run_selects_select(RouterThread *thread)
     // Decide how long to wait.
     struct timeval wait, *wait_ptr = &wait;
     Timestamp t;
-    int delay_type = thread->timer_set().next_timer_delay(thread->active(), t);
+    int delay_type = thread->select_delay(t);
     if (delay_type == 0)
 	timerclear(&wait);
     else if (delay_type > 0)
@@ -561,7 +665,7 @@ SelectSet::run_selects(RouterThread *thread)
     // Return early (just run signals) if there are no selectors and there are
     // tasks to run.  NB there will always be at least one _pollfd (the
     // _wake_pipe).
-    if (_pollfds.size() < 2 && thread->active()) {
+    if (_pollfds.size() < 2 && thread->active() && !thread->poll_idle()) {
 #if HAVE_MULTITHREAD
 	_select_lock.release();
 #endif
@@ -571,6 +675,12 @@ SelectSet::run_selects(RouterThread *thread)
 
     // Call the relevant selector implementation.
     do {
+#if HAVE_ALLOW_EPOLL
+	if (_epoll >= 0) {
+	    run_selects_epoll(thread);
+	    break;
+	}
+#endif
 #if HAVE_ALLOW_KQUEUE
 	if (_kqueue >= 0) {
 	    run_selects_kqueue(thread);